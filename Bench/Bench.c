@@ -0,0 +1,806 @@
+/*
+	Microbenchmarks for the portable parts of CocoaGame: the event queue, event filtering and handlers, event
+	translation, the timers and tracing. No OpenGL context is created, so this runs anywhere the library builds.
+
+	Usage: Bench [--iterations n] [--output path]
+	       Bench --check-allocations
+	       Bench --check-gl-trace
+	       Bench --check-jobs
+	       Bench --check-replay
+
+	Results are written as JSON (to stdout unless --output is given), one entry per benchmark with the median and
+	minimum nanoseconds per operation over several runs, so they can be compared between builds.
+
+	--check-allocations instead runs a frame loop (CocoaGame_Poll(), CocoaGame_DequeueEvent(), CocoaGame_BeginRender()
+	and CocoaGame_EndRender()) on a small window, with a counting allocator, and fails if any frame after the first 
+	few allocates. This one does need OpenGL.
+
+	--check-gl-trace makes a known set of OpenGL calls, some of them redundant, in one frame and fails unless 
+	CocoaGame_GetGLTraceFrameStats() and CocoaGame_GetGLTraceFunctionStats() count them correctly. It needs a library 
+	built with COCOAGAME_GL_TRACE.
+
+	--check-jobs runs chains of small jobs, each stage added with CocoaGame_RunJobAfter() on the stage before, from the
+	thread that started the scheduler and from another thread at the same time. It fails unless every job runs exactly
+	once and no job runs before the stage it depends on has finished.
+
+	--check-replay records a few frames of key and mouse events, replays the recording, and fails unless
+	CocoaGame_GetInputState() returns the same state on each replayed frame as it did when recording. It needs OpenGL.
+*/
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Each benchmark is run this many times and the median and best runs reported.
+#define BENCH_RUNS 7
+
+// Events are queued and dequeued in batches of this size, which must fit in the queue.
+#define BENCH_EVENT_BATCH 256
+
+// Frames run by --check-allocations before it starts counting, and then while counting.
+#define CHECK_WARM_UP_FRAMES 16
+#define CHECK_FRAMES 256
+
+// --check-jobs runs this many rounds of stages of jobs, on this many workers. Each round adds more jobs than the pool
+// holds, so the scheduler also has to cope with running out.
+#define CHECK_JOB_ROUNDS 8
+#define CHECK_JOB_STAGES 32
+#define CHECK_JOBS_PER_STAGE 256
+#define CHECK_JOB_WORKERS 4
+
+// --check-replay records this many frames to this file, in the current directory, and then replays them.
+#define CHECK_REPLAY_FRAMES 64
+#define CHECK_REPLAY_PATH "BenchCheckReplay.rec"
+
+typedef struct CheckJobChain CheckJobChain;
+
+typedef struct CheckJob {
+	CheckJobChain *chain;
+	int stage;
+	int runs;
+} CheckJob;
+
+// One thread's jobs. Stage n's jobs are counted by counters[n], and run after counters[n - 1].
+struct CheckJobChain {
+	CocoaGame_JobCounter counters[CHECK_JOB_STAGES];
+	int finished[CHECK_JOB_STAGES];
+	CheckJob jobs[CHECK_JOB_STAGES][CHECK_JOBS_PER_STAGE];
+	int earlyJobs;
+};
+
+typedef struct Benchmark {
+	const char *name;
+
+	// Run the operation count times.
+	void (*run)(int count);
+
+	// Relative number of iterations (the cheaper the operation, the more it needs to be timed reliably).
+	int scale;
+} Benchmark;
+
+static volatile uint64_t sink;
+
+static CocoaGame_Event keyEvent;
+static CocoaGame_Event mouseMoveEvent;
+
+//
+// Benchmarks
+//
+
+static void BenchQueueDequeue(int count)
+{
+	CocoaGame_Event event;
+	int i, j;
+
+	for (i = 0; i < count; i += BENCH_EVENT_BATCH) {
+		for (j = 0; j != BENCH_EVENT_BATCH; ++j)
+			CocoaGame_QueueEvent(&keyEvent);
+
+		for (j = 0; j != BENCH_EVENT_BATCH; ++j)
+			CocoaGame_DequeueEvent(&event);
+	}
+
+	sink += event.modifiers.timestamp;
+}
+
+static void BenchQueueDequeueBatch(int count)
+{
+	CocoaGame_Event events[BENCH_EVENT_BATCH];
+	int i, j;
+
+	for (i = 0; i < count; i += BENCH_EVENT_BATCH) {
+		for (j = 0; j != BENCH_EVENT_BATCH; ++j)
+			CocoaGame_QueueEvent(&keyEvent);
+
+		sink += (uint64_t) CocoaGame_DequeueEvents(events, BENCH_EVENT_BATCH);
+	}
+}
+
+static void BenchCoalescedMouseMoves(int count)
+{
+	CocoaGame_Event event;
+	int i, j;
+
+	CocoaGame_SetMouseMoveCoalescing(TRUE);
+
+	for (i = 0; i < count; i += BENCH_EVENT_BATCH) {
+		for (j = 0; j != BENCH_EVENT_BATCH; ++j)
+			CocoaGame_QueueEvent(&mouseMoveEvent);
+
+		while (CocoaGame_DequeueEvent(&event))
+			sink += (uint64_t) event.mouseMove.deltaX;
+	}
+
+	CocoaGame_SetMouseMoveCoalescing(FALSE);
+}
+
+static void BenchFilteredEvent(int count)
+{
+	int i;
+
+	CocoaGame_SetEventMask(COCOAGAME_EVENT_MASK_ALL & ~COCOAGAME_EVENT_MASK(COCOAGAME_EVENT_KEY_DOWN));
+
+	for (i = 0; i != count; ++i)
+		CocoaGame_QueueEvent(&keyEvent);
+
+	CocoaGame_SetEventMask(COCOAGAME_EVENT_MASK_ALL);
+}
+
+static CocoaGame_Bool CountingEventHandler(const CocoaGame_Event *event, void *context)
+{
+	(void) context;
+	sink += event->key.keyCode + 1;
+	return TRUE;
+}
+
+static void BenchEventHandler(int count)
+{
+	int i;
+
+	CocoaGame_SetEventHandler(COCOAGAME_EVENT_KEY_DOWN, &CountingEventHandler, NULL);
+
+	for (i = 0; i != count; ++i)
+		CocoaGame_QueueEvent(&keyEvent);
+
+	CocoaGame_SetEventHandler(COCOAGAME_EVENT_KEY_DOWN, NULL, NULL);
+}
+
+static void BenchTranslateModifiers(int count)
+{
+	// Shift (right), Alt (left, no device flag) and caps lock.
+	unsigned long flags = (1ul << 17) | 0x04 | (1ul << 19) | (1ul << 16);
+	int i;
+
+	for (i = 0; i != count; ++i)
+		sink += CocoaGame_TranslateModifierFlags(flags ^ (unsigned long) (i & 1));
+}
+
+#ifndef __APPLE__
+	// With the headless backend, CocoaGame_ProcessEvent() takes a CocoaGame_Event and does the same modifier, mouse
+	// and special key handling as the Cocoa backend before queueing it.
+	static void BenchProcessEvent(int count)
+	{
+		CocoaGame_Event event;
+		int i, j;
+
+		for (i = 0; i < count; i += BENCH_EVENT_BATCH) {
+			for (j = 0; j != BENCH_EVENT_BATCH; ++j)
+				CocoaGame_ProcessEvent(&keyEvent);
+
+			while (CocoaGame_DequeueEvent(&event))
+				sink += event.key.keyCode;
+		}
+	}
+#endif
+
+static void BenchGetNanoseconds(int count)
+{
+	int i;
+	for (i = 0; i != count; ++i)
+		sink += CocoaGame_GetNanoseconds();
+}
+
+static void BenchGetTimer(int count)
+{
+	int i;
+	for (i = 0; i != count; ++i)
+		sink += (uint64_t) CocoaGame_GetTimer();
+}
+
+static void BenchGetMillisecondTimer(int count)
+{
+	int i;
+	for (i = 0; i != count; ++i)
+		sink += CocoaGame_GetMillisecondTimer();
+}
+
+static void BenchTraceDisabled(int count)
+{
+	int i;
+
+	CocoaGame_SetTraceEnabled(FALSE);
+
+	for (i = 0; i != count; ++i)
+		CocoaGame_Trace("%s: %d\n", __FUNCTION__, i);
+
+	CocoaGame_SetTraceEnabled(TRUE);
+}
+
+static void FormattingTraceHandler(const char *format, va_list argptr)
+{
+	char buffer[256];
+	sink += (uint64_t) vsnprintf(buffer, sizeof(buffer), format, argptr);
+}
+
+static void BenchTraceFormatted(int count)
+{
+	CocoaGame_TraceHandler previousHandler = CocoaGame_GetTraceHandler();
+	int i;
+
+	CocoaGame_SetTraceHandler(&FormattingTraceHandler);
+
+	for (i = 0; i != count; ++i)
+		CocoaGame_Trace("%s: %d\n", __FUNCTION__, i);
+
+	CocoaGame_SetTraceHandler(previousHandler);
+}
+
+static const Benchmark BENCHMARKS[] = {
+	{ "event_queue_dequeue", &BenchQueueDequeue, 4 },
+	{ "event_queue_dequeue_batch", &BenchQueueDequeueBatch, 4 },
+	{ "event_coalesced_mouse_moves", &BenchCoalescedMouseMoves, 4 },
+	{ "event_filtered", &BenchFilteredEvent, 16 },
+	{ "event_handler", &BenchEventHandler, 4 },
+	{ "translate_modifier_flags", &BenchTranslateModifiers, 16 },
+	#ifndef __APPLE__
+		{ "process_event", &BenchProcessEvent, 4 },
+	#endif
+	{ "get_nanoseconds", &BenchGetNanoseconds, 8 },
+	{ "get_timer", &BenchGetTimer, 8 },
+	{ "get_millisecond_timer", &BenchGetMillisecondTimer, 8 },
+	{ "trace_disabled", &BenchTraceDisabled, 16 },
+	{ "trace_formatted", &BenchTraceFormatted, 2 },
+};
+
+//
+// Allocation check
+//
+
+static uint64_t checkAllocatorCalls;
+
+// Key events dequeued by RunCheckFrame(), to make sure the loop really handled events.
+static int checkKeyEvents;
+
+static void *CountingAllocate(size_t size, CocoaGame_AllocCategory category, void *context)
+{
+	(void) category;
+	(void) context;
+	__atomic_fetch_add(&checkAllocatorCalls, 1, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+static void *CountingReallocate(void *memory, size_t size, CocoaGame_AllocCategory category, void *context)
+{
+	(void) category;
+	(void) context;
+	__atomic_fetch_add(&checkAllocatorCalls, 1, __ATOMIC_RELAXED);
+	return realloc(memory, size);
+}
+
+static void CountingDeallocate(void *memory, CocoaGame_AllocCategory category, void *context)
+{
+	(void) category;
+	(void) context;
+	__atomic_fetch_add(&checkAllocatorCalls, 1, __ATOMIC_RELAXED);
+	free(memory);
+}
+
+static void RunCheckFrame(void)
+{
+	CocoaGame_Event event;
+
+	CocoaGame_QueueEvent(&keyEvent);
+	CocoaGame_QueueEvent(&mouseMoveEvent);
+
+	CocoaGame_Poll();
+	while (CocoaGame_DequeueEvent(&event)) {
+		if (event.type == COCOAGAME_EVENT_KEY_DOWN)
+			++checkKeyEvents;
+
+		sink += (uint64_t) event.type;
+	}
+
+	CocoaGame_BeginRender();
+	glClear(GL_COLOR_BUFFER_BIT);
+	CocoaGame_EndRender();
+}
+
+static int CheckFrameLoopAllocations(void)
+{
+	CocoaGame_Allocator allocator = {
+		.allocate = &CountingAllocate,
+		.reallocate = &CountingReallocate,
+		.deallocate = &CountingDeallocate,
+		.context = NULL
+	};
+
+	CocoaGame_SetAllocator(&allocator);
+
+	CocoaGame_SetTraceEnabled(FALSE);
+
+	if (! CocoaGame_Init())
+		return EXIT_FAILURE;
+
+	CocoaGame_VideoConfig videoConfig = COCOAGAME_VIDEOCONFIG_DEFAULTS;
+	videoConfig.disposition = COCOAGAME_VIDEO_WINDOW;
+	videoConfig.mode.width = 64;
+	videoConfig.mode.height = 64;
+
+	CocoaGame_GLConfig glConfig = COCOAGAME_GLCONFIG_DEFAULTS;
+
+	if (! CocoaGame_InitVideo(&videoConfig) || ! CocoaGame_InitGL(&glConfig)) {
+		fprintf(stderr, "check_allocations: unable to initialise OpenGL.\n");
+		CocoaGame_Shutdown();
+		return EXIT_FAILURE;
+	}
+
+	int frame;
+	for (frame = 0; frame != CHECK_WARM_UP_FRAMES; ++frame)
+		RunCheckFrame();
+
+	checkKeyEvents = 0;
+
+	uint64_t startCalls = __atomic_load_n(&checkAllocatorCalls, __ATOMIC_RELAXED);
+	CocoaGame_AllocStats startStats;
+	CocoaGame_GetTotalAllocStats(&startStats);
+
+	for (frame = 0; frame != CHECK_FRAMES; ++frame)
+		RunCheckFrame();
+
+	uint64_t calls = __atomic_load_n(&checkAllocatorCalls, __ATOMIC_RELAXED) - startCalls;
+	CocoaGame_AllocStats stats;
+	CocoaGame_GetTotalAllocStats(&stats);
+
+	printf("{\n\t\"frames\": %d,\n\t\"allocator_calls\": %llu,\n\t\"allocations\": %llu,\n\t\"frees\": %llu,\n"
+		"\t\"bytes\": %llu\n}\n", CHECK_FRAMES, (unsigned long long) calls,
+		(unsigned long long) (stats.allocations - startStats.allocations),
+		(unsigned long long) (stats.frees - startStats.frees), (unsigned long long) stats.bytes);
+
+	CocoaGame_Shutdown();
+
+	if (calls || stats.allocations != startStats.allocations || stats.frees != startStats.frees) {
+		fprintf(stderr, "check_allocations: the frame loop allocated.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (checkKeyEvents != CHECK_FRAMES) {
+		fprintf(stderr, "check_allocations: dequeued %d key events in %d frames.\n", checkKeyEvents, CHECK_FRAMES);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+//
+// GL trace check
+//
+
+// Returns the traced function's counts for the last frame, or zeroes if it isn't traced.
+static CocoaGame_GLTraceFunctionStats GetGLTraceFunctionStats(const char *name)
+{
+	CocoaGame_GLTraceFunctionStats stats;
+	int i;
+
+	for (i = 0; i != CocoaGame_GetGLTraceFunctionCount(); ++i) {
+		CocoaGame_GetGLTraceFunctionStats(i, &stats);
+		if (! strcmp(stats.name, name))
+			return stats;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	stats.name = name;
+	return stats;
+}
+
+static CocoaGame_Bool CheckGLTraceFunction(const char *name, uint64_t calls, uint64_t redundantCalls)
+{
+	CocoaGame_GLTraceFunctionStats stats = GetGLTraceFunctionStats(name);
+
+	if (stats.calls == calls && stats.redundantCalls == redundantCalls)
+		return TRUE;
+
+	fprintf(stderr, "check_gl_trace: %s: %llu calls (%llu redundant), expected %llu (%llu redundant).\n", name,
+		(unsigned long long) stats.calls, (unsigned long long) stats.redundantCalls, (unsigned long long) calls,
+		(unsigned long long) redundantCalls);
+	return FALSE;
+}
+
+static int CheckGLTrace(void)
+{
+	CocoaGame_SetTraceEnabled(FALSE);
+
+	if (! CocoaGame_Init())
+		return EXIT_FAILURE;
+
+	if (! CocoaGame_SetGLTraceEnabled(TRUE)) {
+		fprintf(stderr, "check_gl_trace: CocoaGame was built without COCOAGAME_GL_TRACE.\n");
+		CocoaGame_Shutdown();
+		return EXIT_FAILURE;
+	}
+
+	CocoaGame_VideoConfig videoConfig = COCOAGAME_VIDEOCONFIG_DEFAULTS;
+	videoConfig.disposition = COCOAGAME_VIDEO_WINDOW;
+	videoConfig.mode.width = 64;
+	videoConfig.mode.height = 64;
+
+	CocoaGame_GLConfig glConfig = COCOAGAME_GLCONFIG_DEFAULTS;
+
+	if (! CocoaGame_InitVideo(&videoConfig) || ! CocoaGame_InitGL(&glConfig)) {
+		fprintf(stderr, "check_gl_trace: unable to initialise OpenGL.\n");
+		CocoaGame_Shutdown();
+		return EXIT_FAILURE;
+	}
+
+	CocoaGame_BeginRender();
+
+	// Each state is set once and then again to the same value. Texture enables are per unit, so enabling 
+	// GL_TEXTURE_2D on a second unit isn't redundant, but enabling it there again is.
+	glEnable(GL_BLEND);
+	glEnable(GL_BLEND);
+	glActiveTexture(GL_TEXTURE0);
+	glEnable(GL_TEXTURE_2D);
+	glActiveTexture(GL_TEXTURE1);
+	glEnable(GL_TEXTURE_2D);
+	glEnable(GL_TEXTURE_2D);
+	glDisable(GL_TEXTURE_2D);
+	glActiveTexture(GL_TEXTURE0);
+	glViewport(0, 0, 32, 32);
+	glViewport(0, 0, 32, 32);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDrawArrays(GL_TRIANGLES, 0, 0);
+
+	CocoaGame_EndRender();
+
+	CocoaGame_GLTraceFrameStats frame;
+	CocoaGame_GetGLTraceFrameStats(&frame);
+
+	printf("{\n\t\"frames\": %llu,\n\t\"calls\": %llu,\n\t\"redundant_calls\": %llu,\n\t\"draw_calls\": %llu\n}\n",
+		(unsigned long long) frame.frames, (unsigned long long) frame.calls, (unsigned long long) frame.redundantCalls,
+		(unsigned long long) frame.drawCalls);
+
+	CocoaGame_Bool passed = CheckGLTraceFunction("glEnable", 5, 2);
+	passed = CheckGLTraceFunction("glDisable", 1, 0) && passed;
+	passed = CheckGLTraceFunction("glActiveTexture", 3, 0) && passed;
+	passed = CheckGLTraceFunction("glViewport", 2, 1) && passed;
+	passed = CheckGLTraceFunction("glDrawArrays", 1, 0) && passed;
+
+	// The library makes calls of its own during the frame, but none of them are redundant or draw.
+	if (frame.frames != 1 || frame.redundantCalls != 3 || frame.drawCalls != 1 || frame.calls < 13) {
+		fprintf(stderr, "check_gl_trace: the frame's totals are wrong.\n");
+		passed = FALSE;
+	}
+
+	CocoaGame_Shutdown();
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//
+// Jobs check
+//
+
+static CheckJobChain checkJobChains[2];
+
+static void RunCheckJob(void *data)
+{
+	CheckJob *job = data;
+	CheckJobChain *chain = job->chain;
+
+	if (job->stage && __atomic_load_n(&chain->finished[job->stage - 1], __ATOMIC_ACQUIRE) != CHECK_JOBS_PER_STAGE)
+		__atomic_add_fetch(&chain->earlyJobs, 1, __ATOMIC_RELAXED);
+
+	__atomic_add_fetch(&job->runs, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&chain->finished[job->stage], 1, __ATOMIC_RELEASE);
+}
+
+// Add every stage's jobs at once, then wait for the last stage.
+static void RunCheckJobChain(CheckJobChain *chain)
+{
+	int stage, i;
+
+	memset(chain, 0, sizeof(*chain));
+
+	for (stage = 0; stage != CHECK_JOB_STAGES; ++stage) {
+		for (i = 0; i != CHECK_JOBS_PER_STAGE; ++i) {
+			CheckJob *job = &chain->jobs[stage][i];
+			job->chain = chain;
+			job->stage = stage;
+
+			CocoaGame_RunJobAfter(stage ? &chain->counters[stage - 1] : NULL, "Check job", &RunCheckJob, job,
+				&chain->counters[stage]);
+		}
+	}
+
+	CocoaGame_WaitForJobs(&chain->counters[CHECK_JOB_STAGES - 1]);
+}
+
+static void *RunCheckJobThread(void *context)
+{
+	RunCheckJobChain(context);
+	return NULL;
+}
+
+static CocoaGame_Bool CheckJobChainResults(const CheckJobChain *chain, int round)
+{
+	CocoaGame_Bool passed = TRUE;
+	int stage, i;
+
+	for (stage = 0; stage != CHECK_JOB_STAGES; ++stage) {
+		for (i = 0; i != CHECK_JOBS_PER_STAGE; ++i) {
+			if (chain->jobs[stage][i].runs != 1) {
+				fprintf(stderr, "check_jobs: round %d: job %d of stage %d ran %d times.\n", round, i, stage,
+					chain->jobs[stage][i].runs);
+				passed = FALSE;
+			}
+		}
+
+		if (! CocoaGame_AreJobsFinished(&chain->counters[stage])) {
+			fprintf(stderr, "check_jobs: round %d: stage %d's counter hasn't finished.\n", round, stage);
+			passed = FALSE;
+		}
+	}
+
+	if (chain->earlyJobs) {
+		fprintf(stderr, "check_jobs: round %d: %d jobs ran before their dependencies.\n", round, chain->earlyJobs);
+		passed = FALSE;
+	}
+
+	return passed;
+}
+
+static int CheckJobs(void)
+{
+	CocoaGame_SetTraceEnabled(FALSE);
+
+	if (! CocoaGame_StartJobs(CHECK_JOB_WORKERS)) {
+		fprintf(stderr, "check_jobs: unable to start the job scheduler.\n");
+		return EXIT_FAILURE;
+	}
+
+	CocoaGame_ResetJobStats();
+
+	CocoaGame_Bool passed = TRUE;
+	int round;
+
+	for (round = 0; round != CHECK_JOB_ROUNDS && passed; ++round) {
+		// The scheduler's thread pushes to its own deque, while the other thread's jobs go through the injection queue.
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, &RunCheckJobThread, &checkJobChains[1]) != 0) {
+			fprintf(stderr, "check_jobs: unable to create a thread.\n");
+			passed = FALSE;
+			break;
+		}
+
+		RunCheckJobChain(&checkJobChains[0]);
+		pthread_join(thread, NULL);
+
+		passed = CheckJobChainResults(&checkJobChains[0], round) && passed;
+		passed = CheckJobChainResults(&checkJobChains[1], round) && passed;
+	}
+
+	CocoaGame_JobStats stats;
+	CocoaGame_GetJobStats(&stats);
+
+	printf("{\n\t\"workers\": %d,\n\t\"jobs_run\": %llu,\n\t\"jobs_stolen\": %llu,\n\t\"jobs_helped\": %llu,\n"
+		"\t\"jobs_inline\": %llu\n}\n", stats.workers, (unsigned long long) stats.jobsRun,
+		(unsigned long long) stats.jobsStolen, (unsigned long long) stats.jobsHelped, (unsigned long long) stats.jobsInline);
+
+	CocoaGame_StopJobs();
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//
+// Replay check
+//
+
+// The input state seen on each frame while recording, then while replaying.
+static CocoaGame_InputState checkReplayStates[2][CHECK_REPLAY_FRAMES];
+
+// Like a game's frame: the polled state is read, then the frame's events are handled. When recording, the events are
+// queued during the frame, as if they'd arrived while it was being rendered.
+static void RunCheckReplayFrame(int frame, CocoaGame_Bool recording, CocoaGame_InputState *state)
+{
+	CocoaGame_Event event;
+
+	CocoaGame_BeginRender();
+
+	*state = *CocoaGame_GetInputState();
+
+	// The runs start on different frame numbers.
+	state->frame = 0;
+
+	if (recording) {
+		// A key goes down on one frame and up on the next, and every third frame another is tapped within the frame.
+		event = keyEvent;
+		event.type = frame & 1 ? COCOAGAME_EVENT_KEY_UP : COCOAGAME_EVENT_KEY_DOWN;
+		event.key.keyCode = (unsigned int) (frame / 2 % 8);
+		CocoaGame_QueueEvent(&event);
+
+		if (frame % 3 == 0) {
+			event.type = COCOAGAME_EVENT_KEY_DOWN;
+			event.key.keyCode = 20;
+			CocoaGame_QueueEvent(&event);
+
+			event.type = COCOAGAME_EVENT_KEY_UP;
+			CocoaGame_QueueEvent(&event);
+		}
+
+		CocoaGame_QueueEvent(&mouseMoveEvent);
+	}
+
+	CocoaGame_Poll();
+	while (CocoaGame_DequeueEvent(&event))
+		sink += (uint64_t) event.type;
+
+	glClear(GL_COLOR_BUFFER_BIT);
+	CocoaGame_EndRender();
+}
+
+static int CheckReplay(void)
+{
+	CocoaGame_SetTraceEnabled(FALSE);
+
+	if (! CocoaGame_Init())
+		return EXIT_FAILURE;
+
+	CocoaGame_VideoConfig videoConfig = COCOAGAME_VIDEOCONFIG_DEFAULTS;
+	videoConfig.disposition = COCOAGAME_VIDEO_WINDOW;
+	videoConfig.mode.width = 64;
+	videoConfig.mode.height = 64;
+
+	CocoaGame_GLConfig glConfig = COCOAGAME_GLCONFIG_DEFAULTS;
+
+	if (! CocoaGame_InitVideo(&videoConfig) || ! CocoaGame_InitGL(&glConfig)) {
+		fprintf(stderr, "check_replay: unable to initialise OpenGL.\n");
+		CocoaGame_Shutdown();
+		return EXIT_FAILURE;
+	}
+
+	int frame;
+
+	if (! CocoaGame_StartRecording(CHECK_REPLAY_PATH)) {
+		fprintf(stderr, "check_replay: unable to create \"%s\".\n", CHECK_REPLAY_PATH);
+		CocoaGame_Shutdown();
+		return EXIT_FAILURE;
+	}
+
+	CocoaGame_ResetInputState();
+
+	for (frame = 0; frame != CHECK_REPLAY_FRAMES; ++frame)
+		RunCheckReplayFrame(frame, TRUE, &checkReplayStates[0][frame]);
+
+	CocoaGame_StopRecording();
+
+	// Keys left down by the recording would otherwise still be down.
+	CocoaGame_ResetInputState();
+
+	CocoaGame_Bool passed = CocoaGame_StartReplay(CHECK_REPLAY_PATH, COCOAGAME_REPLAY_AS_FAST_AS_POSSIBLE);
+	if (! passed)
+		fprintf(stderr, "check_replay: unable to replay \"%s\".\n", CHECK_REPLAY_PATH);
+
+	for (frame = 0; passed && frame != CHECK_REPLAY_FRAMES; ++frame) {
+		RunCheckReplayFrame(frame, FALSE, &checkReplayStates[1][frame]);
+
+		if (memcmp(&checkReplayStates[0][frame], &checkReplayStates[1][frame], sizeof(CocoaGame_InputState))) {
+			fprintf(stderr, "check_replay: the input state differs on frame %d.\n", frame);
+			passed = FALSE;
+		}
+	}
+
+	CocoaGame_StopReplay();
+	CocoaGame_Shutdown();
+	remove(CHECK_REPLAY_PATH);
+
+	printf("{\n\t\"frames\": %d,\n\t\"passed\": %s\n}\n", frame, passed ? "true" : "false");
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//
+// Main
+//
+
+static int CompareDoubles(const void *va, const void *vb)
+{
+	double a = *(const double *) va;
+	double b = *(const double *) vb;
+
+	return a < b ? -1 : a > b ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 100000;
+	const char *outputPath = NULL;
+	int i, run;
+
+	// Both the benchmarks and --check-allocations queue these.
+	keyEvent.type = COCOAGAME_EVENT_KEY_DOWN;
+	keyEvent.key.key = 'a';
+	keyEvent.key.keyCode = 0;
+
+	mouseMoveEvent.type = COCOAGAME_EVENT_MOUSE_MOVE;
+	mouseMoveEvent.mouseMove.deltaX = 1;
+	mouseMoveEvent.mouseMove.deltaY = -1;
+
+	for (i = 1; i < argc; ++i) {
+		if (! strcmp(argv[i], "--check-allocations"))
+			return CheckFrameLoopAllocations();
+		else if (! strcmp(argv[i], "--check-gl-trace"))
+			return CheckGLTrace();
+		else if (! strcmp(argv[i], "--check-jobs"))
+			return CheckJobs();
+		else if (! strcmp(argv[i], "--check-replay"))
+			return CheckReplay();
+		else if (! strcmp(argv[i], "--iterations") && i + 1 < argc)
+			iterations = atoi(argv[++i]);
+		else if (! strcmp(argv[i], "--output") && i + 1 < argc)
+			outputPath = argv[++i];
+		else {
+			fprintf(stderr, "Usage: %s [--iterations n] [--output path] | --check-allocations | --check-gl-trace | --check-jobs | --check-replay\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (iterations < BENCH_EVENT_BATCH)
+		iterations = BENCH_EVENT_BATCH;
+
+	CocoaGame_SetTraceEnabled(FALSE);
+
+	if (! CocoaGame_Init())
+		return EXIT_FAILURE;
+
+	CocoaGame_SetTraceEnabled(TRUE);
+
+	FILE *output = outputPath ? fopen(outputPath, "w") : stdout;
+	if (! output) {
+		fprintf(stderr, "%s: unable to create \"%s\".\n", argv[0], outputPath);
+		CocoaGame_Shutdown();
+		return EXIT_FAILURE;
+	}
+
+	fprintf(output, "{\n\t\"iterations\": %d,\n\t\"runs\": %d,\n\t\"benchmarks\": [\n", iterations, BENCH_RUNS);
+
+	for (i = 0; i != (int) countof(BENCHMARKS); ++i) {
+		const Benchmark *benchmark = &BENCHMARKS[i];
+		int count = iterations * benchmark->scale;
+		double nsPerOp[BENCH_RUNS];
+
+		// Warm up.
+		(*benchmark->run)(count / 8);
+
+		for (run = 0; run != BENCH_RUNS; ++run) {
+			uint64_t start = CocoaGame_GetNanoseconds();
+			(*benchmark->run)(count);
+			nsPerOp[run] = (double) (CocoaGame_GetNanoseconds() - start) / count;
+		}
+
+		qsort(nsPerOp, BENCH_RUNS, sizeof(nsPerOp[0]), &CompareDoubles);
+
+		fprintf(output, "\t\t{ \"name\": \"%s\", \"operations\": %d, \"median_ns\": %.3f, \"min_ns\": %.3f }%s\n",
+			benchmark->name, count, nsPerOp[BENCH_RUNS / 2], nsPerOp[0], i + 1 == (int) countof(BENCHMARKS) ? "" : ",");
+	}
+
+	fprintf(output, "\t]\n}\n");
+
+	if (output != stdout)
+		fclose(output);
+
+	CocoaGame_SetTraceEnabled(FALSE);
+	CocoaGame_Shutdown();
+
+	return EXIT_SUCCESS;
+}
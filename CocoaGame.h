@@ -6,7 +6,15 @@
 #ifndef COCOAGAME_H
 #define COCOAGAME_H
 
-#include <OpenGL/gl.h>
+#ifdef __APPLE__
+	#include <OpenGL/gl.h>
+#else
+	#include <GL/gl.h>
+#endif
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -52,6 +60,69 @@ void CocoaGame_CreateAutoreleasePool(void **pool);
 /// Free an NSAutoreleasePool created by CocoaGame_CreateAutoreleasePool().
 void CocoaGame_FreeAutoreleasePool(void *pool);
 
+//
+// Memory allocation
+// These functions don't require CocoaGame_Init() to have been called.
+//
+
+/// What the library's allocations are for, so they can be budgeted separately.
+typedef enum CocoaGame_AllocCategory {
+	/// The event queue.
+	COCOAGAME_ALLOC_EVENTS,
+
+	/// The video mode list, OpenGL information, pbuffers and shared contexts.
+	COCOAGAME_ALLOC_VIDEO,
+
+	/// Render targets, transient buffers, uploads and render thread snapshots.
+	COCOAGAME_ALLOC_RENDERING,
+
+	/// Frame capture and image encoding.
+	COCOAGAME_ALLOC_CAPTURE,
+
+	/// The OpenGL and program caches, and texture archives.
+	COCOAGAME_ALLOC_CACHES,
+
+	/// Job deques and profiling buffers.
+	COCOAGAME_ALLOC_THREADS,
+
+	COCOAGAME_ALLOC_CATEGORIES
+} CocoaGame_AllocCategory;
+
+/// Functions the library allocates its memory with, in place of malloc(), realloc() and free(). Memory must be
+/// aligned as malloc()'s is. Sizes include a small header the library adds to each block. context is passed to each
+/// function. The functions may be called from any thread.
+typedef struct CocoaGame_Allocator {
+	void *(*allocate)(size_t size, CocoaGame_AllocCategory category, void *context);
+	void *(*reallocate)(void *memory, size_t size, CocoaGame_AllocCategory category, void *context);
+	void (*deallocate)(void *memory, CocoaGame_AllocCategory category, void *context);
+	void *context;
+} CocoaGame_Allocator;
+
+/// Set the allocator used for all of the library's own allocations. A NULL function (or a NULL allocator) uses the
+/// C library's. Memory is freed with whichever allocator is set at the time, so call this before anything else, 
+/// including CocoaGame_Init(), and don't change it while the library has anything allocated. The library doesn't
+/// allocate between frames: once running, CocoaGame_Poll(), CocoaGame_DequeueEvent(), CocoaGame_BeginRender() and
+/// CocoaGame_EndRender() make no allocations (unless you turn on a feature, such as capture, that needs some). If
+/// the allocator returns NULL, whatever needed the memory fails as it would for any other reason.
+void CocoaGame_SetAllocator(const CocoaGame_Allocator *allocator);
+
+typedef struct CocoaGame_AllocStats {
+	/// Calls to allocate or reallocate, and to free.
+	uint64_t allocations;
+	uint64_t frees;
+
+	/// Bytes currently allocated, and the most there have been, not counting headers.
+	size_t bytes;
+	size_t peakBytes;
+} CocoaGame_AllocStats;
+
+void CocoaGame_GetAllocStats(CocoaGame_AllocCategory category, CocoaGame_AllocStats *stats);
+
+/// Sum the counts of every category. peakBytes is the sum of each category's peak.
+void CocoaGame_GetTotalAllocStats(CocoaGame_AllocStats *stats);
+
+const char *CocoaGame_GetAllocCategoryName(CocoaGame_AllocCategory category);
+
 //
 // Initialisation and shutdown
 //
@@ -94,7 +165,7 @@ typedef struct CocoaGame_VideoMode {
 } CocoaGame_VideoMode;
 
 /// Parses a string, e,.g. "1680x1050" and fills in a CocoaGame_VideoMode's width, height and optionally bits members.
-BOOL CocoaGame_ParseVideoMode(const char *str, CocoaGame_VideoMode *videoMode);
+CocoaGame_Bool CocoaGame_ParseVideoMode(const char *str, CocoaGame_VideoMode *videoMode);
 
 /// Returns the number of video modes.
 int CocoaGame_GetVideoModeCount(void);
@@ -131,7 +202,7 @@ typedef enum CocoaGame_VideoDisposition {
 	COCOAGAME_VIDEO_WINDOW,
 	
 	/// Go full-screen, in the user's current video mode. To support different resolutions the game must up-scale
-	/// its back buffer.
+	/// its back buffer (CocoaGame_SetDynamicResolution() can do this for you).
 	COCOAGAME_VIDEO_FULLSCREEN,
 	
 	/// Go full-screen and set the video mode. The width, height and bits members of the CocoaGame_VideoConfig's
@@ -139,8 +210,8 @@ typedef enum CocoaGame_VideoDisposition {
 	COCOAGAME_VIDEO_FULLSCREEN_SET_MODE,
 	
 	/// Create a full-screen window, without changing the video mode. To support different resolutions the game
-	/// must up-scale its back buffer. This is the most user-friendly video disposition, and allows you to debug in
-    /// Xcode.
+	/// must up-scale its back buffer (CocoaGame_SetDynamicResolution() can do this for you). This is the most
+	/// user-friendly video disposition, and allows you to debug in Xcode.
 	COCOAGAME_VIDEO_FULLSCREEN_WINDOW,
 	
 	COCOAGAME_VIDEO__MAX_DISPOSITION
@@ -263,6 +334,18 @@ CocoaGame_Bool CocoaGame_InitGL(const CocoaGame_GLConfig *config);
 /// Returns the actual OpenGL configuration that CocoaGame_InitGL() found.
 const CocoaGame_GLConfig *CocoaGame_GetGLConfig(void);
 
+/// Change the swap interval of the OpenGL context created by CocoaGame_InitGL(). CocoaGame_GetGLConfig() reports the
+/// value that was actually set.
+void CocoaGame_SetSwapInterval(int swapInterval);
+
+/// Cache driver information and the configuration CocoaGame_InitGL() negotiates in the file at path, so later
+/// launches can skip the temporary context CocoaGame_GetGLInfo() would create and try the known-good pixel format
+/// first. Entries are keyed by graphics device and by requested configuration, and are discarded when the driver
+/// reports different strings once a context exists (so after a driver update, CocoaGame_GetGLInfo() can return the
+/// old driver's information until CocoaGame_InitGL() has been called once). Pass NULL to stop caching (the 
+/// default). Call before CocoaGame_GetGLInfo() and CocoaGame_InitGL().
+void CocoaGame_SetGLCachePath(const char *path);
+
 typedef struct CocoaGame_GLInfo {
 	char *version;
 	char *extensions;
@@ -294,9 +377,384 @@ void CocoaGame_EndRender(void);
 /// must still call CocoaGame_EndRender().
 void CocoaGame_DiscardRender(void);
 
+//
+// OpenGL call tracing
+//
+
+/// Count the OpenGL calls made between CocoaGame_BeginRender() and CocoaGame_EndRender(), on any thread, and flag
+/// calls that set state to the value it already has. Tracing only works if CocoaGame was built with 
+/// COCOAGAME_GL_TRACE defined to 1, in which case CocoaGame replaces the OpenGL functions it traces with its own 
+/// (otherwise this returns FALSE). State is tracked per context from the time it's made current with tracing 
+/// enabled, so enable tracing before CocoaGame_InitGL() to have every state change checked. Enabling or disabling 
+/// tracing resets it.
+CocoaGame_Bool CocoaGame_SetGLTraceEnabled(CocoaGame_Bool enabled);
+
+CocoaGame_Bool CocoaGame_IsGLTraceEnabled(void);
+
+/// Discard the counts.
+void CocoaGame_ResetGLTrace(void);
+
+typedef struct CocoaGame_GLTraceFrameStats {
+	/// Number of frames traced.
+	uint64_t frames;
+
+	/// Calls made during the last frame.
+	uint64_t calls;
+
+	/// Calls which set state (capabilities, bindings, viewport, scissor, blending, depth and colour masks, clear 
+	/// colour, cull face) to the value it already had.
+	uint64_t redundantCalls;
+
+	/// glBegin(), glDrawArrays() and glDrawElements() calls.
+	uint64_t drawCalls;
+
+	/// Bytes passed to glTexImage2D() and glTexSubImage2D() (estimated from the format and type) and to
+	/// glBufferData() and glBufferSubData().
+	uint64_t textureUploadBytes;
+	uint64_t bufferUploadBytes;
+} CocoaGame_GLTraceFrameStats;
+
+/// Get the counts for the last frame traced.
+void CocoaGame_GetGLTraceFrameStats(CocoaGame_GLTraceFrameStats *stats);
+
+/// Returns the number of OpenGL functions traced (zero if tracing isn't available).
+int CocoaGame_GetGLTraceFunctionCount(void);
+
+typedef struct CocoaGame_GLTraceFunctionStats {
+	const char *name;
+	uint64_t calls;
+	uint64_t redundantCalls;
+} CocoaGame_GLTraceFunctionStats;
+
+/// Get the last frame's counts for a function, index being from 0 to CocoaGame_GetGLTraceFunctionCount() - 1.
+void CocoaGame_GetGLTraceFunctionStats(int index, CocoaGame_GLTraceFunctionStats *stats);
+
+/// Write the last frame's counts with CocoaGame_Trace(). Call after each CocoaGame_EndRender() for a per-frame dump.
+void CocoaGame_DumpGLTrace(void);
+
+//
+// OpenGL state cache
+//
+
+// Each of these functions sets OpenGL state as the function it's named after does, but does nothing if the current
+// context's state is already known to have that value. State is cached separately for each context CocoaGame 
+// creates and is unknown until it's first set through these functions, so a call is only filtered if it repeats one
+// made through them. CocoaGame's own state changes (render targets, transient buffers, capture) keep the cache 
+// current. If you change cached state by calling OpenGL directly, or bind a vertex array object (which has its own
+// element array buffer binding), call CocoaGame_InvalidateGLState().
+
+/// Texture enables (e.g., GL_TEXTURE_2D) and GL_TEXTURE_GEN_S to GL_TEXTURE_GEN_Q are cached for the active texture
+/// unit, so they're only filtered once the unit has been set with CocoaGame_GLActiveTexture() or
+/// CocoaGame_GLBindTexture().
+void CocoaGame_GLEnable(GLenum cap);
+void CocoaGame_GLDisable(GLenum cap);
+
+/// unit is GL_TEXTURE0 to GL_TEXTURE15. Bindings to 2D, rectangle, cube map and 3D targets are cached, and the unit 
+/// is only made active if the binding changes. Other targets and units are always bound.
+void CocoaGame_GLBindTexture(GLenum unit, GLenum target, GLuint texture);
+void CocoaGame_GLActiveTexture(GLenum unit);
+
+/// Array, element array, pixel pack and pixel unpack buffer bindings are cached.
+void CocoaGame_GLBindBuffer(GLenum target, GLuint buffer);
+
+/// target is GL_FRAMEBUFFER_EXT, GL_DRAW_FRAMEBUFFER_EXT or GL_READ_FRAMEBUFFER_EXT.
+void CocoaGame_GLBindFramebuffer(GLenum target, GLuint framebuffer);
+
+void CocoaGame_GLUseProgram(GLuint program);
+void CocoaGame_GLViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void CocoaGame_GLScissor(GLint x, GLint y, GLsizei width, GLsizei height);
+void CocoaGame_GLBlendFunc(GLenum source, GLenum destination);
+void CocoaGame_GLDepthFunc(GLenum func);
+void CocoaGame_GLDepthMask(GLboolean flag);
+void CocoaGame_GLClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha);
+
+/// Delete objects, unbinding them in the cache as OpenGL does. Use these to delete anything that may have been
+/// bound through the cache, or a new object given the same name might not be bound.
+void CocoaGame_GLDeleteTextures(GLsizei count, const GLuint *textures);
+void CocoaGame_GLDeleteBuffers(GLsizei count, const GLuint *buffers);
+void CocoaGame_GLDeleteFramebuffers(GLsizei count, const GLuint *framebuffers);
+
+/// Forget the current context's cached state, so the next call to each function reaches OpenGL.
+void CocoaGame_InvalidateGLState(void);
+
+typedef struct CocoaGame_GLStateStats {
+	/// Calls to the cached state functions.
+	uint64_t calls;
+
+	/// Calls which didn't need to reach OpenGL.
+	uint64_t filteredCalls;
+} CocoaGame_GLStateStats;
+
+void CocoaGame_GetGLStateStats(CocoaGame_GLStateStats *stats);
+void CocoaGame_ResetGLStateStats(void);
+
+//
+// Program cache
+//
+
+/// Keep the binaries of programs created by CocoaGame_CreateProgram() in the directory at path (creating it if its
+/// parent exists), so later launches on the same driver can load them instead of compiling. Pass NULL to stop 
+/// caching (the default).
+void CocoaGame_SetProgramCacheDirectory(const char *path);
+
+/// Create a program from GLSL vertex and fragment shader sources, loading it from the program cache if it's been
+/// built before with the same sources on the same driver (GL_VENDOR, GL_RENDERER and GL_VERSION), otherwise
+/// compiling and linking it and adding it to the cache. attributes is NULL or a NULL-terminated list of vertex
+/// attribute names, bound to locations 0, 1, 2... before linking. A cached binary the driver won't load is replaced
+/// by compiling. Must be called with an OpenGL context current. Returns 0 if the program can't be compiled or 
+/// linked (the info log is written with CocoaGame_Trace()).
+GLuint CocoaGame_CreateProgram(const char *vertexSource, const char *fragmentSource, const char *const *attributes);
+
+typedef struct CocoaGame_ProgramCacheStats {
+	/// Programs loaded from the cache.
+	uint64_t hits;
+
+	/// Programs which had to be compiled, including those whose cached binary was rejected.
+	uint64_t misses;
+
+	/// Cached binaries the driver rejected (or which couldn't be read).
+	uint64_t failedLoads;
+
+	/// Time spent loading cached binaries, and compiling and linking programs.
+	uint64_t loadNanoseconds;
+	uint64_t compileNanoseconds;
+} CocoaGame_ProgramCacheStats;
+
+void CocoaGame_GetProgramCacheStats(CocoaGame_ProgramCacheStats *stats);
+void CocoaGame_ResetProgramCacheStats(void);
+
+//
+// Texture archives
+//
+
+// A texture archive is a single file of textures whose mip levels are stored ready to upload. It's read through a
+// memory mapping, so textures go from the file to OpenGL without being copied in to memory of your own, and each
+// texture's pages are released once it's been uploaded. Textures are uploaded the first time they're asked for and
+// deleted again, least recently used first, when the archive goes over its memory budget.
+
+#define COCOAGAME_TEXTURE_ARCHIVE_MAX_NAME 48
+#define COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS 16
+
+/// A texture to write to an archive with CocoaGame_WriteTextureArchive().
+typedef struct CocoaGame_TextureArchiveEntry {
+	/// Up to COCOAGAME_TEXTURE_ARCHIVE_MAX_NAME - 1 characters.
+	const char *name;
+
+	/// As passed to glTexImage2D(). format is 0 if the levels are compressed in internalFormat, in which case 
+	/// they're uploaded with glCompressedTexImage2D().
+	GLint internalFormat;
+	GLenum format;
+	GLenum type;
+
+	/// Size of level 0. Each further level halves both dimensions, down to a minimum of 1.
+	int width;
+	int height;
+
+	/// Rows are tightly packed.
+	int levelCount;
+	const void *levels[COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS];
+	size_t levelSizes[COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS];
+} CocoaGame_TextureArchiveEntry;
+
+/// Write an archive of count textures. This is for tools: archives are in the byte order of the machine that wrote
+/// them. Returns FALSE if the file can't be written.
+CocoaGame_Bool CocoaGame_WriteTextureArchive(const char *path, const CocoaGame_TextureArchiveEntry *textures, int count);
+
+typedef struct CocoaGame_TextureArchive CocoaGame_TextureArchive;
+
+/// Map an archive. Returns NULL if it can't be opened or isn't a valid archive.
+CocoaGame_TextureArchive *CocoaGame_OpenTextureArchive(const char *path);
+
+/// Delete the archive's textures and unmap it. Must be called on the thread that renders, with the OpenGL context
+/// current. archive may be NULL.
+void CocoaGame_CloseTextureArchive(CocoaGame_TextureArchive *archive);
+
+int CocoaGame_GetTextureArchiveCount(const CocoaGame_TextureArchive *archive);
+
+/// Returns the index of the texture with the given name, or -1. This is a linear search, so keep the index.
+int CocoaGame_FindArchivedTexture(const CocoaGame_TextureArchive *archive, const char *name);
+
+const char *CocoaGame_GetArchivedTextureName(const CocoaGame_TextureArchive *archive, int index);
+void CocoaGame_GetArchivedTextureSize(const CocoaGame_TextureArchive *archive, int index, int *width, int *height);
+
+/// Returns the GL_TEXTURE_2D texture at index, uploading it first if it isn't resident, and marks it as used this
+/// frame. The texture stays valid until it's evicted, which can happen during any later call on the same archive 
+/// once the frame is over, so ask for it each frame rather than keeping the name. Must be called on the thread
+/// that renders, with the OpenGL context current.
+GLuint CocoaGame_GetArchivedTexture(CocoaGame_TextureArchive *archive, int index);
+
+/// Start making a texture resident before it's needed. If the upload worker is running (and the texture isn't
+/// compressed), its levels are queued for the worker, which stages them through a pixel buffer object, and 
+/// CocoaGame_GetArchivedTexture() only waits if the worker hasn't reached them yet. Otherwise the texture is 
+/// uploaded now. Must be called on the thread that renders.
+void CocoaGame_PrefetchArchivedTexture(CocoaGame_TextureArchive *archive, int index);
+
+/// Limit the size of the archive's resident textures (the total size of their levels in the archive) to bytes, 
+/// evicting least recently used textures as needed. Textures used during the current frame are never evicted, so 
+/// the budget can be exceeded until the next frame. 0, the default, means no limit.
+void CocoaGame_SetTextureArchiveBudget(CocoaGame_TextureArchive *archive, size_t bytes);
+
+typedef struct CocoaGame_TextureArchiveStats {
+	int residentTextures;
+	size_t residentBytes;
+
+	/// Textures made resident, including those queued for the upload worker, and their size.
+	uint64_t uploads;
+	uint64_t uploadedBytes;
+
+	/// Textures deleted to stay within the budget.
+	uint64_t evictions;
+} CocoaGame_TextureArchiveStats;
+
+void CocoaGame_GetTextureArchiveStats(const CocoaGame_TextureArchive *archive, CocoaGame_TextureArchiveStats *stats);
+
+//
+// Render targets
+//
+
+typedef struct CocoaGame_RenderTargetConfig {
+	int width;
+	int height;
+	
+	/// Internal format of the colour texture (e.g., GL_RGBA8, GL_RGBA16F_ARB).
+	GLint internalFormat;
+	
+	/// 0 for no depth buffer, otherwise 16, 24 or 32.
+	int depthBits;
+	
+	/// 0 for no stencil buffer, or 8. A stencil buffer is always paired with a 24-bit depth buffer.
+	int stencilBits;
+	
+	/// 0 for no multisampling, otherwise the number of samples per pixel.
+	int samples;
+} CocoaGame_RenderTargetConfig;
+
+/// A CocoaGame_RenderTargetConfig containing default values for each member (0x0, GL_RGBA8, 24-bit depth, no 
+/// stencil, no multisampling). Assign this to your own CocoaGame_RenderTargetConfig before customising it.
+extern const CocoaGame_RenderTargetConfig COCOAGAME_RENDERTARGETCONFIG_DEFAULTS;
+
+/// An offscreen framebuffer object with a colour texture, drawn using the main OpenGL context.
+typedef struct CocoaGame_RenderTarget CocoaGame_RenderTarget;
+
+/// Get a render target from the pool. A released target with the same configuration is reused if there is one, 
+/// otherwise a released target of the same format is resized (so resizing the window doesn't create new objects), 
+/// otherwise a new one is created. Targets stay in the pool for a few seconds' worth of frames after they're 
+/// released. Render targets must only be used on the thread that renders, with the OpenGL context current. A 
+/// target can be kept acquired for as long as you like. Returns NULL if the framebuffer can't be created.
+CocoaGame_RenderTarget *CocoaGame_AcquireRenderTarget(const CocoaGame_RenderTargetConfig *config);
+
+/// Return a render target to the pool. Its contents may be overwritten by whoever acquires it next.
+void CocoaGame_ReleaseRenderTarget(CocoaGame_RenderTarget *target);
+
+/// Render in to target, or NULL to render to the screen (or to the scaled render target, if dynamic resolution is 
+/// enabled). This is a framebuffer bind on the current context; the viewport is left to you. CocoaGame_EndRender()
+/// switches back to the screen if a target is still set.
+void CocoaGame_SetRenderTarget(CocoaGame_RenderTarget *target);
+
+/// Returns the GL_TEXTURE_2D holding target's colour buffer. For a multisampled target, this resolves the samples 
+/// if anything has been drawn since the last resolve.
+GLuint CocoaGame_GetRenderTargetTexture(CocoaGame_RenderTarget *target);
+
+const CocoaGame_RenderTargetConfig *CocoaGame_GetRenderTargetConfig(CocoaGame_RenderTarget *target);
+
+/// Free every released render target.
+void CocoaGame_TrimRenderTargets(void);
+
+//
+// Transient buffers
+//
+
+/// Set the number of bytes of transient buffer space available to each frame (default 4MB). Takes effect when the 
+/// buffer is next created. If a frame asks for more, the allocations that don't fit fail and the buffer grows to fit
+/// at the start of the next frame.
+void CocoaGame_SetTransientBufferSize(size_t bytesPerFrame);
+
+/// Allocate size bytes, aligned to alignment bytes, of a buffer object for vertices, indices or uniforms that are
+/// only needed for the current frame. Returns a pointer to write the data to and sets *offset to the data's offset
+/// in to the buffer, or returns NULL if the frame's space has run out. Allocation is a pointer bump; there's no
+/// need to free anything. The buffer is a ring a few frames deep: with ARB_buffer_storage it's persistently mapped
+/// and each frame's part is fenced in CocoaGame_EndRender() and only reused once the GPU is done with it, otherwise
+/// the data is kept in system memory and the buffer is orphaned each frame. Call between CocoaGame_BeginRender() 
+/// and CocoaGame_EndRender().
+void *CocoaGame_AllocTransient(size_t size, size_t alignment, size_t *offset);
+
+/// Bind the transient buffer to target and return its name (e.g., for glBindBufferRange()). Without persistent 
+/// mapping this copies the data allocated since the last bind in to the buffer, so finish writing allocations 
+/// before binding to draw them.
+GLuint CocoaGame_BindTransientBuffer(GLenum target);
+
+typedef struct CocoaGame_TransientStats {
+	/// Bytes available to each frame.
+	size_t capacity;
+
+	/// TRUE if the buffer is persistently mapped, FALSE if it's orphaned each frame.
+	CocoaGame_Bool persistent;
+
+	uint64_t frames;
+	size_t lastFrameBytes;
+	size_t peakFrameBytes;
+	uint64_t totalBytes;
+
+	/// Number of frames that had to wait for the GPU to finish with the part of the ring they were about to use.
+	uint64_t stalls;
+
+	/// Number of allocations that failed because the frame's space had run out.
+	uint64_t overflows;
+} CocoaGame_TransientStats;
+
+void CocoaGame_GetTransientStats(CocoaGame_TransientStats *stats);
+
+/// Reset the counters (but not the capacity).
+void CocoaGame_ResetTransientStats(void);
+
+//
+// Dynamic resolution
+//
+
+typedef struct CocoaGame_DynamicResolutionConfig {
+	CocoaGame_Bool enabled;
+	
+	/// The frame time to aim for, in seconds.
+	double targetFrameSeconds;
+	
+	/// Limits on the scale of the render size relative to the video mode, in each direction.
+	double minScale;
+	double maxScale;
+	
+	/// The format of the scaled render target. width and height are ignored.
+	CocoaGame_RenderTargetConfig target;
+} CocoaGame_DynamicResolutionConfig;
+
+/// A CocoaGame_DynamicResolutionConfig containing default values for each member (disabled, 1/60 second, scale 0.5 
+/// to 1, COCOAGAME_RENDERTARGETCONFIG_DEFAULTS). Assign this to your own CocoaGame_DynamicResolutionConfig before 
+/// customising it.
+extern const CocoaGame_DynamicResolutionConfig COCOAGAME_DYNAMICRESOLUTIONCONFIG_DEFAULTS;
+
+/// Render each frame at a reduced resolution which is adjusted to keep frames within a time budget, then upscale it
+/// to the video mode in CocoaGame_EndRender(). While enabled, CocoaGame_BeginRender() binds the scaled render 
+/// target and sets the viewport to CocoaGame_GetRenderSize(), and CocoaGame_SetRenderTarget(NULL) returns to it 
+/// rather than the screen. Each frame is measured from CocoaGame_BeginRender() to CocoaGame_EndRender() on the CPU 
+/// and, if the driver supports timer queries, on the GPU. When the smoothed time goes over budget the scale drops in 
+/// proportion; when it's comfortably under budget the scale creeps back up, and after each change the scale is held 
+/// for a while so it doesn't oscillate. The render target is sized for the maximum scale and not reallocated as the 
+/// scale changes. Call from the thread that renders, with the OpenGL context current.
+void CocoaGame_SetDynamicResolution(const CocoaGame_DynamicResolutionConfig *config);
+
+const CocoaGame_DynamicResolutionConfig *CocoaGame_GetDynamicResolution(void);
+
+/// Returns the current dynamic resolution scale, or 1 if dynamic resolution is disabled.
+double CocoaGame_GetDynamicResolutionScale(void);
+
+/// Get the size of the area being rendered in to this frame: the scaled size if dynamic resolution is enabled, 
+/// otherwise the video mode's size.
+void CocoaGame_GetRenderSize(int *width, int *height);
+
 //
 // OpenGL pbuffer support
 //
+// Each pbuffer has its own OpenGL context, so switching target is a context switch. Render targets are much 
+// cheaper; pbuffers remain as a fallback for drivers without framebuffer objects.
+//
 	
 #ifdef COCOAGAME_ENABLE_PBUFFERS
 
@@ -457,6 +915,9 @@ typedef enum CocoaGame_EventType {
 typedef struct CocoaGame_ModifiersEvent {
 	CocoaGame_EventType type;
 	unsigned int modifiers;
+	
+	/// Monotonic time, in nanoseconds, at which the event was queued. Set by CocoaGame_QueueEvent().
+	uint64_t timestamp;
 } CocoaGame_ModifiersEvent;
 
 typedef struct CocoaGame_ModifiersChangedEvent {
@@ -548,20 +1009,130 @@ void CocoaGame_Poll(void);
 /// CocoaGame_QueueEvent(). Returns FALSE if the queue is empty.
 CocoaGame_Bool CocoaGame_DequeueEvent(CocoaGame_Event *event);
 
+/// Read up to maxEvents events from the event queue in to events. Returns the number of events read (0 if the queue
+/// is empty). Use this rather than calling CocoaGame_DequeueEvent() once per event.
+int CocoaGame_DequeueEvents(CocoaGame_Event *events, int maxEvents);
+
+/// Enable or disable mouse move coalescing. When enabled, consecutive COCOAGAME_EVENT_MOUSE_MOVE events are merged as
+/// they're dequeued in to a single event with the summed deltaX and deltaY and the position and modifiers of the
+/// latest move. Button, key and scroll events are never merged or reordered. Disabled by default.
+void CocoaGame_SetMouseMoveCoalescing(CocoaGame_Bool coalesce);
+
+CocoaGame_Bool CocoaGame_IsCoalescingMouseMoves(void);
+
 /// Process an NSEvent. You only need to use this if you wish to override CocoaGame's NSEvent handling. Returns TRUE 
 /// if the event has been consumed (in which case a CocoaGame_Event may have been queued), FALSE if the NSEvent 
 /// should be processed as normal (e.g., by -[NSApp sendEvent:]). You could place a call to this method in an 
-/// overridden -[NSApp sendEvent:] if you're not running your own event loop.
+/// overridden -[NSApp sendEvent:] if you're not running your own event loop. With the headless backend, event is
+/// a CocoaGame_Event, which is run through the same modifier, mouse position and Alt+Esc handling before being queued.
 CocoaGame_Bool CocoaGame_ProcessEvent(void *event);
 
-/// Manually queue a CocoaGame_Event to be read by CocoaGame_DequeueEvent().
+/// Manually queue a CocoaGame_Event to be read by CocoaGame_DequeueEvent(). This is lock-free and may be called from
+/// any thread (events from a single thread are dequeued in the order they were queued). If the queue is full the
+/// event is dropped and counted in CocoaGame_EventQueueStats.droppedEvents.
 void CocoaGame_QueueEvent(const CocoaGame_Event *event);
 
+/// Set the number of events the queue can hold (rounded up to a power of two, default 1024). The queue is allocated
+/// by CocoaGame_Init(), so this must be called before then.
+void CocoaGame_SetEventQueueCapacity(int capacity);
+
+/// The bit for an event type in an event mask.
+#define COCOAGAME_EVENT_MASK(type) (1u << (type))
+
+#define COCOAGAME_EVENT_MASK_ALL 0xffffffffu
+
+/// Choose which types of event are delivered. The backends don't build events of other types at all, and 
+/// CocoaGame_QueueEvent() discards them (counted in CocoaGame_EventQueueStats.filteredEvents), so they don't reach
+/// handlers, the queue, recordings or the input state returned by CocoaGame_GetInputState(). For example, remove
+/// COCOAGAME_EVENT_CHAR during gameplay and restore it when a text field has focus. The default is 
+/// COCOAGAME_EVENT_MASK_ALL.
+void CocoaGame_SetEventMask(uint32_t mask);
+
+uint32_t CocoaGame_GetEventMask(void);
+
+/// Returns TRUE if events of the given type are in the event mask, FALSE if not or if type isn't a valid event type.
+CocoaGame_Bool CocoaGame_IsEventTypeEnabled(CocoaGame_EventType type);
+
+/// Return TRUE if the event has been handled and shouldn't be queued, FALSE to queue it as usual.
+typedef CocoaGame_Bool (*CocoaGame_EventHandler)(const CocoaGame_Event *event, void *context);
+
+/// Register a handler for a type of event, replacing any previous one, or remove it if handler is NULL. Handlers are
+/// called synchronously by CocoaGame_QueueEvent() on the thread that's queueing the event (usually the main thread, 
+/// in CocoaGame_Poll()), with the event already timestamped and after the input state has been updated, so events 
+/// they handle skip the round trip through the queue. Events handled while recording are recorded as they're handled.
+/// Set handlers before anything else might be queueing events of that type.
+void CocoaGame_SetEventHandler(CocoaGame_EventType type, CocoaGame_EventHandler handler, void *context);
+
+typedef struct CocoaGame_EventQueueStats {
+	/// Number of events the queue can hold.
+	int capacity;
+	
+	/// Number of events waiting to be dequeued.
+	int depth;
+	
+	/// The greatest depth the queue has reached since the statistics were reset.
+	int highWaterMark;
+	
+	/// Number of events successfully queued since the statistics were reset.
+	uint64_t queuedEvents;
+	
+	/// Number of events dropped because the queue was full since the statistics were reset.
+	uint64_t droppedEvents;
+	
+	/// Number of mouse moves merged in to an earlier move by CocoaGame_SetMouseMoveCoalescing() since the statistics
+	/// were reset.
+	uint64_t coalescedEvents;
+	
+	/// Number of events discarded because their type wasn't in the event mask since the statistics were reset.
+	uint64_t filteredEvents;
+	
+	/// Number of events consumed by a handler, and so not queued, since the statistics were reset.
+	uint64_t handledEvents;
+} CocoaGame_EventQueueStats;
+
+/// Read the event queue's counters. Can be called from any thread.
+void CocoaGame_GetEventQueueStats(CocoaGame_EventQueueStats *stats);
+
+/// Reset the high-water mark and the event counts.
+void CocoaGame_ResetEventQueueStats(void);
+
+//
+// Input recording and replay
+//
+
+/// Start recording every event returned by CocoaGame_DequeueEvent() to a file, along with a marker for each
+/// CocoaGame_BeginRender(), so the recording can be replayed with events arriving on the same frames. Returns FALSE
+/// if the file can't be created. Any recording in progress is stopped first.
+CocoaGame_Bool CocoaGame_StartRecording(const char *path);
+
+/// Stop recording and close the file. Also done by CocoaGame_Shutdown().
+void CocoaGame_StopRecording(void);
+
+CocoaGame_Bool CocoaGame_IsRecording(void);
+
+typedef enum CocoaGame_ReplaySpeed {
+	/// Each frame's events are held back until the same amount of time has passed as when they were recorded.
+	COCOAGAME_REPLAY_REALTIME,
+	
+	/// Each frame's events are queued at the next CocoaGame_BeginRender() (useful for tests and benchmarks).
+	COCOAGAME_REPLAY_AS_FAST_AS_POSSIBLE,
+} CocoaGame_ReplaySpeed;
+
+/// Replay a file made by CocoaGame_StartRecording(). Events recorded before the first frame are queued immediately,
+/// then each CocoaGame_BeginRender() queues the next frame's events via CocoaGame_QueueEvent(), so they're read back
+/// with CocoaGame_DequeueEvent() as normal. Replay stops by itself at the end of the file. Recordings are only
+/// portable between builds with the same CocoaGame_Event layout. Returns FALSE if the file can't be read.
+CocoaGame_Bool CocoaGame_StartReplay(const char *path, CocoaGame_ReplaySpeed speed);
+
+void CocoaGame_StopReplay(void);
+
+CocoaGame_Bool CocoaGame_IsReplaying(void);
+
 /// Print the contents of a CocoaGame_Event to stderr (even if CocoaGame_Trace() has been disabled).
 void CocoaGame_TraceEvent(const CocoaGame_Event *event);
 
 /// Sleep the application for the specified number of seconds, or until an event occurs. You can specify fractions of
-/// seconds.
+/// seconds. See also CocoaGame_WaitForEvents().
 void CocoaGame_Sleep(double seconds);
 
 /// Returns TRUE if the application is active, FALSE if not. This does not tell you whether or not the window is
@@ -596,16 +1167,571 @@ void CocoaGame_GetMousePosition(int *x, int *y);
 /// Move the mouse. Coordinates are in Cocoa coordinates (X 0, Y 1 is the bottom-left of the window).
 void CocoaGame_SetMousePosition(int x, int y);
 
+//
+// Input state
+//
+
+/// Number of key codes tracked by CocoaGame_InputState. Carbon key codes all fit.
+#define COCOAGAME_INPUT_KEY_CODES 256
+
+/// The state of the keyboard and mouse as of a CocoaGame_BeginRender(), with everything that happened since the 
+/// previous one. Bitmasks are indexed by Carbon key code (CocoaGame_KeyEvent.keyCode) and CocoaGame_MouseButton. A
+/// key pressed and released between two frames has both its pressed and released bits set; key repeats aren't 
+/// presses. This is a plain struct, so copy it to hand it to another thread.
+typedef struct CocoaGame_InputState {
+	uint32_t keys[COCOAGAME_INPUT_KEY_CODES / 32];
+	uint32_t keysPressed[COCOAGAME_INPUT_KEY_CODES / 32];
+	uint32_t keysReleased[COCOAGAME_INPUT_KEY_CODES / 32];
+
+	uint32_t buttons;
+	uint32_t buttonsPressed;
+	uint32_t buttonsReleased;
+
+	/// CocoaGame_Modifiers.
+	unsigned int modifiers;
+	unsigned int modifiersPressed;
+	unsigned int modifiersReleased;
+
+	/// Mouse position from the most recent mouse event, in the same coordinates as the events.
+	int mouseX;
+	int mouseY;
+
+	/// Sum of the mouse move deltas and scrolling since the previous frame.
+	float mouseDeltaX;
+	float mouseDeltaY;
+	float scrollX;
+	float scrollY;
+
+	/// Incremented by each CocoaGame_BeginRender().
+	uint64_t frame;
+} CocoaGame_InputState;
+
+/// Returns the input state snapshotted by the last CocoaGame_BeginRender(). The state is updated from every event
+/// given to CocoaGame_QueueEvent() (including those from CocoaGame_ProcessEvent() and replays), whether or not 
+/// you dequeue them. Deactivating the application releases every key and button. The returned pointer is only 
+/// valid until the next CocoaGame_BeginRender(), so read it on the thread that renders (e.g., in the render 
+/// thread's callback) and pass a copy to any other thread.
+const CocoaGame_InputState *CocoaGame_GetInputState(void);
+
+CocoaGame_Bool CocoaGame_IsKeyDown(const CocoaGame_InputState *state, unsigned int keyCode);
+CocoaGame_Bool CocoaGame_WasKeyPressed(const CocoaGame_InputState *state, unsigned int keyCode);
+CocoaGame_Bool CocoaGame_WasKeyReleased(const CocoaGame_InputState *state, unsigned int keyCode);
+
+CocoaGame_Bool CocoaGame_IsMouseButtonDown(const CocoaGame_InputState *state, CocoaGame_MouseButton button);
+CocoaGame_Bool CocoaGame_WasMouseButtonPressed(const CocoaGame_InputState *state, CocoaGame_MouseButton button);
+CocoaGame_Bool CocoaGame_WasMouseButtonReleased(const CocoaGame_InputState *state, CocoaGame_MouseButton button);
+
+/// Enable or disable late latching. Disabled by default, in which case CocoaGame_LatchInput() does nothing.
+void CocoaGame_SetLateLatchEnabled(CocoaGame_Bool enabled);
+
+CocoaGame_Bool CocoaGame_IsLateLatchEnabled(void);
+
+/// If late latching is enabled, do a second, lightweight poll that only reads mouse movement and fold the mouse 
+/// position and any deltas received since the last CocoaGame_BeginRender() in to the snapshot returned by 
+/// CocoaGame_GetInputState(). Call this as late as possible before submitting anything that depends on the mouse 
+/// (e.g., just before setting the camera's orientation) so it uses the freshest input. Keys and buttons aren't 
+/// latched. The mouse move events are still queued, so if you take deltas from the events, don't also take them from
+/// the latched state. AppKit can only be polled on the main thread, so with a render thread this only picks up what 
+/// the main thread's CocoaGame_Poll() has read since the frame began. Returns the snapshot.
+const CocoaGame_InputState *CocoaGame_LatchInput(void);
+
 //
 // Timers
 //
 
+/// Returns the number of nanoseconds since some point in the past. This is a monotonic clock: it isn't affected by
+/// changes to the system time. All the other timers are derived from it.
+uint64_t CocoaGame_GetNanoseconds(void);
+
 /// Returns the number of seconds since some point in the past, as a double.
 double CocoaGame_GetTimer(void);
 
 /// Returns the current value of a looping millisecond timer.
 uint32_t CocoaGame_GetMillisecondTimer(void);
 
+//
+// Frame timing
+//
+
+/// The parts of a frame that are timed when frame timing is enabled.
+typedef enum CocoaGame_FramePhase {
+	/// Time spent in CocoaGame_Poll() (all calls since the frame began).
+	COCOAGAME_FRAME_PHASE_POLL,
+	
+	/// Time spent in CocoaGame_BeginRender(), including any resize or update of the OpenGL context.
+	COCOAGAME_FRAME_PHASE_BEGIN_RENDER,
+	
+	/// Time from the end of CocoaGame_BeginRender() to the start of CocoaGame_EndRender(), i.e., your own rendering.
+	COCOAGAME_FRAME_PHASE_RENDER,
+	
+	/// Time spent in CocoaGame_EndRender() flushing the frame.
+	COCOAGAME_FRAME_PHASE_END_RENDER,
+	
+	/// Time from one CocoaGame_BeginRender() to the next.
+	COCOAGAME_FRAME_PHASE_FRAME,
+	
+	COCOAGAME_FRAME_PHASE_COUNT
+} CocoaGame_FramePhase;
+
+/// Enable or disable frame timing. When enabled, CocoaGame records the duration of each CocoaGame_FramePhase, the
+/// event queue depth, the number of dropped events and the input latency for each of the last 1024 frames. Enabling 
+/// timing resets it.
+/// Disabled by default, in which case the cost is a test per phase. Frame timing must only be used from the thread
+/// that renders.
+void CocoaGame_SetFrameTimingEnabled(CocoaGame_Bool enabled);
+
+CocoaGame_Bool CocoaGame_IsFrameTimingEnabled(void);
+
+/// Discard all recorded frames.
+void CocoaGame_ResetFrameTiming(void);
+
+typedef struct CocoaGame_FrameTimingSummary {
+	/// Number of frames the summary covers (at most the last 1024).
+	int frames;
+	
+	/// Percentiles, in seconds. These come from a histogram so are accurate to within about 3%.
+	double p50;
+	double p95;
+	double p99;
+	
+	/// Longest duration in seconds.
+	double max;
+} CocoaGame_FrameTimingSummary;
+
+/// Summarise the durations of a phase over the recorded frames.
+void CocoaGame_GetFrameTimingSummary(CocoaGame_FramePhase phase, CocoaGame_FrameTimingSummary *summary);
+
+/// Input latency is measured from the time each event was queued (CocoaGame_ModifiersEvent.timestamp) to the end of 
+/// the CocoaGame_EndRender() that flushed the first frame after it was consumed, i.e., after it was returned by
+/// CocoaGame_DequeueEvent() or picked up by CocoaGame_LatchInput(). Each frame that consumed input records the age 
+/// of the oldest and the newest such event.
+typedef enum CocoaGame_InputAge {
+	COCOAGAME_INPUT_AGE_OLDEST,
+	COCOAGAME_INPUT_AGE_NEWEST,
+	
+	COCOAGAME_INPUT_AGE_COUNT
+} CocoaGame_InputAge;
+
+/// Summarise the input latency over the recorded frames. summary->frames is the number of those frames which 
+/// consumed input.
+void CocoaGame_GetInputLatencySummary(CocoaGame_InputAge age, CocoaGame_FrameTimingSummary *summary);
+
+typedef enum CocoaGame_FrameTimingFormat {
+	/// One line per frame with a header line. Durations are in nanoseconds. The input latency columns are empty for
+	/// frames which consumed no input.
+	COCOAGAME_FRAME_TIMING_CSV,
+	
+	/// An object with a "summary" of each phase and of the input latency (in seconds) and an array of "frames" 
+	/// (durations in nanoseconds).
+	COCOAGAME_FRAME_TIMING_JSON,
+} CocoaGame_FrameTimingFormat;
+
+/// Write the recorded frames to a file. Returns FALSE if the file can't be written.
+CocoaGame_Bool CocoaGame_WriteFrameTimingLog(const char *path, CocoaGame_FrameTimingFormat format);
+
+//
+// Render thread
+//
+
+/// A set of three buffers used to pass a snapshot of your game's state from the thread that updates it to the
+/// thread that renders it, without either ever waiting for the other. The writer always has a buffer to fill and the
+/// reader always gets the most recently published one; snapshots the reader doesn't get to in time are skipped.
+typedef struct CocoaGame_Snapshots CocoaGame_Snapshots;
+
+/// Create a set of three snapshot buffers of the given size, initially zeroed. Returns NULL if out of memory.
+CocoaGame_Snapshots *CocoaGame_CreateSnapshots(size_t size);
+
+void CocoaGame_DestroySnapshots(CocoaGame_Snapshots *snapshots);
+
+/// Returns the buffer to fill in with the next snapshot. It will contain an old snapshot, not necessarily the last one
+/// you published. Only call this from one thread.
+void *CocoaGame_GetSnapshotForWriting(CocoaGame_Snapshots *snapshots);
+
+/// Publish the buffer returned by CocoaGame_GetSnapshotForWriting().
+void CocoaGame_PublishSnapshot(CocoaGame_Snapshots *snapshots);
+
+/// Returns the most recently published snapshot, which remains valid until the next call. Returns a zeroed buffer if
+/// nothing has been published yet. Only call this from one thread (the render thread, if it's been given the 
+/// snapshots).
+const void *CocoaGame_GetLatestSnapshot(CocoaGame_Snapshots *snapshots);
+
+/// Returns TRUE if a snapshot has been published since the last CocoaGame_GetLatestSnapshot().
+CocoaGame_Bool CocoaGame_HasNewSnapshot(CocoaGame_Snapshots *snapshots);
+
+/// Wait up to timeout seconds for a snapshot to be published. Returns CocoaGame_HasNewSnapshot().
+CocoaGame_Bool CocoaGame_WaitForSnapshot(CocoaGame_Snapshots *snapshots, double timeout);
+
+/// Called on the render thread, between CocoaGame_BeginRender() and CocoaGame_EndRender(), to draw a frame. snapshot
+/// is the latest snapshot, or NULL if the render thread wasn't given any.
+typedef void (*CocoaGame_RenderThreadCallback)(const void *snapshot, void *context);
+
+/// Start a thread that owns the OpenGL context and renders frames by calling callback. If snapshots isn't NULL the
+/// thread renders a frame each time a snapshot is published, otherwise it renders continuously (so set a swap 
+/// interval). Meanwhile, the main thread carries on calling CocoaGame_Poll() and reading events, updates the game,
+/// and publishes snapshots, so event handling, simulation and rendering overlap. Resizes and full screen toggles
+/// are applied by the main thread, between the render thread's frames. While the thread is running, don't call 
+/// CocoaGame_BeginRender(), CocoaGame_EndRender() or make OpenGL calls from any other thread, and the draw callback
+/// set with CocoaGame_SetDrawCallback() isn't used. Input recording frame markers and frame timing come from the 
+/// render thread. Must be called after CocoaGame_InitGL() and from the main thread.
+CocoaGame_Bool CocoaGame_StartRenderThread(CocoaGame_RenderThreadCallback callback, void *context, CocoaGame_Snapshots *snapshots);
+
+/// Stop the render thread after its current frame and give the OpenGL context back to the main thread. Called for
+/// you when video is shut down.
+void CocoaGame_StopRenderThread(void);
+
+CocoaGame_Bool CocoaGame_IsRenderThreadRunning(void);
+
+//
+// Profiling
+//
+
+/// Start writing profiling zones to a file in Chrome's trace event format, which can be loaded in to
+/// chrome://tracing or Perfetto. A background thread writes the file as zones are recorded. CocoaGame's own
+/// Poll, ProcessEvent, BeginRender, EndRender, context update and fade functions are zoned, so they appear on the
+/// same timeline as your zones. Returns FALSE if the file can't be created.
+CocoaGame_Bool CocoaGame_StartProfiling(const char *path);
+
+/// Stop profiling, write any remaining zones and close the file. Zones begun before profiling stopped but not yet
+/// ended are left open.
+void CocoaGame_StopProfiling(void);
+
+CocoaGame_Bool CocoaGame_IsProfiling(void);
+
+/// Begin a zone on the calling thread. name must remain valid until profiling stops (a string literal or 
+/// __FUNCTION__ is ideal) as only the pointer is recorded. Zones nest, and each must be ended on the same thread by 
+/// CocoaGame_EndZone(). When not profiling, this costs a single test. Each thread buffers up to 16384 zone records;
+/// if the background thread can't keep up, zones are dropped.
+void CocoaGame_BeginZone(const char *name);
+
+/// As CocoaGame_BeginZone(), but also records a value which appears in the zone's arguments.
+void CocoaGame_BeginZoneWithValue(const char *name, int64_t value);
+
+/// End the zone most recently begun on the calling thread.
+void CocoaGame_EndZone(void);
+
+/// Name the calling thread in profiles. As with zone names, only the pointer is kept.
+void CocoaGame_SetProfileThreadName(const char *name);
+
+//
+// Frame pacing
+//
+
+typedef enum CocoaGame_FramePacing {
+	/// CocoaGame_WaitForNextFrame() returns immediately.
+	COCOAGAME_FRAME_PACING_OFF,
+	
+	/// CocoaGame_WaitForNextFrame() waits for the next frame's deadline.
+	COCOAGAME_FRAME_PACING_FIXED,
+	
+	/// As COCOAGAME_FRAME_PACING_FIXED, but if frames keep missing their deadline the swap interval is set to 0 so 
+	/// they're no longer held back waiting for a vertical blank, then restored once frames are on time again.
+	COCOAGAME_FRAME_PACING_ADAPTIVE,
+} CocoaGame_FramePacing;
+
+typedef struct CocoaGame_FramePacerConfig {
+	CocoaGame_FramePacing mode;
+	
+	/// Target frame rate.
+	double framesPerSecond;
+	
+	/// The pacer sleeps until this many seconds before each deadline then spins for the remainder, since sleeps can
+	/// overrun by a millisecond or more. Larger values cost CPU time but reduce jitter.
+	double spinSeconds;
+	
+	/// If TRUE, the pacer calls CocoaGame_Poll() while it waits and returns early if any events are queued.
+	CocoaGame_Bool wakeForInput;
+} CocoaGame_FramePacerConfig;
+
+/// A CocoaGame_FramePacerConfig containing default values for each member (pacing off, 60 frames per second, 2 ms
+/// spin, wake for input). Assign this to your own CocoaGame_FramePacerConfig before customising it.
+extern const CocoaGame_FramePacerConfig COCOAGAME_FRAMEPACERCONFIG_DEFAULTS;
+
+/// Configure the frame pacer. Restores the swap interval if the adaptive mode had relaxed it, and resets the cadence.
+void CocoaGame_SetFramePacer(const CocoaGame_FramePacerConfig *config);
+
+const CocoaGame_FramePacerConfig *CocoaGame_GetFramePacer(void);
+
+typedef enum CocoaGame_FrameWait {
+	/// The frame's deadline was reached.
+	COCOAGAME_FRAME_WAIT_ON_TIME,
+	
+	/// The deadline had already passed when CocoaGame_WaitForNextFrame() was called, so it returned immediately.
+	COCOAGAME_FRAME_WAIT_MISSED,
+	
+	/// Events were queued before the deadline. Process them and call CocoaGame_WaitForNextFrame() again to wait for 
+	/// the rest of the frame.
+	COCOAGAME_FRAME_WAIT_INPUT,
+} CocoaGame_FrameWait;
+
+/// Wait until it's time to start the next frame. Call this once per frame, typically after CocoaGame_EndRender().
+/// If a frame is more than a whole period late the cadence restarts from now instead of rushing to catch up. On the
+/// render thread, events are left to the main thread, so this never returns COCOAGAME_FRAME_WAIT_INPUT there.
+CocoaGame_FrameWait CocoaGame_WaitForNextFrame(void);
+
+typedef struct CocoaGame_FramePacerStats {
+	/// Number of frames paced since the statistics were reset.
+	uint64_t frames;
+	
+	/// Number of frames for which CocoaGame_WaitForNextFrame() returned COCOAGAME_FRAME_WAIT_MISSED.
+	uint64_t missedDeadlines;
+	
+	/// How long after its deadline, in nanoseconds, the last frame was released. Small for on-time frames (the 
+	/// pacer's jitter), larger for missed frames.
+	uint64_t lastLateness;
+	
+	/// The largest lastLateness since the statistics were reset.
+	uint64_t maxLateness;
+	
+	/// TRUE if the last frame missed its deadline.
+	CocoaGame_Bool lastFrameMissed;
+	
+	/// TRUE if COCOAGAME_FRAME_PACING_ADAPTIVE has currently relaxed the swap interval.
+	CocoaGame_Bool swapIntervalRelaxed;
+} CocoaGame_FramePacerStats;
+
+void CocoaGame_GetFramePacerStats(CocoaGame_FramePacerStats *stats);
+
+void CocoaGame_ResetFramePacerStats(void);
+
+//
+// Idle waiting
+//
+
+typedef enum CocoaGame_WaitResult {
+	/// Events were queued. Process them.
+	COCOAGAME_WAIT_EVENT,
+	
+	/// CocoaGame_Wake() was called.
+	COCOAGAME_WAIT_WOKEN,
+	
+	/// The time ran out.
+	COCOAGAME_WAIT_TIMEOUT,
+} CocoaGame_WaitResult;
+
+/// Block the main thread until an event is queued, CocoaGame_Wake() is called or the specified number of seconds
+/// (or forever, if negative) have passed, calling CocoaGame_Poll() for you. Unlike CocoaGame_Sleep(), this uses no CPU
+/// time while it waits, and returns as soon as another thread queues an event or wakes it.
+CocoaGame_WaitResult CocoaGame_WaitForEvents(double seconds);
+
+/// Wake CocoaGame_WaitForEvents(). May be called from any thread (e.g., by a loader when its work is done). If the main
+/// thread isn't waiting, the next CocoaGame_WaitForEvents() returns COCOAGAME_WAIT_WOKEN immediately.
+void CocoaGame_Wake(void);
+
+typedef enum CocoaGame_FrameState {
+	/// The application is active and the last frame was rendered.
+	COCOAGAME_FRAME_STATE_ACTIVE,
+	
+	/// The application is inactive (it has had COCOAGAME_EVENT_APP_DEACTIVATE) but still rendering, i.e., it's in a
+	/// window.
+	COCOAGAME_FRAME_STATE_INACTIVE,
+	
+	/// The last CocoaGame_BeginRender() returned FALSE, or the window is completely covered by other windows.
+	COCOAGAME_FRAME_STATE_HIDDEN,
+} CocoaGame_FrameState;
+
+CocoaGame_FrameState CocoaGame_GetFrameState(void);
+
+typedef struct CocoaGame_FrameRateCaps {
+	/// Maximum frames per second in each state, or 0 for no cap.
+	double activeFramesPerSecond;
+	double inactiveFramesPerSecond;
+	double hiddenFramesPerSecond;
+} CocoaGame_FrameRateCaps;
+
+/// A CocoaGame_FrameRateCaps containing default values for each member (uncapped when active, 30 frames per second
+/// when inactive, 4 when hidden). Assign this to your own CocoaGame_FrameRateCaps before customising it.
+extern const CocoaGame_FrameRateCaps COCOAGAME_FRAMERATECAPS_DEFAULTS;
+
+/// Set the frame rate caps used by CocoaGame_ThrottleFrame(), and reset its cadence.
+void CocoaGame_SetFrameRateCaps(const CocoaGame_FrameRateCaps *caps);
+
+const CocoaGame_FrameRateCaps *CocoaGame_GetFrameRateCaps(void);
+
+/// Call once per frame, after CocoaGame_EndRender() or after CocoaGame_BeginRender() returns FALSE, to hold the frame
+/// rate to the cap for the current CocoaGame_FrameState. Waits with CocoaGame_WaitForEvents(), so it returns early if
+/// an event is queued or CocoaGame_Wake() is called; call it again after processing them to wait for the rest of the 
+/// frame. Returns COCOAGAME_WAIT_TIMEOUT immediately if the current state isn't capped.
+CocoaGame_WaitResult CocoaGame_ThrottleFrame(void);
+
+//
+// Frame capture
+//
+
+typedef enum CocoaGame_CaptureFormat {
+	/// Every frame appended to a single file as top-down RGBA, 4 bytes per pixel, with no header.
+	COCOAGAME_CAPTURE_RAW,
+	
+	/// A YUV4MPEG2 (4:4:4) stream, which ffmpeg and most video tools read directly.
+	COCOAGAME_CAPTURE_Y4M,
+	
+	/// One uncompressed PNG per frame. path is a printf format which is passed the frame number.
+	COCOAGAME_CAPTURE_PNG,
+} CocoaGame_CaptureFormat;
+
+typedef struct CocoaGame_CaptureConfig {
+	CocoaGame_CaptureFormat format;
+	
+	/// The file to write, or for COCOAGAME_CAPTURE_PNG a printf format for each frame's file (e.g., "frame%05d.png").
+	const char *path;
+	
+	/// Number of frames to skip after each captured frame, so 1 captures every other frame.
+	int frameSkip;
+	
+	/// Frames are shrunk by this factor in each direction (with a box filter) before they're written.
+	int downscale;
+	
+	/// Frame rate written in to the Y4M header.
+	int framesPerSecond;
+} CocoaGame_CaptureConfig;
+
+/// A CocoaGame_CaptureConfig containing default values for each member (PNG, "capture%05d.png", every frame, full
+/// size, 60 frames per second). Assign this to your own CocoaGame_CaptureConfig before customising it.
+extern const CocoaGame_CaptureConfig COCOAGAME_CAPTURECONFIG_DEFAULTS;
+
+/// Start capturing every frame passed to CocoaGame_EndRender() (other than discarded frames). The read back is
+/// asynchronous: a frame is copied in to a pixel buffer object when it ends and collected a frame or two later, once
+/// the GPU has finished with it, then converted and written by a background thread. If either falls behind, frames
+/// are dropped rather than stalling rendering. With RAW and Y4M, frames captured after the window is resized are
+/// dropped as the stream can't change size. Call the capture functions from the thread that renders, with the
+/// OpenGL context current. Returns FALSE if the file can't be created.
+CocoaGame_Bool CocoaGame_StartCapture(const CocoaGame_CaptureConfig *config);
+
+/// Wait for frames already read back to be written, then close the file. Called for you when video is shut down.
+void CocoaGame_StopCapture(void);
+
+CocoaGame_Bool CocoaGame_IsCapturing(void);
+
+typedef struct CocoaGame_CaptureStats {
+	/// Frames read back from OpenGL.
+	uint64_t capturedFrames;
+	
+	/// Frames written to disk.
+	uint64_t writtenFrames;
+	
+	/// Frames skipped because the read back or the writer fell behind, or because the frame size changed.
+	uint64_t droppedFrames;
+} CocoaGame_CaptureStats;
+
+/// Statistics for the current capture, or the last one if capture has stopped.
+void CocoaGame_GetCaptureStats(CocoaGame_CaptureStats *stats);
+
+//
+// Background uploads
+//
+
+/// Start a thread which uploads textures and buffers using its own OpenGL context, shared with the main one, so 
+/// streaming resources in doesn't stall the thread that renders. Must be called after CocoaGame_InitGL(), from the
+/// main thread. Returns FALSE if the shared context or the thread can't be created.
+CocoaGame_Bool CocoaGame_StartUploadWorker(void);
+
+/// Upload everything that's been queued, then stop the thread. Called for you when video is shut down.
+void CocoaGame_StopUploadWorker(void);
+
+CocoaGame_Bool CocoaGame_IsUploadWorkerRunning(void);
+
+/// An upload queued for the upload worker.
+typedef struct CocoaGame_Upload CocoaGame_Upload;
+
+/// Queue a glTexImage2D() of one level of texture (target may be a cube map face), which must already have been 
+/// created with glGenTextures(). pixels (size bytes, rows tightly packed) is staged through a pixel buffer object 
+/// by the worker and must remain valid until CocoaGame_IsUploadFinished() returns TRUE or CocoaGame_FinishUpload()
+/// is called. Can be called from any thread. Returns NULL if the worker isn't running.
+CocoaGame_Upload *CocoaGame_UploadTexture(GLuint texture, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels, size_t size);
+
+/// Queue a glBufferSubData() of size bytes at offset in buffer, which must already have its storage allocated with
+/// glBufferData(). data must remain valid as for CocoaGame_UploadTexture().
+CocoaGame_Upload *CocoaGame_UploadBuffer(GLuint buffer, size_t offset, size_t size, const void *data);
+
+/// Returns TRUE once the worker has issued the upload, after which its source data is no longer needed. The GPU may
+/// not have finished with it yet.
+CocoaGame_Bool CocoaGame_IsUploadFinished(const CocoaGame_Upload *upload);
+
+/// Call before first using the resource, on the thread that's going to use it with its context current. Waits 
+/// only if the worker hasn't issued the upload yet (counted as a stall), then makes the context's command stream 
+/// wait for the upload on the GPU, and frees upload. Textures must be bound again after this for the new contents 
+/// to be seen. upload may be NULL.
+void CocoaGame_FinishUpload(CocoaGame_Upload *upload);
+
+typedef struct CocoaGame_UploadStats {
+	uint64_t queuedUploads;
+	uint64_t queuedBytes;
+	uint64_t completedUploads;
+	uint64_t completedBytes;
+
+	/// Number of times CocoaGame_FinishUpload() had to wait for the worker.
+	uint64_t stalls;
+} CocoaGame_UploadStats;
+
+void CocoaGame_GetUploadStats(CocoaGame_UploadStats *stats);
+
+//
+// Jobs
+//
+
+/// Start a work-stealing job scheduler with workerCount worker threads (0 for one fewer than the number of cores, 
+/// and at least one). The calling thread also runs jobs while it waits for them. Jobs can be added without starting 
+/// the scheduler, in which case they run immediately on the thread adding them.
+CocoaGame_Bool CocoaGame_StartJobs(int workerCount);
+
+/// Run every job that's ready to run, then stop the worker threads. Called for you by CocoaGame_Shutdown().
+void CocoaGame_StopJobs(void);
+
+int CocoaGame_GetJobWorkerCount(void);
+
+typedef void (*CocoaGame_JobFunction)(void *data);
+
+/// Counts jobs that haven't finished. Must be zeroed before use (CocoaGame_JobCounter counter = { 0 };) and can be
+/// reused once CocoaGame_AreJobsFinished() returns TRUE. Don't touch the members.
+typedef struct CocoaGame_JobCounter {
+	int pending;
+	void *waiting;
+} CocoaGame_JobCounter;
+
+/// Run function(data) on a job thread. name shows up in the profiler and must remain valid. If counter isn't NULL,
+/// it's incremented now and decremented once the job has finished. Can be called from any thread, including jobs.
+void CocoaGame_RunJob(const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter);
+
+/// As CocoaGame_RunJob(), but the job isn't run until every job counted by dependency has finished.
+void CocoaGame_RunJobAfter(CocoaGame_JobCounter *dependency, const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter);
+
+typedef enum CocoaGame_JobTiming {
+	COCOAGAME_JOB_NOW,
+
+	/// Held until the next CocoaGame_BeginRender(), which waits for the job to finish before rendering starts.
+	COCOAGAME_JOB_BEFORE_BEGIN_RENDER,
+
+	/// Held until the next CocoaGame_EndRender() has finished, then run alongside the following frame.
+	COCOAGAME_JOB_AFTER_END_RENDER
+} CocoaGame_JobTiming;
+
+/// As CocoaGame_RunJob(), but the job is held until a frame boundary. counter is incremented immediately.
+void CocoaGame_RunJobAt(CocoaGame_JobTiming timing, const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter);
+
+CocoaGame_Bool CocoaGame_AreJobsFinished(const CocoaGame_JobCounter *counter);
+
+/// Wait until every job counted by counter has finished, running other jobs in the meantime.
+void CocoaGame_WaitForJobs(CocoaGame_JobCounter *counter);
+
+typedef struct CocoaGame_JobStats {
+	int workers;
+	uint64_t jobsRun;
+
+	/// Jobs taken from another thread's queue.
+	uint64_t jobsStolen;
+
+	/// Jobs run by threads waiting in CocoaGame_WaitForJobs().
+	uint64_t jobsHelped;
+
+	/// Jobs run immediately by the thread adding them, because the scheduler wasn't running or the job pool was empty.
+	uint64_t jobsInline;
+
+	/// Time spent running jobs, summed over every thread.
+	uint64_t busyNanoseconds;
+} CocoaGame_JobStats;
+
+void CocoaGame_GetJobStats(CocoaGame_JobStats *stats);
+void CocoaGame_ResetJobStats(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,16 +8,9 @@
 // - prevent click-through
 //
 
-#include "CocoaGame.h"
+#include "CocoaGamePrivate.h"
 #import <Cocoa/Cocoa.h>
-#include <sys/time.h>
-
-//
-// Compile-time options
-//
-
-// If you get "queue full" in your Console, increase this. Or your frame rate.
-#define COCOAGAME_MAX_QUEUED_EVENTS 64
+#include <float.h>
 
 //
 // Compatibility
@@ -69,45 +62,10 @@
 
 @end
 
-//
-// Globals
-//
-
-const CocoaGame_VideoConfig COCOAGAME_VIDEOCONFIG_DEFAULTS = { 
-	.disposition = COCOAGAME_VIDEO_FULLSCREEN_WINDOW, 
-	.mode = {
-		.width = 800, 
-		.height = 600, 
-		.bits = 32
-	},
-	.title = NULL, 
-	.acceptClosestMode = FALSE, 
-	.captureDisplay = TRUE,
-	.enableWindowResizing = TRUE,
-	.fullScreenWindowLevel = COCOAGAME_WINDOWLEVEL_DEFAULT,
-	.useLionFullScreenSupport = TRUE,
-};
-	
-const CocoaGame_GLConfig COCOAGAME_GLCONFIG_DEFAULTS = { 
-	.colourBits = 24, 
-	.depthBits = 24, 
-	.alphaBits = 8, 
-	.stencilBits = 8, 
-	.msaa = 4, 
-	.swapInterval = 1 
-};
-
 //
 // Private functions
 //
 
-#define countof(arr) (sizeof(arr) / sizeof((arr)[0]))
-
-static void CocoaGame_DefaultTraceHandler(const char *format, va_list argptr);
-static void CocoaGame_FormatAndAppendNewline(char *buf, size_t bufsize, const char *format, va_list argptr);
-
-static void CocoaGame_DefaultAbortWithMessageHandler(const char *title, const char *format, va_list argptr);
-
 static void CocoaGame_GetVideoModeFromDictionary(NSDictionary *dict, CocoaGame_VideoMode *mode);
 
 static CocoaGame_Bool CocoaGame_CreateDelegate(void);
@@ -125,13 +83,21 @@ static void CocoaGame_DestroyWindow(void);
 static CocoaGame_Int CocoaGame_WindowLevelToNSWindowLevel(CocoaGame_WindowLevel level);
 
 static void CocoaGame_ReadViewDimensions(int *width, int *height);
+static void CocoaGame_CacheRenderThreadState(void);
+static void CocoaGame_UpdateRenderThreadState(void);
 static CGRect CocoaGame_GetDisplayBoundsInNSWindowCoordinateSpace(void);
 
 static NSOpenGLContext *CocoaGame_CreateOpenGLContext(const CocoaGame_GLConfig *config, CocoaGame_GLConfig *actualConfig);
+static NSOpenGLContext *CocoaGame_TryCreateOpenGLContext(const CocoaGame_GLConfig *config, int msaa, CocoaGame_GLConfig *actualConfig);
 static CocoaGame_Bool CocoaGame_ReadGLConfig(NSOpenGLContext *context, NSOpenGLPixelFormat *pixelFormat, CocoaGame_GLConfig *config);
+static void CocoaGame_RequestOpenGLUpdate(void);
+static void CocoaGame_ApplyOpenGLUpdate(void);
 static BOOL CocoaGame_UpdateOpenGLContext(void);
 
 static CocoaGame_Bool CocoaGame_PollOne(void);
+static void CocoaGame_CreateSleepTimer(void);
+static void CocoaGame_DestroySleepTimer(void);
+static void CocoaGame_SleepTimerFired(CFRunLoopTimerRef timer, void *info);
 static void CocoaGame_UpdateModifiers(unsigned long cocoaModifierFlags);
 
 static BOOL CocoaGame_UpdateMousePosition(NSEvent *event);
@@ -164,24 +130,13 @@ static NSOpenGLPixelFormat *CocoaGame_CreatePixelFormatForPixelBuffer(const Coco
 // Private data
 //
 
-static CocoaGame_Bool traceEnabled = TRUE;
-static CocoaGame_TraceHandler traceHandler = &CocoaGame_DefaultTraceHandler;
-static CocoaGame_AbortWithMessageHandler abortWithMessageHandler = &CocoaGame_DefaultAbortWithMessageHandler;
-
 static CocoaGame_Bool isInitialised = FALSE;
 
 static CGDirectDisplayID whichDisplay;
 static NSDictionary *originalMode;
 
-static int videoModeCount;
-static CocoaGame_VideoMode *videoModes;
-
 static CocoaGame_Delegate *delegate;
 
-static CocoaGame_Event queue[COCOAGAME_MAX_QUEUED_EVENTS];
-static int queueRead = 0;
-static int queueWrite = 0;
-
 static CocoaGame_Bool enableAltEsc = TRUE;
 static CocoaGame_Bool shouldQuit;
 static unsigned int modifiers;
@@ -272,6 +227,24 @@ static volatile CocoaGame_Bool windowIsTogglingFullScreen;
 static NSOpenGLContext *openGLContext;
 static CocoaGame_Bool openGLUpdateRequired;
 
+// While a render thread is running, AppKit state is read on the main thread (in CocoaGame_Poll()) and cached here
+// for CocoaGame_BeginRender(), under the context lock.
+static volatile CocoaGame_Bool renderThreadActive;
+static CocoaGame_Bool renderThreadShouldRender;
+static int renderThreadViewWidth, renderThreadViewHeight;
+
+// Subtype of the NSApplicationDefined event CocoaGame_WakeBlocked() posts. Only one is posted at a time: wakeEventPosted
+// is cleared when CocoaGame_ProcessEvent() drops it.
+#define COCOAGAME_WAKE_EVENT_SUBTYPE 0x4347
+static CocoaGame_Bool wakeEventPosted;
+
+// CocoaGame_Sleep() waits for an event with no time limit and arms sleepTimer to post sleepEvent when the time is up,
+// so that it needn't allocate an NSDate. Both are created once, on the first sleep, and only used on the main thread.
+#define COCOAGAME_SLEEP_EVENT_SUBTYPE 0x4348
+static CFRunLoopTimerRef sleepTimer;
+static NSEvent *sleepEvent;
+static CocoaGame_Bool sleepEventPosted;
+
 static CocoaGame_GLConfig glConfig;
 
 static CocoaGame_Bool wantKeyRepeats = TRUE;
@@ -291,48 +264,6 @@ static CocoaGame_Bool discardedRender = FALSE;
 // Implementation
 //
 
-static void CocoaGame_DefaultTraceHandler(const char *format, va_list argptr)
-{
-	char buf[1024];
-	CocoaGame_FormatAndAppendNewline(buf, sizeof(buf), format, argptr);
-
-	fputs(buf, stderr);
-}
-
-void CocoaGame_Trace(const char *format, ...)
-{
-	va_list argptr;
-	va_start(argptr, format);
-
-	if (traceEnabled)
-		traceHandler(format, argptr);
-	
-	va_end(argptr);
-}
-
-void CocoaGame_SetTraceEnabled(CocoaGame_Bool newTraceEnabled)
-{
-	traceEnabled = newTraceEnabled;
-}
-
-void CocoaGame_SetTraceHandler(CocoaGame_TraceHandler handler)
-{
-	traceHandler = handler ? handler : &CocoaGame_DefaultTraceHandler;
-}
-
-CocoaGame_TraceHandler CocoaGame_GetTraceHandler(void)
-{
-	return traceHandler;
-}
-
-static void CocoaGame_FormatAndAppendNewline(char *buf, size_t bufsize, const char *format, va_list argptr)
-{
-	vsnprintf(buf, bufsize - 1, format, argptr);
-
-	if (buf[0] && buf[strlen(buf) - 1] != '\n')
-		strcat(buf, "\n");
-}
-
 void CocoaGame_CreateAutoreleasePool(void **pool)
 {
 	*pool = [[NSAutoreleasePool alloc] init];
@@ -355,6 +286,12 @@ CocoaGame_GLInfo *CocoaGame_GetGLInfo2(const CocoaGame_GLConfig *fakeConfig)
 	NSOpenGLContext *tempContext = nil;
 	
 	if (! openGLContext) {
+		info = CocoaGame_LookupGLInfoCache();
+		if (info) {
+			[pool drain];
+			return info;
+		}
+
 		NSOpenGLPixelFormatAttribute attribs[40];
 		unsigned int attribCount = 0;
 
@@ -397,15 +334,25 @@ CocoaGame_GLInfo *CocoaGame_GetGLInfo2(const CocoaGame_GLConfig *fakeConfig)
 		
 		[tempContext makeCurrentContext];
 		[tempContext setFullScreen];
+		CocoaGame_CoreContextCurrent(NULL);
 	}
 	
-	info = calloc(1, sizeof(CocoaGame_GLInfo));
-	info->version = strdup((const char *) glGetString(GL_VERSION));
-	info->extensions = strdup((const char *) glGetString(GL_EXTENSIONS));
-	info->renderer = strdup((const char *) glGetString(GL_RENDERER));
-	info->vendor = strdup((const char *) glGetString(GL_VENDOR));
+	info = CocoaGame_AllocZeroed(1, sizeof(CocoaGame_GLInfo), COCOAGAME_ALLOC_VIDEO);
+	if (info) {
+		info->version = CocoaGame_StrDup((const char *) glGetString(GL_VERSION), COCOAGAME_ALLOC_VIDEO);
+		info->extensions = CocoaGame_StrDup((const char *) glGetString(GL_EXTENSIONS), COCOAGAME_ALLOC_VIDEO);
+		info->renderer = CocoaGame_StrDup((const char *) glGetString(GL_RENDERER), COCOAGAME_ALLOC_VIDEO);
+		info->vendor = CocoaGame_StrDup((const char *) glGetString(GL_VENDOR), COCOAGAME_ALLOC_VIDEO);
+
+		if (! info->version || ! info->extensions || ! info->renderer || ! info->vendor) {
+			CocoaGame_FreeGLInfo(info);
+			info = NULL;
+		}
+	}
 	
 	if (tempContext) {
+		CocoaGame_UpdateGLCache(NULL, NULL);
+
 		if ([NSOpenGLContext currentContext] == tempContext) 
 			[NSOpenGLContext clearCurrentContext];
 			
@@ -417,6 +364,34 @@ CocoaGame_GLInfo *CocoaGame_GetGLInfo2(const CocoaGame_GLConfig *fakeConfig)
 	return info;
 }
 
+CocoaGame_Bool CocoaGame_GetGLDeviceKey(char *key, size_t size)
+{
+	CGLRendererInfoObj rendererInfo;
+	GLint rendererCount = 0;
+	if (CGLQueryRendererInfo(CGDisplayIDToOpenGLDisplayMask(whichDisplay), &rendererInfo, &rendererCount) != kCGLNoError)
+		return FALSE;
+
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	// The drivers are part of the OS, so its version identifies them. The renderer IDs identify the GPUs.
+	NSString *osVersion = [[NSProcessInfo processInfo] operatingSystemVersionString];
+	int length = snprintf(key, size, "mac %s", [osVersion UTF8String]);
+
+	GLint i;
+	for (i = 0; i != rendererCount && length >= 0 && (size_t) length < size; ++i) {
+		GLint rendererID = 0, accelerated = 0;
+		CGLDescribeRenderer(rendererInfo, i, kCGLRPRendererID, &rendererID);
+		CGLDescribeRenderer(rendererInfo, i, kCGLRPAccelerated, &accelerated);
+
+		if (accelerated)
+			length += snprintf(key + length, size - (size_t) length, " %08x", (unsigned int) rendererID);
+	}
+
+	CGLDestroyRendererInfo(rendererInfo);
+	[pool drain];
+	return TRUE;
+}
+
 CocoaGame_GLInfo *CocoaGame_GetGLInfo(void)
 {
 	return CocoaGame_GetGLInfo2(&COCOAGAME_GLCONFIG_DEFAULTS);
@@ -424,11 +399,11 @@ CocoaGame_GLInfo *CocoaGame_GetGLInfo(void)
 
 void CocoaGame_FreeGLInfo(CocoaGame_GLInfo *info)
 {
-	free(info->version);
-	free(info->extensions);
-	free(info->vendor);
-	free(info->renderer);
-	free(info);
+	CocoaGame_Free(info->version);
+	CocoaGame_Free(info->extensions);
+	CocoaGame_Free(info->vendor);
+	CocoaGame_Free(info->renderer);
+	CocoaGame_Free(info);
 }
 
 CocoaGame_Bool CocoaGame_Init(void)
@@ -445,9 +420,11 @@ CocoaGame_Bool CocoaGame_Init(void)
 	if (! CocoaGame_BuildModeList())
 		return FALSE;
 	
+	if (! CocoaGame_InitEventQueue())
+		return FALSE;
+	
 	isInitialised = TRUE;
 	shouldQuit = FALSE;
-	queueRead = queueWrite = 0;
 	modifiers = 0; // force an event for any modifiers
 	videoConfig.disposition = COCOAGAME_VIDEO_NONE;
 	
@@ -464,67 +441,25 @@ CocoaGame_Bool CocoaGame_Init(void)
 	return TRUE;
 }
 
-static int CocoaGame_VideoModeCompare(const void *va, const void *vb)
-{
-	const CocoaGame_VideoMode *a = (const CocoaGame_VideoMode *) va;
-	const CocoaGame_VideoMode *b = (const CocoaGame_VideoMode *) vb;
-	
-	if (a->bits > b->bits)
-		return -1;
-		
-	if (a->bits < b->bits)
-		return 1;
-	
-	if (a->width > b->width)
-		return -1;
-		
-	if (a->width < b->width)
-		return 1;
-		
-	if (a->height > b->height)
-		return -1;
-		
-	if (a->height < b->height)
-		return 1;
-		
-	return 0;
-}
-
 CocoaGame_Bool CocoaGame_BuildModeList(void)
 {
 	// Owned by the system - don't release.
 	NSArray *modeList = (NSArray *) CGDisplayAvailableModes(whichDisplay);
 	
-	videoModes = realloc(videoModes, [modeList count] * sizeof(CocoaGame_VideoMode));
-	videoModeCount = (int) [modeList count];
+	int count = (int) [modeList count];
+	CocoaGame_VideoMode *modes = CocoaGame_AllocVideoModes(count);
+	if (! modes)
+		return FALSE;
 	
 	int i;
-	for (i = 0; i != videoModeCount; ++i) {
+	for (i = 0; i != count; ++i) {
 		// Owned by the system - don't release.
 		NSDictionary *mode = (NSDictionary *) [modeList objectAtIndex:i];
 		
-		CocoaGame_GetVideoModeFromDictionary(mode, &videoModes[i]);
+		CocoaGame_GetVideoModeFromDictionary(mode, &modes[i]);
 	}
 	
-	qsort(videoModes, videoModeCount, sizeof(*videoModes), &CocoaGame_VideoModeCompare);
-	
-	CocoaGame_VideoMode *out = videoModes;
-	const CocoaGame_VideoMode *in = videoModes;
-	const CocoaGame_VideoMode *inEnd = videoModes + videoModeCount;
-	
-	*out++ = *in++;
-	
-	for (; in != inEnd; ++in) {
-		if (! CocoaGame_VideoModesEqual(in - 1, in))
-			*out++ = *in;
-	}
-	
-	int newVideoModeCount = (int) (out - videoModes);
-	
-	CocoaGame_Trace("%s: %d video modes (%d duplicates removed).\n", __FUNCTION__, newVideoModeCount, videoModeCount - newVideoModeCount);
-	videoModeCount = newVideoModeCount;
-	
-	videoModes = realloc(videoModes, videoModeCount * sizeof(CocoaGame_VideoMode));
+	CocoaGame_FinishVideoModes();
 	
 	return TRUE;
 }
@@ -536,50 +471,22 @@ static void CocoaGame_GetVideoModeFromDictionary(NSDictionary *dict, CocoaGame_V
 	mode->bits = [[dict objectForKey:(id) kCGDisplayBitsPerPixel] intValue];
 }
 
-CocoaGame_Bool CocoaGame_VideoModesEqual(const CocoaGame_VideoMode *a, const CocoaGame_VideoMode *b)
-{
-	return a->width == b->width && a->height == b->height && a->bits == b->bits;
-}
-
-BOOL CocoaGame_ParseVideoMode(const char *str, CocoaGame_VideoMode *videoMode)
-{
-	videoMode->bits = 32;
-	if (sscanf(str, "%dx%dx%d", &videoMode->width, &videoMode->height, &videoMode->bits) < 2)
-		return NO;
-		
-	if (videoMode->width < 1 || videoMode->height < 1)
-		return NO;
-		
-	if (videoMode->bits < 16)
-		return NO;
-		
-	return YES;
-}
-
-int CocoaGame_GetVideoModeCount(void)
-{
-	return videoModeCount;
-}
-
-const CocoaGame_VideoMode *CocoaGame_GetVideoMode(int modeNumber)
-{
-	NSCAssert(modeNumber >= 0 && modeNumber < videoModeCount, @"Invalid mode number");
-	
-	return &videoModes[modeNumber];	   
-}
-
 void CocoaGame_Shutdown(void)
 {
 	if (! isInitialised)
 		return;
 	
+	// Jobs may still be queueing uploads or events.
+	CocoaGame_StopJobs();
+
 	CocoaGame_ShutdownVideo();
 	CocoaGame_FadeFromBlack();
 	
-	free(videoModes);
-	videoModes = NULL;
-	videoModeCount = 0;
+	CocoaGame_FreeVideoModes();
+	
+	CocoaGame_ShutdownEventQueue();
 
+	CocoaGame_DestroySleepTimer();
 	CocoaGame_DestroyDelegate();
 	
 	isInitialised = FALSE;
@@ -587,20 +494,7 @@ void CocoaGame_Shutdown(void)
 	CocoaGame_Trace("%s: shutdown complete.\n", __FUNCTION__);
 }
 
-void CocoaGame_AbortWithMessage(const char *title, const char *format, ...)
-{
-	va_list argptr;
-	va_start(argptr, format);
-	CocoaGame_AbortWithMessageVA(title, format, argptr);
-	va_end(argptr);
-}
-
-void CocoaGame_AbortWithMessageVA(const char *title, const char *format, va_list argptr)
-{
-	(*abortWithMessageHandler)(title, format, argptr);
-}
-
-static void CocoaGame_DefaultAbortWithMessageHandler(const char *title, const char *format, va_list argptr)
+void CocoaGame_DefaultAbortWithMessageHandler(const char *title, const char *format, va_list argptr)
 {
 	char buf[1024];
 	vsnprintf(buf, sizeof(buf), format, argptr);
@@ -612,16 +506,14 @@ static void CocoaGame_DefaultAbortWithMessageHandler(const char *title, const ch
 	exit(1);
 }
 
-void CocoaGame_SetAbortWithMessageHandler(CocoaGame_AbortWithMessageHandler handler)
-{
-	abortWithMessageHandler = handler;
-}
-
 static void CocoaGame_ShutdownVideo(void)
 {
 	// CocoaGame_Shutdown should have checked this
 	NSCAssert(isInitialised, @"");
 
+	CocoaGame_StopRenderThread();
+	CocoaGame_StopUploadWorker();
+
 	// Destroying a window while it's in the process of toggling fullscreen is bad.
 	while (windowIsTogglingFullScreen) 
 		CocoaGame_Poll();
@@ -632,11 +524,22 @@ static void CocoaGame_ShutdownVideo(void)
 	CocoaGame_ImplementDefaultMouseMode();
 
 	if (openGLContext) {
+		// Capture's buffers, render targets and transient buffers belong to the context, so release them while it still
+		// exists.
+		[openGLContext makeCurrentContext];
+		CocoaGame_CoreContextCurrent(openGLContext);
+		CocoaGame_ShutdownCapture();
+		CocoaGame_ShutdownRenderTargets();
+		CocoaGame_ShutdownTransient();
+
 		CocoaGame_Trace("%s: shutting down OpenGL...\n", __FUNCTION__);
 
-		if ([NSOpenGLContext currentContext] == openGLContext) 
+		if ([NSOpenGLContext currentContext] == openGLContext) {
 			[NSOpenGLContext clearCurrentContext];
+			CocoaGame_CoreContextCurrent(NULL);
+		}
 			
+		CocoaGame_CoreContextDestroyed(openGLContext);
 		[openGLContext clearDrawable];
 		[openGLContext release];
 		openGLContext = nil;
@@ -815,22 +718,30 @@ CocoaGame_Bool CocoaGame_InitVideo(const CocoaGame_VideoConfig *config)
 
 void CocoaGame_FadeToBlack(void)
 {
+	CocoaGame_BeginZone(__FUNCTION__);
+
 	if (fadeToken == kCGDisplayFadeReservationInvalidToken) {
 		if (CGAcquireDisplayFadeReservation(5, &fadeToken) == kCGErrorSuccess)
 			CGDisplayFade(fadeToken, fadeTime, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, TRUE);
 		else
 			fadeToken = kCGDisplayFadeReservationInvalidToken;
 	}
+
+	CocoaGame_EndZone();
 }
 
 void CocoaGame_FadeFromBlack(void)
 {
+	CocoaGame_BeginZone(__FUNCTION__);
+
 	if (fadeToken != kCGDisplayFadeReservationInvalidToken) {
 		CGDisplayFade(fadeToken, fadeTime, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, FALSE);
 		CGReleaseDisplayFadeReservation(fadeToken);
 
 		fadeToken = kCGDisplayFadeReservationInvalidToken;
 	}
+
+	CocoaGame_EndZone();
 }
 
 void CocoaGame_SetFadeTime(float newFadeTime)
@@ -1094,6 +1005,7 @@ CocoaGame_Bool CocoaGame_InitGL(const CocoaGame_GLConfig *config)
 		return FALSE;
 		
 	if (! CocoaGame_UpdateOpenGLContext()) {
+		CocoaGame_CoreContextDestroyed(openGLContext);
 		openGLContext = nil;
 		return FALSE;
 	}
@@ -1103,14 +1015,17 @@ CocoaGame_Bool CocoaGame_InitGL(const CocoaGame_GLConfig *config)
 	openGLUpdateRequired = FALSE;
 
 	[openGLContext makeCurrentContext];
+	CocoaGame_CoreContextCurrent(openGLContext);
 
 	// Make sure we don't display any garbage to the user.
-	glDisable(GL_SCISSOR_TEST);
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	CocoaGame_GLDisable(GL_SCISSOR_TEST);
+	CocoaGame_GLClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 	
 	[openGLContext flushBuffer];
 
+	CocoaGame_UpdateGLCache(config, &glConfig);
+
 	CocoaGame_Trace("%s: OpenGL initialised.\n", __FUNCTION__);
 
 	return TRUE;
@@ -1118,65 +1033,86 @@ CocoaGame_Bool CocoaGame_InitGL(const CocoaGame_GLConfig *config)
 
 static NSOpenGLContext *CocoaGame_CreateOpenGLContext(const CocoaGame_GLConfig *config, CocoaGame_GLConfig *actualConfig)
 {
+	// Try the configuration that worked last time first, to save walking down through the MSAA modes.
+	int cachedMSAA = 0;
+	CocoaGame_GLConfig cachedConfig;
+	if (CocoaGame_LookupGLConfigCache(config, &cachedConfig)) {
+		cachedMSAA = cachedConfig.msaa < 1 ? 1 : cachedConfig.msaa;
+
+		NSOpenGLContext *context = CocoaGame_TryCreateOpenGLContext(config, cachedMSAA, actualConfig);
+		if (context)
+			return context;
+	}
+
 	int msaa = config->msaa;
 	if (msaa < 1)
 		msaa = 1;
 
 	for (; msaa; --msaa) {
-		NSOpenGLPixelFormatAttribute attribs[40];
-		unsigned int attribCount = 0;
-
-		attribs[attribCount++] = NSOpenGLPFAAccelerated;
-		attribs[attribCount++] = NSOpenGLPFADoubleBuffer;
-		attribs[attribCount++] = NSOpenGLPFANoRecovery;
+		if (msaa == cachedMSAA)
+			continue;
 
-		if (CocoaGame_GetVideoTraits()->acquiresDisplays) {
-			attribs[attribCount++] = NSOpenGLPFAFullScreen;
-			attribs[attribCount++] = NSOpenGLPFAScreenMask;
-			attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) CGDisplayIDToOpenGLDisplayMask(whichDisplay);
-		}
+		NSOpenGLContext *context = CocoaGame_TryCreateOpenGLContext(config, msaa, actualConfig);
+		if (context)
+			return context;
+	}
 
-		attribs[attribCount++] = NSOpenGLPFAColorSize;
-		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->colourBits;
-		attribs[attribCount++] = NSOpenGLPFAAlphaSize;
-		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->alphaBits;
-		attribs[attribCount++] = NSOpenGLPFADepthSize;
-		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->depthBits;
-		attribs[attribCount++] = NSOpenGLPFAStencilSize;
-		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->stencilBits;
-
-		if (msaa > 1) {
-			attribs[attribCount++] = NSOpenGLPFAMultisample;
-			attribs[attribCount++] = NSOpenGLPFASampleBuffers;
-			attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) 1;
-			attribs[attribCount++] = NSOpenGLPFASamples;
-			attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) msaa;
-		}
+	NSLog(@"%s: unable to create GL pixel format/context.", __FUNCTION__);
+	return nil;
+}
 
-		// Terminate the attributes.
-		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) 0;
-		
-		NSCAssert(attribCount <= countof(attribs), @"Overflowed attribs buffer");
+static NSOpenGLContext *CocoaGame_TryCreateOpenGLContext(const CocoaGame_GLConfig *config, int msaa, CocoaGame_GLConfig *actualConfig)
+{
+	NSOpenGLPixelFormatAttribute attribs[40];
+	unsigned int attribCount = 0;
 
-		NSOpenGLPixelFormat *pixelFormat = [[[NSOpenGLPixelFormat alloc] initWithAttributes:attribs] autorelease];
+	attribs[attribCount++] = NSOpenGLPFAAccelerated;
+	attribs[attribCount++] = NSOpenGLPFADoubleBuffer;
+	attribs[attribCount++] = NSOpenGLPFANoRecovery;
 
-		if (! pixelFormat) 
-			continue;
+	if (CocoaGame_GetVideoTraits()->acquiresDisplays) {
+		attribs[attribCount++] = NSOpenGLPFAFullScreen;
+		attribs[attribCount++] = NSOpenGLPFAScreenMask;
+		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) CGDisplayIDToOpenGLDisplayMask(whichDisplay);
+	}
 
-		NSOpenGLContext *context = [[NSOpenGLContext alloc] initWithFormat:pixelFormat shareContext:nil];
-		
-		if (! context) 
-			continue;
-		
-		GLint swapInterval = config->swapInterval;
-		[context setValues:&swapInterval forParameter:NSOpenGLCPSwapInterval];
+	attribs[attribCount++] = NSOpenGLPFAColorSize;
+	attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->colourBits;
+	attribs[attribCount++] = NSOpenGLPFAAlphaSize;
+	attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->alphaBits;
+	attribs[attribCount++] = NSOpenGLPFADepthSize;
+	attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->depthBits;
+	attribs[attribCount++] = NSOpenGLPFAStencilSize;
+	attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) config->stencilBits;
 
-		CocoaGame_ReadGLConfig(context, pixelFormat, actualConfig);
-		return [context autorelease];
+	if (msaa > 1) {
+		attribs[attribCount++] = NSOpenGLPFAMultisample;
+		attribs[attribCount++] = NSOpenGLPFASampleBuffers;
+		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) 1;
+		attribs[attribCount++] = NSOpenGLPFASamples;
+		attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) msaa;
 	}
 
-	NSLog(@"%s: unable to create GL pixel format/context.", __FUNCTION__);
-	return nil;
+	// Terminate the attributes.
+	attribs[attribCount++] = (NSOpenGLPixelFormatAttribute) 0;
+	
+	NSCAssert(attribCount <= countof(attribs), @"Overflowed attribs buffer");
+
+	NSOpenGLPixelFormat *pixelFormat = [[[NSOpenGLPixelFormat alloc] initWithAttributes:attribs] autorelease];
+
+	if (! pixelFormat) 
+		return nil;
+
+	NSOpenGLContext *context = [[NSOpenGLContext alloc] initWithFormat:pixelFormat shareContext:nil];
+	
+	if (! context) 
+		return nil;
+	
+	GLint swapInterval = config->swapInterval;
+	[context setValues:&swapInterval forParameter:NSOpenGLCPSwapInterval];
+
+	CocoaGame_ReadGLConfig(context, pixelFormat, actualConfig);
+	return [context autorelease];
 }
 
 static CocoaGame_Bool CocoaGame_ReadGLConfig(NSOpenGLContext *context, NSOpenGLPixelFormat *pixelFormat, CocoaGame_GLConfig *config)
@@ -1216,43 +1152,86 @@ const CocoaGame_GLConfig *CocoaGame_GetGLConfig(void)
 	return &glConfig;
 }
 
+void CocoaGame_SetSwapInterval(int swapInterval)
+{
+	NSCAssert(isInitialised && openGLContext, @"Attempt to set the swap interval when GL not initialised.");
+
+	GLint value = swapInterval;
+	[openGLContext setValues:&value forParameter:NSOpenGLCPSwapInterval];
+	[openGLContext getValues:&value forParameter:NSOpenGLCPSwapInterval];
+	glConfig.swapInterval = (int) value;
+}
+
 CocoaGame_Bool CocoaGame_BeginRender(void)
 {
 	NSCAssert(isInitialised && openGLContext, @"Attempt to begin rendering when GL not initialised.");
 
+	CocoaGame_BeginZone(__FUNCTION__);
+	CocoaGame_CoreBeginRender();
+
+	uint64_t timingStart = CocoaGame_BeginTiming();
+
 	CocoaGame_Bool shouldRender;
 	
 	if (CocoaGame_GetVideoTraits()->rendersToView) {
-		shouldRender = [window isVisible];
+		if (renderThreadActive) {
+			shouldRender = renderThreadShouldRender;
+			videoConfig.mode.width = renderThreadViewWidth;
+			videoConfig.mode.height = renderThreadViewHeight;
+		} else {
+			shouldRender = [window isVisible];
 
-		CocoaGame_ReadViewDimensions(&videoConfig.mode.width, &videoConfig.mode.height);
+			CocoaGame_ReadViewDimensions(&videoConfig.mode.width, &videoConfig.mode.height);
+		}
 
 		NSCAssert([openGLContext view] == view, @"openGLContext has been reassigned somehow.");
 	} else {
-		shouldRender = [NSApp isActive];
+		shouldRender = renderThreadActive ? renderThreadShouldRender : [NSApp isActive];
 			
 		CGRect bounds = CGDisplayBounds(whichDisplay);
 		if ((int) bounds.size.width != videoConfig.mode.width || (int) bounds.size.height != videoConfig.mode.height) {
 			NSLog(@"%s: video mode changed externally!\n", __FUNCTION__);
 			CocoaGame_GetVideoModeFromDictionary((NSDictionary *) CGDisplayCurrentMode(whichDisplay), &videoConfig.mode);
-			openGLUpdateRequired = TRUE;
+			CocoaGame_RequestOpenGLUpdate();
 		}
 	}
 
-	if (openGLUpdateRequired)  {
-		CocoaGame_UpdateOpenGLContext();
-		openGLUpdateRequired = FALSE;
-	}
+	// With a render thread the main thread updates the context under the context lock (see CocoaGame_Poll()).
+	if (! renderThreadActive)
+		CocoaGame_ApplyOpenGLUpdate();
 
 	[openGLContext makeCurrentContext];
+	CocoaGame_CoreContextCurrent(openGLContext);
 	
 	discardedRender = FALSE;
 
+	if (shouldRender)
+		CocoaGame_CoreBeginFrame();
+
+	CocoaGame_EndTiming(COCOAGAME_FRAME_PHASE_BEGIN_RENDER, timingStart);
+	CocoaGame_EndZone();
+
 	return shouldRender;
 }
 
+// May be called on any thread. The update happens in the next CocoaGame_BeginRender() or, with a render thread, in
+// the main thread's next CocoaGame_Poll().
+static void CocoaGame_RequestOpenGLUpdate(void)
+{
+	__atomic_store_n(&openGLUpdateRequired, TRUE, __ATOMIC_RELEASE);
+}
+
+// Clearing the flag before updating means a request made during the update isn't lost.
+static void CocoaGame_ApplyOpenGLUpdate(void)
+{
+	if (__atomic_exchange_n(&openGLUpdateRequired, FALSE, __ATOMIC_ACQ_REL))
+		CocoaGame_UpdateOpenGLContext();
+}
+
 static BOOL CocoaGame_UpdateOpenGLContext(void)
 {
+	CocoaGame_BeginZone(__FUNCTION__);
+
 	if (CocoaGame_GetVideoTraits()->rendersToView) {
 		CocoaGame_Trace("%s: updating OpenGL context (windowed).\n", __FUNCTION__);
 		[openGLContext setView:view];
@@ -1272,6 +1251,7 @@ static BOOL CocoaGame_UpdateOpenGLContext(void)
 		CocoaGame_Trace("%s: OpenGL context updated.\n", __FUNCTION__);
 	}
 
+	CocoaGame_EndZone();
 	return TRUE;
 }
 
@@ -1284,74 +1264,200 @@ void CocoaGame_EndRender(void)
 	NSCAssert([NSOpenGLContext currentContext] == openGLContext, @"Did you forget to CocoaGame_SetTargetPixelBuffer(NULL)?");
 	NSCAssert(! CocoaGame_GetVideoTraits()->rendersToView || [openGLContext view] == view, @"openGLContext view reassigned somehow.");
 	
+	CocoaGame_CoreEndRender(discardedRender);
+
+	CocoaGame_BeginZone(__FUNCTION__);
+	uint64_t timingStart = CocoaGame_BeginTiming();
+
 	if (! discardedRender)
 		[openGLContext flushBuffer];
 	
 	discardedRender = TRUE;
+
+	CocoaGame_CoreFinishRender(glConfig.swapInterval != 0);
+
+	CocoaGame_EndTiming(COCOAGAME_FRAME_PHASE_END_RENDER, timingStart);
+	CocoaGame_EndZone();
 }
 
 void CocoaGame_DiscardRender(void)
 {
 	discardedRender = TRUE;
 }
-	
 
-typedef struct CocoaGame_SidedModifierTest {
-	CocoaGame_UInt cocoaFlag;
-	CocoaGame_UInt cocoaLeftDeviceFlag;
-	CocoaGame_UInt cocoaRightDeviceFlag;
-	enum CocoaGame_Modifiers leftFlag;
-	enum CocoaGame_Modifiers rightFlag;
-} CocoaGame_SidedModifierTest;
+//
+// Render thread support
+//
 
-static CocoaGame_SidedModifierTest SIDED_MODIFIER_TESTS[] = {
-	{ NSShiftKeyMask, NX_DEVICELSHIFTKEYMASK, NX_DEVICERSHIFTKEYMASK, COCOAGAME_MODIFIER_LEFT_SHIFT, COCOAGAME_MODIFIER_RIGHT_SHIFT },
-	{ NSControlKeyMask, NX_DEVICELCTLKEYMASK, NX_DEVICERCTLKEYMASK, COCOAGAME_MODIFIER_LEFT_CTRL, COCOAGAME_MODIFIER_RIGHT_CTRL },
-	{ NSAlternateKeyMask, NX_DEVICELALTKEYMASK, NX_DEVICERALTKEYMASK, COCOAGAME_MODIFIER_LEFT_ALT, COCOAGAME_MODIFIER_RIGHT_ALT },
-	{ NSCommandKeyMask, NX_DEVICELCMDKEYMASK, NX_DEVICERCMDKEYMASK, COCOAGAME_MODIFIER_LEFT_COMMAND, COCOAGAME_MODIFIER_RIGHT_COMMAND }
-};
+void CocoaGame_PrepareRenderThread(void)
+{
+	NSCAssert(isInitialised && openGLContext, @"Attempt to start render thread when GL not initialised.");
+	NSCAssert([NSThread isMainThread], @"The render thread must be started from the main thread.");
+
+	CocoaGame_CacheRenderThreadState();
+	renderThreadActive = TRUE;
+
+	[NSOpenGLContext clearCurrentContext];
+	CocoaGame_CoreContextCurrent(NULL);
+}
 
-static unsigned int CocoaGame_TestSidedModifiers(const CocoaGame_SidedModifierTest *test, CocoaGame_UInt cocoaModifierFlags)
+void CocoaGame_FinishRenderThread(void)
 {
-	if (! (cocoaModifierFlags & test->cocoaFlag)) 
-		return 0;
-		
-	unsigned int flags = 0;
-		
-	if (cocoaModifierFlags & test->cocoaLeftDeviceFlag)
-		flags |= test->leftFlag;
-		
-	if (cocoaModifierFlags & test->cocoaRightDeviceFlag)
-		flags |= test->rightFlag;
-		
-	// If neither of the device flags are set, just assume left
-	if (! flags)
-		return test->leftFlag;
-		
-	return flags;
+	[NSOpenGLContext clearCurrentContext];
+	CocoaGame_CoreContextCurrent(NULL);
+
+	renderThreadActive = FALSE;
+}
+
+void CocoaGame_ReclaimContext(void)
+{
+	NSCAssert([NSThread isMainThread], @"The context must be reclaimed by the main thread.");
+
+	[openGLContext makeCurrentContext];
+	CocoaGame_CoreContextCurrent(openGLContext);
+}
+
+void CocoaGame_LockContext(void)
+{
+	CGLLockContext([openGLContext CGLContextObj]);
+}
+
+void CocoaGame_UnlockContext(void)
+{
+	CGLUnlockContext([openGLContext CGLContextObj]);
+}
+
+// Read the AppKit state CocoaGame_BeginRender() needs. Must be called on the main thread.
+static void CocoaGame_CacheRenderThreadState(void)
+{
+	if (CocoaGame_GetVideoTraits()->rendersToView) {
+		renderThreadShouldRender = [window isVisible];
+		CocoaGame_ReadViewDimensions(&renderThreadViewWidth, &renderThreadViewHeight);
+	} else
+		renderThreadShouldRender = [NSApp isActive];
+}
+
+// Apply any pending context update and refresh the cached state, between the render thread's frames.
+static void CocoaGame_UpdateRenderThreadState(void)
+{
+	CocoaGame_LockContext();
+	CocoaGame_ApplyOpenGLUpdate();
+	CocoaGame_CacheRenderThreadState();
+	CocoaGame_UnlockContext();
+}
+
+//
+// Shared contexts
+//
+
+void *CocoaGame_CreateSharedContext(void)
+{
+	NSCAssert(isInitialised && openGLContext, @"Attempt to create a shared context when GL not initialised.");
+
+	// Objects can only be shared between contexts with the same pixel format. No drawable is needed just to upload.
+	NSOpenGLPixelFormat *pixelFormat = [[[NSOpenGLPixelFormat alloc] initWithCGLPixelFormatObj:CGLGetPixelFormat([openGLContext CGLContextObj])] autorelease];
+	if (! pixelFormat) {
+		CocoaGame_Trace("%s: unable to get pixel format.\n", __FUNCTION__);
+		return NULL;
+	}
+
+	NSOpenGLContext *context = [[NSOpenGLContext alloc] initWithFormat:pixelFormat shareContext:openGLContext];
+	if (! context) {
+		CocoaGame_Trace("%s: unable to create shared context.\n", __FUNCTION__);
+		return NULL;
+	}
+
+	return context;
+}
+
+CocoaGame_Bool CocoaGame_MakeSharedContextCurrent(void *context)
+{
+	if (! context)
+		[NSOpenGLContext clearCurrentContext];
+	else
+		[(NSOpenGLContext *) context makeCurrentContext];
+
+	CocoaGame_CoreContextCurrent(context);
+	return TRUE;
+}
+
+void CocoaGame_DestroySharedContext(void *context)
+{
+	CocoaGame_CoreContextDestroyed(context);
+	[(NSOpenGLContext *) context release];
+}
+
+//
+// Idle waiting
+//
+
+void CocoaGame_BlockUntilWoken(uint64_t nanoseconds)
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	NSDate *date = nanoseconds == UINT64_MAX ? [NSDate distantFuture] : [NSDate dateWithTimeIntervalSinceNow:(double) nanoseconds / 1e9];
+	
+	// Returns when any event arrives, including the one posted by CocoaGame_WakeBlocked(). It's left in the queue for 
+	// CocoaGame_Poll().
+	[NSApp nextEventMatchingMask:NSAnyEventMask 
+					   untilDate:date 
+						  inMode:NSDefaultRunLoopMode 
+						 dequeue:NO];
+	
+	[pool drain];
+}
+
+void CocoaGame_WakeBlocked(void)
+{
+	if (__atomic_exchange_n(&wakeEventPosted, TRUE, __ATOMIC_SEQ_CST))
+		return;
+	
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	// postEvent:atStart: may be called from any thread.
+	NSEvent *event = [NSEvent otherEventWithType:NSApplicationDefined
+										location:NSZeroPoint
+								   modifierFlags:0
+									   timestamp:0
+									windowNumber:0
+										 context:nil
+										 subtype:COCOAGAME_WAKE_EVENT_SUBTYPE
+										   data1:0
+										   data2:0];
+	
+	[NSApp postEvent:event atStart:NO];
+	
+	[pool drain];
+}
+
+CocoaGame_Bool CocoaGame_IsViewOccluded(void)
+{
+	// Window occlusion is only reported by Mac OS X 10.9 and later.
+	#if MAC_OS_X_VERSION_MAX_ALLOWED >= 1090
+		if (CocoaGame_GetVideoTraits()->rendersToView && window && [window respondsToSelector:@selector(occlusionState)])
+			return ([window occlusionState] & NSWindowOcclusionStateVisible) == 0;
+	#endif
+	
+	return FALSE;
 }
+	
 
 void CocoaGame_UpdateModifiers(unsigned long cocoaModifierFlags)
 {
 	NSCAssert(isInitialised, @"");
 	
-	unsigned int i;
-
-	unsigned int newModifiers = 0;	  
-	for (i = 0; i != countof(SIDED_MODIFIER_TESTS); ++i) 
-		newModifiers |= CocoaGame_TestSidedModifiers(&SIDED_MODIFIER_TESTS[i], (CocoaGame_UInt) cocoaModifierFlags);
-		
-	if (cocoaModifierFlags & NSAlphaShiftKeyMask)
-		newModifiers |= COCOAGAME_MODIFIER_CAPS_LOCK;
+	unsigned int newModifiers = CocoaGame_TranslateModifierFlags(cocoaModifierFlags);
 		
 	if (modifiers == newModifiers)
 		return;
 		
-	CocoaGame_Event ourEvent;
-	ourEvent.type = COCOAGAME_EVENT_MODIFIERS_CHANGED;
-	ourEvent.modifiers.modifiers = newModifiers;
-	ourEvent.modifiersChanged.previousModifiers = modifiers;
-	CocoaGame_QueueEvent(&ourEvent);
+	if (CocoaGame_IsEventTypeEnabled(COCOAGAME_EVENT_MODIFIERS_CHANGED)) {
+		CocoaGame_Event ourEvent;
+		ourEvent.type = COCOAGAME_EVENT_MODIFIERS_CHANGED;
+		ourEvent.modifiers.modifiers = newModifiers;
+		ourEvent.modifiersChanged.previousModifiers = modifiers;
+		CocoaGame_QueueEvent(&ourEvent);
+	}
 		
 	modifiers = newModifiers;
 }
@@ -1365,112 +1471,70 @@ unsigned int CocoaGame_GetModifiers(void)
 
 void CocoaGame_Sleep(double seconds)
 {
-	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
-	
-	// CocoaGame_Trace("%s...\n", __FUNCTION__);
-	
-	[NSApp nextEventMatchingMask:NSAnyEventMask 
-					   untilDate:[NSDate dateWithTimeIntervalSinceNow:seconds] 
-						  inMode:NSDefaultRunLoopMode 
-						 dequeue:NO];
-	
-	[pool drain];
-}
+	if (! sleepTimer)
+		CocoaGame_CreateSleepTimer();
 
-void CocoaGame_QueueEvent(const CocoaGame_Event *event)
-{
-	int nextQueueWrite = (queueWrite + 1) % COCOAGAME_MAX_QUEUED_EVENTS;
-	
-	if (nextQueueWrite == queueRead) {
-		NSLog(@"%s: queue full.", __FUNCTION__);
-	} else {	
-		queue[queueWrite] = *event;
-		queueWrite = nextQueueWrite;
+	CFRunLoopTimerSetNextFireDate(sleepTimer, CFAbsoluteTimeGetCurrent() + seconds);
+
+	// Returns at once if an event is already queued, otherwise when one arrives or sleepTimer posts sleepEvent. The
+	// frame pacer calls this every frame, hence @autoreleasepool, which doesn't allocate, over NSAutoreleasePool.
+	@autoreleasepool {
+		[NSApp nextEventMatchingMask:NSAnyEventMask 
+						   untilDate:[NSDate distantFuture] 
+							  inMode:NSDefaultRunLoopMode 
+							 dequeue:NO];
 	}
+
+	// Disarm the timer if something else ended the sleep.
+	CFRunLoopTimerSetNextFireDate(sleepTimer, DBL_MAX);
 }
 
-CocoaGame_Bool CocoaGame_DequeueEvent(CocoaGame_Event *event)
+static void CocoaGame_CreateSleepTimer(void)
 {
-	if (queueRead == queueWrite) 
-		return FALSE;
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 
-	// Leaving this here as a reminder. Standard Cocoa application's don't process any input during a fullscreen
-	// toggle. I've found this to be an issue only when quitting while a window is in the process of animating 
-	// between fullscreen and a window, so I've put some code to protect from that in CocoaGame_ShutdownVideo
-	// instead. If there's some other issue then this code may need to be restored.
-	// if (windowIsTogglingFullScreen) {
-	// 	CocoaGame_Poll();
-	// 	return FALSE;
-	// }
-	
-	*event = queue[queueRead];
-	queueRead = (queueRead + 1) % COCOAGAME_MAX_QUEUED_EVENTS;
-	return TRUE;
-}	
+	sleepEvent = [[NSEvent otherEventWithType:NSApplicationDefined
+									 location:NSZeroPoint
+								modifierFlags:0
+									timestamp:0
+								 windowNumber:0
+									  context:nil
+									  subtype:COCOAGAME_SLEEP_EVENT_SUBTYPE
+										data1:0
+										data2:0] retain];
 
-void CocoaGame_TraceEvent(const CocoaGame_Event *event)
+	[pool drain];
+
+	// Repeating, so that it stays valid after firing. CocoaGame_Sleep() sets the next fire date every time.
+	sleepTimer = CFRunLoopTimerCreate(kCFAllocatorDefault, DBL_MAX, 1.0e9, 0, 0, &CocoaGame_SleepTimerFired, NULL);
+	CFRunLoopAddTimer(CFRunLoopGetMain(), sleepTimer, kCFRunLoopDefaultMode);
+}
+
+static void CocoaGame_DestroySleepTimer(void)
 {
-	switch (event->type) {
-		case COCOAGAME_EVENT_NONE:
-			break;
-			
-		case COCOAGAME_EVENT_APP_ACTIVATE:
-			fprintf(stderr, "App activate\n");
-			break;
-			
-		case COCOAGAME_EVENT_APP_DEACTIVATE:
-			fprintf(stderr, "App deactivate\n");
-			break;
-			
-		case COCOAGAME_EVENT_MODIFIERS_CHANGED:
-			fprintf(stderr, "Modifiers	 : modifiers now 0x%02x were 0x%02x\n", 
-				event->modifiers.modifiers, event->modifiersChanged.previousModifiers);
-			break;
-			
-		case COCOAGAME_EVENT_KEY_DOWN:
-			fprintf(stderr, "Key down	 : key 0x%04x modifiers 0x%02x keyCode 0x%02x\n", 
-				(unsigned int) event->key.key, event->modifiers.modifiers, event->key.keyCode);
-			break;
+	if (! sleepTimer)
+		return;
 
-		case COCOAGAME_EVENT_KEY_UP:
-			fprintf(stderr, "Key up		 : key 0x%04x modifiers 0x%02x keyCode 0x%02x\n", 
-				(unsigned int) event->key.key, event->modifiers.modifiers, event->key.keyCode);
-			break;
+	CFRunLoopTimerInvalidate(sleepTimer);
+	CFRelease(sleepTimer);
+	sleepTimer = NULL;
 
-		case COCOAGAME_EVENT_CHAR:
-			if (event->character.unicode >= ' ' && event->character.unicode < 127) {
-				fprintf(stderr, "Character	 : '%c' modifiers 0x%02x\n", 
-					(char) event->character.unicode, event->modifiers.modifiers);
-			} else {
-				fprintf(stderr, "Character	 : UNICODE 0x%04x modifiers 0x%02x\n", 
-					(unsigned int) event->character.unicode, event->modifiers.modifiers);
-			}
-			break;
-			
-		case COCOAGAME_EVENT_MOUSE_MOVE:
-			fprintf(stderr, "Mouse move	 :			@ %4d, %4d delta % 3.4f, % 3.4f modifiers 0x%02x\n", 
-				event->mousePosition.x, event->mousePosition.y, 
-				event->mouseMove.deltaX, event->mouseMove.deltaY, event->modifiers.modifiers);
-			break;
+	[sleepEvent release];
+	sleepEvent = nil;
+	sleepEventPosted = FALSE;
+}
 
-		case COCOAGAME_EVENT_MOUSE_DOWN:
-			fprintf(stderr, "Mouse down	 : button %d @ %4d, %4d modifiers 0x%02x\n", 
-				(int) event->mouseButton.button, event->mousePosition.x, event->mousePosition.y, 
-				event->modifiers.modifiers);
-			break;
-			
-		case COCOAGAME_EVENT_MOUSE_UP:
-			fprintf(stderr, "Mouse up	 : button %d @ %4d, %4d modifiers 0x%02x\n", 
-				(int) event->mouseButton.button, event->mousePosition.x, event->mousePosition.y, 
-				event->modifiers.modifiers);
-			break;
+static void CocoaGame_SleepTimerFired(CFRunLoopTimerRef timer, void *info)
+{
+	(void) timer;
+	(void) info;
 
-		case COCOAGAME_EVENT_MOUSE_SCROLL:
-			fprintf(stderr, "Mouse scroll:			@ %4d, %4d scroll % 3.4f, % 3.4f modifiers 0x%02x\n", 
-				event->mouseScroll.cursorX, event->mouseScroll.cursorY, 
-				event->mouseScroll.scrollX, event->mouseScroll.scrollY, event->modifiers.modifiers);
-			break;
-	}
+	// The same event is reposted each time, once CocoaGame_ProcessEvent() has dropped the last one.
+	if (sleepEventPosted)
+		return;
+
+	sleepEventPosted = TRUE;
+	[NSApp postEvent:sleepEvent atStart:NO];
 }
 
 static CocoaGame_Bool CocoaGame_PollOne(void)
@@ -1493,14 +1557,47 @@ static CocoaGame_Bool CocoaGame_PollOne(void)
 
 void CocoaGame_Poll(void)
 {
+	CocoaGame_BeginZone(__FUNCTION__);
+	uint64_t timingStart = CocoaGame_BeginTiming();
+
 	while (CocoaGame_PollOne())
 		{}
+
+	// The render thread mustn't touch the NSOpenGLContext's view, so resizes are applied here, between its frames.
+	if (renderThreadActive)
+		CocoaGame_UpdateRenderThreadState();
+
+	CocoaGame_EndTiming(COCOAGAME_FRAME_PHASE_POLL, timingStart);
+	CocoaGame_EndZone();
+}
+
+void CocoaGame_PollMouseMovement(void)
+{
+	// AppKit may only be polled on the main thread. A render thread relies on the main thread's CocoaGame_Poll().
+	if (! [NSThread isMainThread])
+		return;
+	
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	
+	// Only mouse movement is taken from the queue, so these may be queued ahead of keys and clicks that happened 
+	// before them.
+	CocoaGame_UInt mask = NSMouseMovedMask | NSLeftMouseDraggedMask | NSRightMouseDraggedMask | NSOtherMouseDraggedMask;
+	NSEvent *event;
+	
+	while ((event = [NSApp nextEventMatchingMask:mask untilDate:nil inMode:NSDefaultRunLoopMode dequeue:YES]) != nil) {
+		if (! CocoaGame_ProcessEvent(event))
+			[NSApp sendEvent:event];
+	}
+	
+	[pool drain];
 }
 
 CocoaGame_Bool CocoaGame_ProcessEvent(void *voidEvent)
 {
 	NSEvent *event = (NSEvent *) voidEvent;
 	
+	CocoaGame_BeginZoneWithValue(__FUNCTION__, (int64_t) [event type]);
+
 	CocoaGame_UpdateModifiers([event modifierFlags]);
 	
 	CocoaGame_Bool consumed = FALSE;
@@ -1514,7 +1611,8 @@ CocoaGame_Bool CocoaGame_ProcessEvent(void *voidEvent)
 			if (CocoaGame_UpdateMousePosition(event))
 				CocoaGame_QueueMouseMoveEvent(event);
 
-			if (([event window] == window && mouseIsInView) || CocoaGame_GetVideoTraits()->acquiresDisplays) {
+			if ((([event window] == window && mouseIsInView) || CocoaGame_GetVideoTraits()->acquiresDisplays) &&
+				CocoaGame_IsEventTypeEnabled(COCOAGAME_EVENT_MOUSE_DOWN)) {
 				CocoaGame_Event ourEvent;
 				CocoaGame_NSEventToMouseButtonEvent(event, &ourEvent.mouseButton);
 				ourEvent.type = COCOAGAME_EVENT_MOUSE_DOWN;
@@ -1531,7 +1629,8 @@ CocoaGame_Bool CocoaGame_ProcessEvent(void *voidEvent)
 			if (CocoaGame_UpdateMousePosition(event))
 				CocoaGame_QueueMouseMoveEvent(event);
 			
-			if ([event window] == window || CocoaGame_GetVideoTraits()->acquiresDisplays) {
+			if (([event window] == window || CocoaGame_GetVideoTraits()->acquiresDisplays) &&
+				CocoaGame_IsEventTypeEnabled(COCOAGAME_EVENT_MOUSE_UP)) {
 				CocoaGame_Event ourEvent;
 				CocoaGame_NSEventToMouseButtonEvent(event, &ourEvent.mouseButton);
 				ourEvent.type = COCOAGAME_EVENT_MOUSE_UP;
@@ -1555,6 +1654,9 @@ CocoaGame_Bool CocoaGame_ProcessEvent(void *voidEvent)
 			if ([event window] == window || CocoaGame_GetVideoTraits()->acquiresDisplays) {
 				consumed = TRUE;
 
+				if (! CocoaGame_IsEventTypeEnabled(COCOAGAME_EVENT_MOUSE_SCROLL))
+					break;
+
 				CocoaGame_Event ourEvent;
 				CocoaGame_SetupModifiersEvent(&ourEvent.modifiers);
 				ourEvent.mouseScroll.cursorX = (int) mousePosition.x;
@@ -1583,10 +1685,21 @@ CocoaGame_Bool CocoaGame_ProcessEvent(void *voidEvent)
 			}
 			break;
 			
+		case NSApplicationDefined:
+			if ([event subtype] == COCOAGAME_WAKE_EVENT_SUBTYPE) {
+				__atomic_store_n(&wakeEventPosted, FALSE, __ATOMIC_SEQ_CST);
+				consumed = TRUE;
+			} else if ([event subtype] == COCOAGAME_SLEEP_EVENT_SUBTYPE) {
+				sleepEventPosted = FALSE;
+				consumed = TRUE;
+			}
+			break;
+			
 		default:
 			break;
 	}
 
+	CocoaGame_EndZone();
 	return consumed;
 }
 
@@ -1627,6 +1740,9 @@ static BOOL CocoaGame_UpdateMousePosition(NSEvent *event)
 
 static void CocoaGame_QueueMouseMoveEvent(NSEvent *event)
 {
+	if (! CocoaGame_IsEventTypeEnabled(COCOAGAME_EVENT_MOUSE_MOVE))
+		return;
+
 	CocoaGame_Event ourEvent;
 	CocoaGame_SetupMouseMoveEvent(event, &ourEvent.mouseMove);
 	ourEvent.type = COCOAGAME_EVENT_MOUSE_MOVE;
@@ -1666,10 +1782,12 @@ static void CocoaGame_NSEventToMouseButtonEvent(NSEvent *event, CocoaGame_MouseB
 
 static void CocoaGame_QueueKeyAndCharacterEvents(NSEvent *event)
 {
-	if ([event type] == NSKeyDown)
+	// Filtered events aren't built at all, which saves looking up the characters.
+	if ([event type] == NSKeyDown && CocoaGame_IsEventTypeEnabled(COCOAGAME_EVENT_CHAR))
 		CocoaGame_QueueCharEvent(event);
 
-	CocoaGame_QueueKeyEvent(event);
+	if (CocoaGame_IsEventTypeEnabled([event type] == NSKeyDown ? COCOAGAME_EVENT_KEY_DOWN : COCOAGAME_EVENT_KEY_UP))
+		CocoaGame_QueueKeyEvent(event);
 }
 
 static void CocoaGame_QueueKeyEvent(NSEvent *event)
@@ -1915,7 +2033,11 @@ CocoaGame_PixelBuffer *CocoaGame_CreatePixelBuffer(GLenum textureTarget, GLint i
 		return NULL;
 	}
 	
-	pb = calloc(1, sizeof(*pb));
+	pb = CocoaGame_AllocZeroed(1, sizeof(*pb), COCOAGAME_ALLOC_VIDEO);
+	if (! pb) {
+		[pool drain];
+		return NULL;
+	}
 	
 	pb->pixelBuffer = [[NSOpenGLPixelBuffer alloc] initWithTextureTarget:textureTarget 
 												   textureInternalFormat:internalFormat 
@@ -1924,7 +2046,7 @@ CocoaGame_PixelBuffer *CocoaGame_CreatePixelBuffer(GLenum textureTarget, GLint i
 															  pixelsHigh:height];
 															
 	if (! pb->pixelBuffer) {
-		free(pb);
+		CocoaGame_Free(pb);
 		[pool drain];
 		return NULL;
 	}
@@ -1933,7 +2055,7 @@ CocoaGame_PixelBuffer *CocoaGame_CreatePixelBuffer(GLenum textureTarget, GLint i
 	
 	if (! pb->context) {
 		[pb->pixelBuffer release];
-		free(pb);
+		CocoaGame_Free(pb);
 		[pool drain];
 		return NULL;
 	}
@@ -1993,8 +2115,11 @@ void CocoaGame_SetTargetPixelBuffer(CocoaGame_PixelBuffer *pbuffer)
 	if (pbuffer) {
 		[pbuffer->context setPixelBuffer:pbuffer->pixelBuffer cubeMapFace:0 mipMapLevel:0 currentVirtualScreen:[openGLContext currentVirtualScreen]];
 		[pbuffer->context makeCurrentContext];
-	} else 
+		CocoaGame_CoreContextCurrent(pbuffer->context);
+	} else {
 		[openGLContext makeCurrentContext];
+		CocoaGame_CoreContextCurrent(openGLContext);
+	}
 }
 
 void CocoaGame_SetTextureImageToPixelBuffer(CocoaGame_PixelBuffer *targetPbuffer, CocoaGame_PixelBuffer *pbuffer, GLenum colourBuffer)
@@ -2009,41 +2134,20 @@ void CocoaGame_DestroyPixelBuffer(CocoaGame_PixelBuffer *pbuffer)
 	if ([NSOpenGLContext currentContext] == pbuffer->context) 
 		[NSOpenGLContext clearCurrentContext];
 		
+	CocoaGame_CoreContextDestroyed(pbuffer->context);
 	[pbuffer->context clearDrawable];
 	[pbuffer->context release];
 
 	[pbuffer->pixelBuffer release];
 	
-	free(pbuffer);
+	CocoaGame_Free(pbuffer);
 	
 	[openGLContext makeCurrentContext];
+	CocoaGame_CoreContextCurrent(openGLContext);
 }
 
 #endif // COCOAGAME_ENABLE_PBUFFERS
 
-//
-// Timers
-//
-
-double CocoaGame_GetTimer(void)
-{
-	struct timeval tv;
-	gettimeofday(&tv, 0);
-
-	return (double) tv.tv_sec + (double) tv.tv_usec / 1e6;
-}
-
-uint32_t CocoaGame_GetMillisecondTimer(void)
-{
-	struct timeval tv;
-	gettimeofday(&tv, 0);
-
-	uintmax_t bigTime;
-	bigTime = (uintmax_t) tv.tv_sec * 1000 + (uintmax_t) tv.tv_usec / 1000;
-
-	return (uint32_t) bigTime;
-}
-
 //
 // NSWindow (CocoaGameAdditions)
 //
@@ -2165,7 +2269,7 @@ uint32_t CocoaGame_GetMillisecondTimer(void)
 	ourEvent.type = COCOAGAME_EVENT_APP_ACTIVATE;
 	CocoaGame_QueueEvent(&ourEvent);
 	
-	openGLUpdateRequired = TRUE;
+	CocoaGame_RequestOpenGLUpdate();
 }
 
 - (void)applicationWillResignActive:(NSNotification *)aNotification;
@@ -2189,7 +2293,7 @@ uint32_t CocoaGame_GetMillisecondTimer(void)
 - (void)applicationDidChangeScreenParameters:(NSNotification *)aNotification;
 {
 	(void) aNotification;
-	openGLUpdateRequired = TRUE;
+	CocoaGame_RequestOpenGLUpdate();
 }
 
 - (void)windowDidResignKey:(NSNotification *)notification
@@ -2275,7 +2379,10 @@ uint32_t CocoaGame_GetMillisecondTimer(void)
 
 - (void)drawRect:(NSRect)rect 
 {
-	// Use the callback if we can.
+	// Use the callback if we can. The render thread draws for itself.
+	if (renderThreadActive)
+		return;
+
 	if (openGLContext && drawCallback) {
 		if (CocoaGame_BeginRender()) {
 			(*drawCallback)(drawCallbackContext);
@@ -2292,7 +2399,11 @@ uint32_t CocoaGame_GetMillisecondTimer(void)
 {
 	(void) aNotification;
 
-	openGLUpdateRequired = TRUE;
+	CocoaGame_RequestOpenGLUpdate();
+
+	// A live resize doesn't return to CocoaGame_Poll() until it ends, so keep the render thread's view current now.
+	if (renderThreadActive)
+		CocoaGame_UpdateRenderThreadState();
 	
 	if (videoConfig.disposition == COCOAGAME_VIDEO_WINDOW && ! [[self window] cocoaGame_IsFullScreen]) {
 		windowWidth = [self bounds].size.width;
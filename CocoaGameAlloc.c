@@ -0,0 +1,231 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Memory allocation. Everything the library allocates for itself goes through CocoaGame_Alloc() and friends, which
+// call the allocator set with CocoaGame_SetAllocator() (the C library's by default) and count allocations and bytes
+// for each category. Each block starts with a small header recording its size and category, so freeing needs
+// neither and the counts stay exact.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+//
+// Private types
+//
+
+// Written in front of each block. Padded so the memory after it is aligned as malloc()'s is.
+typedef union CocoaGame_AllocHeader {
+	struct {
+		size_t size;
+		CocoaGame_AllocCategory category;
+	} info;
+
+	long double alignDouble;
+	void *alignPointer;
+	uint64_t alignInteger;
+} CocoaGame_AllocHeader;
+
+//
+// Private functions
+//
+
+static void *CocoaGame_DefaultAllocate(size_t size, CocoaGame_AllocCategory category, void *context);
+static void *CocoaGame_DefaultReallocate(void *memory, size_t size, CocoaGame_AllocCategory category, void *context);
+static void CocoaGame_DefaultDeallocate(void *memory, CocoaGame_AllocCategory category, void *context);
+static void CocoaGame_CountAlloc(CocoaGame_AllocCategory category, size_t size);
+static void CocoaGame_CountFree(CocoaGame_AllocCategory category, size_t size);
+
+//
+// Private data
+//
+
+static CocoaGame_Allocator allocator = {
+	.allocate = &CocoaGame_DefaultAllocate,
+	.reallocate = &CocoaGame_DefaultReallocate,
+	.deallocate = &CocoaGame_DefaultDeallocate,
+	.context = NULL
+};
+
+// Updated atomically, as any thread may allocate.
+static CocoaGame_AllocStats allocStats[COCOAGAME_ALLOC_CATEGORIES];
+
+//
+// Allocator
+//
+
+static void *CocoaGame_DefaultAllocate(size_t size, CocoaGame_AllocCategory category, void *context)
+{
+	(void) category;
+	(void) context;
+	return malloc(size);
+}
+
+static void *CocoaGame_DefaultReallocate(void *memory, size_t size, CocoaGame_AllocCategory category, void *context)
+{
+	(void) category;
+	(void) context;
+	return realloc(memory, size);
+}
+
+static void CocoaGame_DefaultDeallocate(void *memory, CocoaGame_AllocCategory category, void *context)
+{
+	(void) category;
+	(void) context;
+	free(memory);
+}
+
+void CocoaGame_SetAllocator(const CocoaGame_Allocator *newAllocator)
+{
+	allocator.allocate = newAllocator && newAllocator->allocate ? newAllocator->allocate : &CocoaGame_DefaultAllocate;
+	allocator.reallocate = newAllocator && newAllocator->reallocate ? newAllocator->reallocate : &CocoaGame_DefaultReallocate;
+	allocator.deallocate = newAllocator && newAllocator->deallocate ? newAllocator->deallocate : &CocoaGame_DefaultDeallocate;
+	allocator.context = newAllocator ? newAllocator->context : NULL;
+}
+
+//
+// Allocation
+//
+
+void *CocoaGame_Alloc(size_t size, CocoaGame_AllocCategory category)
+{
+	if (size > SIZE_MAX - sizeof(CocoaGame_AllocHeader))
+		return NULL;
+
+	CocoaGame_AllocHeader *header = (*allocator.allocate)(sizeof(CocoaGame_AllocHeader) + size, category, allocator.context);
+	if (! header)
+		return NULL;
+
+	header->info.size = size;
+	header->info.category = category;
+	CocoaGame_CountAlloc(category, size);
+
+	return header + 1;
+}
+
+void *CocoaGame_AllocZeroed(size_t count, size_t size, CocoaGame_AllocCategory category)
+{
+	if (size && count > (SIZE_MAX - sizeof(CocoaGame_AllocHeader)) / size)
+		return NULL;
+
+	void *memory = CocoaGame_Alloc(count * size, category);
+	if (memory)
+		memset(memory, 0, count * size);
+
+	return memory;
+}
+
+void *CocoaGame_Realloc(void *memory, size_t size, CocoaGame_AllocCategory category)
+{
+	if (! memory)
+		return CocoaGame_Alloc(size, category);
+
+	if (size > SIZE_MAX - sizeof(CocoaGame_AllocHeader))
+		return NULL;
+
+	CocoaGame_AllocHeader *header = (CocoaGame_AllocHeader *) memory - 1;
+	size_t oldSize = header->info.size;
+	category = header->info.category;
+
+	header = (*allocator.reallocate)(header, sizeof(CocoaGame_AllocHeader) + size, category, allocator.context);
+	if (! header)
+		return NULL;
+
+	header->info.size = size;
+	CocoaGame_CountFree(category, oldSize);
+	CocoaGame_CountAlloc(category, size);
+
+	return header + 1;
+}
+
+void CocoaGame_Free(void *memory)
+{
+	if (! memory)
+		return;
+
+	CocoaGame_AllocHeader *header = (CocoaGame_AllocHeader *) memory - 1;
+	CocoaGame_CountFree(header->info.category, header->info.size);
+
+	(*allocator.deallocate)(header, header->info.category, allocator.context);
+}
+
+char *CocoaGame_StrDup(const char *string, CocoaGame_AllocCategory category)
+{
+	size_t size = strlen(string) + 1;
+
+	char *copy = CocoaGame_Alloc(size, category);
+	if (copy)
+		memcpy(copy, string, size);
+
+	return copy;
+}
+
+//
+// Statistics
+//
+
+static void CocoaGame_CountAlloc(CocoaGame_AllocCategory category, size_t size)
+{
+	CocoaGame_AllocStats *stats = &allocStats[category];
+
+	__atomic_fetch_add(&stats->allocations, 1, __ATOMIC_RELAXED);
+	size_t bytes = __atomic_add_fetch(&stats->bytes, size, __ATOMIC_RELAXED);
+
+	size_t peak = __atomic_load_n(&stats->peakBytes, __ATOMIC_RELAXED);
+	while (bytes > peak && ! __atomic_compare_exchange_n(&stats->peakBytes, &peak, bytes, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static void CocoaGame_CountFree(CocoaGame_AllocCategory category, size_t size)
+{
+	CocoaGame_AllocStats *stats = &allocStats[category];
+
+	__atomic_fetch_add(&stats->frees, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_sub(&stats->bytes, size, __ATOMIC_RELAXED);
+}
+
+void CocoaGame_GetAllocStats(CocoaGame_AllocCategory category, CocoaGame_AllocStats *stats)
+{
+	assert(category >= 0 && category < COCOAGAME_ALLOC_CATEGORIES);
+
+	stats->allocations = __atomic_load_n(&allocStats[category].allocations, __ATOMIC_RELAXED);
+	stats->frees = __atomic_load_n(&allocStats[category].frees, __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&allocStats[category].bytes, __ATOMIC_RELAXED);
+	stats->peakBytes = __atomic_load_n(&allocStats[category].peakBytes, __ATOMIC_RELAXED);
+}
+
+void CocoaGame_GetTotalAllocStats(CocoaGame_AllocStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	int category;
+	for (category = 0; category != COCOAGAME_ALLOC_CATEGORIES; ++category) {
+		CocoaGame_AllocStats categoryStats;
+		CocoaGame_GetAllocStats((CocoaGame_AllocCategory) category, &categoryStats);
+
+		stats->allocations += categoryStats.allocations;
+		stats->frees += categoryStats.frees;
+		stats->bytes += categoryStats.bytes;
+
+		// The peaks may not have coincided, so this is an upper bound.
+		stats->peakBytes += categoryStats.peakBytes;
+	}
+}
+
+const char *CocoaGame_GetAllocCategoryName(CocoaGame_AllocCategory category)
+{
+	static const char *const names[COCOAGAME_ALLOC_CATEGORIES] = {
+		"events",
+		"video",
+		"rendering",
+		"capture",
+		"caches",
+		"threads"
+	};
+
+	assert(category >= 0 && category < COCOAGAME_ALLOC_CATEGORIES);
+	return names[category];
+}
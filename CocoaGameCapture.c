@@ -0,0 +1,644 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Frame capture. CocoaGame_EndRender() starts an asynchronous read of the back buffer in to one of a ring of pixel
+// buffer objects and fences it. Later frames pick up the reads the GPU has finished, without waiting, and hand them
+// to a worker thread which converts and writes them.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+//
+// Compile-time options
+//
+
+// Number of pixel buffer objects in the ring. A read is given this many frames to complete before frames start
+// being dropped.
+#define COCOAGAME_CAPTURE_PBOS 3
+
+// Number of frames that can be waiting for the worker thread. If the worker falls this far behind, frames are
+// dropped.
+#define COCOAGAME_CAPTURE_QUEUE 4
+
+//
+// Private types
+//
+
+typedef struct CocoaGame_CaptureReadback {
+	GLuint pbo;
+	GLsync fence;
+	int width;
+	int height;
+	uint64_t frame;
+} CocoaGame_CaptureReadback;
+
+typedef struct CocoaGame_CaptureFrame {
+	// RGBA, bottom row first as read from OpenGL.
+	unsigned char *pixels;
+	size_t capacity;
+	int width;
+	int height;
+	uint64_t frame;
+	CocoaGame_Bool full;
+} CocoaGame_CaptureFrame;
+
+//
+// Private functions
+//
+
+static void CocoaGame_StartReadback(int width, int height);
+static void CocoaGame_CollectReadbacks(CocoaGame_Bool wait);
+static void CocoaGame_DeliverReadback(CocoaGame_CaptureReadback *readback);
+static void CocoaGame_FreeReadbacks(void);
+static void *CocoaGame_CaptureWorker(void *context);
+static void CocoaGame_WriteCaptureFrame(CocoaGame_CaptureFrame *frame);
+static unsigned char *CocoaGame_PrepareCaptureImage(const CocoaGame_CaptureFrame *frame, int *width, int *height);
+static void CocoaGame_WriteY4MFrame(FILE *fp, const unsigned char *rgba, int width, int height);
+static CocoaGame_Bool CocoaGame_WritePNG(const char *path, const unsigned char *rgba, int width, int height);
+
+//
+// Private data
+//
+
+const CocoaGame_CaptureConfig COCOAGAME_CAPTURECONFIG_DEFAULTS = {
+	.format = COCOAGAME_CAPTURE_PNG,
+	.path = "capture%05d.png",
+	.frameSkip = 0,
+	.downscale = 1,
+	.framesPerSecond = 60
+};
+
+static CocoaGame_Bool capturing;
+static CocoaGame_CaptureConfig captureConfig;
+static char *capturePath;
+static uint64_t captureFrameCounter;
+static CocoaGame_CaptureStats captureStats;
+
+static CocoaGame_CaptureReadback captureReadbacks[COCOAGAME_CAPTURE_PBOS];
+static int captureReadbackNext;
+
+// Shared with the worker, protected by captureMutex.
+static CocoaGame_CaptureFrame captureFrames[COCOAGAME_CAPTURE_QUEUE];
+static int captureFrameWrite;
+static int captureFrameRead;
+static CocoaGame_Bool captureWorkerStop;
+static pthread_mutex_t captureMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t captureCond = PTHREAD_COND_INITIALIZER;
+static pthread_t captureWorker;
+
+// Only touched by the worker.
+static FILE *captureFile;
+static int captureVideoWidth, captureVideoHeight;
+static uint64_t captureWrittenFrames;
+static uint64_t captureSkippedFrames;
+
+//
+// Frame capture
+//
+
+CocoaGame_Bool CocoaGame_StartCapture(const CocoaGame_CaptureConfig *config)
+{
+	CocoaGame_StopCapture();
+
+	captureConfig = *config;
+	if (captureConfig.downscale < 1)
+		captureConfig.downscale = 1;
+	if (captureConfig.frameSkip < 0)
+		captureConfig.frameSkip = 0;
+	if (captureConfig.framesPerSecond < 1)
+		captureConfig.framesPerSecond = 60;
+
+	capturePath = CocoaGame_StrDup(config->path, COCOAGAME_ALLOC_CAPTURE);
+	captureConfig.path = capturePath;
+
+	if (captureConfig.format != COCOAGAME_CAPTURE_PNG) {
+		captureFile = fopen(capturePath, "wb");
+		if (! captureFile) {
+			CocoaGame_Trace("%s: unable to create \"%s\".\n", __FUNCTION__, capturePath);
+			CocoaGame_Free(capturePath);
+			capturePath = NULL;
+			return FALSE;
+		}
+	}
+
+	memset(&captureStats, 0, sizeof(captureStats));
+	captureFrameCounter = 0;
+	captureFrameWrite = 0;
+	captureFrameRead = 0;
+	captureVideoWidth = 0;
+	captureVideoHeight = 0;
+	captureWrittenFrames = 0;
+	captureSkippedFrames = 0;
+	captureWorkerStop = FALSE;
+
+	if (pthread_create(&captureWorker, NULL, CocoaGame_CaptureWorker, NULL) != 0) {
+		CocoaGame_Trace("%s: unable to start capture thread.\n", __FUNCTION__);
+		if (captureFile)
+			fclose(captureFile);
+		captureFile = NULL;
+		CocoaGame_Free(capturePath);
+		capturePath = NULL;
+		return FALSE;
+	}
+
+	capturing = TRUE;
+
+	CocoaGame_Trace("%s: capturing to \"%s\".\n", __FUNCTION__, capturePath);
+	return TRUE;
+}
+
+void CocoaGame_StopCapture(void)
+{
+	if (! capturing)
+		return;
+
+	// Wait for the reads already started, then let the worker finish writing them.
+	CocoaGame_CollectReadbacks(TRUE);
+	CocoaGame_FreeReadbacks();
+
+	pthread_mutex_lock(&captureMutex);
+	captureWorkerStop = TRUE;
+	pthread_cond_signal(&captureCond);
+	pthread_mutex_unlock(&captureMutex);
+
+	pthread_join(captureWorker, NULL);
+
+	if (captureFile) {
+		if (fclose(captureFile) != 0)
+			CocoaGame_Trace("%s: error writing \"%s\".\n", __FUNCTION__, capturePath);
+
+		captureFile = NULL;
+	}
+
+	captureStats.writtenFrames = captureWrittenFrames;
+	captureStats.droppedFrames += captureSkippedFrames;
+
+	CocoaGame_Trace("%s: %llu frames written, %llu dropped.\n", __FUNCTION__,
+		(unsigned long long) captureStats.writtenFrames, (unsigned long long) captureStats.droppedFrames);
+
+	int i;
+	for (i = 0; i != COCOAGAME_CAPTURE_QUEUE; ++i) {
+		CocoaGame_Free(captureFrames[i].pixels);
+		memset(&captureFrames[i], 0, sizeof(captureFrames[i]));
+	}
+
+	CocoaGame_Free(capturePath);
+	capturePath = NULL;
+
+	capturing = FALSE;
+}
+
+CocoaGame_Bool CocoaGame_IsCapturing(void)
+{
+	return capturing;
+}
+
+void CocoaGame_GetCaptureStats(CocoaGame_CaptureStats *stats)
+{
+	*stats = captureStats;
+
+	if (capturing) {
+		pthread_mutex_lock(&captureMutex);
+		stats->writtenFrames = captureWrittenFrames;
+		stats->droppedFrames += captureSkippedFrames;
+		pthread_mutex_unlock(&captureMutex);
+	}
+}
+
+void CocoaGame_CaptureEndRender(void)
+{
+	if (! capturing)
+		return;
+
+	CocoaGame_BeginZone(__FUNCTION__);
+
+	// Pick up any reads that have finished before starting another, so a slot is free if at all possible.
+	CocoaGame_CollectReadbacks(FALSE);
+
+	if (captureFrameCounter++ % (uint64_t) (captureConfig.frameSkip + 1) == 0) {
+		const CocoaGame_VideoConfig *videoConfig = CocoaGame_GetVideoConfig();
+		CocoaGame_StartReadback(videoConfig->mode.width, videoConfig->mode.height);
+	}
+
+	CocoaGame_EndZone();
+}
+
+void CocoaGame_ShutdownCapture(void)
+{
+	CocoaGame_StopCapture();
+}
+
+static void CocoaGame_StartReadback(int width, int height)
+{
+	CocoaGame_CaptureReadback *readback = &captureReadbacks[captureReadbackNext];
+
+	if (readback->fence) {
+		// The GPU hasn't finished a read from COCOAGAME_CAPTURE_PBOS frames ago. Rather than wait, drop this frame.
+		++captureStats.droppedFrames;
+		return;
+	}
+
+	if (! readback->pbo)
+		glGenBuffers(1, &readback->pbo);
+
+	CocoaGame_GLBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+
+	if (readback->width != width || readback->height != height) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) width * height * 4, NULL, GL_STREAM_READ);
+		readback->width = width;
+		readback->height = height;
+	}
+
+	// The back buffer, as CocoaGame_EndRender() hasn't flushed yet.
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	CocoaGame_GLBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback->frame = captureStats.capturedFrames++;
+
+	captureReadbackNext = (captureReadbackNext + 1) % COCOAGAME_CAPTURE_PBOS;
+}
+
+// Deliver finished reads to the worker, oldest first. If wait is FALSE, stop at the first read that isn't finished.
+static void CocoaGame_CollectReadbacks(CocoaGame_Bool wait)
+{
+	int i;
+	for (i = 0; i != COCOAGAME_CAPTURE_PBOS; ++i) {
+		CocoaGame_CaptureReadback *readback = &captureReadbacks[(captureReadbackNext + i) % COCOAGAME_CAPTURE_PBOS];
+		if (! readback->fence)
+			continue;
+
+		GLenum result = glClientWaitSync(readback->fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000u : 0);
+		if (result == GL_TIMEOUT_EXPIRED)
+			break;
+
+		glDeleteSync(readback->fence);
+		readback->fence = 0;
+
+		if (result != GL_WAIT_FAILED)
+			CocoaGame_DeliverReadback(readback);
+		else
+			++captureStats.droppedFrames;
+	}
+}
+
+static void CocoaGame_DeliverReadback(CocoaGame_CaptureReadback *readback)
+{
+	size_t size = (size_t) readback->width * (size_t) readback->height * 4;
+
+	pthread_mutex_lock(&captureMutex);
+	CocoaGame_CaptureFrame *frame = &captureFrames[captureFrameWrite];
+	CocoaGame_Bool available = ! frame->full;
+	pthread_mutex_unlock(&captureMutex);
+
+	if (! available) {
+		++captureStats.droppedFrames;
+		return;
+	}
+
+	if (frame->capacity < size) {
+		unsigned char *pixels = CocoaGame_Realloc(frame->pixels, size, COCOAGAME_ALLOC_CAPTURE);
+		if (! pixels) {
+			++captureStats.droppedFrames;
+			return;
+		}
+
+		frame->pixels = pixels;
+		frame->capacity = size;
+	}
+
+	CocoaGame_GLBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo);
+	const void *mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (mapped) {
+		memcpy(frame->pixels, mapped, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	CocoaGame_GLBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (! mapped) {
+		++captureStats.droppedFrames;
+		return;
+	}
+
+	frame->width = readback->width;
+	frame->height = readback->height;
+	frame->frame = readback->frame;
+
+	pthread_mutex_lock(&captureMutex);
+	frame->full = TRUE;
+	captureFrameWrite = (captureFrameWrite + 1) % COCOAGAME_CAPTURE_QUEUE;
+	pthread_cond_signal(&captureCond);
+	pthread_mutex_unlock(&captureMutex);
+}
+
+static void CocoaGame_FreeReadbacks(void)
+{
+	int i;
+	for (i = 0; i != COCOAGAME_CAPTURE_PBOS; ++i) {
+		CocoaGame_CaptureReadback *readback = &captureReadbacks[i];
+
+		if (readback->fence)
+			glDeleteSync(readback->fence);
+
+		if (readback->pbo)
+			CocoaGame_GLDeleteBuffers(1, &readback->pbo);
+
+		memset(readback, 0, sizeof(*readback));
+	}
+
+	captureReadbackNext = 0;
+}
+
+//
+// Worker thread
+//
+
+static void *CocoaGame_CaptureWorker(void *context)
+{
+	(void) context;
+
+	CocoaGame_SetProfileThreadName("CocoaGame capture thread");
+
+	pthread_mutex_lock(&captureMutex);
+
+	for (;;) {
+		CocoaGame_CaptureFrame *frame = &captureFrames[captureFrameRead];
+
+		if (! frame->full) {
+			if (captureWorkerStop)
+				break;
+
+			pthread_cond_wait(&captureCond, &captureMutex);
+			continue;
+		}
+
+		pthread_mutex_unlock(&captureMutex);
+		CocoaGame_WriteCaptureFrame(frame);
+		pthread_mutex_lock(&captureMutex);
+
+		frame->full = FALSE;
+		captureFrameRead = (captureFrameRead + 1) % COCOAGAME_CAPTURE_QUEUE;
+	}
+
+	pthread_mutex_unlock(&captureMutex);
+	return NULL;
+}
+
+static void CocoaGame_WriteCaptureFrame(CocoaGame_CaptureFrame *frame)
+{
+	CocoaGame_BeginZoneWithValue(__FUNCTION__, (int64_t) frame->frame);
+
+	int width, height;
+	unsigned char *image = CocoaGame_PrepareCaptureImage(frame, &width, &height);
+	CocoaGame_Bool written = FALSE;
+
+	if (image) {
+		switch (captureConfig.format) {
+			case COCOAGAME_CAPTURE_RAW:
+			case COCOAGAME_CAPTURE_Y4M:
+				// A video stream can't change size, so frames captured after a resize are dropped.
+				if (! captureVideoWidth) {
+					captureVideoWidth = width;
+					captureVideoHeight = height;
+
+					if (captureConfig.format == COCOAGAME_CAPTURE_Y4M)
+						fprintf(captureFile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, captureConfig.framesPerSecond);
+				}
+
+				if (width != captureVideoWidth || height != captureVideoHeight)
+					break;
+
+				if (captureConfig.format == COCOAGAME_CAPTURE_Y4M)
+					CocoaGame_WriteY4MFrame(captureFile, image, width, height);
+				else
+					fwrite(image, (size_t) width * (size_t) height * 4, 1, captureFile);
+
+				written = TRUE;
+				break;
+
+			case COCOAGAME_CAPTURE_PNG: {
+				char path[1024];
+				snprintf(path, sizeof(path), captureConfig.path, (int) frame->frame);
+				written = CocoaGame_WritePNG(path, image, width, height);
+				break;
+			}
+		}
+
+		CocoaGame_Free(image);
+	}
+
+	pthread_mutex_lock(&captureMutex);
+	if (written)
+		++captureWrittenFrames;
+	else
+		++captureSkippedFrames;
+	pthread_mutex_unlock(&captureMutex);
+
+	CocoaGame_EndZone();
+}
+
+// Flip the frame so the top row is first, and downscale it with a box filter. Returns an RGBA image allocated with
+// CocoaGame_Alloc().
+static unsigned char *CocoaGame_PrepareCaptureImage(const CocoaGame_CaptureFrame *frame, int *width, int *height)
+{
+	int scale = captureConfig.downscale;
+	int w = frame->width / scale;
+	int h = frame->height / scale;
+
+	if (w < 1 || h < 1)
+		return NULL;
+
+	unsigned char *image = CocoaGame_Alloc((size_t) w * (size_t) h * 4, COCOAGAME_ALLOC_CAPTURE);
+	if (! image)
+		return NULL;
+
+	size_t stride = (size_t) frame->width * 4;
+	int x, y, sx, sy, c;
+
+	for (y = 0; y != h; ++y) {
+		unsigned char *out = image + (size_t) y * (size_t) w * 4;
+
+		// Source rows, bottom up.
+		int top = frame->height - 1 - y * scale;
+
+		if (scale == 1) {
+			memcpy(out, frame->pixels + (size_t) top * stride, (size_t) w * 4);
+			continue;
+		}
+
+		for (x = 0; x != w; ++x) {
+			unsigned int sum[4] = { 0, 0, 0, 0 };
+
+			for (sy = 0; sy != scale; ++sy) {
+				const unsigned char *in = frame->pixels + (size_t) (top - sy) * stride + (size_t) x * (size_t) scale * 4;
+
+				for (sx = 0; sx != scale; ++sx, in += 4) {
+					for (c = 0; c != 4; ++c)
+						sum[c] += in[c];
+				}
+			}
+
+			for (c = 0; c != 4; ++c)
+				*out++ = (unsigned char) (sum[c] / (unsigned int) (scale * scale));
+		}
+	}
+
+	*width = w;
+	*height = h;
+	return image;
+}
+
+//
+// Writers
+//
+
+static void CocoaGame_WriteY4MFrame(FILE *fp, const unsigned char *rgba, int width, int height)
+{
+	size_t pixels = (size_t) width * (size_t) height;
+	unsigned char *planes = CocoaGame_Alloc(pixels * 3, COCOAGAME_ALLOC_CAPTURE);
+	if (! planes)
+		return;
+
+	size_t i;
+	for (i = 0; i != pixels; ++i) {
+		int r = rgba[i * 4], g = rgba[i * 4 + 1], b = rgba[i * 4 + 2];
+
+		// BT.601 studio range.
+		planes[i] = (unsigned char) ((66 * r + 129 * g + 25 * b + 128) / 256 + 16);
+		planes[pixels + i] = (unsigned char) ((-38 * r - 74 * g + 112 * b + 128) / 256 + 128);
+		planes[pixels * 2 + i] = (unsigned char) ((112 * r - 94 * g - 18 * b + 128) / 256 + 128);
+	}
+
+	fputs("FRAME\n", fp);
+	fwrite(planes, pixels * 3, 1, fp);
+
+	CocoaGame_Free(planes);
+}
+
+static uint32_t CocoaGame_CRC32(uint32_t crc, const unsigned char *data, size_t length)
+{
+	static uint32_t table[256];
+
+	if (! table[1]) {
+		uint32_t n, k;
+		for (n = 0; n != 256; ++n) {
+			uint32_t c = n;
+			for (k = 0; k != 8; ++k)
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+
+	crc = ~crc;
+	while (length--)
+		crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void CocoaGame_PutBigEndian32(unsigned char *out, uint32_t value)
+{
+	out[0] = (unsigned char) (value >> 24);
+	out[1] = (unsigned char) (value >> 16);
+	out[2] = (unsigned char) (value >> 8);
+	out[3] = (unsigned char) value;
+}
+
+static void CocoaGame_WritePNGChunk(FILE *fp, const char *type, const unsigned char *data, size_t length)
+{
+	unsigned char header[8];
+	CocoaGame_PutBigEndian32(header, (uint32_t) length);
+	memcpy(header + 4, type, 4);
+	fwrite(header, 8, 1, fp);
+
+	if (length)
+		fwrite(data, length, 1, fp);
+
+	unsigned char crc[4];
+	CocoaGame_PutBigEndian32(crc, CocoaGame_CRC32(CocoaGame_CRC32(0, header + 4, 4), data, length));
+	fwrite(crc, 4, 1, fp);
+}
+
+// PNGs are written with stored (uncompressed) deflate blocks. They're large, but fast to write and need no zlib.
+static CocoaGame_Bool CocoaGame_WritePNG(const char *path, const unsigned char *rgba, int width, int height)
+{
+	FILE *fp = fopen(path, "wb");
+	if (! fp)
+		return FALSE;
+
+	static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(SIGNATURE, 8, 1, fp);
+
+	unsigned char ihdr[13];
+	CocoaGame_PutBigEndian32(ihdr, (uint32_t) width);
+	CocoaGame_PutBigEndian32(ihdr + 4, (uint32_t) height);
+	ihdr[8] = 8; // bit depth
+	ihdr[9] = 6; // RGBA
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+	CocoaGame_WritePNGChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+
+	// Each row is a filter byte (0, none) followed by the pixels.
+	size_t rowSize = (size_t) width * 4 + 1;
+	size_t rawSize = rowSize * (size_t) height;
+	size_t blocks = (rawSize + 65534) / 65535;
+	size_t idatSize = 2 + rawSize + blocks * 5 + 4;
+
+	unsigned char *idat = CocoaGame_Alloc(idatSize, COCOAGAME_ALLOC_CAPTURE);
+	if (! idat) {
+		fclose(fp);
+		return FALSE;
+	}
+
+	unsigned char *out = idat;
+	*out++ = 0x78; // zlib header, no compression
+	*out++ = 0x01;
+
+	uint32_t adlerA = 1, adlerB = 0;
+	size_t rawPos = 0;
+	size_t blockLeft = 0;
+	int y;
+
+	for (y = 0; y != height; ++y) {
+		const unsigned char *row = rgba + (size_t) y * (size_t) width * 4;
+		size_t i;
+
+		for (i = 0; i != rowSize; ++i, ++rawPos) {
+			if (! blockLeft) {
+				blockLeft = rawSize - rawPos < 65535 ? rawSize - rawPos : 65535;
+				*out++ = rawPos + blockLeft == rawSize ? 1 : 0;
+				*out++ = (unsigned char) blockLeft;
+				*out++ = (unsigned char) (blockLeft >> 8);
+				*out++ = (unsigned char) ~blockLeft;
+				*out++ = (unsigned char) (~blockLeft >> 8);
+			}
+
+			unsigned char byte = i ? row[i - 1] : 0;
+			*out++ = byte;
+			--blockLeft;
+
+			adlerA = (adlerA + byte) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+	}
+
+	CocoaGame_PutBigEndian32(out, (adlerB << 16) | adlerA);
+	out += 4;
+
+	assert((size_t) (out - idat) == idatSize);
+
+	CocoaGame_WritePNGChunk(fp, "IDAT", idat, idatSize);
+	CocoaGame_WritePNGChunk(fp, "IEND", NULL, 0);
+
+	CocoaGame_Free(idat);
+
+	return fclose(fp) == 0;
+}
@@ -0,0 +1,1306 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Platform independent parts of CocoaGame, shared by all backends.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+	#include <mach/mach_time.h>
+#endif
+
+//
+// Compile-time options
+//
+
+// Number of events the queue can hold if CocoaGame_SetEventQueueCapacity() isn't called. If
+// CocoaGame_GetEventQueueStats() reports dropped events, increase the capacity. Or your frame rate.
+#define COCOAGAME_DEFAULT_EVENT_QUEUE_CAPACITY 1024
+
+// The frame pacer's adaptive mode looks at this many frames at a time...
+#define COCOAGAME_FRAME_PACER_WINDOW 60
+
+// ...and relaxes the swap interval if at least this percentage of them missed their deadline.
+#define COCOAGAME_FRAME_PACER_MISS_PERCENT 10
+
+// When waking for input, the frame pacer sleeps for no more than this many nanoseconds between polls.
+#define COCOAGAME_FRAME_PACER_INPUT_SLICE 1000000u
+
+//
+// Globals
+//
+
+const CocoaGame_VideoConfig COCOAGAME_VIDEOCONFIG_DEFAULTS = {
+	.disposition = COCOAGAME_VIDEO_FULLSCREEN_WINDOW,
+	.mode = {
+		.width = 800,
+		.height = 600,
+		.bits = 32
+	},
+	.title = NULL,
+	.acceptClosestMode = FALSE,
+	.captureDisplay = TRUE,
+	.enableWindowResizing = TRUE,
+	.fullScreenWindowLevel = COCOAGAME_WINDOWLEVEL_DEFAULT,
+	.useLionFullScreenSupport = TRUE,
+};
+
+const CocoaGame_GLConfig COCOAGAME_GLCONFIG_DEFAULTS = {
+	.colourBits = 24,
+	.depthBits = 24,
+	.alphaBits = 8,
+	.stencilBits = 8,
+	.msaa = 4,
+	.swapInterval = 1
+};
+
+const CocoaGame_FramePacerConfig COCOAGAME_FRAMEPACERCONFIG_DEFAULTS = {
+	.mode = COCOAGAME_FRAME_PACING_OFF,
+	.framesPerSecond = 60.0,
+	.spinSeconds = 0.002,
+	.wakeForInput = TRUE
+};
+
+//
+// Private functions
+//
+
+static void CocoaGame_DefaultTraceHandler(const char *format, va_list argptr);
+static void CocoaGame_FormatAndAppendNewline(char *buf, size_t bufsize, const char *format, va_list argptr);
+
+static void CocoaGame_RecordEvent(const CocoaGame_Event *event);
+static void CocoaGame_WriteRecord(uint8_t type, const void *payload, size_t size);
+static CocoaGame_Bool CocoaGame_IsRecordValid(const uint8_t *record);
+static void CocoaGame_ReplayFrame(void);
+
+static void CocoaGame_SleepNanoseconds(uint64_t nanoseconds);
+
+static void CocoaGame_AdaptSwapInterval(CocoaGame_Bool missed);
+static CocoaGame_FrameWait CocoaGame_FinishPacedFrame(uint64_t now, CocoaGame_Bool missed);
+
+//
+// Private data
+//
+
+static CocoaGame_Bool traceEnabled = TRUE;
+static CocoaGame_TraceHandler traceHandler = &CocoaGame_DefaultTraceHandler;
+static CocoaGame_AbortWithMessageHandler abortWithMessageHandler = &CocoaGame_DefaultAbortWithMessageHandler;
+
+static int videoModeCount;
+static CocoaGame_VideoMode *videoModes;
+
+// NSEvent modifier flags, and the device-dependent flags from IOLLEvent.h which tell left from right, so the
+// translation can be done (and benchmarked) without AppKit.
+typedef struct CocoaGame_SidedModifierTest {
+	unsigned long cocoaFlag;
+	unsigned long cocoaLeftDeviceFlag;
+	unsigned long cocoaRightDeviceFlag;
+	enum CocoaGame_Modifiers leftFlag;
+	enum CocoaGame_Modifiers rightFlag;
+} CocoaGame_SidedModifierTest;
+
+static const CocoaGame_SidedModifierTest SIDED_MODIFIER_TESTS[] = {
+	{ 1ul<<17 /* NSShiftKeyMask */, 0x02, 0x04, COCOAGAME_MODIFIER_LEFT_SHIFT, COCOAGAME_MODIFIER_RIGHT_SHIFT },
+	{ 1ul<<18 /* NSControlKeyMask */, 0x01, 0x2000, COCOAGAME_MODIFIER_LEFT_CTRL, COCOAGAME_MODIFIER_RIGHT_CTRL },
+	{ 1ul<<19 /* NSAlternateKeyMask */, 0x20, 0x40, COCOAGAME_MODIFIER_LEFT_ALT, COCOAGAME_MODIFIER_RIGHT_ALT },
+	{ 1ul<<20 /* NSCommandKeyMask */, 0x08, 0x10, COCOAGAME_MODIFIER_LEFT_COMMAND, COCOAGAME_MODIFIER_RIGHT_COMMAND }
+};
+
+#define COCOAGAME_COCOA_CAPS_LOCK_FLAG (1ul<<16) // NSAlphaShiftKeyMask
+
+// The event queue is a bounded multi-producer/single-consumer ring (Dmitry Vyukov's design). Each cell's sequence
+// number tells a producer whether the cell is free for the position it claimed, and tells the consumer whether the
+// producer has finished writing it. Producers only contend on queueWrite.
+typedef struct CocoaGame_EventCell {
+	size_t sequence;
+	CocoaGame_Event event;
+} CocoaGame_EventCell;
+
+static int queueCapacity = COCOAGAME_DEFAULT_EVENT_QUEUE_CAPACITY;
+static CocoaGame_EventCell *queueCells;
+static size_t queueMask;
+static size_t queueWrite;
+static size_t queueRead;
+
+static size_t queueHighWaterMark;
+static uint64_t queueQueuedEvents;
+static uint64_t queueDroppedEvents;
+static uint64_t queueCoalescedEvents;
+static uint64_t queueFilteredEvents;
+
+// Never reset, so CocoaGame_WaitForEvents() can tell when an event has been handled. The statistics report the count
+// since queueHandledEventsAtReset.
+static uint64_t queueHandledEvents;
+static uint64_t queueHandledEventsAtReset;
+
+static CocoaGame_Bool coalesceMouseMoves = FALSE;
+
+typedef struct CocoaGame_EventHandlerEntry {
+	CocoaGame_EventHandler handler;
+	void *context;
+} CocoaGame_EventHandlerEntry;
+
+// Event types are below this. Anything else (e.g., from a damaged recording) is rejected by CocoaGame_QueueEvent().
+#define COCOAGAME_EVENT_TYPE_COUNT (COCOAGAME_EVENT_APP_ACTIVATE + 1)
+
+// Indexed by CocoaGame_EventType.
+static uint32_t eventMask = COCOAGAME_EVENT_MASK_ALL;
+static CocoaGame_EventHandlerEntry eventHandlers[COCOAGAME_EVENT_TYPE_COUNT];
+
+// Input recordings are a small header followed by a stream of records. Each record is a CocoaGame_RecordHeader
+// followed by size bytes of payload, which is the event's struct (e.g., a CocoaGame_KeyEvent for
+// COCOAGAME_EVENT_KEY_DOWN). A COCOAGAME_RECORD_FRAME record, with no payload, is written at each
+// CocoaGame_BeginRender(). Recordings are meant to be replayed by the build that made them, so structs are stored in
+// native layout and byte order.
+#define COCOAGAME_RECORDING_MAGIC 0x43524743u // "CGRC"
+#define COCOAGAME_RECORDING_VERSION 1u
+#define COCOAGAME_RECORD_FRAME 0xff
+
+typedef struct CocoaGame_RecordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t eventSize;
+	uint32_t reserved;
+} CocoaGame_RecordingHeader;
+
+typedef struct CocoaGame_RecordHeader {
+	/// A CocoaGame_EventType or COCOAGAME_RECORD_FRAME.
+	uint8_t type;
+
+	/// Size of the payload that follows.
+	uint8_t size;
+
+	uint16_t reserved;
+
+	/// Microseconds since the previous record.
+	uint32_t delta;
+} CocoaGame_RecordHeader;
+
+// Pacing is off until CocoaGame_SetFramePacer() is called.
+static CocoaGame_FramePacerConfig pacerConfig;
+
+static uint64_t pacerPeriod;
+static uint64_t pacerDeadline;
+static CocoaGame_FramePacerStats pacerStats;
+static int pacerWindowFrames;
+static int pacerWindowMisses;
+static int pacerRelaxedSwapInterval = -1;
+
+// Records are written by the render thread (frames), the thread that dequeues events and, for events taken by a
+// handler, the thread that queued them. The mutex keeps each record's delta and its place in the file together.
+static pthread_mutex_t recordingMutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *recordingFile;
+static uint64_t recordingLastTime;
+
+static const uint8_t *replayData;
+static size_t replaySize;
+static size_t replayOffset;
+static CocoaGame_ReplaySpeed replaySpeed;
+static uint64_t replayStartTime;
+static uint64_t replayRecordTime;
+
+// Whether the frame being ended was discarded, between CocoaGame_CoreEndRender() and CocoaGame_CoreFinishRender().
+static CocoaGame_Bool frameDiscarded;
+
+//
+// Logging
+//
+
+static void CocoaGame_DefaultTraceHandler(const char *format, va_list argptr)
+{
+	char buf[1024];
+	CocoaGame_FormatAndAppendNewline(buf, sizeof(buf), format, argptr);
+
+	fputs(buf, stderr);
+}
+
+void CocoaGame_Trace(const char *format, ...)
+{
+	va_list argptr;
+	va_start(argptr, format);
+
+	if (traceEnabled)
+		traceHandler(format, argptr);
+
+	va_end(argptr);
+}
+
+void CocoaGame_SetTraceEnabled(CocoaGame_Bool newTraceEnabled)
+{
+	traceEnabled = newTraceEnabled;
+}
+
+void CocoaGame_SetTraceHandler(CocoaGame_TraceHandler handler)
+{
+	traceHandler = handler ? handler : &CocoaGame_DefaultTraceHandler;
+}
+
+CocoaGame_TraceHandler CocoaGame_GetTraceHandler(void)
+{
+	return traceHandler;
+}
+
+static void CocoaGame_FormatAndAppendNewline(char *buf, size_t bufsize, const char *format, va_list argptr)
+{
+	vsnprintf(buf, bufsize - 1, format, argptr);
+
+	if (buf[0] && buf[strlen(buf) - 1] != '\n')
+		strcat(buf, "\n");
+}
+
+//
+// Aborting
+//
+
+void CocoaGame_AbortWithMessage(const char *title, const char *format, ...)
+{
+	va_list argptr;
+	va_start(argptr, format);
+	CocoaGame_AbortWithMessageVA(title, format, argptr);
+	va_end(argptr);
+}
+
+void CocoaGame_AbortWithMessageVA(const char *title, const char *format, va_list argptr)
+{
+	(*abortWithMessageHandler)(title, format, argptr);
+}
+
+void CocoaGame_SetAbortWithMessageHandler(CocoaGame_AbortWithMessageHandler handler)
+{
+	abortWithMessageHandler = handler;
+}
+
+//
+// Files
+//
+
+CocoaGame_Bool CocoaGame_WriteFileSafely(const char *path, CocoaGame_Bool (*writer)(FILE *fp, void *context), void *context)
+{
+	size_t pathLength = strlen(path);
+	char *tempPath = CocoaGame_Alloc(pathLength + 5, COCOAGAME_ALLOC_CACHES);
+	if (! tempPath)
+		return FALSE;
+
+	memcpy(tempPath, path, pathLength);
+	memcpy(tempPath + pathLength, ".tmp", 5);
+
+	FILE *fp = fopen(tempPath, "wb");
+	if (! fp) {
+		CocoaGame_Trace("%s: unable to create \"%s\".\n", __FUNCTION__, tempPath);
+		CocoaGame_Free(tempPath);
+		return FALSE;
+	}
+
+	CocoaGame_Bool ok = (*writer)(fp, context);
+
+	if (fclose(fp) != 0 || ! ok || rename(tempPath, path) != 0) {
+		CocoaGame_Trace("%s: unable to write \"%s\".\n", __FUNCTION__, path);
+		remove(tempPath);
+		ok = FALSE;
+	}
+
+	CocoaGame_Free(tempPath);
+	return ok;
+}
+
+//
+// Video modes
+//
+
+static int CocoaGame_VideoModeCompare(const void *va, const void *vb)
+{
+	const CocoaGame_VideoMode *a = (const CocoaGame_VideoMode *) va;
+	const CocoaGame_VideoMode *b = (const CocoaGame_VideoMode *) vb;
+
+	if (a->bits > b->bits)
+		return -1;
+
+	if (a->bits < b->bits)
+		return 1;
+
+	if (a->width > b->width)
+		return -1;
+
+	if (a->width < b->width)
+		return 1;
+
+	if (a->height > b->height)
+		return -1;
+
+	if (a->height < b->height)
+		return 1;
+
+	return 0;
+}
+
+CocoaGame_VideoMode *CocoaGame_AllocVideoModes(int count)
+{
+	CocoaGame_VideoMode *modes = CocoaGame_Realloc(videoModes, count * sizeof(CocoaGame_VideoMode), COCOAGAME_ALLOC_VIDEO);
+	if (! modes)
+		return NULL;
+
+	videoModes = modes;
+	videoModeCount = count;
+
+	return videoModes;
+}
+
+void CocoaGame_FinishVideoModes(void)
+{
+	if (! videoModeCount)
+		return;
+
+	qsort(videoModes, videoModeCount, sizeof(*videoModes), &CocoaGame_VideoModeCompare);
+
+	CocoaGame_VideoMode *out = videoModes;
+	const CocoaGame_VideoMode *in = videoModes;
+	const CocoaGame_VideoMode *inEnd = videoModes + videoModeCount;
+
+	*out++ = *in++;
+
+	for (; in != inEnd; ++in) {
+		if (! CocoaGame_VideoModesEqual(in - 1, in))
+			*out++ = *in;
+	}
+
+	int newVideoModeCount = (int) (out - videoModes);
+
+	CocoaGame_Trace("%s: %d video modes (%d duplicates removed).\n", __FUNCTION__, newVideoModeCount, videoModeCount - newVideoModeCount);
+	videoModeCount = newVideoModeCount;
+
+	// If the memory can't be given back, the list just stays the size it was.
+	CocoaGame_VideoMode *modes = CocoaGame_Realloc(videoModes, videoModeCount * sizeof(CocoaGame_VideoMode), COCOAGAME_ALLOC_VIDEO);
+	if (modes)
+		videoModes = modes;
+}
+
+void CocoaGame_FreeVideoModes(void)
+{
+	CocoaGame_Free(videoModes);
+	videoModes = NULL;
+	videoModeCount = 0;
+}
+
+CocoaGame_Bool CocoaGame_VideoModesEqual(const CocoaGame_VideoMode *a, const CocoaGame_VideoMode *b)
+{
+	return a->width == b->width && a->height == b->height && a->bits == b->bits;
+}
+
+CocoaGame_Bool CocoaGame_ParseVideoMode(const char *str, CocoaGame_VideoMode *videoMode)
+{
+	videoMode->bits = 32;
+	if (sscanf(str, "%dx%dx%d", &videoMode->width, &videoMode->height, &videoMode->bits) < 2)
+		return FALSE;
+
+	if (videoMode->width < 1 || videoMode->height < 1)
+		return FALSE;
+
+	if (videoMode->bits < 16)
+		return FALSE;
+
+	return TRUE;
+}
+
+int CocoaGame_GetVideoModeCount(void)
+{
+	return videoModeCount;
+}
+
+const CocoaGame_VideoMode *CocoaGame_GetVideoMode(int modeNumber)
+{
+	assert(modeNumber >= 0 && modeNumber < videoModeCount && "Invalid mode number");
+
+	return &videoModes[modeNumber];
+}
+
+//
+// Modifiers
+//
+
+unsigned int CocoaGame_TranslateModifierFlags(unsigned long cocoaModifierFlags)
+{
+	unsigned int newModifiers = 0;
+	size_t i;
+
+	for (i = 0; i != countof(SIDED_MODIFIER_TESTS); ++i) {
+		const CocoaGame_SidedModifierTest *test = &SIDED_MODIFIER_TESTS[i];
+
+		if (! (cocoaModifierFlags & test->cocoaFlag))
+			continue;
+
+		unsigned int flags = 0;
+
+		if (cocoaModifierFlags & test->cocoaLeftDeviceFlag)
+			flags |= test->leftFlag;
+
+		if (cocoaModifierFlags & test->cocoaRightDeviceFlag)
+			flags |= test->rightFlag;
+
+		// If neither of the device flags are set, just assume left
+		newModifiers |= flags ? flags : (unsigned int) test->leftFlag;
+	}
+
+	if (cocoaModifierFlags & COCOAGAME_COCOA_CAPS_LOCK_FLAG)
+		newModifiers |= COCOAGAME_MODIFIER_CAPS_LOCK;
+
+	return newModifiers;
+}
+
+//
+// Event queue
+//
+
+void CocoaGame_SetEventQueueCapacity(int capacity)
+{
+	assert(! queueCells && "The event queue capacity must be set before CocoaGame_Init().");
+	assert(capacity > 0);
+
+	queueCapacity = capacity;
+}
+
+CocoaGame_Bool CocoaGame_InitEventQueue(void)
+{
+	// Round the capacity up to a power of two so positions can be masked instead of divided.
+	size_t capacity = 2;
+	while (capacity < (size_t) queueCapacity)
+		capacity <<= 1;
+
+	queueCells = CocoaGame_Alloc(capacity * sizeof(CocoaGame_EventCell), COCOAGAME_ALLOC_EVENTS);
+	if (! queueCells) {
+		CocoaGame_Trace("%s: unable to allocate event queue.\n", __FUNCTION__);
+		return FALSE;
+	}
+
+	size_t i;
+	for (i = 0; i != capacity; ++i)
+		queueCells[i].sequence = i;
+
+	queueMask = capacity - 1;
+	queueWrite = queueRead = 0;
+
+	CocoaGame_ResetEventQueueStats();
+	CocoaGame_ResetInputState();
+
+	return TRUE;
+}
+
+void CocoaGame_ShutdownEventQueue(void)
+{
+	CocoaGame_StopRecording();
+	CocoaGame_StopReplay();
+
+	if (queueDroppedEvents)
+		CocoaGame_Trace("%s: %llu events were dropped (queue capacity %d).\n", __FUNCTION__, (unsigned long long) queueDroppedEvents, (int) (queueMask + 1));
+
+	CocoaGame_Free(queueCells);
+	queueCells = NULL;
+	queueMask = 0;
+}
+
+void CocoaGame_QueueEvent(const CocoaGame_Event *event)
+{
+	// Out of range types are never enabled, so this also keeps them out of eventHandlers and the input state.
+	if (! CocoaGame_IsEventTypeEnabled(event->type)) {
+		__atomic_fetch_add(&queueFilteredEvents, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	uint64_t timestamp = CocoaGame_GetNanoseconds();
+
+	// The input state is kept up to date even if the event has to be dropped.
+	CocoaGame_UpdateInputState(event, timestamp);
+
+	const CocoaGame_EventHandlerEntry *entry = &eventHandlers[event->type];
+	if (entry->handler) {
+		CocoaGame_Event stamped = *event;
+		stamped.modifiers.timestamp = timestamp;
+
+		if ((*entry->handler)(&stamped, entry->context)) {
+			__atomic_fetch_add(&queueHandledEvents, 1, __ATOMIC_RELAXED);
+			CocoaGame_FrameTimingInputConsumed(timestamp, timestamp);
+
+			if (recordingFile)
+				CocoaGame_RecordEvent(&stamped);
+
+			CocoaGame_IdleEventQueued();
+			return;
+		}
+	}
+
+	if (! queueCells) {
+		__atomic_fetch_add(&queueDroppedEvents, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	CocoaGame_EventCell *cell;
+	size_t pos = __atomic_load_n(&queueWrite, __ATOMIC_RELAXED);
+
+	for (;;) {
+		cell = &queueCells[pos & queueMask];
+		size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+		intptr_t difference = (intptr_t) sequence - (intptr_t) pos;
+
+		if (difference == 0) {
+			// The cell is free. Try to claim it (on failure, pos is updated with the current write position).
+			if (__atomic_compare_exchange_n(&queueWrite, &pos, pos + 1, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (difference < 0) {
+			// The consumer hasn't got this far yet: the queue is full. Counted rather than logged, since this
+			// tends to happen in bursts and logging would only make the hitch worse.
+			__atomic_fetch_add(&queueDroppedEvents, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&queueWrite, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->event = *event;
+	cell->event.modifiers.timestamp = timestamp;
+	__atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+	__atomic_fetch_add(&queueQueuedEvents, 1, __ATOMIC_RELAXED);
+
+	CocoaGame_IdleEventQueued();
+
+	size_t depth = pos + 1 - __atomic_load_n(&queueRead, __ATOMIC_RELAXED);
+	size_t highWaterMark = __atomic_load_n(&queueHighWaterMark, __ATOMIC_RELAXED);
+	while (depth > highWaterMark) {
+		if (__atomic_compare_exchange_n(&queueHighWaterMark, &highWaterMark, depth, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+}
+
+// Returns the cell at the read position if a producer has finished writing it, NULL otherwise. Consumer only.
+static CocoaGame_EventCell *CocoaGame_PeekEventCell(void)
+{
+	// Only the consumer writes queueRead, so it doesn't need to be loaded atomically here.
+	size_t pos = queueRead;
+	CocoaGame_EventCell *cell = &queueCells[pos & queueMask];
+
+	// Empty, or a producer has claimed the cell but not finished writing it.
+	if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != pos + 1)
+		return NULL;
+
+	return cell;
+}
+
+// Hand a cell returned by CocoaGame_PeekEventCell() back to the producers for the next lap around the ring.
+static void CocoaGame_ReleaseEventCell(CocoaGame_EventCell *cell)
+{
+	size_t pos = queueRead;
+
+	__atomic_store_n(&cell->sequence, pos + queueMask + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&queueRead, pos + 1, __ATOMIC_RELAXED);
+}
+
+CocoaGame_Bool CocoaGame_DequeueEvent(CocoaGame_Event *event)
+{
+	if (! queueCells)
+		return FALSE;
+
+	// Leaving this here as a reminder. Standard Cocoa application's don't process any input during a fullscreen
+	// toggle. I've found this to be an issue only when quitting while a window is in the process of animating
+	// between fullscreen and a window, so I've put some code to protect from that in CocoaGame_ShutdownVideo
+	// instead. If there's some other issue then this code may need to be restored.
+	// if (windowIsTogglingFullScreen) {
+	// 	CocoaGame_Poll();
+	// 	return FALSE;
+	// }
+
+	CocoaGame_EventCell *cell = CocoaGame_PeekEventCell();
+	if (! cell)
+		return FALSE;
+
+	*event = cell->event;
+	CocoaGame_ReleaseEventCell(cell);
+
+	uint64_t oldest = event->modifiers.timestamp;
+
+	if (coalesceMouseMoves && event->type == COCOAGAME_EVENT_MOUSE_MOVE) {
+		// Fold any directly following moves in to this one. Anything else stops the merge, so moves are never
+		// reordered relative to buttons, keys or scrolls.
+		while ((cell = CocoaGame_PeekEventCell()) != NULL && cell->event.type == COCOAGAME_EVENT_MOUSE_MOVE) {
+			float deltaX = event->mouseMove.deltaX + cell->event.mouseMove.deltaX;
+			float deltaY = event->mouseMove.deltaY + cell->event.mouseMove.deltaY;
+
+			*event = cell->event;
+			event->mouseMove.deltaX = deltaX;
+			event->mouseMove.deltaY = deltaY;
+
+			CocoaGame_ReleaseEventCell(cell);
+			__atomic_fetch_add(&queueCoalescedEvents, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	CocoaGame_FrameTimingInputConsumed(oldest, event->modifiers.timestamp);
+
+	if (recordingFile)
+		CocoaGame_RecordEvent(event);
+
+	return TRUE;
+}
+
+int CocoaGame_DequeueEvents(CocoaGame_Event *events, int maxEvents)
+{
+	int count = 0;
+
+	while (count < maxEvents && CocoaGame_DequeueEvent(&events[count]))
+		++count;
+
+	return count;
+}
+
+void CocoaGame_SetMouseMoveCoalescing(CocoaGame_Bool coalesce)
+{
+	coalesceMouseMoves = coalesce;
+}
+
+CocoaGame_Bool CocoaGame_IsCoalescingMouseMoves(void)
+{
+	return coalesceMouseMoves;
+}
+
+void CocoaGame_GetEventQueueStats(CocoaGame_EventQueueStats *stats)
+{
+	size_t write = __atomic_load_n(&queueWrite, __ATOMIC_RELAXED);
+	size_t read = __atomic_load_n(&queueRead, __ATOMIC_RELAXED);
+
+	stats->capacity = queueCells ? (int) (queueMask + 1) : 0;
+	stats->depth = write > read ? (int) (write - read) : 0;
+	stats->highWaterMark = (int) __atomic_load_n(&queueHighWaterMark, __ATOMIC_RELAXED);
+	stats->queuedEvents = __atomic_load_n(&queueQueuedEvents, __ATOMIC_RELAXED);
+	stats->droppedEvents = __atomic_load_n(&queueDroppedEvents, __ATOMIC_RELAXED);
+	stats->coalescedEvents = __atomic_load_n(&queueCoalescedEvents, __ATOMIC_RELAXED);
+	stats->filteredEvents = __atomic_load_n(&queueFilteredEvents, __ATOMIC_RELAXED);
+	stats->handledEvents = __atomic_load_n(&queueHandledEvents, __ATOMIC_RELAXED) - __atomic_load_n(&queueHandledEventsAtReset, __ATOMIC_RELAXED);
+}
+
+void CocoaGame_ResetEventQueueStats(void)
+{
+	__atomic_store_n(&queueHighWaterMark, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&queueQueuedEvents, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&queueDroppedEvents, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&queueCoalescedEvents, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&queueFilteredEvents, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&queueHandledEventsAtReset, __atomic_load_n(&queueHandledEvents, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+uint64_t CocoaGame_GetHandledEventCount(void)
+{
+	return __atomic_load_n(&queueHandledEvents, __ATOMIC_RELAXED);
+}
+
+//
+// Event filtering and handlers
+//
+
+void CocoaGame_SetEventMask(uint32_t mask)
+{
+	__atomic_store_n(&eventMask, mask, __ATOMIC_RELAXED);
+}
+
+uint32_t CocoaGame_GetEventMask(void)
+{
+	return __atomic_load_n(&eventMask, __ATOMIC_RELAXED);
+}
+
+CocoaGame_Bool CocoaGame_IsEventTypeEnabled(CocoaGame_EventType type)
+{
+	// Also keeps the shift in COCOAGAME_EVENT_MASK() defined.
+	if ((unsigned int) type >= COCOAGAME_EVENT_TYPE_COUNT)
+		return FALSE;
+
+	return (__atomic_load_n(&eventMask, __ATOMIC_RELAXED) & COCOAGAME_EVENT_MASK(type)) != 0;
+}
+
+void CocoaGame_SetEventHandler(CocoaGame_EventType type, CocoaGame_EventHandler handler, void *context)
+{
+	assert((unsigned int) type < COCOAGAME_EVENT_TYPE_COUNT);
+
+	eventHandlers[type].handler = handler;
+	eventHandlers[type].context = context;
+}
+
+//
+// Recording and replay
+//
+
+static size_t CocoaGame_GetEventSize(CocoaGame_EventType type)
+{
+	switch (type) {
+		case COCOAGAME_EVENT_MODIFIERS_CHANGED:
+			return sizeof(CocoaGame_ModifiersChangedEvent);
+
+		case COCOAGAME_EVENT_KEY_DOWN:
+		case COCOAGAME_EVENT_KEY_UP:
+			return sizeof(CocoaGame_KeyEvent);
+
+		case COCOAGAME_EVENT_CHAR:
+			return sizeof(CocoaGame_CharEvent);
+
+		case COCOAGAME_EVENT_MOUSE_MOVE:
+			return sizeof(CocoaGame_MouseMoveEvent);
+
+		case COCOAGAME_EVENT_MOUSE_DOWN:
+		case COCOAGAME_EVENT_MOUSE_UP:
+			return sizeof(CocoaGame_MouseButtonEvent);
+
+		case COCOAGAME_EVENT_MOUSE_SCROLL:
+			return sizeof(CocoaGame_MouseScrollEvent);
+
+		case COCOAGAME_EVENT_NONE:
+		case COCOAGAME_EVENT_APP_DEACTIVATE:
+		case COCOAGAME_EVENT_APP_ACTIVATE:
+			return sizeof(CocoaGame_ModifiersEvent);
+	}
+
+	return sizeof(CocoaGame_Event);
+}
+
+CocoaGame_Bool CocoaGame_StartRecording(const char *path)
+{
+	CocoaGame_StopRecording();
+
+	FILE *fp = fopen(path, "wb");
+	if (! fp) {
+		CocoaGame_Trace("%s: unable to create \"%s\".\n", __FUNCTION__, path);
+		return FALSE;
+	}
+
+	CocoaGame_RecordingHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = COCOAGAME_RECORDING_MAGIC;
+	header.version = COCOAGAME_RECORDING_VERSION;
+	header.eventSize = (uint32_t) sizeof(CocoaGame_Event);
+
+	fwrite(&header, sizeof(header), 1, fp);
+
+	pthread_mutex_lock(&recordingMutex);
+	recordingLastTime = CocoaGame_GetNanoseconds();
+	recordingFile = fp;
+	pthread_mutex_unlock(&recordingMutex);
+
+	CocoaGame_Trace("%s: recording input to \"%s\".\n", __FUNCTION__, path);
+	return TRUE;
+}
+
+void CocoaGame_StopRecording(void)
+{
+	pthread_mutex_lock(&recordingMutex);
+	FILE *fp = recordingFile;
+	recordingFile = NULL;
+	pthread_mutex_unlock(&recordingMutex);
+
+	if (fp && fclose(fp) != 0)
+		CocoaGame_Trace("%s: error writing recording.\n", __FUNCTION__);
+}
+
+CocoaGame_Bool CocoaGame_IsRecording(void)
+{
+	return recordingFile != NULL;
+}
+
+// Callers check recordingFile first, but it's checked again here as recording may have stopped since.
+static void CocoaGame_WriteRecord(uint8_t type, const void *payload, size_t size)
+{
+	pthread_mutex_lock(&recordingMutex);
+
+	if (! recordingFile) {
+		pthread_mutex_unlock(&recordingMutex);
+		return;
+	}
+
+	// Taken under the lock, so records are written in time order.
+	uint64_t now = CocoaGame_GetNanoseconds();
+	uint64_t delta = (now - recordingLastTime) / 1000;
+
+	// Build the whole record so it's a single fwrite().
+	unsigned char record[sizeof(CocoaGame_RecordHeader) + sizeof(CocoaGame_Event)];
+	CocoaGame_RecordHeader header;
+	header.type = type;
+	header.size = (uint8_t) size;
+	header.reserved = 0;
+	header.delta = delta > UINT32_MAX ? UINT32_MAX : (uint32_t) delta;
+
+	// Only advance by what was written, so rounding doesn't accumulate.
+	recordingLastTime += (uint64_t) header.delta * 1000;
+
+	assert(size <= sizeof(CocoaGame_Event));
+	memcpy(record, &header, sizeof(header));
+	if (size)
+		memcpy(record + sizeof(header), payload, size);
+
+	fwrite(record, sizeof(header) + size, 1, recordingFile);
+
+	pthread_mutex_unlock(&recordingMutex);
+}
+
+static void CocoaGame_RecordEvent(const CocoaGame_Event *event)
+{
+	CocoaGame_WriteRecord((uint8_t) event->type, event, CocoaGame_GetEventSize(event->type));
+}
+
+CocoaGame_Bool CocoaGame_StartReplay(const char *path, CocoaGame_ReplaySpeed speed)
+{
+	CocoaGame_StopReplay();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		CocoaGame_Trace("%s: unable to open \"%s\".\n", __FUNCTION__, path);
+		return FALSE;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CocoaGame_RecordingHeader)) {
+		CocoaGame_Trace("%s: \"%s\" is not a recording.\n", __FUNCTION__, path);
+		close(fd);
+		return FALSE;
+	}
+
+	void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		CocoaGame_Trace("%s: unable to map \"%s\".\n", __FUNCTION__, path);
+		return FALSE;
+	}
+
+	const CocoaGame_RecordingHeader *header = (const CocoaGame_RecordingHeader *) data;
+	if (header->magic != COCOAGAME_RECORDING_MAGIC || header->version != COCOAGAME_RECORDING_VERSION || header->eventSize != sizeof(CocoaGame_Event)) {
+		CocoaGame_Trace("%s: \"%s\" is not a recording made by this build.\n", __FUNCTION__, path);
+		munmap(data, (size_t) st.st_size);
+		return FALSE;
+	}
+
+	replayData = (const uint8_t *) data;
+	replaySize = (size_t) st.st_size;
+	replayOffset = sizeof(CocoaGame_RecordingHeader);
+	replaySpeed = speed;
+	replayStartTime = CocoaGame_GetNanoseconds();
+	replayRecordTime = 0;
+
+	CocoaGame_Trace("%s: replaying \"%s\".\n", __FUNCTION__, path);
+
+	// Events recorded before the first CocoaGame_BeginRender().
+	CocoaGame_ReplayFrame();
+	return TRUE;
+}
+
+void CocoaGame_StopReplay(void)
+{
+	if (! replayData)
+		return;
+
+	munmap((void *) replayData, replaySize);
+	replayData = NULL;
+	replaySize = 0;
+}
+
+CocoaGame_Bool CocoaGame_IsReplaying(void)
+{
+	return replayData != NULL;
+}
+
+// A record's payload must be exactly what CocoaGame_RecordEvent() writes for its type, and begin with that type. The
+// caller has checked that the payload is within the recording.
+static CocoaGame_Bool CocoaGame_IsRecordValid(const uint8_t *record)
+{
+	CocoaGame_RecordHeader header;
+	memcpy(&header, record, sizeof(header));
+
+	if (header.type == COCOAGAME_RECORD_FRAME)
+		return header.size == 0;
+
+	if (header.type >= COCOAGAME_EVENT_TYPE_COUNT || header.size != CocoaGame_GetEventSize((CocoaGame_EventType) header.type))
+		return FALSE;
+
+	CocoaGame_EventType type;
+	memcpy(&type, record + sizeof(header), sizeof(type));
+
+	return type == (CocoaGame_EventType) header.type;
+}
+
+// Queue the events recorded for the current frame, stopping after the next frame record.
+static void CocoaGame_ReplayFrame(void)
+{
+	while (replayData && replayOffset + sizeof(CocoaGame_RecordHeader) <= replaySize) {
+		CocoaGame_RecordHeader header;
+		memcpy(&header, replayData + replayOffset, sizeof(header));
+
+		if (replayOffset + sizeof(header) + header.size > replaySize)
+			break;
+
+		if (! CocoaGame_IsRecordValid(replayData + replayOffset)) {
+			CocoaGame_Trace("%s: damaged record at offset %llu, stopping replay.\n", __FUNCTION__, (unsigned long long) replayOffset);
+			CocoaGame_StopReplay();
+			return;
+		}
+
+		replayOffset += sizeof(header);
+		replayRecordTime += (uint64_t) header.delta * 1000;
+
+		if (header.type == COCOAGAME_RECORD_FRAME) {
+			if (replaySpeed == COCOAGAME_REPLAY_REALTIME) {
+				// Hold the frame back until the same time has passed as when it was recorded.
+				for (;;) {
+					uint64_t elapsed = CocoaGame_GetNanoseconds() - replayStartTime;
+					if (elapsed >= replayRecordTime)
+						break;
+
+					CocoaGame_SleepNanoseconds(replayRecordTime - elapsed);
+				}
+			}
+
+			return;
+		}
+
+		CocoaGame_Event event;
+		memset(&event, 0, sizeof(event));
+		memcpy(&event, replayData + replayOffset, header.size);
+		replayOffset += header.size;
+
+		CocoaGame_QueueEvent(&event);
+	}
+
+	CocoaGame_Trace("%s: replay finished.\n", __FUNCTION__);
+	CocoaGame_StopReplay();
+}
+
+void CocoaGame_CoreBeginRender(void)
+{
+	// Before timing starts, so the frame is timed from when rendering can actually begin.
+	CocoaGame_JobsBeginRender();
+
+	CocoaGame_FrameTimingBeginRender();
+
+	if (recordingFile)
+		CocoaGame_WriteRecord(COCOAGAME_RECORD_FRAME, NULL, 0);
+
+	// Before the replay. The events replayed here were dequeued during this frame when it was recorded, so they arrived
+	// after its snapshot was taken and belong in the next one.
+	CocoaGame_InputBeginRender();
+
+	if (replayData)
+		CocoaGame_ReplayFrame();
+
+	CocoaGame_IdleBeginRender();
+}
+
+void CocoaGame_CoreBeginFrame(void)
+{
+	CocoaGame_RenderTargetsBeginFrame();
+	CocoaGame_TransientBeginFrame();
+	CocoaGame_TextureArchivesBeginFrame();
+	CocoaGame_IdleBeginFrame();
+	CocoaGame_GLTraceBeginFrame();
+}
+
+void CocoaGame_CoreEndRender(CocoaGame_Bool discarded)
+{
+	frameDiscarded = discarded;
+
+	CocoaGame_RenderTargetsEndRender();
+	CocoaGame_TransientEndRender();
+
+	if (! discarded)
+		CocoaGame_CaptureEndRender();
+
+	CocoaGame_GLTraceEndRender();
+	CocoaGame_FrameTimingEndRender();
+}
+
+void CocoaGame_CoreFinishRender(CocoaGame_Bool syncedToRefresh)
+{
+	CocoaGame_FrameTimingFinishRender(frameDiscarded);
+	CocoaGame_RenderTargetsFinishRender(syncedToRefresh);
+	CocoaGame_JobsFinishRender();
+}
+
+void CocoaGame_CoreContextCurrent(void *context)
+{
+	CocoaGame_GLTraceContextCurrent(context);
+	CocoaGame_GLStateContextCurrent(context);
+	CocoaGame_ProgramCacheContextCurrent(context);
+}
+
+void CocoaGame_CoreContextDestroyed(void *context)
+{
+	CocoaGame_GLTraceContextDestroyed(context);
+	CocoaGame_GLStateContextDestroyed(context);
+	CocoaGame_ProgramCacheContextDestroyed(context);
+}
+
+void CocoaGame_TraceEvent(const CocoaGame_Event *event)
+{
+	switch (event->type) {
+		case COCOAGAME_EVENT_NONE:
+			break;
+
+		case COCOAGAME_EVENT_APP_ACTIVATE:
+			fprintf(stderr, "App activate\n");
+			break;
+
+		case COCOAGAME_EVENT_APP_DEACTIVATE:
+			fprintf(stderr, "App deactivate\n");
+			break;
+
+		case COCOAGAME_EVENT_MODIFIERS_CHANGED:
+			fprintf(stderr, "Modifiers	 : modifiers now 0x%02x were 0x%02x\n",
+				event->modifiers.modifiers, event->modifiersChanged.previousModifiers);
+			break;
+
+		case COCOAGAME_EVENT_KEY_DOWN:
+			fprintf(stderr, "Key down	 : key 0x%04x modifiers 0x%02x keyCode 0x%02x\n",
+				(unsigned int) event->key.key, event->modifiers.modifiers, event->key.keyCode);
+			break;
+
+		case COCOAGAME_EVENT_KEY_UP:
+			fprintf(stderr, "Key up		 : key 0x%04x modifiers 0x%02x keyCode 0x%02x\n",
+				(unsigned int) event->key.key, event->modifiers.modifiers, event->key.keyCode);
+			break;
+
+		case COCOAGAME_EVENT_CHAR:
+			if (event->character.unicode >= ' ' && event->character.unicode < 127) {
+				fprintf(stderr, "Character	 : '%c' modifiers 0x%02x\n",
+					(char) event->character.unicode, event->modifiers.modifiers);
+			} else {
+				fprintf(stderr, "Character	 : UNICODE 0x%04x modifiers 0x%02x\n",
+					(unsigned int) event->character.unicode, event->modifiers.modifiers);
+			}
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_MOVE:
+			fprintf(stderr, "Mouse move	 :			@ %4d, %4d delta % 3.4f, % 3.4f modifiers 0x%02x\n",
+				event->mousePosition.x, event->mousePosition.y,
+				event->mouseMove.deltaX, event->mouseMove.deltaY, event->modifiers.modifiers);
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_DOWN:
+			fprintf(stderr, "Mouse down	 : button %d @ %4d, %4d modifiers 0x%02x\n",
+				(int) event->mouseButton.button, event->mousePosition.x, event->mousePosition.y,
+				event->modifiers.modifiers);
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_UP:
+			fprintf(stderr, "Mouse up	 : button %d @ %4d, %4d modifiers 0x%02x\n",
+				(int) event->mouseButton.button, event->mousePosition.x, event->mousePosition.y,
+				event->modifiers.modifiers);
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_SCROLL:
+			fprintf(stderr, "Mouse scroll:			@ %4d, %4d scroll % 3.4f, % 3.4f modifiers 0x%02x\n",
+				event->mouseScroll.cursorX, event->mouseScroll.cursorY,
+				event->mouseScroll.scrollX, event->mouseScroll.scrollY, event->modifiers.modifiers);
+			break;
+	}
+}
+
+//
+// Timers
+//
+
+uint64_t CocoaGame_GetNanoseconds(void)
+{
+	#ifdef __APPLE__
+		static mach_timebase_info_data_t timebase;
+		if (! timebase.denom)
+			mach_timebase_info(&timebase);
+
+		return mach_absolute_time() * timebase.numer / timebase.denom;
+	#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+	#endif
+}
+
+double CocoaGame_GetTimer(void)
+{
+	return (double) CocoaGame_GetNanoseconds() / 1e9;
+}
+
+uint32_t CocoaGame_GetMillisecondTimer(void)
+{
+	return (uint32_t) (CocoaGame_GetNanoseconds() / 1000000);
+}
+
+// CocoaGame_Sleep() waits for events, which can only be done on the main thread. The render thread runs with the
+// context locked and leaves events to the main thread, so it just sleeps.
+static void CocoaGame_SleepNanoseconds(uint64_t nanoseconds)
+{
+	if (CocoaGame_IsRenderThread()) {
+		struct timespec ts;
+		ts.tv_sec = (time_t) (nanoseconds / 1000000000u);
+		ts.tv_nsec = (long) (nanoseconds % 1000000000u);
+		nanosleep(&ts, NULL);
+	} else
+		CocoaGame_Sleep((double) nanoseconds / 1e9);
+}
+
+//
+// Frame pacing
+//
+
+void CocoaGame_SetFramePacer(const CocoaGame_FramePacerConfig *config)
+{
+	pacerConfig = *config;
+
+	if (pacerConfig.framesPerSecond > 0.0)
+		pacerPeriod = (uint64_t) (1e9 / pacerConfig.framesPerSecond);
+	else
+		pacerPeriod = 0;
+
+	if (pacerConfig.spinSeconds < 0.0)
+		pacerConfig.spinSeconds = 0.0;
+
+	// Restore anything the adaptive mode relaxed.
+	if (pacerRelaxedSwapInterval >= 0) {
+		CocoaGame_SetSwapInterval(pacerRelaxedSwapInterval);
+		pacerRelaxedSwapInterval = -1;
+	}
+
+	pacerDeadline = 0;
+	pacerWindowFrames = 0;
+	pacerWindowMisses = 0;
+}
+
+const CocoaGame_FramePacerConfig *CocoaGame_GetFramePacer(void)
+{
+	return &pacerConfig;
+}
+
+// Called for each paced frame. Relaxes the swap interval if too many recent frames missed their deadline, and
+// restores it once a whole window of frames has been on time.
+static void CocoaGame_AdaptSwapInterval(CocoaGame_Bool missed)
+{
+	++pacerWindowFrames;
+	if (missed)
+		++pacerWindowMisses;
+
+	if (pacerWindowFrames < COCOAGAME_FRAME_PACER_WINDOW)
+		return;
+
+	const CocoaGame_GLConfig *glConfig = CocoaGame_GetGLConfig();
+
+	if (pacerWindowMisses * 100 >= COCOAGAME_FRAME_PACER_WINDOW * COCOAGAME_FRAME_PACER_MISS_PERCENT) {
+		if (pacerRelaxedSwapInterval < 0 && glConfig->swapInterval > 0) {
+			CocoaGame_Trace("%s: %d of %d frames missed their deadline, disabling swap interval %d.\n", __FUNCTION__,
+				pacerWindowMisses, pacerWindowFrames, glConfig->swapInterval);
+
+			pacerRelaxedSwapInterval = glConfig->swapInterval;
+			CocoaGame_SetSwapInterval(0);
+		}
+	} else if (pacerWindowMisses == 0 && pacerRelaxedSwapInterval >= 0) {
+		CocoaGame_Trace("%s: frames on time, restoring swap interval %d.\n", __FUNCTION__, pacerRelaxedSwapInterval);
+
+		CocoaGame_SetSwapInterval(pacerRelaxedSwapInterval);
+		pacerRelaxedSwapInterval = -1;
+	}
+
+	pacerWindowFrames = 0;
+	pacerWindowMisses = 0;
+}
+
+// Finish a paced frame whose deadline has been reached at time now. missed is TRUE if the deadline had already
+// passed when CocoaGame_WaitForNextFrame() was called.
+static CocoaGame_FrameWait CocoaGame_FinishPacedFrame(uint64_t now, CocoaGame_Bool missed)
+{
+	uint64_t lateness = now - pacerDeadline;
+
+	++pacerStats.frames;
+	pacerStats.lastLateness = lateness;
+	if (lateness > pacerStats.maxLateness)
+		pacerStats.maxLateness = lateness;
+
+	if (missed)
+		++pacerStats.missedDeadlines;
+
+	pacerStats.lastFrameMissed = missed;
+
+	// If we've fallen more than a frame behind, start again from now rather than rushing to catch up.
+	if (lateness >= pacerPeriod)
+		pacerDeadline = now + pacerPeriod;
+	else
+		pacerDeadline += pacerPeriod;
+
+	if (pacerConfig.mode == COCOAGAME_FRAME_PACING_ADAPTIVE)
+		CocoaGame_AdaptSwapInterval(missed);
+
+	return missed ? COCOAGAME_FRAME_WAIT_MISSED : COCOAGAME_FRAME_WAIT_ON_TIME;
+}
+
+CocoaGame_Bool CocoaGame_InputWaiting(void)
+{
+	return __atomic_load_n(&queueWrite, __ATOMIC_RELAXED) != __atomic_load_n(&queueRead, __ATOMIC_RELAXED);
+}
+
+CocoaGame_FrameWait CocoaGame_WaitForNextFrame(void)
+{
+	if (pacerConfig.mode == COCOAGAME_FRAME_PACING_OFF || ! pacerPeriod)
+		return COCOAGAME_FRAME_WAIT_ON_TIME;
+
+	uint64_t now = CocoaGame_GetNanoseconds();
+
+	// The first frame sets the cadence.
+	if (! pacerDeadline) {
+		pacerDeadline = now;
+		return CocoaGame_FinishPacedFrame(now, FALSE);
+	}
+
+	if (now > pacerDeadline)
+		return CocoaGame_FinishPacedFrame(now, TRUE);
+
+	uint64_t spin = (uint64_t) (pacerConfig.spinSeconds * 1e9);
+
+	// Events can only be polled on the main thread. The render thread leaves them to it.
+	CocoaGame_Bool wakeForInput = pacerConfig.wakeForInput && ! CocoaGame_IsRenderThread();
+
+	// Sleep until shortly before the deadline. The OS may oversleep by a millisecond or more, which is why we stop
+	// early and spin for the rest.
+	while (pacerDeadline - now > spin) {
+		if (wakeForInput) {
+			CocoaGame_Poll();
+			if (CocoaGame_InputWaiting())
+				return COCOAGAME_FRAME_WAIT_INPUT;
+		}
+
+		uint64_t remaining = pacerDeadline - now - spin;
+		if (wakeForInput && remaining > COCOAGAME_FRAME_PACER_INPUT_SLICE)
+			remaining = COCOAGAME_FRAME_PACER_INPUT_SLICE;
+
+		CocoaGame_SleepNanoseconds(remaining);
+
+		now = CocoaGame_GetNanoseconds();
+		if (now >= pacerDeadline)
+			break;
+	}
+
+	while (now < pacerDeadline)
+		now = CocoaGame_GetNanoseconds();
+
+	return CocoaGame_FinishPacedFrame(now, FALSE);
+}
+
+void CocoaGame_GetFramePacerStats(CocoaGame_FramePacerStats *stats)
+{
+	*stats = pacerStats;
+	stats->swapIntervalRelaxed = pacerRelaxedSwapInterval >= 0;
+}
+
+void CocoaGame_ResetFramePacerStats(void)
+{
+	memset(&pacerStats, 0, sizeof(pacerStats));
+}
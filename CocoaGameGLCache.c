@@ -0,0 +1,440 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// On-disk cache of OpenGL driver information and negotiated pixel formats. Each backend identifies the graphics
+// device and driver without creating a context (CocoaGame_GetGLDeviceKey()). Under that key the cache holds the
+// driver's GL_VERSION, GL_VENDOR, GL_RENDERER and GL_EXTENSIONS and, for each CocoaGame_GLConfig that's been asked
+// for, the configuration CocoaGame_InitGL() ended up with. The strings are checked against the real context each
+// time OpenGL is initialised, and a mismatch discards everything cached for the device.
+//
+// The file is text, one record per line:
+//
+//     CocoaGameGLCache 1
+//     device <key>
+//     version <GL_VERSION>
+//     vendor <GL_VENDOR>
+//     renderer <GL_RENDERER>
+//     extensions <GL_EXTENSIONS>
+//     config <requested colour alpha depth stencil msaa> <actual colour alpha depth stencil msaa>
+//
+// with a device line starting each device's records.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Compile-time options
+//
+
+// Devices remembered, e.g., the integrated and discrete GPUs of a laptop. The least recently updated is forgotten.
+#define COCOAGAME_GL_CACHE_MAX_DEVICES 8
+
+// Requested configurations remembered per device.
+#define COCOAGAME_GL_CACHE_MAX_CONFIGS 8
+
+// Written after "CocoaGameGLCache" on the first line. Files with any other version are ignored.
+#define COCOAGAME_GL_CACHE_VERSION "1"
+
+//
+// Private types
+//
+
+typedef struct CocoaGame_GLCacheConfig {
+	CocoaGame_GLConfig requested;
+	CocoaGame_GLConfig actual;
+} CocoaGame_GLCacheConfig;
+
+typedef struct CocoaGame_GLCacheDevice {
+	char *key;
+	CocoaGame_GLInfo info;
+	int configCount;
+	CocoaGame_GLCacheConfig configs[COCOAGAME_GL_CACHE_MAX_CONFIGS];
+} CocoaGame_GLCacheDevice;
+
+//
+// Private functions
+//
+
+static void CocoaGame_LoadGLCache(void);
+static void CocoaGame_SaveGLCache(void);
+static CocoaGame_Bool CocoaGame_WriteGLCache(FILE *fp, void *context);
+static void CocoaGame_FreeGLCacheInfo(CocoaGame_GLInfo *info);
+static void CocoaGame_FreeGLCache(void);
+static CocoaGame_GLCacheDevice *CocoaGame_FindGLCacheDevice(const char *key);
+static CocoaGame_GLCacheDevice *CocoaGame_AddGLCacheDevice(const char *key);
+static void CocoaGame_FreeGLCacheDevice(CocoaGame_GLCacheDevice *device);
+static CocoaGame_Bool CocoaGame_GLCacheConfigsMatch(const CocoaGame_GLConfig *a, const CocoaGame_GLConfig *b);
+static char *CocoaGame_DuplicateGLString(GLenum name);
+
+//
+// Private data
+//
+
+static char *glCachePath;
+static CocoaGame_Bool glCacheLoaded;
+
+// Most recently updated first.
+static CocoaGame_GLCacheDevice glCacheDevices[COCOAGAME_GL_CACHE_MAX_DEVICES];
+static int glCacheDeviceCount;
+
+//
+// OpenGL cache
+//
+
+void CocoaGame_SetGLCachePath(const char *path)
+{
+	CocoaGame_FreeGLCache();
+
+	CocoaGame_Free(glCachePath);
+	glCachePath = path ? CocoaGame_StrDup(path, COCOAGAME_ALLOC_CACHES) : NULL;
+}
+
+CocoaGame_GLInfo *CocoaGame_LookupGLInfoCache(void)
+{
+	if (! glCachePath)
+		return NULL;
+
+	char key[512];
+	if (! CocoaGame_GetGLDeviceKey(key, sizeof(key)))
+		return NULL;
+
+	CocoaGame_LoadGLCache();
+
+	CocoaGame_GLCacheDevice *device = CocoaGame_FindGLCacheDevice(key);
+	if (! device || ! device->info.version)
+		return NULL;
+
+	CocoaGame_GLInfo *info = CocoaGame_AllocZeroed(1, sizeof(CocoaGame_GLInfo), COCOAGAME_ALLOC_CACHES);
+	if (! info)
+		return NULL;
+
+	info->version = CocoaGame_StrDup(device->info.version, COCOAGAME_ALLOC_CACHES);
+	info->extensions = CocoaGame_StrDup(device->info.extensions, COCOAGAME_ALLOC_CACHES);
+	info->renderer = CocoaGame_StrDup(device->info.renderer, COCOAGAME_ALLOC_CACHES);
+	info->vendor = CocoaGame_StrDup(device->info.vendor, COCOAGAME_ALLOC_CACHES);
+
+	if (! info->version || ! info->extensions || ! info->renderer || ! info->vendor) {
+		CocoaGame_FreeGLInfo(info);
+		return NULL;
+	}
+
+	CocoaGame_Trace("%s: using cached information for %s.\n", __FUNCTION__, info->renderer);
+	return info;
+}
+
+CocoaGame_Bool CocoaGame_LookupGLConfigCache(const CocoaGame_GLConfig *requested, CocoaGame_GLConfig *actual)
+{
+	if (! glCachePath)
+		return FALSE;
+
+	char key[512];
+	if (! CocoaGame_GetGLDeviceKey(key, sizeof(key)))
+		return FALSE;
+
+	CocoaGame_LoadGLCache();
+
+	CocoaGame_GLCacheDevice *device = CocoaGame_FindGLCacheDevice(key);
+	if (! device)
+		return FALSE;
+
+	int i;
+	for (i = 0; i != device->configCount; ++i) {
+		if (CocoaGame_GLCacheConfigsMatch(&device->configs[i].requested, requested)) {
+			*actual = device->configs[i].actual;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+void CocoaGame_UpdateGLCache(const CocoaGame_GLConfig *requested, const CocoaGame_GLConfig *actual)
+{
+	if (! glCachePath)
+		return;
+
+	char key[512];
+	if (! CocoaGame_GetGLDeviceKey(key, sizeof(key)))
+		return;
+
+	CocoaGame_LoadGLCache();
+
+	CocoaGame_GLInfo info;
+	info.version = CocoaGame_DuplicateGLString(GL_VERSION);
+	info.vendor = CocoaGame_DuplicateGLString(GL_VENDOR);
+	info.renderer = CocoaGame_DuplicateGLString(GL_RENDERER);
+	info.extensions = CocoaGame_DuplicateGLString(GL_EXTENSIONS);
+
+	if (! info.version || ! info.vendor || ! info.renderer || ! info.extensions) {
+		CocoaGame_FreeGLCacheInfo(&info);
+		return;
+	}
+
+	CocoaGame_Bool changed = FALSE;
+	CocoaGame_GLCacheDevice *device = CocoaGame_FindGLCacheDevice(key);
+
+	if (device && (! device->info.version ||
+		strcmp(device->info.version, info.version) != 0 ||
+		strcmp(device->info.vendor, info.vendor) != 0 ||
+		strcmp(device->info.renderer, info.renderer) != 0 ||
+		strcmp(device->info.extensions, info.extensions) != 0)) {
+		// The driver changed, so nothing cached for it can be trusted.
+		CocoaGame_Trace("%s: driver changed, discarding cached formats.\n", __FUNCTION__);
+		CocoaGame_FreeGLCacheDevice(device);
+		device = NULL;
+	}
+
+	if (! device) {
+		device = CocoaGame_AddGLCacheDevice(key);
+		if (! device) {
+			CocoaGame_FreeGLCacheInfo(&info);
+			return;
+		}
+
+		device->info = info;
+		changed = TRUE;
+	} else
+		CocoaGame_FreeGLCacheInfo(&info);
+
+	if (requested) {
+		int i;
+		for (i = 0; i != device->configCount; ++i) {
+			if (CocoaGame_GLCacheConfigsMatch(&device->configs[i].requested, requested))
+				break;
+		}
+
+		if (i == device->configCount) {
+			// Forget the oldest.
+			if (device->configCount == COCOAGAME_GL_CACHE_MAX_CONFIGS)
+				memmove(&device->configs[0], &device->configs[1], sizeof(device->configs[0]) * --device->configCount);
+
+			i = device->configCount++;
+			device->configs[i].requested = *requested;
+			changed = TRUE;
+		} else if (! CocoaGame_GLCacheConfigsMatch(&device->configs[i].actual, actual))
+			changed = TRUE;
+
+		device->configs[i].actual = *actual;
+	}
+
+	if (changed)
+		CocoaGame_SaveGLCache();
+}
+
+// Swap interval isn't part of the pixel format, so it's ignored.
+static CocoaGame_Bool CocoaGame_GLCacheConfigsMatch(const CocoaGame_GLConfig *a, const CocoaGame_GLConfig *b)
+{
+	return a->colourBits == b->colourBits && a->alphaBits == b->alphaBits && a->depthBits == b->depthBits &&
+		a->stencilBits == b->stencilBits && a->msaa == b->msaa;
+}
+
+static char *CocoaGame_DuplicateGLString(GLenum name)
+{
+	const char *string = (const char *) glGetString(name);
+	char *copy = CocoaGame_StrDup(string ? string : "", COCOAGAME_ALLOC_CACHES);
+	if (! copy)
+		return NULL;
+
+	// Newlines would break the file format (and no driver should return one).
+	char *c;
+	for (c = copy; *c; ++c) {
+		if (*c == '\n' || *c == '\r')
+			*c = ' ';
+	}
+
+	return copy;
+}
+
+static CocoaGame_GLCacheDevice *CocoaGame_FindGLCacheDevice(const char *key)
+{
+	int i;
+	for (i = 0; i != glCacheDeviceCount; ++i) {
+		if (strcmp(glCacheDevices[i].key, key) == 0)
+			return &glCacheDevices[i];
+	}
+
+	return NULL;
+}
+
+// Add an empty device at the front of the list, forgetting the last one if the list is full. Returns NULL if out of
+// memory.
+static CocoaGame_GLCacheDevice *CocoaGame_AddGLCacheDevice(const char *key)
+{
+	char *keyCopy = CocoaGame_StrDup(key, COCOAGAME_ALLOC_CACHES);
+	if (! keyCopy)
+		return NULL;
+
+	if (glCacheDeviceCount == COCOAGAME_GL_CACHE_MAX_DEVICES)
+		CocoaGame_FreeGLCacheDevice(&glCacheDevices[glCacheDeviceCount - 1]);
+
+	memmove(&glCacheDevices[1], &glCacheDevices[0], sizeof(glCacheDevices[0]) * glCacheDeviceCount);
+	++glCacheDeviceCount;
+
+	CocoaGame_GLCacheDevice *device = &glCacheDevices[0];
+	memset(device, 0, sizeof(*device));
+	device->key = keyCopy;
+	return device;
+}
+
+static void CocoaGame_FreeGLCacheDevice(CocoaGame_GLCacheDevice *device)
+{
+	CocoaGame_Free(device->key);
+	CocoaGame_FreeGLCacheInfo(&device->info);
+
+	int index = (int) (device - glCacheDevices);
+	memmove(device, device + 1, sizeof(*device) * (size_t) (glCacheDeviceCount - index - 1));
+	--glCacheDeviceCount;
+}
+
+// Free the strings of info, which isn't allocated itself.
+static void CocoaGame_FreeGLCacheInfo(CocoaGame_GLInfo *info)
+{
+	CocoaGame_Free(info->version);
+	CocoaGame_Free(info->vendor);
+	CocoaGame_Free(info->renderer);
+	CocoaGame_Free(info->extensions);
+}
+
+static void CocoaGame_FreeGLCache(void)
+{
+	while (glCacheDeviceCount)
+		CocoaGame_FreeGLCacheDevice(&glCacheDevices[0]);
+
+	glCacheLoaded = FALSE;
+}
+
+static void CocoaGame_LoadGLCache(void)
+{
+	if (glCacheLoaded)
+		return;
+
+	glCacheLoaded = TRUE;
+
+	FILE *fp = fopen(glCachePath, "rb");
+	if (! fp)
+		return;
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	char *text = size > 0 ? CocoaGame_Alloc((size_t) size + 1, COCOAGAME_ALLOC_CACHES) : NULL;
+	if (! text || fread(text, (size_t) size, 1, fp) != 1) {
+		CocoaGame_Free(text);
+		fclose(fp);
+		return;
+	}
+
+	fclose(fp);
+	text[size] = 0;
+
+	CocoaGame_GLCacheDevice *device = NULL;
+	char *line = text;
+	CocoaGame_Bool valid = FALSE;
+
+	while (*line) {
+		char *end = strchr(line, '\n');
+		if (end)
+			*end = 0;
+
+		char *value = strchr(line, ' ');
+		if (value)
+			*value++ = 0;
+		else
+			value = line + strlen(line);
+
+		if (! valid) {
+			// Anything written by an incompatible version is ignored, and replaced when the cache is next saved.
+			if (strcmp(line, "CocoaGameGLCache") != 0 || strcmp(value, COCOAGAME_GL_CACHE_VERSION) != 0)
+				break;
+
+			valid = TRUE;
+		} else if (strcmp(line, "device") == 0) {
+			device = NULL;
+
+			char *key = glCacheDeviceCount != COCOAGAME_GL_CACHE_MAX_DEVICES ? CocoaGame_StrDup(value, COCOAGAME_ALLOC_CACHES) : NULL;
+			if (key) {
+				device = &glCacheDevices[glCacheDeviceCount++];
+				memset(device, 0, sizeof(*device));
+				device->key = key;
+			}
+		} else if (device && strcmp(line, "version") == 0) {
+			CocoaGame_Free(device->info.version);
+			device->info.version = CocoaGame_StrDup(value, COCOAGAME_ALLOC_CACHES);
+		} else if (device && strcmp(line, "vendor") == 0) {
+			CocoaGame_Free(device->info.vendor);
+			device->info.vendor = CocoaGame_StrDup(value, COCOAGAME_ALLOC_CACHES);
+		} else if (device && strcmp(line, "renderer") == 0) {
+			CocoaGame_Free(device->info.renderer);
+			device->info.renderer = CocoaGame_StrDup(value, COCOAGAME_ALLOC_CACHES);
+		} else if (device && strcmp(line, "extensions") == 0) {
+			CocoaGame_Free(device->info.extensions);
+			device->info.extensions = CocoaGame_StrDup(value, COCOAGAME_ALLOC_CACHES);
+		} else if (device && strcmp(line, "config") == 0 && device->configCount != COCOAGAME_GL_CACHE_MAX_CONFIGS) {
+			CocoaGame_GLCacheConfig *config = &device->configs[device->configCount];
+			memset(config, 0, sizeof(*config));
+
+			if (sscanf(value, "%d %d %d %d %d %d %d %d %d %d",
+				&config->requested.colourBits, &config->requested.alphaBits, &config->requested.depthBits,
+				&config->requested.stencilBits, &config->requested.msaa,
+				&config->actual.colourBits, &config->actual.alphaBits, &config->actual.depthBits,
+				&config->actual.stencilBits, &config->actual.msaa) == 10)
+				++device->configCount;
+		}
+
+		if (! end)
+			break;
+
+		line = end + 1;
+	}
+
+	CocoaGame_Free(text);
+
+	// A device whose information is incomplete can't be validated, so forget it.
+	int i;
+	for (i = glCacheDeviceCount - 1; i >= 0; --i) {
+		CocoaGame_GLInfo *info = &glCacheDevices[i].info;
+		if (! info->version || ! info->vendor || ! info->renderer || ! info->extensions)
+			CocoaGame_FreeGLCacheDevice(&glCacheDevices[i]);
+	}
+
+	CocoaGame_Trace("%s: %d devices cached in \"%s\".\n", __FUNCTION__, glCacheDeviceCount, glCachePath);
+}
+
+static void CocoaGame_SaveGLCache(void)
+{
+	CocoaGame_WriteFileSafely(glCachePath, &CocoaGame_WriteGLCache, NULL);
+}
+
+static CocoaGame_Bool CocoaGame_WriteGLCache(FILE *fp, void *context)
+{
+	(void) context;
+
+	fprintf(fp, "CocoaGameGLCache %s\n", COCOAGAME_GL_CACHE_VERSION);
+
+	int i, j;
+	for (i = 0; i != glCacheDeviceCount; ++i) {
+		const CocoaGame_GLCacheDevice *device = &glCacheDevices[i];
+
+		fprintf(fp, "device %s\n", device->key);
+		fprintf(fp, "version %s\n", device->info.version);
+		fprintf(fp, "vendor %s\n", device->info.vendor);
+		fprintf(fp, "renderer %s\n", device->info.renderer);
+		fprintf(fp, "extensions %s\n", device->info.extensions);
+
+		for (j = 0; j != device->configCount; ++j) {
+			const CocoaGame_GLConfig *requested = &device->configs[j].requested;
+			const CocoaGame_GLConfig *actual = &device->configs[j].actual;
+
+			fprintf(fp, "config %d %d %d %d %d %d %d %d %d %d\n",
+				requested->colourBits, requested->alphaBits, requested->depthBits, requested->stencilBits, requested->msaa,
+				actual->colourBits, actual->alphaBits, actual->depthBits, actual->stencilBits, actual->msaa);
+		}
+	}
+
+	return ! ferror(fp);
+}
@@ -0,0 +1,636 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// OpenGL state cache. Each context made current through the backend gets a shadow of the state set through the
+// CocoaGame_GL functions, which only call OpenGL when the value actually changes. State starts out unknown, so the
+// first change always reaches the driver, and the shadow is forgotten when its context is destroyed. The library's
+// own state changes go through the cache where they aren't undone straight away.
+//
+
+#include "CocoaGamePrivate.h"
+#include <string.h>
+#include <pthread.h>
+
+//
+// Compile-time options
+//
+
+// Contexts that can have their state cached at once. State set on any other context isn't cached.
+#define COCOAGAME_GL_STATE_MAX_CONTEXTS 8
+
+// Texture units whose bindings are cached.
+#define COCOAGAME_GL_STATE_TEXTURE_UNITS 16
+
+// Capabilities (glEnable()/glDisable()) cached per context.
+#define COCOAGAME_GL_STATE_CAPABILITIES 24
+
+//
+// Private types
+//
+
+// A binding whose value isn't known.
+#define COCOAGAME_GL_STATE_UNKNOWN ((GLuint) -1)
+
+enum {
+	COCOAGAME_GL_STATE_KNOWN_VIEWPORT = 1 << 0,
+	COCOAGAME_GL_STATE_KNOWN_SCISSOR = 1 << 1,
+	COCOAGAME_GL_STATE_KNOWN_BLEND_FUNC = 1 << 2,
+	COCOAGAME_GL_STATE_KNOWN_DEPTH_FUNC = 1 << 3,
+	COCOAGAME_GL_STATE_KNOWN_DEPTH_MASK = 1 << 4,
+	COCOAGAME_GL_STATE_KNOWN_CLEAR_COLOUR = 1 << 5
+};
+
+enum {
+	COCOAGAME_GL_STATE_TEXTURE_2D,
+	COCOAGAME_GL_STATE_TEXTURE_RECTANGLE,
+	COCOAGAME_GL_STATE_TEXTURE_CUBE_MAP,
+	COCOAGAME_GL_STATE_TEXTURE_3D,
+
+	COCOAGAME_GL_STATE_TEXTURE_TARGETS
+};
+
+enum {
+	COCOAGAME_GL_STATE_ARRAY_BUFFER,
+	COCOAGAME_GL_STATE_ELEMENT_ARRAY_BUFFER,
+	COCOAGAME_GL_STATE_PIXEL_PACK_BUFFER,
+	COCOAGAME_GL_STATE_PIXEL_UNPACK_BUFFER,
+
+	COCOAGAME_GL_STATE_BUFFER_TARGETS
+};
+
+typedef struct CocoaGame_GLStateCache {
+	void *context;
+
+	unsigned int known;
+
+	// Texture capabilities are per texture unit, so capabilityUnits has the unit for those and 0 for the rest.
+	int capabilityCount;
+	GLenum capabilities[COCOAGAME_GL_STATE_CAPABILITIES];
+	GLenum capabilityUnits[COCOAGAME_GL_STATE_CAPABILITIES];
+	CocoaGame_Bool capabilityEnabled[COCOAGAME_GL_STATE_CAPABILITIES];
+
+	// 0 if unknown.
+	GLenum activeTexture;
+
+	GLuint textures[COCOAGAME_GL_STATE_TEXTURE_UNITS][COCOAGAME_GL_STATE_TEXTURE_TARGETS];
+	GLuint buffers[COCOAGAME_GL_STATE_BUFFER_TARGETS];
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+	GLuint program;
+
+	GLint viewport[4];
+	GLint scissor[4];
+	GLenum blendSource;
+	GLenum blendDestination;
+	GLenum depthFunc;
+	GLboolean depthMask;
+	GLfloat clearColour[4];
+
+	// Only touched by the thread the context is current on.
+	uint64_t calls;
+	uint64_t filteredCalls;
+} CocoaGame_GLStateCache;
+
+//
+// Private functions
+//
+
+static void CocoaGame_ForgetGLState(CocoaGame_GLStateCache *cache);
+static CocoaGame_Bool CocoaGame_FilterGLCall(CocoaGame_GLStateCache *cache, CocoaGame_Bool unchanged);
+static void CocoaGame_SetGLCapability(GLenum cap, CocoaGame_Bool enabled);
+static int CocoaGame_GetGLTextureTargetIndex(GLenum target);
+static int CocoaGame_GetGLBufferTargetIndex(GLenum target);
+static CocoaGame_Bool CocoaGame_IsGLNameIn(GLuint name, GLsizei count, const GLuint *names);
+
+//
+// Private data
+//
+
+static pthread_mutex_t glStateMutex = PTHREAD_MUTEX_INITIALIZER;
+static CocoaGame_GLStateCache glStateCaches[COCOAGAME_GL_STATE_MAX_CONTEXTS];
+
+// Counts from caches which have been forgotten, so CocoaGame_GetGLStateStats() still includes them.
+static CocoaGame_GLStateStats glStateRetiredStats;
+
+// The cache of the context current on this thread, or NULL if its state isn't being cached.
+static __thread CocoaGame_GLStateCache *glStateCache;
+
+//
+// Context tracking
+//
+
+static void CocoaGame_ForgetGLState(CocoaGame_GLStateCache *cache)
+{
+	cache->known = 0;
+	cache->capabilityCount = 0;
+	cache->activeTexture = 0;
+
+	memset(cache->textures, 0xff, sizeof(cache->textures));
+	memset(cache->buffers, 0xff, sizeof(cache->buffers));
+	cache->drawFramebuffer = COCOAGAME_GL_STATE_UNKNOWN;
+	cache->readFramebuffer = COCOAGAME_GL_STATE_UNKNOWN;
+	cache->program = COCOAGAME_GL_STATE_UNKNOWN;
+}
+
+void CocoaGame_GLStateContextCurrent(void *context)
+{
+	if (! context) {
+		glStateCache = NULL;
+		return;
+	}
+
+	if (glStateCache && glStateCache->context == context)
+		return;
+
+	pthread_mutex_lock(&glStateMutex);
+
+	CocoaGame_GLStateCache *cache = NULL;
+	int i;
+	for (i = 0; i != COCOAGAME_GL_STATE_MAX_CONTEXTS; ++i) {
+		if (glStateCaches[i].context == context) {
+			cache = &glStateCaches[i];
+			break;
+		}
+
+		if (! cache && ! glStateCaches[i].context)
+			cache = &glStateCaches[i];
+	}
+
+	if (cache && cache->context != context) {
+		cache->context = context;
+		cache->calls = 0;
+		cache->filteredCalls = 0;
+		CocoaGame_ForgetGLState(cache);
+	}
+
+	pthread_mutex_unlock(&glStateMutex);
+
+	if (! cache)
+		CocoaGame_Trace("%s: too many contexts, state won't be cached.\n", __FUNCTION__);
+
+	glStateCache = cache;
+}
+
+void CocoaGame_GLStateContextDestroyed(void *context)
+{
+	pthread_mutex_lock(&glStateMutex);
+
+	int i;
+	for (i = 0; i != COCOAGAME_GL_STATE_MAX_CONTEXTS; ++i) {
+		CocoaGame_GLStateCache *cache = &glStateCaches[i];
+		if (cache->context != context)
+			continue;
+
+		glStateRetiredStats.calls += cache->calls;
+		glStateRetiredStats.filteredCalls += cache->filteredCalls;
+		cache->context = NULL;
+
+		if (glStateCache == cache)
+			glStateCache = NULL;
+	}
+
+	pthread_mutex_unlock(&glStateMutex);
+}
+
+void CocoaGame_InvalidateGLState(void)
+{
+	if (glStateCache)
+		CocoaGame_ForgetGLState(glStateCache);
+}
+
+void CocoaGame_InvalidateGLFramebufferState(void)
+{
+	if (glStateCache) {
+		glStateCache->drawFramebuffer = COCOAGAME_GL_STATE_UNKNOWN;
+		glStateCache->readFramebuffer = COCOAGAME_GL_STATE_UNKNOWN;
+	}
+}
+
+void CocoaGame_GetGLStateStats(CocoaGame_GLStateStats *stats)
+{
+	pthread_mutex_lock(&glStateMutex);
+
+	*stats = glStateRetiredStats;
+
+	int i;
+	for (i = 0; i != COCOAGAME_GL_STATE_MAX_CONTEXTS; ++i) {
+		if (glStateCaches[i].context) {
+			stats->calls += glStateCaches[i].calls;
+			stats->filteredCalls += glStateCaches[i].filteredCalls;
+		}
+	}
+
+	pthread_mutex_unlock(&glStateMutex);
+}
+
+void CocoaGame_ResetGLStateStats(void)
+{
+	pthread_mutex_lock(&glStateMutex);
+
+	memset(&glStateRetiredStats, 0, sizeof(glStateRetiredStats));
+
+	int i;
+	for (i = 0; i != COCOAGAME_GL_STATE_MAX_CONTEXTS; ++i) {
+		glStateCaches[i].calls = 0;
+		glStateCaches[i].filteredCalls = 0;
+	}
+
+	pthread_mutex_unlock(&glStateMutex);
+}
+
+//
+// Cached state
+//
+
+// Returns TRUE if the call should be skipped.
+static CocoaGame_Bool CocoaGame_FilterGLCall(CocoaGame_GLStateCache *cache, CocoaGame_Bool unchanged)
+{
+	cache->calls++;
+
+	if (unchanged)
+		cache->filteredCalls++;
+
+	return unchanged;
+}
+
+CocoaGame_Bool CocoaGame_IsGLCapabilityPerTextureUnit(GLenum cap)
+{
+	switch (cap) {
+		case GL_TEXTURE_1D:
+		case GL_TEXTURE_2D:
+		case GL_TEXTURE_3D:
+		case GL_TEXTURE_RECTANGLE_ARB:
+		case GL_TEXTURE_CUBE_MAP:
+		case GL_TEXTURE_GEN_S:
+		case GL_TEXTURE_GEN_T:
+		case GL_TEXTURE_GEN_R:
+		case GL_TEXTURE_GEN_Q:
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
+static void CocoaGame_SetGLCapability(GLenum cap, CocoaGame_Bool enabled)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+	GLenum unit = 0;
+
+	if (cache && CocoaGame_IsGLCapabilityPerTextureUnit(cap)) {
+		unit = cache->activeTexture;
+
+		// Without knowing which unit this applies to, it can't be cached.
+		if (! unit) {
+			CocoaGame_FilterGLCall(cache, FALSE);
+			cache = NULL;
+		}
+	}
+
+	if (cache) {
+		int i;
+		for (i = 0; i != cache->capabilityCount; ++i) {
+			if (cache->capabilities[i] == cap && cache->capabilityUnits[i] == unit)
+				break;
+		}
+
+		if (i != cache->capabilityCount) {
+			if (CocoaGame_FilterGLCall(cache, cache->capabilityEnabled[i] == enabled))
+				return;
+
+			cache->capabilityEnabled[i] = enabled;
+		} else {
+			CocoaGame_FilterGLCall(cache, FALSE);
+
+			if (cache->capabilityCount != COCOAGAME_GL_STATE_CAPABILITIES) {
+				cache->capabilities[cache->capabilityCount] = cap;
+				cache->capabilityUnits[cache->capabilityCount] = unit;
+				cache->capabilityEnabled[cache->capabilityCount] = enabled;
+				cache->capabilityCount++;
+			}
+		}
+	}
+
+	if (enabled)
+		glEnable(cap);
+	else
+		glDisable(cap);
+}
+
+void CocoaGame_GLEnable(GLenum cap)
+{
+	CocoaGame_SetGLCapability(cap, TRUE);
+}
+
+void CocoaGame_GLDisable(GLenum cap)
+{
+	CocoaGame_SetGLCapability(cap, FALSE);
+}
+
+void CocoaGame_GLActiveTexture(GLenum unit)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		if (CocoaGame_FilterGLCall(cache, cache->activeTexture == unit))
+			return;
+
+		cache->activeTexture = unit;
+	}
+
+	glActiveTexture(unit);
+}
+
+static int CocoaGame_GetGLTextureTargetIndex(GLenum target)
+{
+	switch (target) {
+		case GL_TEXTURE_2D:
+			return COCOAGAME_GL_STATE_TEXTURE_2D;
+
+		case GL_TEXTURE_RECTANGLE_ARB:
+			return COCOAGAME_GL_STATE_TEXTURE_RECTANGLE;
+
+		case GL_TEXTURE_CUBE_MAP:
+			return COCOAGAME_GL_STATE_TEXTURE_CUBE_MAP;
+
+		case GL_TEXTURE_3D:
+			return COCOAGAME_GL_STATE_TEXTURE_3D;
+
+		default:
+			return -1;
+	}
+}
+
+void CocoaGame_GLBindTexture(GLenum unit, GLenum target, GLuint texture)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+	int index = CocoaGame_GetGLTextureTargetIndex(target);
+	GLuint *binding = NULL;
+
+	if (cache && index >= 0 && unit >= GL_TEXTURE0 && unit < GL_TEXTURE0 + COCOAGAME_GL_STATE_TEXTURE_UNITS) {
+		binding = &cache->textures[unit - GL_TEXTURE0][index];
+
+		// Binding doesn't need the unit to be active if it's already bound.
+		if (CocoaGame_FilterGLCall(cache, *binding == texture))
+			return;
+	}
+
+	CocoaGame_GLActiveTexture(unit);
+	glBindTexture(target, texture);
+
+	if (binding)
+		*binding = texture;
+}
+
+static int CocoaGame_GetGLBufferTargetIndex(GLenum target)
+{
+	switch (target) {
+		case GL_ARRAY_BUFFER:
+			return COCOAGAME_GL_STATE_ARRAY_BUFFER;
+
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return COCOAGAME_GL_STATE_ELEMENT_ARRAY_BUFFER;
+
+		case GL_PIXEL_PACK_BUFFER:
+			return COCOAGAME_GL_STATE_PIXEL_PACK_BUFFER;
+
+		case GL_PIXEL_UNPACK_BUFFER:
+			return COCOAGAME_GL_STATE_PIXEL_UNPACK_BUFFER;
+
+		default:
+			return -1;
+	}
+}
+
+void CocoaGame_GLBindBuffer(GLenum target, GLuint buffer)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+	int index = CocoaGame_GetGLBufferTargetIndex(target);
+
+	if (cache && index >= 0) {
+		if (CocoaGame_FilterGLCall(cache, cache->buffers[index] == buffer))
+			return;
+
+		cache->buffers[index] = buffer;
+	}
+
+	glBindBuffer(target, buffer);
+}
+
+void CocoaGame_GLBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		CocoaGame_Bool unchanged;
+		if (target == GL_DRAW_FRAMEBUFFER_EXT)
+			unchanged = cache->drawFramebuffer == framebuffer;
+		else if (target == GL_READ_FRAMEBUFFER_EXT)
+			unchanged = cache->readFramebuffer == framebuffer;
+		else
+			unchanged = cache->drawFramebuffer == framebuffer && cache->readFramebuffer == framebuffer;
+
+		if (CocoaGame_FilterGLCall(cache, unchanged))
+			return;
+
+		if (target != GL_READ_FRAMEBUFFER_EXT)
+			cache->drawFramebuffer = framebuffer;
+
+		if (target != GL_DRAW_FRAMEBUFFER_EXT)
+			cache->readFramebuffer = framebuffer;
+	}
+
+	glBindFramebufferEXT(target, framebuffer);
+}
+
+void CocoaGame_GLUseProgram(GLuint program)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		if (CocoaGame_FilterGLCall(cache, cache->program == program))
+			return;
+
+		cache->program = program;
+	}
+
+	glUseProgram(program);
+}
+
+void CocoaGame_GLViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		CocoaGame_Bool unchanged = (cache->known & COCOAGAME_GL_STATE_KNOWN_VIEWPORT) && cache->viewport[0] == x &&
+			cache->viewport[1] == y && cache->viewport[2] == width && cache->viewport[3] == height;
+
+		if (CocoaGame_FilterGLCall(cache, unchanged))
+			return;
+
+		cache->viewport[0] = x;
+		cache->viewport[1] = y;
+		cache->viewport[2] = width;
+		cache->viewport[3] = height;
+		cache->known |= COCOAGAME_GL_STATE_KNOWN_VIEWPORT;
+	}
+
+	glViewport(x, y, width, height);
+}
+
+void CocoaGame_GLScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		CocoaGame_Bool unchanged = (cache->known & COCOAGAME_GL_STATE_KNOWN_SCISSOR) && cache->scissor[0] == x &&
+			cache->scissor[1] == y && cache->scissor[2] == width && cache->scissor[3] == height;
+
+		if (CocoaGame_FilterGLCall(cache, unchanged))
+			return;
+
+		cache->scissor[0] = x;
+		cache->scissor[1] = y;
+		cache->scissor[2] = width;
+		cache->scissor[3] = height;
+		cache->known |= COCOAGAME_GL_STATE_KNOWN_SCISSOR;
+	}
+
+	glScissor(x, y, width, height);
+}
+
+void CocoaGame_GLBlendFunc(GLenum source, GLenum destination)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		CocoaGame_Bool unchanged = (cache->known & COCOAGAME_GL_STATE_KNOWN_BLEND_FUNC) && cache->blendSource == source &&
+			cache->blendDestination == destination;
+
+		if (CocoaGame_FilterGLCall(cache, unchanged))
+			return;
+
+		cache->blendSource = source;
+		cache->blendDestination = destination;
+		cache->known |= COCOAGAME_GL_STATE_KNOWN_BLEND_FUNC;
+	}
+
+	glBlendFunc(source, destination);
+}
+
+void CocoaGame_GLDepthFunc(GLenum func)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		if (CocoaGame_FilterGLCall(cache, (cache->known & COCOAGAME_GL_STATE_KNOWN_DEPTH_FUNC) && cache->depthFunc == func))
+			return;
+
+		cache->depthFunc = func;
+		cache->known |= COCOAGAME_GL_STATE_KNOWN_DEPTH_FUNC;
+	}
+
+	glDepthFunc(func);
+}
+
+void CocoaGame_GLDepthMask(GLboolean flag)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+	flag = flag ? GL_TRUE : GL_FALSE;
+
+	if (cache) {
+		if (CocoaGame_FilterGLCall(cache, (cache->known & COCOAGAME_GL_STATE_KNOWN_DEPTH_MASK) && cache->depthMask == flag))
+			return;
+
+		cache->depthMask = flag;
+		cache->known |= COCOAGAME_GL_STATE_KNOWN_DEPTH_MASK;
+	}
+
+	glDepthMask(flag);
+}
+
+void CocoaGame_GLClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		CocoaGame_Bool unchanged = (cache->known & COCOAGAME_GL_STATE_KNOWN_CLEAR_COLOUR) && cache->clearColour[0] == red &&
+			cache->clearColour[1] == green && cache->clearColour[2] == blue && cache->clearColour[3] == alpha;
+
+		if (CocoaGame_FilterGLCall(cache, unchanged))
+			return;
+
+		cache->clearColour[0] = red;
+		cache->clearColour[1] = green;
+		cache->clearColour[2] = blue;
+		cache->clearColour[3] = alpha;
+		cache->known |= COCOAGAME_GL_STATE_KNOWN_CLEAR_COLOUR;
+	}
+
+	glClearColor(red, green, blue, alpha);
+}
+
+//
+// Deletion
+//
+
+// Deleting a bound object binds zero in its place.
+
+static CocoaGame_Bool CocoaGame_IsGLNameIn(GLuint name, GLsizei count, const GLuint *names)
+{
+	GLsizei i;
+	for (i = 0; i != count; ++i) {
+		if (names[i] == name && name)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+void CocoaGame_GLDeleteTextures(GLsizei count, const GLuint *textures)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		int unit, index;
+		for (unit = 0; unit != COCOAGAME_GL_STATE_TEXTURE_UNITS; ++unit) {
+			for (index = 0; index != COCOAGAME_GL_STATE_TEXTURE_TARGETS; ++index) {
+				if (CocoaGame_IsGLNameIn(cache->textures[unit][index], count, textures))
+					cache->textures[unit][index] = 0;
+			}
+		}
+	}
+
+	glDeleteTextures(count, textures);
+}
+
+void CocoaGame_GLDeleteBuffers(GLsizei count, const GLuint *buffers)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		int index;
+		for (index = 0; index != COCOAGAME_GL_STATE_BUFFER_TARGETS; ++index) {
+			if (CocoaGame_IsGLNameIn(cache->buffers[index], count, buffers))
+				cache->buffers[index] = 0;
+		}
+	}
+
+	glDeleteBuffers(count, buffers);
+}
+
+void CocoaGame_GLDeleteFramebuffers(GLsizei count, const GLuint *framebuffers)
+{
+	CocoaGame_GLStateCache *cache = glStateCache;
+
+	if (cache) {
+		if (CocoaGame_IsGLNameIn(cache->drawFramebuffer, count, framebuffers))
+			cache->drawFramebuffer = 0;
+
+		if (CocoaGame_IsGLNameIn(cache->readFramebuffer, count, framebuffers))
+			cache->readFramebuffer = 0;
+	}
+
+	glDeleteFramebuffersEXT(count, framebuffers);
+}
@@ -0,0 +1,866 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// OpenGL call tracing. When the library is built with COCOAGAME_GL_TRACE, this file defines its own versions of the
+// OpenGL entry points listed in COCOAGAME_GL_TRACE_FUNCTIONS. They take precedence over the system library's for
+// the whole program, and forward to the real functions (found with dlsym(RTLD_NEXT)) after counting the call.
+// Calls are counted between CocoaGame_BeginRender() and CocoaGame_EndRender(). The state each call sets is shadowed
+// per context, so a call that sets state to the value it already has can be flagged as redundant. The backends
+// report which context is current on each thread through CocoaGame_CoreContextCurrent().
+//
+
+#if COCOAGAME_GL_TRACE && ! defined(__APPLE__)
+	// For RTLD_NEXT.
+	#define _GNU_SOURCE
+#endif
+
+#include "CocoaGamePrivate.h"
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#if COCOAGAME_GL_TRACE
+	#include <dlfcn.h>
+#endif
+
+//
+// Compile-time options
+//
+
+// Set to 1 (the CMake option COCOAGAME_GL_TRACE does this) to intercept OpenGL calls. Otherwise
+// CocoaGame_SetGLTraceEnabled() fails and the OpenGL functions are called directly, at no cost.
+#ifndef COCOAGAME_GL_TRACE
+	#define COCOAGAME_GL_TRACE 0
+#endif
+
+// Contexts that can have their state shadowed at once.
+#define COCOAGAME_GL_TRACE_MAX_CONTEXTS 8
+
+// State values shadowed per context. Once full, further state isn't checked for redundancy.
+#define COCOAGAME_GL_TRACE_MAX_STATES 128
+
+//
+// Private types
+//
+
+#if COCOAGAME_GL_TRACE
+
+// The functions intercepted. State setting functions are checked for redundancy, the rest are only counted.
+#define COCOAGAME_GL_TRACE_FUNCTIONS(X) \
+	X(glEnable) \
+	X(glDisable) \
+	X(glViewport) \
+	X(glScissor) \
+	X(glClearColor) \
+	X(glBlendFunc) \
+	X(glDepthFunc) \
+	X(glDepthMask) \
+	X(glColorMask) \
+	X(glCullFace) \
+	X(glActiveTexture) \
+	X(glBindTexture) \
+	X(glBindBuffer) \
+	X(glBindFramebufferEXT) \
+	X(glUseProgram) \
+	X(glClear) \
+	X(glBegin) \
+	X(glDrawArrays) \
+	X(glDrawElements) \
+	X(glBlitFramebufferEXT) \
+	X(glTexImage2D) \
+	X(glTexSubImage2D) \
+	X(glBufferData) \
+	X(glBufferSubData) \
+	X(glReadPixels) \
+	X(glDeleteTextures) \
+	X(glDeleteBuffers) \
+	X(glDeleteFramebuffersEXT) \
+	X(glPopAttrib) \
+	X(glGetError) \
+	X(glGetIntegerv) \
+	X(glFlush) \
+	X(glFinish)
+
+#define COCOAGAME_GL_TRACE_ENUM(name) COCOAGAME_GL_TRACE_##name,
+
+typedef enum CocoaGame_GLTraceFunction {
+	COCOAGAME_GL_TRACE_FUNCTIONS(COCOAGAME_GL_TRACE_ENUM)
+
+	COCOAGAME_GL_TRACE_FUNCTION_COUNT
+} CocoaGame_GLTraceFunction;
+
+// The kinds of state shadowed. Each value is identified by its kind, a target (e.g., the capability or the binding
+// point) and a texture unit.
+typedef enum CocoaGame_GLTraceStateKind {
+	COCOAGAME_GL_TRACE_STATE_CAPABILITY,
+	COCOAGAME_GL_TRACE_STATE_VIEWPORT,
+	COCOAGAME_GL_TRACE_STATE_SCISSOR,
+	COCOAGAME_GL_TRACE_STATE_CLEAR_COLOUR,
+	COCOAGAME_GL_TRACE_STATE_BLEND_FUNC,
+	COCOAGAME_GL_TRACE_STATE_DEPTH_FUNC,
+	COCOAGAME_GL_TRACE_STATE_DEPTH_MASK,
+	COCOAGAME_GL_TRACE_STATE_COLOUR_MASK,
+	COCOAGAME_GL_TRACE_STATE_CULL_FACE,
+	COCOAGAME_GL_TRACE_STATE_ACTIVE_TEXTURE,
+	COCOAGAME_GL_TRACE_STATE_TEXTURE,
+	COCOAGAME_GL_TRACE_STATE_BUFFER,
+	COCOAGAME_GL_TRACE_STATE_FRAMEBUFFER,
+	COCOAGAME_GL_TRACE_STATE_PROGRAM
+} CocoaGame_GLTraceStateKind;
+
+typedef struct CocoaGame_GLTraceState {
+	CocoaGame_GLTraceStateKind kind;
+	GLenum target;
+	GLenum unit;
+	GLint value[4];
+} CocoaGame_GLTraceState;
+
+typedef struct CocoaGame_GLTraceShadow {
+	void *context;
+	int stateCount;
+	CocoaGame_GLTraceState states[COCOAGAME_GL_TRACE_MAX_STATES];
+} CocoaGame_GLTraceShadow;
+
+#endif // COCOAGAME_GL_TRACE
+
+//
+// Private functions
+//
+
+#if COCOAGAME_GL_TRACE
+static void *CocoaGame_GetRealGLFunction(CocoaGame_GLTraceFunction function);
+static CocoaGame_Bool CocoaGame_CountGLCall(CocoaGame_GLTraceFunction function);
+static CocoaGame_GLTraceState *CocoaGame_FindGLTraceState(CocoaGame_GLTraceStateKind kind, GLenum target, GLenum unit);
+static CocoaGame_Bool CocoaGame_SetGLTraceState(CocoaGame_GLTraceStateKind kind, GLenum target, GLenum unit, GLint v0, GLint v1, GLint v2, GLint v3);
+static CocoaGame_Bool CocoaGame_SetGLTraceCapability(GLenum cap, CocoaGame_Bool enabled);
+static void CocoaGame_CheckGLTraceState(CocoaGame_GLTraceFunction function, CocoaGame_Bool redundant);
+static void CocoaGame_ForgetGLTraceObjects(CocoaGame_GLTraceStateKind kind, GLsizei count, const GLuint *names);
+static GLint CocoaGame_GLFloatBits(GLfloat value);
+static size_t CocoaGame_GetGLImageSize(GLsizei width, GLsizei height, GLenum format, GLenum type);
+#endif
+
+//
+// Private data
+//
+
+static CocoaGame_Bool glTraceEnabled;
+
+#if COCOAGAME_GL_TRACE
+
+#define COCOAGAME_GL_TRACE_NAME(name) #name,
+
+static const char *const glTraceFunctionNames[COCOAGAME_GL_TRACE_FUNCTION_COUNT] = {
+	COCOAGAME_GL_TRACE_FUNCTIONS(COCOAGAME_GL_TRACE_NAME)
+};
+
+static void *glTraceRealFunctions[COCOAGAME_GL_TRACE_FUNCTION_COUNT];
+
+// Set between CocoaGame_BeginRender() and CocoaGame_EndRender() while tracing.
+static CocoaGame_Bool glTraceCounting;
+
+// This frame's counts, updated by any thread, and the last frame's.
+static uint64_t glTraceCalls[COCOAGAME_GL_TRACE_FUNCTION_COUNT];
+static uint64_t glTraceRedundant[COCOAGAME_GL_TRACE_FUNCTION_COUNT];
+static uint64_t glTraceTextureBytes;
+static uint64_t glTraceBufferBytes;
+
+static uint64_t glTraceLastCalls[COCOAGAME_GL_TRACE_FUNCTION_COUNT];
+static uint64_t glTraceLastRedundant[COCOAGAME_GL_TRACE_FUNCTION_COUNT];
+static CocoaGame_GLTraceFrameStats glTraceLastFrame;
+
+static pthread_mutex_t glTraceShadowMutex = PTHREAD_MUTEX_INITIALIZER;
+static CocoaGame_GLTraceShadow glTraceShadows[COCOAGAME_GL_TRACE_MAX_CONTEXTS];
+
+// The shadow of the context current on this thread, or NULL if it isn't being shadowed.
+static __thread CocoaGame_GLTraceShadow *glTraceShadow;
+
+#endif // COCOAGAME_GL_TRACE
+
+//
+// Tracing
+//
+
+CocoaGame_Bool CocoaGame_SetGLTraceEnabled(CocoaGame_Bool enabled)
+{
+	#if COCOAGAME_GL_TRACE
+		if (enabled == glTraceEnabled)
+			return TRUE;
+
+		glTraceEnabled = enabled;
+
+		if (! enabled)
+			__atomic_store_n(&glTraceCounting, FALSE, __ATOMIC_RELAXED);
+
+		// Shadowed state may have gone stale while tracing was disabled. Each thread picks up its shadow again the
+		// next time a context is made current on it.
+		pthread_mutex_lock(&glTraceShadowMutex);
+		memset(glTraceShadows, 0, sizeof(glTraceShadows));
+		pthread_mutex_unlock(&glTraceShadowMutex);
+		glTraceShadow = NULL;
+
+		CocoaGame_ResetGLTrace();
+		return TRUE;
+	#else
+		if (enabled)
+			CocoaGame_Trace("%s: CocoaGame was built without COCOAGAME_GL_TRACE.\n", __FUNCTION__);
+
+		return ! enabled;
+	#endif
+}
+
+CocoaGame_Bool CocoaGame_IsGLTraceEnabled(void)
+{
+	return glTraceEnabled;
+}
+
+void CocoaGame_ResetGLTrace(void)
+{
+	#if COCOAGAME_GL_TRACE
+		int i;
+		for (i = 0; i != COCOAGAME_GL_TRACE_FUNCTION_COUNT; ++i) {
+			__atomic_store_n(&glTraceCalls[i], 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&glTraceRedundant[i], 0, __ATOMIC_RELAXED);
+		}
+
+		__atomic_store_n(&glTraceTextureBytes, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&glTraceBufferBytes, 0, __ATOMIC_RELAXED);
+
+		memset(glTraceLastCalls, 0, sizeof(glTraceLastCalls));
+		memset(glTraceLastRedundant, 0, sizeof(glTraceLastRedundant));
+		memset(&glTraceLastFrame, 0, sizeof(glTraceLastFrame));
+	#endif
+}
+
+void CocoaGame_GLTraceBeginFrame(void)
+{
+	#if COCOAGAME_GL_TRACE
+		if (! glTraceEnabled)
+			return;
+
+		// Calls made between frames aren't counted, but they still update the shadowed state.
+		int i;
+		for (i = 0; i != COCOAGAME_GL_TRACE_FUNCTION_COUNT; ++i) {
+			__atomic_store_n(&glTraceCalls[i], 0, __ATOMIC_RELAXED);
+			__atomic_store_n(&glTraceRedundant[i], 0, __ATOMIC_RELAXED);
+		}
+
+		__atomic_store_n(&glTraceTextureBytes, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&glTraceBufferBytes, 0, __ATOMIC_RELAXED);
+
+		__atomic_store_n(&glTraceCounting, TRUE, __ATOMIC_RELAXED);
+	#endif
+}
+
+void CocoaGame_GLTraceEndRender(void)
+{
+	#if COCOAGAME_GL_TRACE
+		if (! __atomic_load_n(&glTraceCounting, __ATOMIC_RELAXED))
+			return;
+
+		__atomic_store_n(&glTraceCounting, FALSE, __ATOMIC_RELAXED);
+
+		CocoaGame_GLTraceFrameStats *frame = &glTraceLastFrame;
+		uint64_t frames = frame->frames;
+		memset(frame, 0, sizeof(*frame));
+		frame->frames = frames + 1;
+
+		int i;
+		for (i = 0; i != COCOAGAME_GL_TRACE_FUNCTION_COUNT; ++i) {
+			glTraceLastCalls[i] = __atomic_load_n(&glTraceCalls[i], __ATOMIC_RELAXED);
+			glTraceLastRedundant[i] = __atomic_load_n(&glTraceRedundant[i], __ATOMIC_RELAXED);
+
+			frame->calls += glTraceLastCalls[i];
+			frame->redundantCalls += glTraceLastRedundant[i];
+		}
+
+		frame->drawCalls = glTraceLastCalls[COCOAGAME_GL_TRACE_glBegin] + glTraceLastCalls[COCOAGAME_GL_TRACE_glDrawArrays] +
+			glTraceLastCalls[COCOAGAME_GL_TRACE_glDrawElements];
+		frame->textureUploadBytes = __atomic_load_n(&glTraceTextureBytes, __ATOMIC_RELAXED);
+		frame->bufferUploadBytes = __atomic_load_n(&glTraceBufferBytes, __ATOMIC_RELAXED);
+	#endif
+}
+
+void CocoaGame_GetGLTraceFrameStats(CocoaGame_GLTraceFrameStats *stats)
+{
+	#if COCOAGAME_GL_TRACE
+		*stats = glTraceLastFrame;
+	#else
+		memset(stats, 0, sizeof(*stats));
+	#endif
+}
+
+int CocoaGame_GetGLTraceFunctionCount(void)
+{
+	#if COCOAGAME_GL_TRACE
+		return COCOAGAME_GL_TRACE_FUNCTION_COUNT;
+	#else
+		return 0;
+	#endif
+}
+
+void CocoaGame_GetGLTraceFunctionStats(int index, CocoaGame_GLTraceFunctionStats *stats)
+{
+	#if COCOAGAME_GL_TRACE
+		assert(index >= 0 && index < COCOAGAME_GL_TRACE_FUNCTION_COUNT);
+
+		stats->name = glTraceFunctionNames[index];
+		stats->calls = glTraceLastCalls[index];
+		stats->redundantCalls = glTraceLastRedundant[index];
+	#else
+		(void) index;
+		memset(stats, 0, sizeof(*stats));
+	#endif
+}
+
+void CocoaGame_DumpGLTrace(void)
+{
+	#if COCOAGAME_GL_TRACE
+		const CocoaGame_GLTraceFrameStats *frame = &glTraceLastFrame;
+
+		CocoaGame_Trace("%s: frame %llu: %llu calls, %llu redundant, %llu draws, %llu texture bytes, %llu buffer bytes.\n",
+			__FUNCTION__, (unsigned long long) frame->frames, (unsigned long long) frame->calls,
+			(unsigned long long) frame->redundantCalls, (unsigned long long) frame->drawCalls,
+			(unsigned long long) frame->textureUploadBytes, (unsigned long long) frame->bufferUploadBytes);
+
+		int i;
+		for (i = 0; i != COCOAGAME_GL_TRACE_FUNCTION_COUNT; ++i) {
+			if (! glTraceLastCalls[i])
+				continue;
+
+			if (glTraceLastRedundant[i])
+				CocoaGame_Trace("%s:     %s %llu (%llu redundant)\n", __FUNCTION__, glTraceFunctionNames[i], (unsigned long long) glTraceLastCalls[i], (unsigned long long) glTraceLastRedundant[i]);
+			else
+				CocoaGame_Trace("%s:     %s %llu\n", __FUNCTION__, glTraceFunctionNames[i], (unsigned long long) glTraceLastCalls[i]);
+		}
+	#endif
+}
+
+//
+// Context tracking
+//
+
+void CocoaGame_GLTraceContextCurrent(void *context)
+{
+	#if COCOAGAME_GL_TRACE
+		if (! glTraceEnabled || ! context) {
+			glTraceShadow = NULL;
+			return;
+		}
+
+		if (glTraceShadow && glTraceShadow->context == context)
+			return;
+
+		pthread_mutex_lock(&glTraceShadowMutex);
+
+		CocoaGame_GLTraceShadow *shadow = NULL;
+		int i;
+		for (i = 0; i != COCOAGAME_GL_TRACE_MAX_CONTEXTS; ++i) {
+			if (glTraceShadows[i].context == context) {
+				shadow = &glTraceShadows[i];
+				break;
+			}
+
+			if (! shadow && ! glTraceShadows[i].context)
+				shadow = &glTraceShadows[i];
+		}
+
+		// A context seen for the first time starts with nothing known about its state.
+		if (shadow && shadow->context != context) {
+			shadow->context = context;
+			shadow->stateCount = 0;
+		}
+
+		pthread_mutex_unlock(&glTraceShadowMutex);
+
+		glTraceShadow = shadow;
+	#else
+		(void) context;
+	#endif
+}
+
+void CocoaGame_GLTraceContextDestroyed(void *context)
+{
+	#if COCOAGAME_GL_TRACE
+		pthread_mutex_lock(&glTraceShadowMutex);
+
+		int i;
+		for (i = 0; i != COCOAGAME_GL_TRACE_MAX_CONTEXTS; ++i) {
+			if (glTraceShadows[i].context == context) {
+				glTraceShadows[i].context = NULL;
+				glTraceShadows[i].stateCount = 0;
+			}
+		}
+
+		pthread_mutex_unlock(&glTraceShadowMutex);
+
+		if (glTraceShadow && ! glTraceShadow->context)
+			glTraceShadow = NULL;
+	#else
+		(void) context;
+	#endif
+}
+
+#if COCOAGAME_GL_TRACE
+
+//
+// Interception
+//
+
+static void *CocoaGame_GetRealGLFunction(CocoaGame_GLTraceFunction function)
+{
+	void *real = __atomic_load_n(&glTraceRealFunctions[function], __ATOMIC_RELAXED);
+
+	if (! real) {
+		real = dlsym(RTLD_NEXT, glTraceFunctionNames[function]);
+		if (! real)
+			CocoaGame_AbortWithMessage("OpenGL tracing", "%s is not available.", glTraceFunctionNames[function]);
+
+		__atomic_store_n(&glTraceRealFunctions[function], real, __ATOMIC_RELAXED);
+	}
+
+	return real;
+}
+
+#define COCOAGAME_REAL_GL(name) ((__typeof__(&name)) CocoaGame_GetRealGLFunction(COCOAGAME_GL_TRACE_##name))
+
+// Returns TRUE if the call was counted, i.e., a frame is being traced.
+static CocoaGame_Bool CocoaGame_CountGLCall(CocoaGame_GLTraceFunction function)
+{
+	if (! __atomic_load_n(&glTraceCounting, __ATOMIC_RELAXED))
+		return FALSE;
+
+	__atomic_fetch_add(&glTraceCalls[function], 1, __ATOMIC_RELAXED);
+	return TRUE;
+}
+
+static CocoaGame_GLTraceState *CocoaGame_FindGLTraceState(CocoaGame_GLTraceStateKind kind, GLenum target, GLenum unit)
+{
+	CocoaGame_GLTraceShadow *shadow = glTraceShadow;
+	if (! shadow)
+		return NULL;
+
+	int i;
+	for (i = 0; i != shadow->stateCount; ++i) {
+		CocoaGame_GLTraceState *state = &shadow->states[i];
+		if (state->kind == kind && state->target == target && state->unit == unit)
+			return state;
+	}
+
+	return NULL;
+}
+
+// Record a state value in the current context's shadow. Returns TRUE if it already had that value.
+static CocoaGame_Bool CocoaGame_SetGLTraceState(CocoaGame_GLTraceStateKind kind, GLenum target, GLenum unit, GLint v0, GLint v1, GLint v2, GLint v3)
+{
+	CocoaGame_GLTraceShadow *shadow = glTraceShadow;
+	if (! shadow)
+		return FALSE;
+
+	CocoaGame_GLTraceState *state = CocoaGame_FindGLTraceState(kind, target, unit);
+
+	if (state) {
+		if (state->value[0] == v0 && state->value[1] == v1 && state->value[2] == v2 && state->value[3] == v3)
+			return TRUE;
+	} else {
+		if (shadow->stateCount == COCOAGAME_GL_TRACE_MAX_STATES)
+			return FALSE;
+
+		state = &shadow->states[shadow->stateCount++];
+		state->kind = kind;
+		state->target = target;
+		state->unit = unit;
+	}
+
+	state->value[0] = v0;
+	state->value[1] = v1;
+	state->value[2] = v2;
+	state->value[3] = v3;
+	return FALSE;
+}
+
+// Texture enables are per texture unit, like texture bindings, so they're only shadowed once the active unit is known.
+static CocoaGame_Bool CocoaGame_SetGLTraceCapability(GLenum cap, CocoaGame_Bool enabled)
+{
+	GLenum unit = 0;
+
+	if (CocoaGame_IsGLCapabilityPerTextureUnit(cap)) {
+		CocoaGame_GLTraceState *activeTexture = CocoaGame_FindGLTraceState(COCOAGAME_GL_TRACE_STATE_ACTIVE_TEXTURE, 0, 0);
+		if (! activeTexture)
+			return FALSE;
+
+		unit = (GLenum) activeTexture->value[0];
+	}
+
+	return CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_CAPABILITY, cap, unit, enabled, 0, 0, 0);
+}
+
+static void CocoaGame_CheckGLTraceState(CocoaGame_GLTraceFunction function, CocoaGame_Bool redundant)
+{
+	if (redundant && __atomic_load_n(&glTraceCounting, __ATOMIC_RELAXED))
+		__atomic_fetch_add(&glTraceRedundant[function], 1, __ATOMIC_RELAXED);
+}
+
+// Deleting a bound object resets the binding to zero, so forget any binding of the deleted names.
+static void CocoaGame_ForgetGLTraceObjects(CocoaGame_GLTraceStateKind kind, GLsizei count, const GLuint *names)
+{
+	CocoaGame_GLTraceShadow *shadow = glTraceShadow;
+	if (! shadow || ! names)
+		return;
+
+	int i = 0;
+	while (i != shadow->stateCount) {
+		CocoaGame_GLTraceState *state = &shadow->states[i];
+		CocoaGame_Bool deleted = FALSE;
+
+		if (state->kind == kind) {
+			GLsizei j;
+			for (j = 0; j != count; ++j) {
+				if ((GLint) names[j] == state->value[0]) {
+					deleted = TRUE;
+					break;
+				}
+			}
+		}
+
+		if (deleted)
+			*state = shadow->states[--shadow->stateCount];
+		else
+			++i;
+	}
+}
+
+static GLint CocoaGame_GLFloatBits(GLfloat value)
+{
+	GLint bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+// An estimate: unpack alignment and row length are ignored.
+static size_t CocoaGame_GetGLImageSize(GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+	size_t components;
+	switch (format) {
+		case GL_RED:
+		case GL_GREEN:
+		case GL_BLUE:
+		case GL_ALPHA:
+		case GL_LUMINANCE:
+		case GL_DEPTH_COMPONENT:
+		case GL_STENCIL_INDEX:
+			components = 1;
+			break;
+
+		case GL_LUMINANCE_ALPHA:
+		case GL_RG:
+		case GL_DEPTH_STENCIL_EXT:
+			components = 2;
+			break;
+
+		case GL_RGB:
+		case GL_BGR:
+			components = 3;
+			break;
+
+		default:
+			components = 4;
+			break;
+	}
+
+	size_t pixelSize;
+	switch (type) {
+		case GL_UNSIGNED_BYTE:
+		case GL_BYTE:
+			pixelSize = components;
+			break;
+
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT_ARB:
+			pixelSize = components * 2;
+			break;
+
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_5_6_5_REV:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+		case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+			pixelSize = 2;
+			break;
+
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_10_10_10_2:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+		case GL_UNSIGNED_INT_24_8_EXT:
+			pixelSize = 4;
+			break;
+
+		default:
+			pixelSize = components * 4;
+			break;
+	}
+
+	return (size_t) width * (size_t) height * pixelSize;
+}
+
+//
+// Intercepted functions
+//
+
+void glEnable(GLenum cap)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glEnable);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glEnable, CocoaGame_SetGLTraceCapability(cap, TRUE));
+	COCOAGAME_REAL_GL(glEnable)(cap);
+}
+
+void glDisable(GLenum cap)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDisable);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glDisable, CocoaGame_SetGLTraceCapability(cap, FALSE));
+	COCOAGAME_REAL_GL(glDisable)(cap);
+}
+
+void glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glViewport);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glViewport, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_VIEWPORT, 0, 0, x, y, width, height));
+	COCOAGAME_REAL_GL(glViewport)(x, y, width, height);
+}
+
+void glScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glScissor);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glScissor, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_SCISSOR, 0, 0, x, y, width, height));
+	COCOAGAME_REAL_GL(glScissor)(x, y, width, height);
+}
+
+void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glClearColor);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glClearColor, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_CLEAR_COLOUR, 0, 0,
+		CocoaGame_GLFloatBits(red), CocoaGame_GLFloatBits(green), CocoaGame_GLFloatBits(blue), CocoaGame_GLFloatBits(alpha)));
+	COCOAGAME_REAL_GL(glClearColor)(red, green, blue, alpha);
+}
+
+void glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBlendFunc);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glBlendFunc, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_BLEND_FUNC, 0, 0, (GLint) sfactor, (GLint) dfactor, 0, 0));
+	COCOAGAME_REAL_GL(glBlendFunc)(sfactor, dfactor);
+}
+
+void glDepthFunc(GLenum func)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDepthFunc);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glDepthFunc, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_DEPTH_FUNC, 0, 0, (GLint) func, 0, 0, 0));
+	COCOAGAME_REAL_GL(glDepthFunc)(func);
+}
+
+void glDepthMask(GLboolean flag)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDepthMask);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glDepthMask, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_DEPTH_MASK, 0, 0, flag != GL_FALSE, 0, 0, 0));
+	COCOAGAME_REAL_GL(glDepthMask)(flag);
+}
+
+void glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glColorMask);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glColorMask, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_COLOUR_MASK, 0, 0, red != GL_FALSE, green != GL_FALSE, blue != GL_FALSE, alpha != GL_FALSE));
+	COCOAGAME_REAL_GL(glColorMask)(red, green, blue, alpha);
+}
+
+void glCullFace(GLenum mode)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glCullFace);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glCullFace, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_CULL_FACE, 0, 0, (GLint) mode, 0, 0, 0));
+	COCOAGAME_REAL_GL(glCullFace)(mode);
+}
+
+void glActiveTexture(GLenum texture)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glActiveTexture);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glActiveTexture, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_ACTIVE_TEXTURE, 0, 0, (GLint) texture, 0, 0, 0));
+	COCOAGAME_REAL_GL(glActiveTexture)(texture);
+}
+
+void glBindTexture(GLenum target, GLuint texture)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBindTexture);
+
+	// Bindings are per texture unit, so nothing can be said until the active unit is known.
+	CocoaGame_GLTraceState *unit = CocoaGame_FindGLTraceState(COCOAGAME_GL_TRACE_STATE_ACTIVE_TEXTURE, 0, 0);
+	if (unit)
+		CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glBindTexture, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_TEXTURE, target, (GLenum) unit->value[0], (GLint) texture, 0, 0, 0));
+
+	COCOAGAME_REAL_GL(glBindTexture)(target, texture);
+}
+
+void glBindBuffer(GLenum target, GLuint buffer)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBindBuffer);
+
+	// The element array binding belongs to the vertex array object, which isn't tracked.
+	if (target != GL_ELEMENT_ARRAY_BUFFER)
+		CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glBindBuffer, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_BUFFER, target, 0, (GLint) buffer, 0, 0, 0));
+
+	COCOAGAME_REAL_GL(glBindBuffer)(target, buffer);
+}
+
+void glBindFramebufferEXT(GLenum target, GLuint framebuffer)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBindFramebufferEXT);
+
+	CocoaGame_Bool redundant;
+	if (target == GL_FRAMEBUFFER_EXT) {
+		// Binds both the draw and read framebuffers.
+		CocoaGame_Bool draw = CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER_EXT, 0, (GLint) framebuffer, 0, 0, 0);
+		CocoaGame_Bool read = CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_FRAMEBUFFER, GL_READ_FRAMEBUFFER_EXT, 0, (GLint) framebuffer, 0, 0, 0);
+		redundant = draw && read;
+	} else
+		redundant = CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_FRAMEBUFFER, target, 0, (GLint) framebuffer, 0, 0, 0);
+
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glBindFramebufferEXT, redundant);
+	COCOAGAME_REAL_GL(glBindFramebufferEXT)(target, framebuffer);
+}
+
+void glUseProgram(GLuint program)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glUseProgram);
+	CocoaGame_CheckGLTraceState(COCOAGAME_GL_TRACE_glUseProgram, CocoaGame_SetGLTraceState(COCOAGAME_GL_TRACE_STATE_PROGRAM, 0, 0, (GLint) program, 0, 0, 0));
+	COCOAGAME_REAL_GL(glUseProgram)(program);
+}
+
+void glClear(GLbitfield mask)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glClear);
+	COCOAGAME_REAL_GL(glClear)(mask);
+}
+
+void glBegin(GLenum mode)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBegin);
+	COCOAGAME_REAL_GL(glBegin)(mode);
+}
+
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDrawArrays);
+	COCOAGAME_REAL_GL(glDrawArrays)(mode, first, count);
+}
+
+void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDrawElements);
+	COCOAGAME_REAL_GL(glDrawElements)(mode, count, type, indices);
+}
+
+void glBlitFramebufferEXT(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBlitFramebufferEXT);
+	COCOAGAME_REAL_GL(glBlitFramebufferEXT)(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+}
+
+void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	if (CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glTexImage2D)) {
+		// With a pixel unpack buffer bound, pixels is an offset in to it.
+		CocoaGame_GLTraceState *unpack = CocoaGame_FindGLTraceState(COCOAGAME_GL_TRACE_STATE_BUFFER, GL_PIXEL_UNPACK_BUFFER, 0);
+		if (pixels || (unpack && unpack->value[0]))
+			__atomic_fetch_add(&glTraceTextureBytes, CocoaGame_GetGLImageSize(width, height, format, type), __ATOMIC_RELAXED);
+	}
+
+	COCOAGAME_REAL_GL(glTexImage2D)(target, level, internalFormat, width, height, border, format, type, pixels);
+}
+
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	if (CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glTexSubImage2D))
+		__atomic_fetch_add(&glTraceTextureBytes, CocoaGame_GetGLImageSize(width, height, format, type), __ATOMIC_RELAXED);
+
+	COCOAGAME_REAL_GL(glTexSubImage2D)(target, level, xoffset, yoffset, width, height, format, type, pixels);
+}
+
+void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+{
+	if (CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBufferData) && data)
+		__atomic_fetch_add(&glTraceBufferBytes, (uint64_t) size, __ATOMIC_RELAXED);
+
+	COCOAGAME_REAL_GL(glBufferData)(target, size, data, usage);
+}
+
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data)
+{
+	if (CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glBufferSubData))
+		__atomic_fetch_add(&glTraceBufferBytes, (uint64_t) size, __ATOMIC_RELAXED);
+
+	COCOAGAME_REAL_GL(glBufferSubData)(target, offset, size, data);
+}
+
+void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *pixels)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glReadPixels);
+	COCOAGAME_REAL_GL(glReadPixels)(x, y, width, height, format, type, pixels);
+}
+
+void glDeleteTextures(GLsizei n, const GLuint *textures)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDeleteTextures);
+	CocoaGame_ForgetGLTraceObjects(COCOAGAME_GL_TRACE_STATE_TEXTURE, n, textures);
+	COCOAGAME_REAL_GL(glDeleteTextures)(n, textures);
+}
+
+void glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDeleteBuffers);
+	CocoaGame_ForgetGLTraceObjects(COCOAGAME_GL_TRACE_STATE_BUFFER, n, buffers);
+	COCOAGAME_REAL_GL(glDeleteBuffers)(n, buffers);
+}
+
+void glDeleteFramebuffersEXT(GLsizei n, const GLuint *framebuffers)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glDeleteFramebuffersEXT);
+	CocoaGame_ForgetGLTraceObjects(COCOAGAME_GL_TRACE_STATE_FRAMEBUFFER, n, framebuffers);
+	COCOAGAME_REAL_GL(glDeleteFramebuffersEXT)(n, framebuffers);
+}
+
+void glPopAttrib(void)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glPopAttrib);
+
+	// Restores much of the shadowed state to values that weren't seen being set.
+	if (glTraceShadow)
+		glTraceShadow->stateCount = 0;
+
+	COCOAGAME_REAL_GL(glPopAttrib)();
+}
+
+GLenum glGetError(void)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glGetError);
+	return COCOAGAME_REAL_GL(glGetError)();
+}
+
+void glGetIntegerv(GLenum pname, GLint *params)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glGetIntegerv);
+	COCOAGAME_REAL_GL(glGetIntegerv)(pname, params);
+}
+
+void glFlush(void)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glFlush);
+	COCOAGAME_REAL_GL(glFlush)();
+}
+
+void glFinish(void)
+{
+	CocoaGame_CountGLCall(COCOAGAME_GL_TRACE_glFinish);
+	COCOAGAME_REAL_GL(glFinish)();
+}
+
+#endif // COCOAGAME_GL_TRACE
@@ -0,0 +1,1182 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Headless backend for Linux. Implements the CocoaGame API on top of a surfaceless EGL display (e.g., Mesa's
+// llvmpipe), so the frame loop, input and render target code can be run on machines without a GPU or a display
+// server. There's no window: the "screen" is an EGL pbuffer the size of the current video mode, the mode list is a
+// fixed virtual list and input arrives through CocoaGame_ProcessEvent() or CocoaGame_QueueEvent().
+//
+// The startup video mode defaults to 1920x1080x32 and can be changed with the COCOAGAME_HEADLESS_MODE environment
+// variable (in any format accepted by CocoaGame_ParseVideoMode()).
+//
+
+#include "CocoaGamePrivate.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+//
+// Private functions
+//
+
+static CocoaGame_Bool CocoaGame_OpenDisplay(void);
+static void CocoaGame_CloseDisplay(void);
+
+static void CocoaGame_ShutdownVideo(void);
+static CocoaGame_Bool CocoaGame_FindVideoMode(const CocoaGame_VideoMode *wanted, CocoaGame_Bool acceptClosestMode, CocoaGame_VideoMode *found);
+
+static EGLConfig CocoaGame_ChooseEGLConfig(const CocoaGame_GLConfig *config, int msaa);
+static CocoaGame_Bool CocoaGame_CreateOpenGLContext(const CocoaGame_GLConfig *config, CocoaGame_GLConfig *actualConfig);
+static CocoaGame_Bool CocoaGame_TryCreateOpenGLContext(const CocoaGame_GLConfig *config, int msaa, CocoaGame_GLConfig *actualConfig);
+static void CocoaGame_ReadGLConfig(EGLConfig eglConfig, CocoaGame_GLConfig *config);
+static CocoaGame_Bool CocoaGame_UpdateOpenGLContext(void);
+static CocoaGame_Bool CocoaGame_ProcessHeadlessEvent(const CocoaGame_Event *event);
+static void CocoaGame_InitIdleCond(void);
+
+static void CocoaGame_UpdateModifiers(unsigned int newModifiers);
+
+// Returns TRUE if the key should not be passed to the application.
+static CocoaGame_Bool CocoaGame_CheckForSpecialKeys(const CocoaGame_Event *event);
+
+//
+// Private data
+//
+
+// Used if COCOAGAME_HEADLESS_MODE isn't set.
+static const CocoaGame_VideoMode defaultStartupMode = { 1920, 1080, 32 };
+
+// The virtual display's mode list. The startup mode is always added to it.
+static const CocoaGame_VideoMode virtualModes[] = {
+	{ 3840, 2160, 32 },
+	{ 2560, 1600, 32 },
+	{ 2560, 1440, 32 },
+	{ 1920, 1200, 32 },
+	{ 1920, 1080, 32 },
+	{ 1680, 1050, 32 },
+	{ 1600, 900, 32 },
+	{ 1440, 900, 32 },
+	{ 1280, 800, 32 },
+	{ 1280, 720, 32 },
+	{ 1024, 768, 32 },
+	{ 800, 600, 32 },
+	{ 640, 480, 32 },
+};
+
+static CocoaGame_Bool isInitialised = FALSE;
+
+static CocoaGame_VideoMode startupMode;
+static CocoaGame_VideoMode displayMode;
+
+static CocoaGame_Bool enableAltEsc = TRUE;
+static CocoaGame_Bool shouldQuit;
+static unsigned int modifiers;
+
+static int mouseX, mouseY;
+
+static CocoaGame_VideoConfig videoConfig = {
+	.disposition = COCOAGAME_VIDEO_NONE,
+	.mode = {
+		.width = 0,
+		.height = 0,
+		.bits = 0
+	},
+	.title = NULL,
+	.acceptClosestMode = FALSE,
+	.captureDisplay = FALSE,
+	.enableWindowResizing = FALSE
+};
+
+static int windowWidth, windowHeight;
+
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLConfig eglConfig;
+static EGLContext openGLContext = EGL_NO_CONTEXT;
+static EGLSurface openGLSurface = EGL_NO_SURFACE;
+static CocoaGame_Bool openGLUpdateRequired;
+
+// Held by the render thread for each frame.
+static pthread_mutex_t contextMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// CocoaGame_BlockUntilWoken() waits on idleCond, which times out against the monotonic clock, until idleSignalled
+// is set.
+static pthread_once_t idleOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t idleMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idleCond;
+static CocoaGame_Bool idleSignalled;
+
+static CocoaGame_GLConfig glConfig;
+
+static CocoaGame_Bool wantKeyRepeats = TRUE;
+
+static CocoaGame_Bool wantMouseDeltaMode = FALSE;
+static CocoaGame_Bool wantMouseCursorVisible = TRUE;
+
+static void (*drawCallback)(void *);
+static void *drawCallbackContext;
+
+static CocoaGame_Bool discardedRender = FALSE;
+
+//
+// Implementation
+//
+
+void CocoaGame_DefaultAbortWithMessageHandler(const char *title, const char *format, va_list argptr)
+{
+	char buf[1024];
+	vsnprintf(buf, sizeof(buf), format, argptr);
+	buf[sizeof(buf) - 1] = 0;
+
+	CocoaGame_Shutdown();
+	fprintf(stderr, "%s: %s\n", title, buf);
+
+	exit(1);
+}
+
+void CocoaGame_CreateAutoreleasePool(void **pool)
+{
+	// There's nothing to autorelease without Cocoa.
+	*pool = NULL;
+}
+
+void CocoaGame_FreeAutoreleasePool(void *pool)
+{
+	(void) pool;
+}
+
+void CocoaGame_SetAltEscEnabled(CocoaGame_Bool newEnableAltEsc)
+{
+	enableAltEsc = newEnableAltEsc;
+}
+
+static CocoaGame_Bool CocoaGame_OpenDisplay(void)
+{
+	if (eglDisplay != EGL_NO_DISPLAY)
+		return TRUE;
+
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+	if (getPlatformDisplay)
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+	if (eglDisplay == EGL_NO_DISPLAY)
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || ! eglInitialize(eglDisplay, &major, &minor)) {
+		CocoaGame_Trace("%s: unable to initialise EGL (error 0x%04x).\n", __FUNCTION__, (unsigned int) eglGetError());
+		eglDisplay = EGL_NO_DISPLAY;
+		return FALSE;
+	}
+
+	if (! eglBindAPI(EGL_OPENGL_API)) {
+		CocoaGame_Trace("%s: EGL display doesn't support desktop OpenGL.\n", __FUNCTION__);
+		CocoaGame_CloseDisplay();
+		return FALSE;
+	}
+
+	CocoaGame_Trace("%s: EGL %d.%d (%s).\n", __FUNCTION__, (int) major, (int) minor, eglQueryString(eglDisplay, EGL_VENDOR));
+	return TRUE;
+}
+
+static void CocoaGame_CloseDisplay(void)
+{
+	if (eglDisplay != EGL_NO_DISPLAY) {
+		eglTerminate(eglDisplay);
+		eglDisplay = EGL_NO_DISPLAY;
+	}
+}
+
+CocoaGame_Bool CocoaGame_GetGLDeviceKey(char *key, size_t size)
+{
+	if (! CocoaGame_OpenDisplay())
+		return FALSE;
+
+	// EGL's version is only the API version, so tell driver releases apart by a hash of the extensions as well.
+	const char *extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+	uint32_t hash = 2166136261u;
+	for (; extensions && *extensions; ++extensions)
+		hash = (hash ^ (unsigned char) *extensions) * 16777619u;
+
+	snprintf(key, size, "egl %s %s %08x", eglQueryString(eglDisplay, EGL_VENDOR), eglQueryString(eglDisplay, EGL_VERSION), (unsigned int) hash);
+	return TRUE;
+}
+
+CocoaGame_GLInfo *CocoaGame_GetGLInfo2(const CocoaGame_GLConfig *fakeConfig)
+{
+	CocoaGame_GLInfo *info;
+	EGLContext tempContext = EGL_NO_CONTEXT;
+	EGLSurface tempSurface = EGL_NO_SURFACE;
+
+	if (openGLContext == EGL_NO_CONTEXT) {
+		if (! CocoaGame_OpenDisplay())
+			return NULL;
+
+		info = CocoaGame_LookupGLInfoCache();
+		if (info)
+			return info;
+
+		EGLConfig tempConfig = CocoaGame_ChooseEGLConfig(fakeConfig, 1);
+		if (! tempConfig)
+			return NULL;
+
+		static const EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		tempSurface = eglCreatePbufferSurface(eglDisplay, tempConfig, surfaceAttribs);
+		tempContext = eglCreateContext(eglDisplay, tempConfig, EGL_NO_CONTEXT, NULL);
+
+		if (tempSurface == EGL_NO_SURFACE || tempContext == EGL_NO_CONTEXT || ! eglMakeCurrent(eglDisplay, tempSurface, tempSurface, tempContext)) {
+			if (tempContext != EGL_NO_CONTEXT)
+				eglDestroyContext(eglDisplay, tempContext);
+
+			if (tempSurface != EGL_NO_SURFACE)
+				eglDestroySurface(eglDisplay, tempSurface);
+
+			return NULL;
+		}
+
+		CocoaGame_CoreContextCurrent(NULL);
+	}
+
+	info = CocoaGame_AllocZeroed(1, sizeof(CocoaGame_GLInfo), COCOAGAME_ALLOC_VIDEO);
+	if (info) {
+		info->version = CocoaGame_StrDup((const char *) glGetString(GL_VERSION), COCOAGAME_ALLOC_VIDEO);
+		info->extensions = CocoaGame_StrDup((const char *) glGetString(GL_EXTENSIONS), COCOAGAME_ALLOC_VIDEO);
+		info->renderer = CocoaGame_StrDup((const char *) glGetString(GL_RENDERER), COCOAGAME_ALLOC_VIDEO);
+		info->vendor = CocoaGame_StrDup((const char *) glGetString(GL_VENDOR), COCOAGAME_ALLOC_VIDEO);
+
+		if (! info->version || ! info->extensions || ! info->renderer || ! info->vendor) {
+			CocoaGame_FreeGLInfo(info);
+			info = NULL;
+		}
+	}
+
+	if (tempContext != EGL_NO_CONTEXT) {
+		CocoaGame_UpdateGLCache(NULL, NULL);
+
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(eglDisplay, tempContext);
+		eglDestroySurface(eglDisplay, tempSurface);
+	}
+
+	return info;
+}
+
+CocoaGame_GLInfo *CocoaGame_GetGLInfo(void)
+{
+	return CocoaGame_GetGLInfo2(&COCOAGAME_GLCONFIG_DEFAULTS);
+}
+
+void CocoaGame_FreeGLInfo(CocoaGame_GLInfo *info)
+{
+	CocoaGame_Free(info->version);
+	CocoaGame_Free(info->extensions);
+	CocoaGame_Free(info->vendor);
+	CocoaGame_Free(info->renderer);
+	CocoaGame_Free(info);
+}
+
+CocoaGame_Bool CocoaGame_Init(void)
+{
+	assert(! isInitialised && "CocoaGame already initialised.");
+
+	startupMode = defaultStartupMode;
+
+	const char *modeString = getenv("COCOAGAME_HEADLESS_MODE");
+	if (modeString && ! CocoaGame_ParseVideoMode(modeString, &startupMode)) {
+		CocoaGame_Trace("%s: ignoring invalid COCOAGAME_HEADLESS_MODE \"%s\".\n", __FUNCTION__, modeString);
+		startupMode = defaultStartupMode;
+	}
+
+	displayMode = startupMode;
+
+	if (! CocoaGame_BuildModeList())
+		return FALSE;
+
+	if (! CocoaGame_InitEventQueue())
+		return FALSE;
+
+	isInitialised = TRUE;
+	shouldQuit = FALSE;
+	modifiers = 0; // force an event for any modifiers
+	videoConfig.disposition = COCOAGAME_VIDEO_NONE;
+
+	openGLContext = EGL_NO_CONTEXT;
+	openGLSurface = EGL_NO_SURFACE;
+	openGLUpdateRequired = FALSE;
+
+	CocoaGame_Trace("%s: initialisation complete (headless %dx%dx%d).\n", __FUNCTION__, startupMode.width, startupMode.height, startupMode.bits);
+	return TRUE;
+}
+
+CocoaGame_Bool CocoaGame_BuildModeList(void)
+{
+	int count = (int) countof(virtualModes) + 1;
+	CocoaGame_VideoMode *modes = CocoaGame_AllocVideoModes(count);
+	if (! modes)
+		return FALSE;
+
+	memcpy(modes, virtualModes, sizeof(virtualModes));
+	modes[count - 1] = startupMode;
+
+	CocoaGame_FinishVideoModes();
+
+	return TRUE;
+}
+
+void CocoaGame_Shutdown(void)
+{
+	if (! isInitialised)
+		return;
+
+	// Jobs may still be queueing uploads or events.
+	CocoaGame_StopJobs();
+
+	CocoaGame_ShutdownVideo();
+
+	CocoaGame_FreeVideoModes();
+
+	CocoaGame_ShutdownEventQueue();
+
+	CocoaGame_CloseDisplay();
+
+	isInitialised = FALSE;
+
+	CocoaGame_Trace("%s: shutdown complete.\n", __FUNCTION__);
+}
+
+static void CocoaGame_ShutdownVideo(void)
+{
+	// CocoaGame_Shutdown should have checked this
+	assert(isInitialised);
+
+	CocoaGame_StopRenderThread();
+	CocoaGame_StopUploadWorker();
+
+	if (openGLContext != EGL_NO_CONTEXT) {
+		// Capture's buffers, render targets and transient buffers belong to the context, so release them while it still
+		// exists.
+		eglMakeCurrent(eglDisplay, openGLSurface, openGLSurface, openGLContext);
+		CocoaGame_CoreContextCurrent(openGLContext);
+		CocoaGame_ShutdownCapture();
+		CocoaGame_ShutdownRenderTargets();
+		CocoaGame_ShutdownTransient();
+
+		CocoaGame_Trace("%s: shutting down OpenGL...\n", __FUNCTION__);
+
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		CocoaGame_CoreContextCurrent(NULL);
+
+		if (openGLSurface != EGL_NO_SURFACE) {
+			eglDestroySurface(eglDisplay, openGLSurface);
+			openGLSurface = EGL_NO_SURFACE;
+		}
+
+		CocoaGame_CoreContextDestroyed(openGLContext);
+		eglDestroyContext(eglDisplay, openGLContext);
+		openGLContext = EGL_NO_CONTEXT;
+	}
+
+	// Switching mode on a virtual display is free, so always go back to the startup mode.
+	displayMode = startupMode;
+
+	videoConfig.disposition = COCOAGAME_VIDEO_NONE;
+}
+
+void CocoaGame_GetStartupVideoMode(CocoaGame_VideoMode *mode)
+{
+	*mode = startupMode;
+}
+
+float CocoaGame_GetStartupAspectRatio(void)
+{
+	CocoaGame_VideoMode mode;
+	CocoaGame_GetStartupVideoMode(&mode);
+
+	return (float) mode.width / (float) mode.height;
+}
+
+static CocoaGame_Bool CocoaGame_FindVideoMode(const CocoaGame_VideoMode *wanted, CocoaGame_Bool acceptClosestMode, CocoaGame_VideoMode *found)
+{
+	int bestMode = -1;
+	int bestDistance = 0;
+
+	int i;
+	for (i = 0; i != CocoaGame_GetVideoModeCount(); ++i) {
+		const CocoaGame_VideoMode *mode = CocoaGame_GetVideoMode(i);
+
+		int distance = abs(mode->width - wanted->width) + abs(mode->height - wanted->height) + abs(mode->bits - wanted->bits);
+		if (bestMode < 0 || distance < bestDistance) {
+			bestMode = i;
+			bestDistance = distance;
+		}
+	}
+
+	if (bestMode < 0 || (bestDistance && ! acceptClosestMode))
+		return FALSE;
+
+	*found = *CocoaGame_GetVideoMode(bestMode);
+	return TRUE;
+}
+
+CocoaGame_Bool CocoaGame_InitVideo(const CocoaGame_VideoConfig *config)
+{
+	assert(isInitialised);
+	assert((int) config->disposition > COCOAGAME_VIDEO_NONE && (int) config->disposition < (int) COCOAGAME_VIDEO__MAX_DISPOSITION && "Invalid video disposition.");
+
+	if (videoConfig.disposition != COCOAGAME_VIDEO_NONE)
+		CocoaGame_ShutdownVideo();
+
+	videoConfig = *config;
+
+	// Remember these values for CocoaGame_ToggleFullScreenWindow().
+	windowWidth = config->mode.width;
+	windowHeight = config->mode.height;
+
+	// There's no display to capture.
+	videoConfig.captureDisplay = FALSE;
+
+	switch (config->disposition) {
+		case COCOAGAME_VIDEO_FULLSCREEN_SET_MODE:
+			CocoaGame_Trace("%s: finding best match for mode %dx%dx%d...\n", __FUNCTION__, config->mode.width, config->mode.height, config->mode.bits);
+			if (! CocoaGame_FindVideoMode(&config->mode, config->acceptClosestMode, &displayMode)) {
+				CocoaGame_Trace("%s: unable to find match for mode.\n", __FUNCTION__);
+				videoConfig.disposition = COCOAGAME_VIDEO_NONE;
+				return FALSE;
+			}
+
+			videoConfig.mode = displayMode;
+			break;
+
+		case COCOAGAME_VIDEO_FULLSCREEN:
+		case COCOAGAME_VIDEO_FULLSCREEN_WINDOW:
+			videoConfig.mode = displayMode;
+			break;
+
+		case COCOAGAME_VIDEO_WINDOW:
+			videoConfig.mode.bits = displayMode.bits;
+			break;
+
+		default:
+			videoConfig.disposition = COCOAGAME_VIDEO_NONE;
+			return FALSE;
+	}
+
+	CocoaGame_Trace("%s: headless video initialised (%dx%d).\n", __FUNCTION__, videoConfig.mode.width, videoConfig.mode.height);
+	return TRUE;
+}
+
+void CocoaGame_FadeToBlack(void)
+{
+}
+
+void CocoaGame_FadeFromBlack(void)
+{
+}
+
+void CocoaGame_SetFadeTime(float newFadeTime)
+{
+	(void) newFadeTime;
+}
+
+const CocoaGame_VideoConfig *CocoaGame_GetVideoConfig(void)
+{
+	return &videoConfig;
+}
+
+float CocoaGame_GetAspectRatio(void)
+{
+	return (float) CocoaGame_GetVideoConfig()->mode.width / (float) CocoaGame_GetVideoConfig()->mode.height;
+}
+
+void CocoaGame_ToggleFullScreenWindow(void)
+{
+	assert(isInitialised);
+	assert((videoConfig.disposition == COCOAGAME_VIDEO_FULLSCREEN_WINDOW || videoConfig.disposition == COCOAGAME_VIDEO_WINDOW) &&
+		"CocoaGame_ToggleFullScreenWindow only available in window or full-screen-window video setup.");
+
+	// A render thread may be reading the mode.
+	CocoaGame_LockContext();
+
+	if (videoConfig.disposition == COCOAGAME_VIDEO_FULLSCREEN_WINDOW) {
+		videoConfig.disposition = COCOAGAME_VIDEO_WINDOW;
+		videoConfig.mode.width = windowWidth;
+		videoConfig.mode.height = windowHeight;
+	} else {
+		videoConfig.disposition = COCOAGAME_VIDEO_FULLSCREEN_WINDOW;
+		videoConfig.mode = displayMode;
+	}
+
+	// The pbuffer has to be resized, exactly like a window resize on the Mac.
+	__atomic_store_n(&openGLUpdateRequired, TRUE, __ATOMIC_RELEASE);
+
+	CocoaGame_UnlockContext();
+}
+
+void CocoaGame_GetWindowDimensions(int *width, int *height)
+{
+	assert((videoConfig.disposition == COCOAGAME_VIDEO_FULLSCREEN_WINDOW || videoConfig.disposition == COCOAGAME_VIDEO_WINDOW) &&
+		"CocoaGame_GetWindowDimensions only available in window or full-screen-window video setup.");
+
+	*width = windowWidth;
+	*height = windowHeight;
+}
+
+void CocoaGame_SetDrawCallback(void (*callback)(void *), void *context)
+{
+	// Nothing ever needs redrawing outside the game loop, but remember the callback for API compatibility.
+	drawCallback = callback;
+	drawCallbackContext = context;
+}
+
+CocoaGame_Bool CocoaGame_InitGL(const CocoaGame_GLConfig *config)
+{
+	assert(isInitialised && videoConfig.disposition != COCOAGAME_VIDEO_NONE &&
+		"Attempt to initialise GL without initialising video first.");
+
+	CocoaGame_Trace("%s: initialising OpenGL...\n", __FUNCTION__);
+
+	if (! CocoaGame_OpenDisplay())
+		return FALSE;
+
+	if (! CocoaGame_CreateOpenGLContext(config, &glConfig))
+		return FALSE;
+
+	if (! CocoaGame_UpdateOpenGLContext()) {
+		CocoaGame_CoreContextDestroyed(openGLContext);
+		eglDestroyContext(eglDisplay, openGLContext);
+		openGLContext = EGL_NO_CONTEXT;
+		return FALSE;
+	}
+
+	openGLUpdateRequired = FALSE;
+
+	// Make sure we don't display any garbage to the user.
+	CocoaGame_GLDisable(GL_SCISSOR_TEST);
+	CocoaGame_GLClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glFlush();
+
+	CocoaGame_UpdateGLCache(config, &glConfig);
+
+	CocoaGame_Trace("%s: OpenGL initialised (%s).\n", __FUNCTION__, (const char *) glGetString(GL_RENDERER));
+
+	return TRUE;
+}
+
+static EGLConfig CocoaGame_ChooseEGLConfig(const CocoaGame_GLConfig *config, int msaa)
+{
+	EGLint attribs[40];
+	unsigned int attribCount = 0;
+
+	// Split the colour bits evenly between the channels (i.e., 24 means 8 bits each of R, G and B).
+	EGLint channelBits = (EGLint) (config->colourBits / 3);
+
+	attribs[attribCount++] = EGL_SURFACE_TYPE;
+	attribs[attribCount++] = EGL_PBUFFER_BIT;
+	attribs[attribCount++] = EGL_RENDERABLE_TYPE;
+	attribs[attribCount++] = EGL_OPENGL_BIT;
+
+	attribs[attribCount++] = EGL_RED_SIZE;
+	attribs[attribCount++] = channelBits;
+	attribs[attribCount++] = EGL_GREEN_SIZE;
+	attribs[attribCount++] = channelBits;
+	attribs[attribCount++] = EGL_BLUE_SIZE;
+	attribs[attribCount++] = channelBits;
+	attribs[attribCount++] = EGL_ALPHA_SIZE;
+	attribs[attribCount++] = (EGLint) config->alphaBits;
+	attribs[attribCount++] = EGL_DEPTH_SIZE;
+	attribs[attribCount++] = (EGLint) config->depthBits;
+	attribs[attribCount++] = EGL_STENCIL_SIZE;
+	attribs[attribCount++] = (EGLint) config->stencilBits;
+
+	if (msaa > 1) {
+		attribs[attribCount++] = EGL_SAMPLE_BUFFERS;
+		attribs[attribCount++] = 1;
+		attribs[attribCount++] = EGL_SAMPLES;
+		attribs[attribCount++] = (EGLint) msaa;
+	}
+
+	// Terminate the attributes.
+	attribs[attribCount++] = EGL_NONE;
+
+	assert(attribCount <= countof(attribs) && "Overflowed attribs buffer");
+
+	EGLConfig chosen;
+	EGLint chosenCount = 0;
+	if (! eglChooseConfig(eglDisplay, attribs, &chosen, 1, &chosenCount) || chosenCount < 1)
+		return NULL;
+
+	return chosen;
+}
+
+static CocoaGame_Bool CocoaGame_CreateOpenGLContext(const CocoaGame_GLConfig *config, CocoaGame_GLConfig *actualConfig)
+{
+	// Try the configuration that worked last time first, to save walking down through the MSAA modes.
+	int cachedMSAA = 0;
+	CocoaGame_GLConfig cachedConfig;
+	if (CocoaGame_LookupGLConfigCache(config, &cachedConfig)) {
+		cachedMSAA = cachedConfig.msaa < 1 ? 1 : cachedConfig.msaa;
+
+		if (CocoaGame_TryCreateOpenGLContext(config, cachedMSAA, actualConfig))
+			return TRUE;
+	}
+
+	int msaa = config->msaa;
+	if (msaa < 1)
+		msaa = 1;
+
+	for (; msaa; --msaa) {
+		if (msaa != cachedMSAA && CocoaGame_TryCreateOpenGLContext(config, msaa, actualConfig))
+			return TRUE;
+	}
+
+	CocoaGame_Trace("%s: unable to create EGL config/context.\n", __FUNCTION__);
+	return FALSE;
+}
+
+static CocoaGame_Bool CocoaGame_TryCreateOpenGLContext(const CocoaGame_GLConfig *config, int msaa, CocoaGame_GLConfig *actualConfig)
+{
+	EGLConfig chosen = CocoaGame_ChooseEGLConfig(config, msaa);
+	if (! chosen)
+		return FALSE;
+
+	EGLContext context = eglCreateContext(eglDisplay, chosen, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT)
+		return FALSE;
+
+	eglConfig = chosen;
+	openGLContext = context;
+
+	CocoaGame_ReadGLConfig(chosen, actualConfig);
+
+	// Pbuffers are never presented, so there's nothing to synchronise with. Remember what was asked for so the game
+	// sees the same value it would on a real display.
+	actualConfig->swapInterval = config->swapInterval;
+	return TRUE;
+}
+
+static void CocoaGame_ReadGLConfig(EGLConfig chosen, CocoaGame_GLConfig *config)
+{
+	EGLint red = 0, green = 0, blue = 0, alpha = 0, depth = 0, stencil = 0, samples = 0;
+
+	eglGetConfigAttrib(eglDisplay, chosen, EGL_RED_SIZE, &red);
+	eglGetConfigAttrib(eglDisplay, chosen, EGL_GREEN_SIZE, &green);
+	eglGetConfigAttrib(eglDisplay, chosen, EGL_BLUE_SIZE, &blue);
+	eglGetConfigAttrib(eglDisplay, chosen, EGL_ALPHA_SIZE, &alpha);
+	eglGetConfigAttrib(eglDisplay, chosen, EGL_DEPTH_SIZE, &depth);
+	eglGetConfigAttrib(eglDisplay, chosen, EGL_STENCIL_SIZE, &stencil);
+	eglGetConfigAttrib(eglDisplay, chosen, EGL_SAMPLES, &samples);
+
+	config->colourBits = (int) (red + green + blue);
+	config->alphaBits = (int) alpha;
+	config->depthBits = (int) depth;
+	config->stencilBits = (int) stencil;
+	config->msaa = (int) samples;
+
+	CocoaGame_Trace("%s: colourBits=%d alphaBits=%d depthBits=%d stencilBits=%d msaa=%d\n",
+		__FUNCTION__, config->colourBits, config->alphaBits, config->depthBits, config->stencilBits, config->msaa);
+}
+
+const CocoaGame_GLConfig *CocoaGame_GetGLConfig(void)
+{
+	return &glConfig;
+}
+
+void CocoaGame_SetSwapInterval(int swapInterval)
+{
+	assert(isInitialised && openGLContext != EGL_NO_CONTEXT && "Attempt to set the swap interval when GL not initialised.");
+
+	// Pbuffers are never presented, so there's nothing to synchronise with, but keep the value for consistency.
+	eglSwapInterval(eglDisplay, swapInterval);
+	glConfig.swapInterval = swapInterval;
+}
+
+CocoaGame_Bool CocoaGame_BeginRender(void)
+{
+	assert(isInitialised && openGLContext != EGL_NO_CONTEXT && "Attempt to begin rendering when GL not initialised.");
+
+	CocoaGame_BeginZone(__FUNCTION__);
+	CocoaGame_CoreBeginRender();
+
+	uint64_t timingStart = CocoaGame_BeginTiming();
+
+	// Clearing the flag before updating means a request made during the update isn't lost.
+	if (__atomic_exchange_n(&openGLUpdateRequired, FALSE, __ATOMIC_ACQ_REL))
+		CocoaGame_UpdateOpenGLContext();
+
+	eglMakeCurrent(eglDisplay, openGLSurface, openGLSurface, openGLContext);
+	CocoaGame_CoreContextCurrent(openGLContext);
+
+	discardedRender = FALSE;
+
+	CocoaGame_CoreBeginFrame();
+
+	CocoaGame_EndTiming(COCOAGAME_FRAME_PHASE_BEGIN_RENDER, timingStart);
+	CocoaGame_EndZone();
+
+	// A virtual display is never hidden.
+	return TRUE;
+}
+
+static CocoaGame_Bool CocoaGame_UpdateOpenGLContext(void)
+{
+	CocoaGame_BeginZone(__FUNCTION__);
+
+	CocoaGame_Trace("%s: updating OpenGL context (%dx%d pbuffer).\n", __FUNCTION__, videoConfig.mode.width, videoConfig.mode.height);
+
+	EGLint surfaceAttribs[] = {
+		EGL_WIDTH, (EGLint) videoConfig.mode.width,
+		EGL_HEIGHT, (EGLint) videoConfig.mode.height,
+		EGL_NONE
+	};
+
+	EGLSurface newSurface = eglCreatePbufferSurface(eglDisplay, eglConfig, surfaceAttribs);
+	if (newSurface == EGL_NO_SURFACE) {
+		CocoaGame_Trace("%s: unable to create pbuffer (error 0x%04x).\n", __FUNCTION__, (unsigned int) eglGetError());
+		CocoaGame_EndZone();
+		return FALSE;
+	}
+
+	if (! eglMakeCurrent(eglDisplay, newSurface, newSurface, openGLContext)) {
+		CocoaGame_Trace("%s: unable to make context current (error 0x%04x).\n", __FUNCTION__, (unsigned int) eglGetError());
+		eglDestroySurface(eglDisplay, newSurface);
+		CocoaGame_EndZone();
+		return FALSE;
+	}
+
+	CocoaGame_CoreContextCurrent(openGLContext);
+
+	if (openGLSurface != EGL_NO_SURFACE)
+		eglDestroySurface(eglDisplay, openGLSurface);
+
+	openGLSurface = newSurface;
+
+	CocoaGame_Trace("%s: OpenGL context updated.\n", __FUNCTION__);
+	CocoaGame_EndZone();
+	return TRUE;
+}
+
+void CocoaGame_EndRender(void)
+{
+	// Shut down during render?
+	if (! isInitialised || openGLContext == EGL_NO_CONTEXT)
+		return;
+
+	assert(eglGetCurrentContext() == openGLContext && "Did you forget to CocoaGame_SetTargetPixelBuffer(NULL)?");
+
+	CocoaGame_CoreEndRender(discardedRender);
+
+	CocoaGame_BeginZone(__FUNCTION__);
+	uint64_t timingStart = CocoaGame_BeginTiming();
+
+	// The equivalent of -[NSOpenGLContext flushBuffer] for a single buffered pbuffer.
+	if (! discardedRender)
+		glFlush();
+
+	discardedRender = TRUE;
+
+	// Flushing a pbuffer never waits for a vertical blank.
+	CocoaGame_CoreFinishRender(FALSE);
+
+	CocoaGame_EndTiming(COCOAGAME_FRAME_PHASE_END_RENDER, timingStart);
+	CocoaGame_EndZone();
+}
+
+//
+// Render thread support
+//
+
+void CocoaGame_PrepareRenderThread(void)
+{
+	assert(isInitialised && openGLContext != EGL_NO_CONTEXT && "Attempt to start render thread when GL not initialised.");
+
+	eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	CocoaGame_CoreContextCurrent(NULL);
+}
+
+void CocoaGame_FinishRenderThread(void)
+{
+	eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	CocoaGame_CoreContextCurrent(NULL);
+}
+
+void CocoaGame_ReclaimContext(void)
+{
+	eglMakeCurrent(eglDisplay, openGLSurface, openGLSurface, openGLContext);
+	CocoaGame_CoreContextCurrent(openGLContext);
+}
+
+void CocoaGame_LockContext(void)
+{
+	pthread_mutex_lock(&contextMutex);
+}
+
+void CocoaGame_UnlockContext(void)
+{
+	pthread_mutex_unlock(&contextMutex);
+}
+
+void CocoaGame_DiscardRender(void)
+{
+	discardedRender = TRUE;
+}
+
+//
+// Shared contexts
+//
+
+// EGL won't make a context current without a surface unless EGL_KHR_surfaceless_context is supported, so each shared
+// context gets a tiny pbuffer of its own.
+typedef struct CocoaGame_SharedContext {
+	EGLContext context;
+	EGLSurface surface;
+} CocoaGame_SharedContext;
+
+void *CocoaGame_CreateSharedContext(void)
+{
+	assert(isInitialised && openGLContext != EGL_NO_CONTEXT && "Attempt to create a shared context when GL not initialised.");
+
+	CocoaGame_SharedContext *shared = CocoaGame_AllocZeroed(1, sizeof(*shared), COCOAGAME_ALLOC_VIDEO);
+	if (! shared)
+		return NULL;
+
+	EGLint surfaceAttribs[] = {
+		EGL_WIDTH, 1,
+		EGL_HEIGHT, 1,
+		EGL_NONE
+	};
+
+	shared->surface = eglCreatePbufferSurface(eglDisplay, eglConfig, surfaceAttribs);
+	shared->context = eglCreateContext(eglDisplay, eglConfig, openGLContext, NULL);
+
+	if (shared->surface == EGL_NO_SURFACE || shared->context == EGL_NO_CONTEXT) {
+		CocoaGame_Trace("%s: unable to create shared context (error 0x%04x).\n", __FUNCTION__, (unsigned int) eglGetError());
+		CocoaGame_DestroySharedContext(shared);
+		return NULL;
+	}
+
+	return shared;
+}
+
+CocoaGame_Bool CocoaGame_MakeSharedContextCurrent(void *context)
+{
+	CocoaGame_SharedContext *shared = (CocoaGame_SharedContext *) context;
+
+	CocoaGame_Bool made;
+	if (! shared)
+		made = eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	else
+		made = eglMakeCurrent(eglDisplay, shared->surface, shared->surface, shared->context);
+
+	CocoaGame_CoreContextCurrent(made && shared ? shared->context : NULL);
+	return made;
+}
+
+void CocoaGame_DestroySharedContext(void *context)
+{
+	CocoaGame_SharedContext *shared = (CocoaGame_SharedContext *) context;
+	if (! shared)
+		return;
+
+	if (shared->context != EGL_NO_CONTEXT) {
+		CocoaGame_CoreContextDestroyed(shared->context);
+		eglDestroyContext(eglDisplay, shared->context);
+	}
+
+	if (shared->surface != EGL_NO_SURFACE)
+		eglDestroySurface(eglDisplay, shared->surface);
+
+	CocoaGame_Free(shared);
+}
+
+//
+// Idle waiting
+//
+
+static void CocoaGame_InitIdleCond(void)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&idleCond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+void CocoaGame_BlockUntilWoken(uint64_t nanoseconds)
+{
+	pthread_once(&idleOnce, &CocoaGame_InitIdleCond);
+
+	pthread_mutex_lock(&idleMutex);
+
+	if (nanoseconds == UINT64_MAX) {
+		while (! idleSignalled)
+			pthread_cond_wait(&idleCond, &idleMutex);
+	} else {
+		struct timespec deadline;
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+		uint64_t nsec = (uint64_t) deadline.tv_nsec + nanoseconds % 1000000000;
+		deadline.tv_sec += (time_t) (nanoseconds / 1000000000 + nsec / 1000000000);
+		deadline.tv_nsec = (long) (nsec % 1000000000);
+
+		while (! idleSignalled) {
+			if (pthread_cond_timedwait(&idleCond, &idleMutex, &deadline) != 0)
+				break;
+		}
+	}
+
+	idleSignalled = FALSE;
+
+	pthread_mutex_unlock(&idleMutex);
+}
+
+void CocoaGame_WakeBlocked(void)
+{
+	pthread_once(&idleOnce, &CocoaGame_InitIdleCond);
+
+	pthread_mutex_lock(&idleMutex);
+	idleSignalled = TRUE;
+	pthread_cond_signal(&idleCond);
+	pthread_mutex_unlock(&idleMutex);
+}
+
+CocoaGame_Bool CocoaGame_IsViewOccluded(void)
+{
+	// There's no window to cover.
+	return FALSE;
+}
+
+static void CocoaGame_UpdateModifiers(unsigned int newModifiers)
+{
+	assert(isInitialised);
+
+	if (modifiers == newModifiers)
+		return;
+
+	if (CocoaGame_IsEventTypeEnabled(COCOAGAME_EVENT_MODIFIERS_CHANGED)) {
+		CocoaGame_Event ourEvent;
+		ourEvent.type = COCOAGAME_EVENT_MODIFIERS_CHANGED;
+		ourEvent.modifiers.modifiers = newModifiers;
+		ourEvent.modifiersChanged.previousModifiers = modifiers;
+		CocoaGame_QueueEvent(&ourEvent);
+	}
+
+	modifiers = newModifiers;
+}
+
+unsigned int CocoaGame_GetModifiers(void)
+{
+	assert(isInitialised);
+
+	return modifiers;
+}
+
+void CocoaGame_Sleep(double seconds)
+{
+	if (seconds <= 0.0)
+		return;
+
+	struct timespec ts;
+	ts.tv_sec = (time_t) seconds;
+	ts.tv_nsec = (long) ((seconds - (double) ts.tv_sec) * 1e9);
+
+	nanosleep(&ts, NULL);
+}
+
+void CocoaGame_PollMouseMovement(void)
+{
+	// Injected events update the input state as soon as they're queued, so there's nothing to read.
+}
+
+void CocoaGame_Poll(void)
+{
+	assert(isInitialised);
+
+	// There's no native event source. Input arrives through CocoaGame_ProcessEvent() and CocoaGame_QueueEvent().
+	CocoaGame_BeginZone(__FUNCTION__);
+	CocoaGame_EndTiming(COCOAGAME_FRAME_PHASE_POLL, CocoaGame_BeginTiming());
+	CocoaGame_EndZone();
+}
+
+CocoaGame_Bool CocoaGame_ProcessEvent(void *voidEvent)
+{
+	CocoaGame_BeginZone(__FUNCTION__);
+	CocoaGame_Bool consumed = CocoaGame_ProcessHeadlessEvent((const CocoaGame_Event *) voidEvent);
+	CocoaGame_EndZone();
+
+	return consumed;
+}
+
+static CocoaGame_Bool CocoaGame_ProcessHeadlessEvent(const CocoaGame_Event *event)
+{
+	switch (event->type) {
+		case COCOAGAME_EVENT_NONE:
+			return FALSE;
+
+		case COCOAGAME_EVENT_APP_ACTIVATE:
+		case COCOAGAME_EVENT_APP_DEACTIVATE:
+			CocoaGame_QueueEvent(event);
+			return TRUE;
+
+		case COCOAGAME_EVENT_MODIFIERS_CHANGED:
+			CocoaGame_UpdateModifiers(event->modifiers.modifiers);
+			return TRUE;
+
+		default:
+			break;
+	}
+
+	CocoaGame_UpdateModifiers(event->modifiers.modifiers);
+
+	switch (event->type) {
+		case COCOAGAME_EVENT_MOUSE_MOVE:
+		case COCOAGAME_EVENT_MOUSE_DOWN:
+		case COCOAGAME_EVENT_MOUSE_UP:
+			mouseX = event->mousePosition.x;
+			mouseY = event->mousePosition.y;
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_SCROLL:
+			mouseX = event->mouseScroll.cursorX;
+			mouseY = event->mouseScroll.cursorY;
+			break;
+
+		case COCOAGAME_EVENT_KEY_DOWN:
+			if (CocoaGame_CheckForSpecialKeys(event))
+				return TRUE;
+			break;
+
+		default:
+			break;
+	}
+
+	CocoaGame_QueueEvent(event);
+	return TRUE;
+}
+
+static CocoaGame_Bool CocoaGame_CheckForSpecialKeys(const CocoaGame_Event *event)
+{
+	if (enableAltEsc) {
+		// Alt+Esc, Alt+Shift+Esc, Alt+Ctrl+Esc will all trigger this
+		if (event->key.key == COCOAGAME_KEY_ESCAPE && (CocoaGame_GetModifiers() & COCOAGAME_MODIFIER_BOTH_ALTS)) {
+			shouldQuit = TRUE;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+CocoaGame_Bool CocoaGame_WasQuitRequested(void)
+{
+	assert(isInitialised);
+
+	return shouldQuit;
+}
+
+void CocoaGame_SetQuitRequested(CocoaGame_Bool newValue)
+{
+	shouldQuit = newValue;
+}
+
+void CocoaGame_GetMousePosition(int *x, int *y)
+{
+	*x = mouseX;
+	*y = mouseY;
+}
+
+CocoaGame_Bool CocoaGame_IsAppActive(void)
+{
+	return TRUE;
+}
+
+void CocoaGame_SetKeyRepeat(CocoaGame_Bool keyRepeatEnabled)
+{
+	// Injected events don't carry a repeat flag, so this is only recorded.
+	wantKeyRepeats = keyRepeatEnabled;
+}
+
+void CocoaGame_SetMouseDeltaMode(CocoaGame_Bool deltaMode)
+{
+	wantMouseDeltaMode = deltaMode;
+
+	if (deltaMode && CocoaGame_AppOwnsMouse()) {
+		mouseX = videoConfig.mode.width / 2;
+		mouseY = videoConfig.mode.height / 2;
+	}
+}
+
+CocoaGame_Bool CocoaGame_IsMouseInDeltaMode(void)
+{
+	return wantMouseDeltaMode;
+}
+
+void CocoaGame_SetMouseCursorVisible(CocoaGame_Bool cursorVisible)
+{
+	wantMouseCursorVisible = cursorVisible;
+}
+
+CocoaGame_Bool CocoaGame_IsMouseCursorVisible(void)
+{
+	return wantMouseCursorVisible;
+}
+
+CocoaGame_Bool CocoaGame_AppOwnsMouse(void)
+{
+	return videoConfig.disposition != COCOAGAME_VIDEO_NONE;
+}
+
+void CocoaGame_SetMousePosition(int x, int y)
+{
+	mouseX = x;
+	mouseY = y;
+}
+
+#ifdef COCOAGAME_ENABLE_PBUFFERS
+
+//
+// Pixel buffers
+//
+
+// Pixel buffers are a Mac OS X workaround for old drivers. Use framebuffer objects with the headless backend.
+
+CocoaGame_PixelBuffer *CocoaGame_CreatePixelBuffer(GLenum textureTarget, GLint internalFormat, GLsizei width, GLsizei height, const CocoaGame_GLConfig *config)
+{
+	(void) textureTarget;
+	(void) internalFormat;
+	(void) width;
+	(void) height;
+	(void) config;
+
+	CocoaGame_Trace("%s: pixel buffers are not supported by the headless backend.\n", __FUNCTION__);
+	return NULL;
+}
+
+void CocoaGame_SetTargetPixelBuffer(CocoaGame_PixelBuffer *pbuffer)
+{
+	assert(! pbuffer);
+	(void) pbuffer;
+
+	eglMakeCurrent(eglDisplay, openGLSurface, openGLSurface, openGLContext);
+	CocoaGame_CoreContextCurrent(openGLContext);
+}
+
+void CocoaGame_SetTextureImageToPixelBuffer(CocoaGame_PixelBuffer *targetPbuffer, CocoaGame_PixelBuffer *pbuffer, GLenum colourBuffer)
+{
+	(void) targetPbuffer;
+	(void) pbuffer;
+	(void) colourBuffer;
+}
+
+void CocoaGame_DestroyPixelBuffer(CocoaGame_PixelBuffer *pbuffer)
+{
+	(void) pbuffer;
+}
+
+#endif // COCOAGAME_ENABLE_PBUFFERS
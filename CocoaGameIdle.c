@@ -0,0 +1,207 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Idle waiting. CocoaGame_WaitForEvents() blocks the main thread in the backend (in the run loop on the Mac, on a
+// condition variable headless) until an event is queued, CocoaGame_Wake() is called from any thread, or a deadline
+// passes. Producers only pay for a wakeup while the main thread is actually blocked. CocoaGame_ThrottleFrame() uses
+// it to hold the frame rate down to a cap chosen by whether the application is active, inactive or hidden.
+//
+
+#include "CocoaGamePrivate.h"
+
+const CocoaGame_FrameRateCaps COCOAGAME_FRAMERATECAPS_DEFAULTS = {
+	.activeFramesPerSecond = 0.0,
+	.inactiveFramesPerSecond = 30.0,
+	.hiddenFramesPerSecond = 4.0
+};
+
+//
+// Private functions
+//
+
+static uint64_t CocoaGame_GetFrameRatePeriod(double framesPerSecond);
+
+//
+// Private data
+//
+
+// Set while the main thread is blocked (or about to block) in the backend, so producers know to wake it.
+static CocoaGame_Bool idleBlocked;
+
+// Set by CocoaGame_Wake() and cleared by the CocoaGame_WaitForEvents() that reports it.
+static CocoaGame_Bool idleWakeRequested;
+
+// Matches COCOAGAME_FRAMERATECAPS_DEFAULTS.
+static CocoaGame_FrameRateCaps idleCaps = {
+	.activeFramesPerSecond = 0.0,
+	.inactiveFramesPerSecond = 30.0,
+	.hiddenFramesPerSecond = 4.0
+};
+
+// Whether the last CocoaGame_BeginRender() went on to render.
+static CocoaGame_Bool idleFrameShown = TRUE;
+
+// When the next throttled frame is due, and the state whose cap it was computed from.
+static uint64_t idleDeadline;
+static CocoaGame_FrameState idleDeadlineState;
+
+//
+// Idle waiting
+//
+
+void CocoaGame_IdleEventQueued(void)
+{
+	// Pairs with the fence in CocoaGame_WaitForEvents(): either we see idleBlocked set, or the waiter sees the event.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&idleBlocked, __ATOMIC_RELAXED))
+		CocoaGame_WakeBlocked();
+}
+
+void CocoaGame_Wake(void)
+{
+	__atomic_store_n(&idleWakeRequested, TRUE, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&idleBlocked, __ATOMIC_SEQ_CST))
+		CocoaGame_WakeBlocked();
+}
+
+CocoaGame_WaitResult CocoaGame_WaitForEvents(double seconds)
+{
+	uint64_t now = CocoaGame_GetNanoseconds();
+	uint64_t deadline = seconds < 0.0 ? UINT64_MAX : now + (uint64_t) (seconds * 1e9);
+
+	// Events consumed by handlers never reach the queue, but still end the wait.
+	uint64_t handled = CocoaGame_GetHandledEventCount();
+
+	CocoaGame_BeginZone(__FUNCTION__);
+
+	CocoaGame_WaitResult result;
+
+	for (;;) {
+		CocoaGame_Poll();
+
+		if (CocoaGame_InputWaiting() || CocoaGame_GetHandledEventCount() != handled) {
+			result = COCOAGAME_WAIT_EVENT;
+			break;
+		}
+
+		if (__atomic_exchange_n(&idleWakeRequested, FALSE, __ATOMIC_SEQ_CST)) {
+			result = COCOAGAME_WAIT_WOKEN;
+			break;
+		}
+
+		now = CocoaGame_GetNanoseconds();
+		if (now >= deadline) {
+			result = COCOAGAME_WAIT_TIMEOUT;
+			break;
+		}
+
+		// Announce that we're blocking before the final check, so anything queued after the check wakes us.
+		__atomic_store_n(&idleBlocked, TRUE, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		if (! CocoaGame_InputWaiting() && CocoaGame_GetHandledEventCount() == handled &&
+			! __atomic_load_n(&idleWakeRequested, __ATOMIC_SEQ_CST))
+			CocoaGame_BlockUntilWoken(deadline == UINT64_MAX ? UINT64_MAX : deadline - now);
+
+		__atomic_store_n(&idleBlocked, FALSE, __ATOMIC_SEQ_CST);
+	}
+
+	CocoaGame_EndZone();
+
+	return result;
+}
+
+//
+// Frame rate caps
+//
+
+void CocoaGame_SetFrameRateCaps(const CocoaGame_FrameRateCaps *caps)
+{
+	idleCaps = *caps;
+	idleDeadline = 0;
+}
+
+const CocoaGame_FrameRateCaps *CocoaGame_GetFrameRateCaps(void)
+{
+	return &idleCaps;
+}
+
+// These may be called on the render thread.
+void CocoaGame_IdleBeginRender(void)
+{
+	__atomic_store_n(&idleFrameShown, FALSE, __ATOMIC_RELAXED);
+}
+
+void CocoaGame_IdleBeginFrame(void)
+{
+	__atomic_store_n(&idleFrameShown, TRUE, __ATOMIC_RELAXED);
+}
+
+CocoaGame_FrameState CocoaGame_GetFrameState(void)
+{
+	if (! __atomic_load_n(&idleFrameShown, __ATOMIC_RELAXED) || CocoaGame_IsViewOccluded())
+		return COCOAGAME_FRAME_STATE_HIDDEN;
+
+	if (! CocoaGame_IsAppActive())
+		return COCOAGAME_FRAME_STATE_INACTIVE;
+
+	return COCOAGAME_FRAME_STATE_ACTIVE;
+}
+
+static uint64_t CocoaGame_GetFrameRatePeriod(double framesPerSecond)
+{
+	return framesPerSecond > 0.0 ? (uint64_t) (1e9 / framesPerSecond) : 0;
+}
+
+CocoaGame_WaitResult CocoaGame_ThrottleFrame(void)
+{
+	CocoaGame_FrameState state = CocoaGame_GetFrameState();
+
+	double framesPerSecond;
+	switch (state) {
+		case COCOAGAME_FRAME_STATE_HIDDEN:
+			framesPerSecond = idleCaps.hiddenFramesPerSecond;
+			break;
+
+		case COCOAGAME_FRAME_STATE_INACTIVE:
+			framesPerSecond = idleCaps.inactiveFramesPerSecond;
+			break;
+
+		default:
+			framesPerSecond = idleCaps.activeFramesPerSecond;
+			break;
+	}
+
+	uint64_t period = CocoaGame_GetFrameRatePeriod(framesPerSecond);
+	if (! period) {
+		idleDeadline = 0;
+		return COCOAGAME_WAIT_TIMEOUT;
+	}
+
+	uint64_t now = CocoaGame_GetNanoseconds();
+
+	// The cadence starts from the first throttled frame, and again whenever the state (and so the cap) changes.
+	if (! idleDeadline || state != idleDeadlineState) {
+		idleDeadline = now + period;
+		idleDeadlineState = state;
+	}
+
+	if (now < idleDeadline) {
+		CocoaGame_WaitResult result = CocoaGame_WaitForEvents((double) (idleDeadline - now) / 1e9);
+		if (result != COCOAGAME_WAIT_TIMEOUT)
+			return result;
+
+		now = CocoaGame_GetNanoseconds();
+	}
+
+	// If we've fallen more than a frame behind, start again from now rather than rushing to catch up.
+	if (now - idleDeadline >= period)
+		idleDeadline = now + period;
+	else
+		idleDeadline += period;
+
+	return COCOAGAME_WAIT_TIMEOUT;
+}
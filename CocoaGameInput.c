@@ -0,0 +1,264 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Polled input state. Every event passed to CocoaGame_QueueEvent() (which includes everything CocoaGame_ProcessEvent()
+// accepts, and replayed events) updates a set of bitmasks, and CocoaGame_BeginRender() copies them to the snapshot
+// returned by CocoaGame_GetInputState() and starts accumulating the next frame's edges. CocoaGame_LatchInput() can
+// fold later mouse movement in to the snapshot just before it's used.
+//
+
+#include "CocoaGamePrivate.h"
+#include <string.h>
+
+//
+// Private functions
+//
+
+static void CocoaGame_LockInput(void);
+static void CocoaGame_UnlockInput(void);
+static void CocoaGame_ReleaseAllInput(void);
+
+//
+// Private data
+//
+
+// Events may be queued from any thread, so the live state is guarded by a spin lock. It's only held for a few
+// instructions, and in practice there's only one producer.
+static char inputLock;
+
+// The live state, accumulating edges, deltas and scrolling since the last snapshot.
+static CocoaGame_InputState inputLive;
+
+// The state as it was at the last CocoaGame_BeginRender().
+static CocoaGame_InputState inputSnapshot;
+
+static CocoaGame_Bool inputLateLatch;
+
+// When the oldest and newest mouse movement accumulated in inputLive were queued, or 0 if there's been none.
+static uint64_t inputOldestMove;
+static uint64_t inputNewestMove;
+
+//
+// Input state
+//
+
+static void CocoaGame_LockInput(void)
+{
+	while (__atomic_test_and_set(&inputLock, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&inputLock, __ATOMIC_RELAXED))
+			;
+	}
+}
+
+static void CocoaGame_UnlockInput(void)
+{
+	__atomic_clear(&inputLock, __ATOMIC_RELEASE);
+}
+
+void CocoaGame_ResetInputState(void)
+{
+	CocoaGame_LockInput();
+	memset(&inputLive, 0, sizeof(inputLive));
+	memset(&inputSnapshot, 0, sizeof(inputSnapshot));
+	inputOldestMove = inputNewestMove = 0;
+	CocoaGame_UnlockInput();
+}
+
+void CocoaGame_UpdateInputState(const CocoaGame_Event *event, uint64_t timestamp)
+{
+	unsigned int keyWord, keyBit;
+	uint32_t buttonBit;
+
+	CocoaGame_LockInput();
+
+	if (event->type != COCOAGAME_EVENT_NONE && event->type != COCOAGAME_EVENT_APP_ACTIVATE &&
+		event->type != COCOAGAME_EVENT_APP_DEACTIVATE) {
+		unsigned int modifiers = event->modifiers.modifiers;
+		inputLive.modifiersPressed |= modifiers & ~inputLive.modifiers;
+		inputLive.modifiersReleased |= inputLive.modifiers & ~modifiers;
+		inputLive.modifiers = modifiers;
+	}
+
+	switch (event->type) {
+		case COCOAGAME_EVENT_KEY_DOWN:
+		case COCOAGAME_EVENT_KEY_UP:
+			if (event->key.keyCode >= COCOAGAME_INPUT_KEY_CODES)
+				break;
+
+			keyWord = event->key.keyCode / 32;
+			keyBit = 1u << (event->key.keyCode % 32);
+
+			// Repeats don't count as presses. A key pressed and released within a frame has both edges set.
+			if (event->type == COCOAGAME_EVENT_KEY_DOWN) {
+				if (! (inputLive.keys[keyWord] & keyBit)) {
+					inputLive.keys[keyWord] |= keyBit;
+					inputLive.keysPressed[keyWord] |= keyBit;
+				}
+			} else if (inputLive.keys[keyWord] & keyBit) {
+				inputLive.keys[keyWord] &= ~keyBit;
+				inputLive.keysReleased[keyWord] |= keyBit;
+			}
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_DOWN:
+		case COCOAGAME_EVENT_MOUSE_UP:
+			inputLive.mouseX = event->mousePosition.x;
+			inputLive.mouseY = event->mousePosition.y;
+
+			if ((unsigned int) event->mouseButton.button >= 32)
+				break;
+
+			buttonBit = (uint32_t) 1 << event->mouseButton.button;
+
+			if (event->type == COCOAGAME_EVENT_MOUSE_DOWN) {
+				if (! (inputLive.buttons & buttonBit)) {
+					inputLive.buttons |= buttonBit;
+					inputLive.buttonsPressed |= buttonBit;
+				}
+			} else if (inputLive.buttons & buttonBit) {
+				inputLive.buttons &= ~buttonBit;
+				inputLive.buttonsReleased |= buttonBit;
+			}
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_MOVE:
+			inputLive.mouseX = event->mousePosition.x;
+			inputLive.mouseY = event->mousePosition.y;
+			inputLive.mouseDeltaX += event->mouseMove.deltaX;
+			inputLive.mouseDeltaY += event->mouseMove.deltaY;
+
+			if (! inputOldestMove)
+				inputOldestMove = timestamp;
+			inputNewestMove = timestamp;
+			break;
+
+		case COCOAGAME_EVENT_MOUSE_SCROLL:
+			inputLive.mouseX = event->mouseScroll.cursorX;
+			inputLive.mouseY = event->mouseScroll.cursorY;
+			inputLive.scrollX += event->mouseScroll.scrollX;
+			inputLive.scrollY += event->mouseScroll.scrollY;
+			break;
+
+		case COCOAGAME_EVENT_APP_DEACTIVATE:
+			// The key and button ups will go to another application, so nothing would ever release them.
+			CocoaGame_ReleaseAllInput();
+			break;
+
+		default:
+			break;
+	}
+
+	CocoaGame_UnlockInput();
+}
+
+static void CocoaGame_ReleaseAllInput(void)
+{
+	int i;
+	for (i = 0; i != (int) countof(inputLive.keys); ++i) {
+		inputLive.keysReleased[i] |= inputLive.keys[i];
+		inputLive.keys[i] = 0;
+	}
+
+	inputLive.buttonsReleased |= inputLive.buttons;
+	inputLive.buttons = 0;
+
+	inputLive.modifiersReleased |= inputLive.modifiers;
+	inputLive.modifiers = 0;
+}
+
+void CocoaGame_InputBeginRender(void)
+{
+	CocoaGame_LockInput();
+
+	inputLive.frame++;
+	inputSnapshot = inputLive;
+
+	memset(inputLive.keysPressed, 0, sizeof(inputLive.keysPressed));
+	memset(inputLive.keysReleased, 0, sizeof(inputLive.keysReleased));
+	inputLive.buttonsPressed = inputLive.buttonsReleased = 0;
+	inputLive.modifiersPressed = inputLive.modifiersReleased = 0;
+	inputLive.mouseDeltaX = inputLive.mouseDeltaY = 0;
+	inputLive.scrollX = inputLive.scrollY = 0;
+	inputOldestMove = inputNewestMove = 0;
+
+	CocoaGame_UnlockInput();
+}
+
+void CocoaGame_SetLateLatchEnabled(CocoaGame_Bool enabled)
+{
+	inputLateLatch = enabled;
+}
+
+CocoaGame_Bool CocoaGame_IsLateLatchEnabled(void)
+{
+	return inputLateLatch;
+}
+
+const CocoaGame_InputState *CocoaGame_LatchInput(void)
+{
+	if (! inputLateLatch)
+		return &inputSnapshot;
+
+	CocoaGame_BeginZone(__FUNCTION__);
+
+	CocoaGame_PollMouseMovement();
+
+	CocoaGame_LockInput();
+
+	uint64_t oldest = inputOldestMove;
+	uint64_t newest = inputNewestMove;
+
+	// Only the mouse is latched. The deltas move from the live state to the snapshot so the next frame doesn't see
+	// them again.
+	inputSnapshot.mouseX = inputLive.mouseX;
+	inputSnapshot.mouseY = inputLive.mouseY;
+	inputSnapshot.mouseDeltaX += inputLive.mouseDeltaX;
+	inputSnapshot.mouseDeltaY += inputLive.mouseDeltaY;
+	inputLive.mouseDeltaX = inputLive.mouseDeltaY = 0;
+	inputOldestMove = inputNewestMove = 0;
+
+	CocoaGame_UnlockInput();
+
+	if (oldest)
+		CocoaGame_FrameTimingInputConsumed(oldest, newest);
+
+	CocoaGame_EndZone();
+
+	return &inputSnapshot;
+}
+
+const CocoaGame_InputState *CocoaGame_GetInputState(void)
+{
+	return &inputSnapshot;
+}
+
+CocoaGame_Bool CocoaGame_IsKeyDown(const CocoaGame_InputState *state, unsigned int keyCode)
+{
+	return keyCode < COCOAGAME_INPUT_KEY_CODES && (state->keys[keyCode / 32] & (1u << (keyCode % 32))) != 0;
+}
+
+CocoaGame_Bool CocoaGame_WasKeyPressed(const CocoaGame_InputState *state, unsigned int keyCode)
+{
+	return keyCode < COCOAGAME_INPUT_KEY_CODES && (state->keysPressed[keyCode / 32] & (1u << (keyCode % 32))) != 0;
+}
+
+CocoaGame_Bool CocoaGame_WasKeyReleased(const CocoaGame_InputState *state, unsigned int keyCode)
+{
+	return keyCode < COCOAGAME_INPUT_KEY_CODES && (state->keysReleased[keyCode / 32] & (1u << (keyCode % 32))) != 0;
+}
+
+CocoaGame_Bool CocoaGame_IsMouseButtonDown(const CocoaGame_InputState *state, CocoaGame_MouseButton button)
+{
+	return (unsigned int) button < 32 && (state->buttons & ((uint32_t) 1 << button)) != 0;
+}
+
+CocoaGame_Bool CocoaGame_WasMouseButtonPressed(const CocoaGame_InputState *state, CocoaGame_MouseButton button)
+{
+	return (unsigned int) button < 32 && (state->buttonsPressed & ((uint32_t) 1 << button)) != 0;
+}
+
+CocoaGame_Bool CocoaGame_WasMouseButtonReleased(const CocoaGame_InputState *state, CocoaGame_MouseButton button)
+{
+	return (unsigned int) button < 32 && (state->buttonsReleased & ((uint32_t) 1 << button)) != 0;
+}
@@ -0,0 +1,646 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Job scheduler. Each worker thread, and the thread that started the scheduler, owns a work-stealing deque (Chase and
+// Lev's design, fixed size): the owner pushes and pops jobs at the bottom while idle threads steal from the top.
+// Other threads hand their jobs over through a locked injection queue. Jobs come from a fixed pool with a lock-free
+// free list, so scheduling never allocates. Workers with nothing to do sleep on a condition variable until a job is
+// added.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+//
+// Compile-time options
+//
+
+// Number of jobs that can exist at once. Jobs added while the pool is empty are run immediately by the thread adding
+// them. Must be a power of two, since it's also the size of each deque.
+#define COCOAGAME_JOB_POOL_SIZE 4096
+
+#define COCOAGAME_MAX_JOB_WORKERS 64
+
+//
+// Private types
+//
+
+typedef struct CocoaGame_Job CocoaGame_Job;
+
+struct CocoaGame_Job {
+	CocoaGame_JobFunction function;
+	void *data;
+	const char *name;
+
+	CocoaGame_JobCounter *counter;
+
+	// For COCOAGAME_JOB_BEFORE_BEGIN_RENDER jobs, the counter CocoaGame_BeginRender() waits for.
+	CocoaGame_JobCounter *frameCounter;
+
+	// Links the injection queue, frame lists and lists of jobs waiting for a counter.
+	CocoaGame_Job *next;
+
+	// Index + 1 of the next free job, while this one is free.
+	uint32_t nextFree;
+};
+
+typedef struct CocoaGame_JobDeque {
+	size_t top;
+
+	// Keep the owner's end on a different cache line from the thieves'.
+	char padding[64 - sizeof(size_t)];
+
+	size_t bottom;
+	CocoaGame_Job **jobs;
+} CocoaGame_JobDeque;
+
+typedef struct CocoaGame_JobList {
+	CocoaGame_Job *head;
+	CocoaGame_Job *tail;
+} CocoaGame_JobList;
+
+//
+// Private functions
+//
+
+static CocoaGame_Job *CocoaGame_AllocJob(void);
+static void CocoaGame_FreeJob(CocoaGame_Job *job);
+
+static CocoaGame_Bool CocoaGame_PushJob(CocoaGame_JobDeque *deque, CocoaGame_Job *job);
+static CocoaGame_Job *CocoaGame_PopJob(CocoaGame_JobDeque *deque);
+static CocoaGame_Job *CocoaGame_StealJob(CocoaGame_JobDeque *deque);
+
+static void CocoaGame_AppendJob(CocoaGame_JobList *list, CocoaGame_Job *job);
+static CocoaGame_Job *CocoaGame_NewJob(const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter);
+static void CocoaGame_SubmitJob(CocoaGame_Job *job);
+static CocoaGame_Job *CocoaGame_FindJob(void);
+static void CocoaGame_ExecuteJob(CocoaGame_Job *job);
+static void CocoaGame_FinishJobCounter(CocoaGame_JobCounter *counter);
+static void CocoaGame_ReleaseWaitingJobs(CocoaGame_JobCounter *counter);
+static void CocoaGame_ReleaseJobList(CocoaGame_JobList *list);
+static void *CocoaGame_JobWorker(void *context);
+
+//
+// Private data
+//
+
+static CocoaGame_Job jobPool[COCOAGAME_JOB_POOL_SIZE];
+
+// The free list's head: a tag in the top 32 bits, to defeat ABA, and the index + 1 of the first free job (0 if none).
+static uint64_t jobFreeHead;
+static pthread_once_t jobPoolOnce = PTHREAD_ONCE_INIT;
+
+// Deque 0 belongs to the thread that called CocoaGame_StartJobs(), the rest to the workers.
+static CocoaGame_JobDeque *jobDeques;
+static int jobDequeCount;
+static int jobWorkerCount;
+static pthread_t jobWorkers[COCOAGAME_MAX_JOB_WORKERS];
+static char jobWorkerNames[COCOAGAME_MAX_JOB_WORKERS][32];
+
+// Index of the calling thread's deque, or -1 if it doesn't have one.
+static __thread int jobThreadIndex = -1;
+
+static pthread_mutex_t jobInjectMutex = PTHREAD_MUTEX_INITIALIZER;
+static CocoaGame_JobList jobInjected;
+
+// Jobs in deques and the injection queue. Workers only sleep when this is zero.
+static int jobsQueued;
+
+static pthread_mutex_t jobSleepMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobSleepCond = PTHREAD_COND_INITIALIZER;
+static int jobSleepers;
+static CocoaGame_Bool jobStop;
+
+// Jobs held until a frame boundary, and the counter CocoaGame_BeginRender() waits on.
+static pthread_mutex_t jobFrameMutex = PTHREAD_MUTEX_INITIALIZER;
+static CocoaGame_JobList jobsBeforeBeginRender;
+static CocoaGame_JobList jobsAfterEndRender;
+static CocoaGame_JobCounter jobFrameCounter;
+
+static CocoaGame_JobStats jobStats;
+
+//
+// Job pool
+//
+
+static void CocoaGame_InitJobPool(void)
+{
+	int i;
+	for (i = 0; i != COCOAGAME_JOB_POOL_SIZE; ++i)
+		jobPool[i].nextFree = i + 2 <= COCOAGAME_JOB_POOL_SIZE ? (uint32_t) (i + 2) : 0;
+
+	__atomic_store_n(&jobFreeHead, 1, __ATOMIC_RELEASE);
+}
+
+static CocoaGame_Job *CocoaGame_AllocJob(void)
+{
+	pthread_once(&jobPoolOnce, &CocoaGame_InitJobPool);
+
+	uint64_t head = __atomic_load_n(&jobFreeHead, __ATOMIC_ACQUIRE);
+
+	for (;;) {
+		uint32_t index = (uint32_t) head;
+		if (! index)
+			return NULL;
+
+		uint32_t next = __atomic_load_n(&jobPool[index - 1].nextFree, __ATOMIC_RELAXED);
+		uint64_t newHead = ((head >> 32) + 1) << 32 | next;
+
+		if (__atomic_compare_exchange_n(&jobFreeHead, &head, newHead, TRUE, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+			return &jobPool[index - 1];
+	}
+}
+
+static void CocoaGame_FreeJob(CocoaGame_Job *job)
+{
+	uint32_t index = (uint32_t) (job - jobPool) + 1;
+	uint64_t head = __atomic_load_n(&jobFreeHead, __ATOMIC_RELAXED);
+
+	for (;;) {
+		__atomic_store_n(&job->nextFree, (uint32_t) head, __ATOMIC_RELAXED);
+		uint64_t newHead = ((head >> 32) + 1) << 32 | index;
+
+		if (__atomic_compare_exchange_n(&jobFreeHead, &head, newHead, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+	}
+}
+
+//
+// Deques
+//
+
+// Owner only. Fails if the deque is full, which can only happen if every job in the pool is in it.
+static CocoaGame_Bool CocoaGame_PushJob(CocoaGame_JobDeque *deque, CocoaGame_Job *job)
+{
+	size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	size_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+	if (bottom - top >= COCOAGAME_JOB_POOL_SIZE)
+		return FALSE;
+
+	__atomic_store_n(&deque->jobs[bottom & (COCOAGAME_JOB_POOL_SIZE - 1)], job, __ATOMIC_RELAXED);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+	return TRUE;
+}
+
+// Owner only. Takes the most recently pushed job, racing thieves for the last one.
+static CocoaGame_Job *CocoaGame_PopJob(CocoaGame_JobDeque *deque)
+{
+	size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	size_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+	if ((ptrdiff_t) (bottom - top) < 0) {
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	CocoaGame_Job *job = __atomic_load_n(&deque->jobs[bottom & (COCOAGAME_JOB_POOL_SIZE - 1)], __ATOMIC_RELAXED);
+
+	if (bottom == top) {
+		if (! __atomic_compare_exchange_n(&deque->top, &top, top + 1, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			job = NULL;
+
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+	}
+
+	return job;
+}
+
+// Any thread. Takes the oldest job. May fail if another thread gets there first.
+static CocoaGame_Job *CocoaGame_StealJob(CocoaGame_JobDeque *deque)
+{
+	size_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	size_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+	if ((ptrdiff_t) (bottom - top) <= 0)
+		return NULL;
+
+	CocoaGame_Job *job = __atomic_load_n(&deque->jobs[top & (COCOAGAME_JOB_POOL_SIZE - 1)], __ATOMIC_RELAXED);
+
+	if (! __atomic_compare_exchange_n(&deque->top, &top, top + 1, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+
+	return job;
+}
+
+//
+// Workers
+//
+
+CocoaGame_Bool CocoaGame_StartJobs(int workerCount)
+{
+	if (jobDeques)
+		return TRUE;
+
+	if (workerCount <= 0) {
+		// The thread starting the scheduler helps whenever it waits, so leave it a core.
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		workerCount = cores > 1 ? (int) cores - 1 : 1;
+	}
+
+	if (workerCount > COCOAGAME_MAX_JOB_WORKERS)
+		workerCount = COCOAGAME_MAX_JOB_WORKERS;
+
+	jobDeques = CocoaGame_AllocZeroed((size_t) workerCount + 1, sizeof(CocoaGame_JobDeque), COCOAGAME_ALLOC_THREADS);
+	if (! jobDeques)
+		return FALSE;
+
+	int i;
+	for (i = 0; i != workerCount + 1; ++i) {
+		jobDeques[i].jobs = CocoaGame_AllocZeroed(COCOAGAME_JOB_POOL_SIZE, sizeof(CocoaGame_Job *), COCOAGAME_ALLOC_THREADS);
+		if (! jobDeques[i].jobs) {
+			CocoaGame_Trace("%s: unable to allocate job deques.\n", __FUNCTION__);
+			jobDequeCount = i;
+			CocoaGame_StopJobs();
+			return FALSE;
+		}
+	}
+
+	jobDequeCount = workerCount + 1;
+	jobThreadIndex = 0;
+	jobStop = FALSE;
+
+	for (i = 0; i != workerCount; ++i) {
+		if (pthread_create(&jobWorkers[i], NULL, &CocoaGame_JobWorker, (void *) (intptr_t) (i + 1)) != 0) {
+			CocoaGame_Trace("%s: unable to create job worker %d.\n", __FUNCTION__, i + 1);
+			break;
+		}
+
+		jobWorkerCount = i + 1;
+	}
+
+	jobStats.workers = jobWorkerCount;
+
+	CocoaGame_Trace("%s: %d job workers started.\n", __FUNCTION__, jobWorkerCount);
+	return TRUE;
+}
+
+void CocoaGame_StopJobs(void)
+{
+	if (! jobDeques)
+		return;
+
+	// Finish everything that's runnable first.
+	while (__atomic_load_n(&jobsQueued, __ATOMIC_ACQUIRE)) {
+		CocoaGame_Job *job = CocoaGame_FindJob();
+		if (job)
+			CocoaGame_ExecuteJob(job);
+		else
+			sched_yield();
+	}
+
+	pthread_mutex_lock(&jobSleepMutex);
+	jobStop = TRUE;
+	pthread_cond_broadcast(&jobSleepCond);
+	pthread_mutex_unlock(&jobSleepMutex);
+
+	int i;
+	for (i = 0; i != jobWorkerCount; ++i)
+		pthread_join(jobWorkers[i], NULL);
+
+	for (i = 0; i != jobDequeCount; ++i)
+		CocoaGame_Free(jobDeques[i].jobs);
+
+	CocoaGame_Free(jobDeques);
+	jobDeques = NULL;
+	jobDequeCount = 0;
+	jobWorkerCount = 0;
+	jobThreadIndex = -1;
+	jobStats.workers = 0;
+
+	CocoaGame_Trace("%s: job workers stopped.\n", __FUNCTION__);
+}
+
+int CocoaGame_GetJobWorkerCount(void)
+{
+	return jobWorkerCount;
+}
+
+static void *CocoaGame_JobWorker(void *context)
+{
+	int index = (int) (intptr_t) context;
+	jobThreadIndex = index;
+
+	snprintf(jobWorkerNames[index - 1], sizeof(jobWorkerNames[index - 1]), "CocoaGame job worker %d", index);
+	CocoaGame_SetProfileThreadName(jobWorkerNames[index - 1]);
+
+	void *pool;
+	CocoaGame_CreateAutoreleasePool(&pool);
+
+	for (;;) {
+		CocoaGame_Job *job = CocoaGame_FindJob();
+		if (job) {
+			CocoaGame_ExecuteJob(job);
+			continue;
+		}
+
+		// Announce that we're going to sleep before the final check, so anyone adding a job after it wakes us.
+		pthread_mutex_lock(&jobSleepMutex);
+		__atomic_add_fetch(&jobSleepers, 1, __ATOMIC_SEQ_CST);
+
+		CocoaGame_Bool stop = jobStop;
+		if (! stop && ! __atomic_load_n(&jobsQueued, __ATOMIC_SEQ_CST))
+			pthread_cond_wait(&jobSleepCond, &jobSleepMutex);
+
+		__atomic_sub_fetch(&jobSleepers, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&jobSleepMutex);
+
+		if (stop)
+			break;
+	}
+
+	CocoaGame_FreeAutoreleasePool(pool);
+	return NULL;
+}
+
+//
+// Jobs
+//
+
+static void CocoaGame_AppendJob(CocoaGame_JobList *list, CocoaGame_Job *job)
+{
+	job->next = NULL;
+
+	if (list->tail)
+		list->tail->next = job;
+	else
+		list->head = job;
+
+	list->tail = job;
+}
+
+static CocoaGame_Job *CocoaGame_NewJob(const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter)
+{
+	CocoaGame_Job *job = CocoaGame_AllocJob();
+	if (! job)
+		return NULL;
+
+	job->function = function;
+	job->data = data;
+	job->name = name;
+	job->counter = counter;
+	job->frameCounter = NULL;
+	job->next = NULL;
+
+	if (counter)
+		__atomic_add_fetch(&counter->pending, 1, __ATOMIC_RELAXED);
+
+	return job;
+}
+
+static void CocoaGame_SubmitJob(CocoaGame_Job *job)
+{
+	// Without workers, nobody else would run it.
+	if (! jobDeques) {
+		__atomic_fetch_add(&jobStats.jobsInline, 1, __ATOMIC_RELAXED);
+		CocoaGame_ExecuteJob(job);
+		return;
+	}
+
+	if (jobThreadIndex < 0 || ! CocoaGame_PushJob(&jobDeques[jobThreadIndex], job)) {
+		pthread_mutex_lock(&jobInjectMutex);
+		CocoaGame_AppendJob(&jobInjected, job);
+		pthread_mutex_unlock(&jobInjectMutex);
+	}
+
+	__atomic_add_fetch(&jobsQueued, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&jobSleepers, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&jobSleepMutex);
+		pthread_cond_signal(&jobSleepCond);
+		pthread_mutex_unlock(&jobSleepMutex);
+	}
+}
+
+// Own deque first, then steal from the others, then take from the injection queue.
+static CocoaGame_Job *CocoaGame_FindJob(void)
+{
+	int self = jobThreadIndex;
+	CocoaGame_Job *job = NULL;
+
+	if (self >= 0 && jobDeques)
+		job = CocoaGame_PopJob(&jobDeques[self]);
+
+	if (! job && jobDeques) {
+		int start = self >= 0 ? self : 0;
+		int i;
+
+		for (i = 1; i <= jobDequeCount && ! job; ++i) {
+			int victim = (start + i) % jobDequeCount;
+			if (victim != self && (job = CocoaGame_StealJob(&jobDeques[victim])) != NULL)
+				__atomic_fetch_add(&jobStats.jobsStolen, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	if (! job && __atomic_load_n(&jobInjected.head, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&jobInjectMutex);
+
+		job = jobInjected.head;
+		if (job) {
+			jobInjected.head = job->next;
+			if (! jobInjected.head)
+				jobInjected.tail = NULL;
+		}
+
+		pthread_mutex_unlock(&jobInjectMutex);
+	}
+
+	if (job)
+		__atomic_sub_fetch(&jobsQueued, 1, __ATOMIC_SEQ_CST);
+
+	return job;
+}
+
+static void CocoaGame_ExecuteJob(CocoaGame_Job *job)
+{
+	CocoaGame_JobCounter *counter = job->counter;
+	CocoaGame_JobCounter *frameCounter = job->frameCounter;
+
+	uint64_t start = CocoaGame_GetNanoseconds();
+
+	CocoaGame_BeginZone(job->name ? job->name : "CocoaGame job");
+	(*job->function)(job->data);
+	CocoaGame_EndZone();
+
+	__atomic_fetch_add(&jobStats.busyNanoseconds, CocoaGame_GetNanoseconds() - start, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&jobStats.jobsRun, 1, __ATOMIC_RELAXED);
+
+	// The job goes back to the pool before its counter is released, so a waiter never finds the pool empty because of
+	// jobs that have finished.
+	CocoaGame_FreeJob(job);
+
+	if (counter)
+		CocoaGame_FinishJobCounter(counter);
+
+	if (frameCounter)
+		CocoaGame_FinishJobCounter(frameCounter);
+}
+
+static void CocoaGame_FinishJobCounter(CocoaGame_JobCounter *counter)
+{
+	if (__atomic_sub_fetch(&counter->pending, 1, __ATOMIC_ACQ_REL) == 0)
+		CocoaGame_ReleaseWaitingJobs(counter);
+}
+
+// Submit the jobs waiting for counter to reach zero. Whoever takes the list submits it, so each job is submitted once.
+static void CocoaGame_ReleaseWaitingJobs(CocoaGame_JobCounter *counter)
+{
+	CocoaGame_Job *job = __atomic_exchange_n((CocoaGame_Job **) &counter->waiting, NULL, __ATOMIC_ACQ_REL);
+
+	while (job) {
+		CocoaGame_Job *next = job->next;
+		CocoaGame_SubmitJob(job);
+		job = next;
+	}
+}
+
+void CocoaGame_RunJob(const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter)
+{
+	CocoaGame_Job *job = CocoaGame_NewJob(name, function, data, counter);
+
+	if (! job) {
+		// The pool's empty, so there's plenty for the workers to be getting on with.
+		__atomic_fetch_add(&jobStats.jobsInline, 1, __ATOMIC_RELAXED);
+
+		CocoaGame_BeginZone(name ? name : "CocoaGame job");
+		(*function)(data);
+		CocoaGame_EndZone();
+		return;
+	}
+
+	CocoaGame_SubmitJob(job);
+}
+
+void CocoaGame_RunJobAfter(CocoaGame_JobCounter *dependency, const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter)
+{
+	if (! dependency || CocoaGame_AreJobsFinished(dependency)) {
+		CocoaGame_RunJob(name, function, data, counter);
+		return;
+	}
+
+	CocoaGame_Job *job = CocoaGame_NewJob(name, function, data, counter);
+	if (! job) {
+		CocoaGame_WaitForJobs(dependency);
+		CocoaGame_RunJob(name, function, data, counter);
+		return;
+	}
+
+	CocoaGame_Job *head = __atomic_load_n((CocoaGame_Job **) &dependency->waiting, __ATOMIC_RELAXED);
+	do {
+		job->next = head;
+	} while (! __atomic_compare_exchange_n((CocoaGame_Job **) &dependency->waiting, &head, job, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	// If the dependency finished while we were adding the job, it may already have released the waiting list.
+	if (CocoaGame_AreJobsFinished(dependency))
+		CocoaGame_ReleaseWaitingJobs(dependency);
+}
+
+void CocoaGame_RunJobAt(CocoaGame_JobTiming timing, const char *name, CocoaGame_JobFunction function, void *data, CocoaGame_JobCounter *counter)
+{
+	if (timing == COCOAGAME_JOB_NOW) {
+		CocoaGame_RunJob(name, function, data, counter);
+		return;
+	}
+
+	CocoaGame_Job *job = CocoaGame_NewJob(name, function, data, counter);
+	if (! job) {
+		CocoaGame_RunJob(name, function, data, counter);
+		return;
+	}
+
+	pthread_mutex_lock(&jobFrameMutex);
+
+	if (timing == COCOAGAME_JOB_BEFORE_BEGIN_RENDER) {
+		job->frameCounter = &jobFrameCounter;
+		__atomic_add_fetch(&jobFrameCounter.pending, 1, __ATOMIC_RELAXED);
+		CocoaGame_AppendJob(&jobsBeforeBeginRender, job);
+	} else
+		CocoaGame_AppendJob(&jobsAfterEndRender, job);
+
+	pthread_mutex_unlock(&jobFrameMutex);
+}
+
+CocoaGame_Bool CocoaGame_AreJobsFinished(const CocoaGame_JobCounter *counter)
+{
+	return __atomic_load_n(&counter->pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+void CocoaGame_WaitForJobs(CocoaGame_JobCounter *counter)
+{
+	if (CocoaGame_AreJobsFinished(counter))
+		return;
+
+	CocoaGame_BeginZone(__FUNCTION__);
+
+	// Help rather than block, so waiting never leaves a core idle while there's work.
+	while (! CocoaGame_AreJobsFinished(counter)) {
+		CocoaGame_Job *job = CocoaGame_FindJob();
+		if (job) {
+			__atomic_fetch_add(&jobStats.jobsHelped, 1, __ATOMIC_RELAXED);
+			CocoaGame_ExecuteJob(job);
+		} else
+			sched_yield();
+	}
+
+	CocoaGame_EndZone();
+}
+
+static void CocoaGame_ReleaseJobList(CocoaGame_JobList *list)
+{
+	pthread_mutex_lock(&jobFrameMutex);
+	CocoaGame_Job *job = list->head;
+	list->head = list->tail = NULL;
+	pthread_mutex_unlock(&jobFrameMutex);
+
+	while (job) {
+		CocoaGame_Job *next = job->next;
+		CocoaGame_SubmitJob(job);
+		job = next;
+	}
+}
+
+void CocoaGame_JobsBeginRender(void)
+{
+	if (! __atomic_load_n(&jobsBeforeBeginRender.head, __ATOMIC_RELAXED))
+		return;
+
+	CocoaGame_ReleaseJobList(&jobsBeforeBeginRender);
+	CocoaGame_WaitForJobs(&jobFrameCounter);
+}
+
+void CocoaGame_JobsFinishRender(void)
+{
+	if (! __atomic_load_n(&jobsAfterEndRender.head, __ATOMIC_RELAXED))
+		return;
+
+	CocoaGame_ReleaseJobList(&jobsAfterEndRender);
+}
+
+void CocoaGame_GetJobStats(CocoaGame_JobStats *stats)
+{
+	stats->workers = jobStats.workers;
+	stats->jobsRun = __atomic_load_n(&jobStats.jobsRun, __ATOMIC_RELAXED);
+	stats->jobsStolen = __atomic_load_n(&jobStats.jobsStolen, __ATOMIC_RELAXED);
+	stats->jobsHelped = __atomic_load_n(&jobStats.jobsHelped, __ATOMIC_RELAXED);
+	stats->jobsInline = __atomic_load_n(&jobStats.jobsInline, __ATOMIC_RELAXED);
+	stats->busyNanoseconds = __atomic_load_n(&jobStats.busyNanoseconds, __ATOMIC_RELAXED);
+}
+
+void CocoaGame_ResetJobStats(void)
+{
+	__atomic_store_n(&jobStats.jobsRun, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&jobStats.jobsStolen, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&jobStats.jobsHelped, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&jobStats.jobsInline, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&jobStats.busyNanoseconds, 0, __ATOMIC_RELAXED);
+}
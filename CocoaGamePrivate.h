@@ -0,0 +1,337 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Declarations shared between the platform independent core (CocoaGameCore.c) and the platform backends
+// (CocoaGame.m on the Mac, CocoaGameHeadless.c on Linux). Not part of the public API.
+//
+
+#ifndef COCOAGAMEPRIVATE_H
+#define COCOAGAMEPRIVATE_H
+
+// The portable modules use OpenGL 2.1 plus extensions (framebuffer objects, sync objects) that are declared in
+// glext.h. Mesa only declares their prototypes if asked, before gl.h is first included.
+#ifdef __APPLE__
+	#include <OpenGL/gl.h>
+	#include <OpenGL/glext.h>
+#else
+	#define GL_GLEXT_PROTOTYPES
+	#include <GL/gl.h>
+	#include <GL/glext.h>
+#endif
+
+#include "CocoaGame.h"
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define countof(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+//
+// Memory allocation (CocoaGameAlloc.c)
+//
+
+/// Like malloc(), calloc(), realloc(), free() and strdup(), but using the allocator set with CocoaGame_SetAllocator()
+/// and counted against category. Everything the library allocates for itself must go through these. Memory must be
+/// freed with CocoaGame_Free(), and a block keeps the category it was first allocated with when it's reallocated.
+void *CocoaGame_Alloc(size_t size, CocoaGame_AllocCategory category);
+void *CocoaGame_AllocZeroed(size_t count, size_t size, CocoaGame_AllocCategory category);
+void *CocoaGame_Realloc(void *memory, size_t size, CocoaGame_AllocCategory category);
+void CocoaGame_Free(void *memory);
+char *CocoaGame_StrDup(const char *string, CocoaGame_AllocCategory category);
+
+//
+// Files (CocoaGameCore.c)
+//
+
+/// Writes the file at path by calling writer() on a temporary file beside it, which is then renamed over path, so a
+/// crash can't leave a truncated file behind. writer() returns FALSE on failure, and the temporary file is removed.
+/// Returns FALSE if the file couldn't be written (including running out of memory).
+CocoaGame_Bool CocoaGame_WriteFileSafely(const char *path, CocoaGame_Bool (*writer)(FILE *fp, void *context), void *context);
+
+//
+// Abort handling (implemented by each backend)
+//
+
+void CocoaGame_DefaultAbortWithMessageHandler(const char *title, const char *format, va_list argptr);
+
+//
+// Video mode list (CocoaGameCore.c)
+//
+
+/// Resize the video mode list so it can hold count modes and return it for the backend to fill in.
+CocoaGame_VideoMode *CocoaGame_AllocVideoModes(int count);
+
+/// Sort the modes filled in after CocoaGame_AllocVideoModes() and remove duplicates.
+void CocoaGame_FinishVideoModes(void);
+
+void CocoaGame_FreeVideoModes(void);
+
+//
+// Modifiers (CocoaGameCore.c)
+//
+
+/// Convert NSEvent modifier flags, including the device-dependent left/right bits, to CocoaGame_Modifiers. If 
+/// neither side's bit is set for a modifier, it's assumed to be the left one.
+unsigned int CocoaGame_TranslateModifierFlags(unsigned long cocoaModifierFlags);
+
+//
+// Event queue (CocoaGameCore.c)
+//
+
+/// Allocate the queue using the capacity given to CocoaGame_SetEventQueueCapacity() and empty it.
+CocoaGame_Bool CocoaGame_InitEventQueue(void);
+
+void CocoaGame_ShutdownEventQueue(void);
+
+/// Returns TRUE if there are events in the queue. May be called from any thread, but is only a hint unless called by
+/// the consumer.
+CocoaGame_Bool CocoaGame_InputWaiting(void);
+
+/// Returns the number of events consumed by handlers since the queue was created. Never reset.
+uint64_t CocoaGame_GetHandledEventCount(void);
+
+//
+// Input state (CocoaGameInput.c)
+//
+
+/// Forget all input. Called when the event queue is initialised.
+void CocoaGame_ResetInputState(void);
+
+/// Called by CocoaGame_QueueEvent() for every event, from whichever thread queued it, with the time it was queued.
+void CocoaGame_UpdateInputState(const CocoaGame_Event *event, uint64_t timestamp);
+
+/// Snapshot the input state and start accumulating the next frame's.
+void CocoaGame_InputBeginRender(void);
+
+/// Implemented by each backend. Process any pending mouse movement, and nothing else, for CocoaGame_LatchInput().
+void CocoaGame_PollMouseMovement(void);
+
+//
+// Frame hooks (CocoaGameCore.c)
+//
+
+/// Called by each backend's CocoaGame_BeginRender(), whether or not the frame is going to be rendered.
+void CocoaGame_CoreBeginRender(void);
+
+/// Called by each backend's CocoaGame_BeginRender() once the OpenGL context is current, only if the frame is going to
+/// be rendered.
+void CocoaGame_CoreBeginFrame(void);
+
+/// Called by each backend's CocoaGame_EndRender() before the frame is flushed. discarded is TRUE if
+/// CocoaGame_DiscardRender() was called, in which case the frame won't be shown.
+void CocoaGame_CoreEndRender(CocoaGame_Bool discarded);
+
+/// Called by each backend's CocoaGame_EndRender() after the frame is flushed. syncedToRefresh is TRUE if the flush
+/// may have waited for a vertical blank, in which case its duration says nothing about the cost of the frame.
+void CocoaGame_CoreFinishRender(CocoaGame_Bool syncedToRefresh);
+
+/// Called by each backend after making an OpenGL context current on the calling thread, context being the backend's
+/// handle for it. NULL if no context is current or the context is a temporary one.
+void CocoaGame_CoreContextCurrent(void *context);
+
+/// Called by each backend before destroying a context passed to CocoaGame_CoreContextCurrent().
+void CocoaGame_CoreContextDestroyed(void *context);
+
+//
+// Idle waiting (CocoaGameIdle.c)
+//
+
+/// Called by CocoaGame_QueueEvent() once the event is in the queue or has been handled, from whichever thread queued
+/// it. Wakes CocoaGame_WaitForEvents() if it's blocked.
+void CocoaGame_IdleEventQueued(void);
+
+/// Track whether frames are being rendered, for CocoaGame_GetFrameState().
+void CocoaGame_IdleBeginRender(void);
+void CocoaGame_IdleBeginFrame(void);
+
+/// Implemented by each backend. Block the calling (main) thread until CocoaGame_WakeBlocked() is called or nanoseconds
+/// (UINT64_MAX for no limit) have passed. May return early. A wake while not blocked makes the next call return 
+/// immediately.
+void CocoaGame_BlockUntilWoken(uint64_t nanoseconds);
+
+/// Implemented by each backend. Wake CocoaGame_BlockUntilWoken(). May be called from any thread.
+void CocoaGame_WakeBlocked(void);
+
+/// Implemented by each backend. Returns TRUE if the window is rendering but can't be seen. Main thread only.
+CocoaGame_Bool CocoaGame_IsViewOccluded(void);
+
+//
+// Jobs (CocoaGameJobs.c)
+//
+
+/// Run the jobs held for CocoaGame_BeginRender() and wait for them to finish.
+void CocoaGame_JobsBeginRender(void);
+
+/// Release the jobs held until after CocoaGame_EndRender().
+void CocoaGame_JobsFinishRender(void);
+
+//
+// Frame timing (CocoaGameTiming.c)
+//
+
+/// Returns the time to pass to CocoaGame_EndTiming(), or 0 if frame timing is disabled.
+uint64_t CocoaGame_BeginTiming(void);
+
+/// Add the time since start to the current frame's phase.
+void CocoaGame_EndTiming(CocoaGame_FramePhase phase, uint64_t start);
+
+void CocoaGame_FrameTimingBeginRender(void);
+void CocoaGame_FrameTimingEndRender(void);
+
+/// Record the flush of a frame, and so the age of the input consumed since the last one.
+void CocoaGame_FrameTimingFinishRender(CocoaGame_Bool discarded);
+
+/// The application has consumed events queued at the given times. May be called on any one thread.
+void CocoaGame_FrameTimingInputConsumed(uint64_t oldest, uint64_t newest);
+
+//
+// Frame capture (CocoaGameCapture.c)
+//
+
+/// Start reading back the frame about to be flushed, if capturing.
+void CocoaGame_CaptureEndRender(void);
+
+/// Stop capturing and free the pixel buffers. Called by each backend with the OpenGL context current, before the
+/// context is destroyed.
+void CocoaGame_ShutdownCapture(void);
+
+//
+// Render targets (CocoaGameRenderTarget.c)
+//
+
+/// Bind the dynamic resolution render target, if enabled.
+void CocoaGame_RenderTargetsBeginFrame(void);
+
+/// Switch back to the screen, upscale the dynamic resolution render target and free render targets that have been
+/// released for a while.
+void CocoaGame_RenderTargetsEndRender(void);
+
+/// Adjust the dynamic resolution scale once the frame's been flushed.
+void CocoaGame_RenderTargetsFinishRender(CocoaGame_Bool syncedToRefresh);
+
+/// Free every render target. Called by each backend with the OpenGL context current, before the context is 
+/// destroyed.
+void CocoaGame_ShutdownRenderTargets(void);
+
+//
+// Transient buffers (CocoaGameTransient.c)
+//
+
+/// Move on to the next region of the ring, waiting for the GPU to finish with it if necessary.
+void CocoaGame_TransientBeginFrame(void);
+
+/// Fence the frame's region.
+void CocoaGame_TransientEndRender(void);
+
+/// Free the buffer. Called by each backend with the OpenGL context current, before the context is destroyed.
+void CocoaGame_ShutdownTransient(void);
+
+//
+// Texture archives (CocoaGameTextureArchive.c)
+//
+
+/// Start a new frame for residency, so textures used from now on aren't evicted until the next one.
+void CocoaGame_TextureArchivesBeginFrame(void);
+
+//
+// OpenGL cache (CocoaGameGLCache.c)
+//
+
+/// Returns the cached information for the current device, or NULL. Free it with CocoaGame_FreeGLInfo().
+CocoaGame_GLInfo *CocoaGame_LookupGLInfoCache(void);
+
+/// Find the configuration CocoaGame_InitGL() ended up with last time requested was asked for on the current device.
+CocoaGame_Bool CocoaGame_LookupGLConfigCache(const CocoaGame_GLConfig *requested, CocoaGame_GLConfig *actual);
+
+/// Called with a context current to record its information and, if requested isn't NULL, the configuration found for
+/// requested. Discards everything cached for the device if the driver has changed.
+void CocoaGame_UpdateGLCache(const CocoaGame_GLConfig *requested, const CocoaGame_GLConfig *actual);
+
+/// Implemented by each backend. Writes a string identifying the graphics device and driver to key, without creating
+/// a context. Returns FALSE if the device can't be identified.
+CocoaGame_Bool CocoaGame_GetGLDeviceKey(char *key, size_t size);
+
+//
+// Program binary cache (CocoaGameProgramCache.c)
+//
+
+/// Track the calling thread's current context, and forget what was learnt about a context, as for the state cache.
+void CocoaGame_ProgramCacheContextCurrent(void *context);
+void CocoaGame_ProgramCacheContextDestroyed(void *context);
+
+//
+// OpenGL call tracing (CocoaGameGLTrace.c)
+//
+
+/// Start and stop counting calls.
+void CocoaGame_GLTraceBeginFrame(void);
+void CocoaGame_GLTraceEndRender(void);
+
+/// Select the shadowed state of the calling thread's current context, and forget a context's shadowed state.
+void CocoaGame_GLTraceContextCurrent(void *context);
+void CocoaGame_GLTraceContextDestroyed(void *context);
+
+//
+// OpenGL state cache (CocoaGameGLState.c)
+//
+
+/// Select the cached state of the calling thread's current context, and forget a context's cached state.
+void CocoaGame_GLStateContextCurrent(void *context);
+void CocoaGame_GLStateContextDestroyed(void *context);
+
+/// Forget the current context's framebuffer bindings, after binding a framebuffer directly.
+void CocoaGame_InvalidateGLFramebufferState(void);
+
+/// Returns TRUE for the capabilities glEnable() sets for the active texture unit rather than the whole context.
+CocoaGame_Bool CocoaGame_IsGLCapabilityPerTextureUnit(GLenum cap);
+
+//
+// Shared contexts (implemented by each backend)
+//
+
+/// Create an OpenGL context which shares objects with the main context, to be made current on another thread. Returns
+/// NULL on failure.
+void *CocoaGame_CreateSharedContext(void);
+
+/// Make a context created by CocoaGame_CreateSharedContext() current on the calling thread, or release the calling 
+/// thread's context if context is NULL.
+CocoaGame_Bool CocoaGame_MakeSharedContextCurrent(void *context);
+
+/// The context must not be current on any thread.
+void CocoaGame_DestroySharedContext(void *context);
+
+//
+// Render thread (CocoaGameRenderThread.c)
+//
+
+/// Returns TRUE if called on the thread started by CocoaGame_StartRenderThread().
+CocoaGame_Bool CocoaGame_IsRenderThread(void);
+
+//
+// Render thread support (implemented by each backend)
+//
+
+/// Called on the main thread before the render thread starts. Releases the OpenGL context from the calling thread
+/// and records any state the render thread can't safely read for itself.
+void CocoaGame_PrepareRenderThread(void);
+
+/// Called on the render thread before it exits. Releases the OpenGL context so the main thread can use it again.
+void CocoaGame_FinishRenderThread(void);
+
+/// Called on the main thread once the render thread has exited, or if it couldn't be started (after calling
+/// CocoaGame_FinishRenderThread() itself). Makes the OpenGL context current on the main thread again.
+void CocoaGame_ReclaimContext(void);
+
+/// Held by the render thread for each frame. The main thread takes it while changing anything the render thread
+/// reads in CocoaGame_BeginRender() (e.g., the mode after a resize).
+void CocoaGame_LockContext(void);
+void CocoaGame_UnlockContext(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,411 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Profiling zones. Each thread that begins a zone while profiling gets its own single producer, single consumer ring
+// of fixed size records, so recording a zone is a timestamp and a store. A flusher thread drains the rings and writes
+// Chrome's trace event format (load the file in chrome://tracing or Perfetto). When a thread exits its ring is handed
+// on to the next thread that needs one.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+//
+// Compile-time options
+//
+
+// Number of records each thread's ring can hold. If the flusher can't keep up, zones are dropped (and counted).
+#define COCOAGAME_PROFILE_RING_SIZE 16384
+
+// How often the flusher thread drains the rings, in seconds.
+#define COCOAGAME_PROFILE_FLUSH_INTERVAL 0.01
+
+//
+// Private types
+//
+
+typedef enum CocoaGame_ProfileRecordType {
+	COCOAGAME_PROFILE_BEGIN,
+	COCOAGAME_PROFILE_BEGIN_WITH_VALUE,
+	COCOAGAME_PROFILE_END,
+} CocoaGame_ProfileRecordType;
+
+typedef struct CocoaGame_ProfileRecord {
+	uint64_t timestamp;
+	const char *name;
+	int64_t value;
+	int type;
+} CocoaGame_ProfileRecord;
+
+typedef struct CocoaGame_ProfileThread {
+	struct CocoaGame_ProfileThread *next;
+
+	// A ring keeps its ID when it's reused, so the threads that have had it share a row in the trace.
+	int threadID;
+
+	// TRUE while a thread is using the ring. Cleared when the thread exits, so another thread can claim it.
+	int owned;
+
+	// Written by the owning thread, read by the flusher.
+	size_t write;
+
+	// Written by the flusher, read by the owning thread.
+	size_t read;
+
+	uint64_t droppedRecords;
+
+	// Only touched by the owning thread. depth is the number of open zones. If a zone is dropped, everything nested
+	// within it is dropped too, until depth returns to droppingBelowDepth, so begins and ends stay balanced.
+	int depth;
+	int droppingBelowDepth;
+
+	// The owning thread's name. The flusher writes it once per profiling session, or again if it changes.
+	const char *name;
+	int nameSession;
+
+	CocoaGame_ProfileRecord records[COCOAGAME_PROFILE_RING_SIZE];
+} CocoaGame_ProfileThread;
+
+//
+// Private functions
+//
+
+static CocoaGame_ProfileThread *CocoaGame_GetProfileThread(void);
+static CocoaGame_ProfileThread *CocoaGame_ClaimProfileThread(void);
+static void CocoaGame_CreateProfileThreadKey(void);
+static void CocoaGame_ReleaseProfileThread(void *thread);
+static void CocoaGame_WriteProfileRecord(int type, const char *name, int64_t value);
+static void *CocoaGame_ProfileFlusher(void *context);
+static void CocoaGame_FlushProfileThreads(void);
+static void CocoaGame_WriteProfileString(const char *string);
+
+//
+// Private data
+//
+
+static int profiling;
+static FILE *profileFile;
+static uint64_t profileStartTime;
+static pthread_t profileFlusherThread;
+static int profileFlusherStop;
+static CocoaGame_Bool profileWroteEvent;
+static int profileSession;
+
+// Rings are pushed on to the front of this list and never removed, since the flusher may be reading one whose thread
+// has exited. They're reused instead.
+static CocoaGame_ProfileThread *profileThreads;
+static int profileNextThreadID = 1;
+
+// Its destructor releases the calling thread's ring when the thread exits.
+static pthread_once_t profileThreadKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t profileThreadKey;
+
+static __thread CocoaGame_ProfileThread *currentProfileThread;
+
+// Kept here rather than in a ring, so naming a thread doesn't allocate one.
+static __thread const char *currentProfileThreadName;
+
+//
+// Profiling
+//
+
+CocoaGame_Bool CocoaGame_StartProfiling(const char *path)
+{
+	CocoaGame_StopProfiling();
+
+	profileFile = fopen(path, "w");
+	if (! profileFile) {
+		CocoaGame_Trace("%s: unable to create \"%s\".\n", __FUNCTION__, path);
+		return FALSE;
+	}
+
+	fputs("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [", profileFile);
+	profileWroteEvent = FALSE;
+
+	// Discard anything left over from a previous session.
+	CocoaGame_ProfileThread *thread;
+	for (thread = __atomic_load_n(&profileThreads, __ATOMIC_ACQUIRE); thread; thread = thread->next)
+		__atomic_store_n(&thread->read, __atomic_load_n(&thread->write, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+	profileStartTime = CocoaGame_GetNanoseconds();
+	profileFlusherStop = FALSE;
+	++profileSession;
+
+	if (pthread_create(&profileFlusherThread, NULL, CocoaGame_ProfileFlusher, NULL) != 0) {
+		CocoaGame_Trace("%s: unable to start flusher thread.\n", __FUNCTION__);
+		fclose(profileFile);
+		profileFile = NULL;
+		return FALSE;
+	}
+
+	__atomic_store_n(&profiling, TRUE, __ATOMIC_RELEASE);
+
+	CocoaGame_Trace("%s: profiling to \"%s\".\n", __FUNCTION__, path);
+	return TRUE;
+}
+
+void CocoaGame_StopProfiling(void)
+{
+	if (! profileFile)
+		return;
+
+	__atomic_store_n(&profiling, FALSE, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&profileFlusherStop, TRUE, __ATOMIC_RELEASE);
+	pthread_join(profileFlusherThread, NULL);
+
+	uint64_t dropped = 0;
+	CocoaGame_ProfileThread *thread;
+	for (thread = __atomic_load_n(&profileThreads, __ATOMIC_ACQUIRE); thread; thread = thread->next) {
+		dropped += __atomic_load_n(&thread->droppedRecords, __ATOMIC_RELAXED);
+		__atomic_store_n(&thread->droppedRecords, 0, __ATOMIC_RELAXED);
+	}
+
+	fputs("\n]}\n", profileFile);
+
+	if (fclose(profileFile) != 0)
+		CocoaGame_Trace("%s: error writing profile.\n", __FUNCTION__);
+
+	profileFile = NULL;
+
+	if (dropped)
+		CocoaGame_Trace("%s: %llu zones were dropped because the flusher couldn't keep up.\n", __FUNCTION__,
+			(unsigned long long) dropped);
+}
+
+CocoaGame_Bool CocoaGame_IsProfiling(void)
+{
+	return __atomic_load_n(&profiling, __ATOMIC_RELAXED);
+}
+
+void CocoaGame_BeginZone(const char *name)
+{
+	if (__atomic_load_n(&profiling, __ATOMIC_RELAXED))
+		CocoaGame_WriteProfileRecord(COCOAGAME_PROFILE_BEGIN, name, 0);
+}
+
+void CocoaGame_BeginZoneWithValue(const char *name, int64_t value)
+{
+	if (__atomic_load_n(&profiling, __ATOMIC_RELAXED))
+		CocoaGame_WriteProfileRecord(COCOAGAME_PROFILE_BEGIN_WITH_VALUE, name, value);
+}
+
+void CocoaGame_EndZone(void)
+{
+	if (__atomic_load_n(&profiling, __ATOMIC_RELAXED))
+		CocoaGame_WriteProfileRecord(COCOAGAME_PROFILE_END, NULL, 0);
+}
+
+void CocoaGame_SetProfileThreadName(const char *name)
+{
+	currentProfileThreadName = name;
+
+	// A thread that doesn't have a ring yet gets the name when it does.
+	CocoaGame_ProfileThread *thread = currentProfileThread;
+	if (thread) {
+		__atomic_store_n(&thread->name, name, __ATOMIC_RELEASE);
+		__atomic_store_n(&thread->nameSession, 0, __ATOMIC_RELEASE);
+	}
+}
+
+// Only called while profiling, so threads that never record a zone while profiling never get a ring.
+static CocoaGame_ProfileThread *CocoaGame_GetProfileThread(void)
+{
+	CocoaGame_ProfileThread *thread = currentProfileThread;
+	if (thread)
+		return thread;
+
+	pthread_once(&profileThreadKeyOnce, &CocoaGame_CreateProfileThreadKey);
+
+	thread = CocoaGame_ClaimProfileThread();
+
+	if (! thread) {
+		thread = CocoaGame_AllocZeroed(1, sizeof(*thread), COCOAGAME_ALLOC_THREADS);
+		if (! thread)
+			return NULL;
+
+		thread->threadID = __atomic_fetch_add(&profileNextThreadID, 1, __ATOMIC_RELAXED);
+		thread->owned = TRUE;
+		thread->droppingBelowDepth = -1;
+		thread->name = currentProfileThreadName;
+
+		thread->next = __atomic_load_n(&profileThreads, __ATOMIC_RELAXED);
+		while (! __atomic_compare_exchange_n(&profileThreads, &thread->next, thread, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			{}
+	}
+
+	pthread_setspecific(profileThreadKey, thread);
+	currentProfileThread = thread;
+	return thread;
+}
+
+// Take over the ring of a thread that has exited, if there is one. Its read and write positions carry on from where
+// they were, so the flusher doesn't need to know.
+static CocoaGame_ProfileThread *CocoaGame_ClaimProfileThread(void)
+{
+	CocoaGame_ProfileThread *thread;
+	for (thread = __atomic_load_n(&profileThreads, __ATOMIC_ACQUIRE); thread; thread = thread->next) {
+		int owned = FALSE;
+		if (! __atomic_load_n(&thread->owned, __ATOMIC_RELAXED) &&
+			__atomic_compare_exchange_n(&thread->owned, &owned, TRUE, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if (! thread)
+		return NULL;
+
+	// Zones the last thread left open are never closed, but this thread's zones aren't nested inside them.
+	thread->depth = 0;
+	thread->droppingBelowDepth = -1;
+
+	__atomic_store_n(&thread->name, currentProfileThreadName, __ATOMIC_RELEASE);
+	__atomic_store_n(&thread->nameSession, 0, __ATOMIC_RELEASE);
+
+	return thread;
+}
+
+static void CocoaGame_CreateProfileThreadKey(void)
+{
+	pthread_key_create(&profileThreadKey, &CocoaGame_ReleaseProfileThread);
+}
+
+// Called as a thread exits.
+static void CocoaGame_ReleaseProfileThread(void *thread)
+{
+	__atomic_store_n(&((CocoaGame_ProfileThread *) thread)->owned, FALSE, __ATOMIC_RELEASE);
+}
+
+static void CocoaGame_WriteProfileRecord(int type, const char *name, int64_t value)
+{
+	CocoaGame_ProfileThread *thread = CocoaGame_GetProfileThread();
+	if (! thread)
+		return;
+
+	size_t write = thread->write;
+
+	if (type == COCOAGAME_PROFILE_END) {
+		if (thread->depth > 0)
+			--thread->depth;
+
+		if (thread->droppingBelowDepth >= 0) {
+			if (thread->depth == thread->droppingBelowDepth)
+				thread->droppingBelowDepth = -1;
+
+			return;
+		}
+	} else {
+		size_t read = __atomic_load_n(&thread->read, __ATOMIC_ACQUIRE);
+
+		// A begin needs room for its own end and those of every open zone, so ends are never dropped.
+		if (thread->droppingBelowDepth < 0 && write - read + (size_t) thread->depth + 2 > COCOAGAME_PROFILE_RING_SIZE)
+			thread->droppingBelowDepth = thread->depth;
+
+		++thread->depth;
+
+		if (thread->droppingBelowDepth >= 0) {
+			__atomic_fetch_add(&thread->droppedRecords, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	CocoaGame_ProfileRecord *record = &thread->records[write % COCOAGAME_PROFILE_RING_SIZE];
+	record->timestamp = CocoaGame_GetNanoseconds();
+	record->name = name;
+	record->value = value;
+	record->type = type;
+
+	__atomic_store_n(&thread->write, write + 1, __ATOMIC_RELEASE);
+}
+
+static void *CocoaGame_ProfileFlusher(void *context)
+{
+	(void) context;
+
+	// Not CocoaGame_Sleep(), which pumps the main thread's run loop on the Mac.
+	struct timespec interval;
+	interval.tv_sec = 0;
+	interval.tv_nsec = (long) (COCOAGAME_PROFILE_FLUSH_INTERVAL * 1e9);
+
+	while (! __atomic_load_n(&profileFlusherStop, __ATOMIC_ACQUIRE)) {
+		CocoaGame_FlushProfileThreads();
+		nanosleep(&interval, NULL);
+	}
+
+	// Pick up anything written before profiling was switched off.
+	CocoaGame_FlushProfileThreads();
+	return NULL;
+}
+
+static void CocoaGame_FlushProfileThreads(void)
+{
+	CocoaGame_ProfileThread *thread;
+	for (thread = __atomic_load_n(&profileThreads, __ATOMIC_ACQUIRE); thread; thread = thread->next) {
+		const char *name = __atomic_load_n(&thread->name, __ATOMIC_ACQUIRE);
+		if (name && __atomic_load_n(&thread->nameSession, __ATOMIC_ACQUIRE) != profileSession) {
+			fputs(profileWroteEvent ? ",\n" : "\n", profileFile);
+			profileWroteEvent = TRUE;
+
+			fputs("{\"ph\": \"M\", \"name\": \"thread_name\", \"args\": {\"name\": ", profileFile);
+			CocoaGame_WriteProfileString(name);
+			fprintf(profileFile, "}, \"pid\": 1, \"tid\": %d}", thread->threadID);
+
+			__atomic_store_n(&thread->nameSession, profileSession, __ATOMIC_RELEASE);
+		}
+
+		size_t read = thread->read;
+		size_t write = __atomic_load_n(&thread->write, __ATOMIC_ACQUIRE);
+
+		for (; read != write; ++read) {
+			const CocoaGame_ProfileRecord *record = &thread->records[read % COCOAGAME_PROFILE_RING_SIZE];
+
+			// Zones begun just before profiling started are placed at the start of the trace.
+			uint64_t time = record->timestamp > profileStartTime ? record->timestamp - profileStartTime : 0;
+
+			fputs(profileWroteEvent ? ",\n" : "\n", profileFile);
+			profileWroteEvent = TRUE;
+
+			switch (record->type) {
+				case COCOAGAME_PROFILE_BEGIN:
+				case COCOAGAME_PROFILE_BEGIN_WITH_VALUE:
+					fputs("{\"ph\": \"B\", \"name\": ", profileFile);
+					CocoaGame_WriteProfileString(record->name);
+					break;
+
+				case COCOAGAME_PROFILE_END:
+					fputs("{\"ph\": \"E\"", profileFile);
+					break;
+			}
+
+			fprintf(profileFile, ", \"pid\": 1, \"tid\": %d, \"ts\": %llu.%03u", thread->threadID,
+				(unsigned long long) (time / 1000), (unsigned int) (time % 1000));
+
+			if (record->type == COCOAGAME_PROFILE_BEGIN_WITH_VALUE)
+				fprintf(profileFile, ", \"args\": {\"value\": %lld}", (long long) record->value);
+
+			fputs("}", profileFile);
+		}
+
+		__atomic_store_n(&thread->read, read, __ATOMIC_RELEASE);
+	}
+}
+
+static void CocoaGame_WriteProfileString(const char *string)
+{
+	fputc('"', profileFile);
+
+	for (; *string; ++string) {
+		if (*string == '"' || *string == '\\')
+			fputc('\\', profileFile);
+
+		if ((unsigned char) *string >= 32)
+			fputc(*string, profileFile);
+	}
+
+	fputc('"', profileFile);
+}
@@ -0,0 +1,494 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Program binary cache. CocoaGame_CreateProgram() hashes a program's shader sources and attribute bindings together
+// with the GL_VENDOR, GL_RENDERER and GL_VERSION of the current context, and looks for a file named after the hash in
+// the cache directory. If one exists the driver is given the binary it holds, otherwise (or if the driver rejects it)
+// the program is compiled and linked from source and the driver's binary for it is written to the cache. A driver
+// update changes the strings and so the hash, so stale binaries are simply never looked up again.
+//
+// Each file holds a CocoaGame_ProgramCacheHeader followed by the binary. Program binaries need OpenGL 4.1 or
+// ARB_get_program_binary, and a driver which offers at least one binary format. Without them every program is
+// compiled.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+//
+// Compile-time options
+//
+
+// The Mac's legacy OpenGL headers don't have program binaries, and its drivers don't offer any binary formats.
+#ifndef COCOAGAME_PROGRAM_BINARIES
+	#ifdef __APPLE__
+		#define COCOAGAME_PROGRAM_BINARIES 0
+	#else
+		#define COCOAGAME_PROGRAM_BINARIES 1
+	#endif
+#endif
+
+// Written at the start of each file. Files with anything else are ignored (and replaced).
+#define COCOAGAME_PROGRAM_CACHE_MAGIC "CGProg1"
+
+// Larger binaries aren't cached.
+#define COCOAGAME_PROGRAM_CACHE_MAX_BINARY (16 * 1024 * 1024)
+
+//
+// Private types
+//
+
+typedef struct CocoaGame_ProgramCacheHeader {
+	char magic[8];
+
+	// Repeated from the file name, in case of a collision in the file system (e.g., a case-insensitive one).
+	uint64_t hash;
+
+	uint32_t binaryFormat;
+	uint32_t binaryLength;
+} CocoaGame_ProgramCacheHeader;
+
+//
+// Private functions
+//
+
+static uint64_t CocoaGame_HashProgram(const char *vertexSource, const char *fragmentSource, const char *const *attributes);
+static uint64_t CocoaGame_HashString(uint64_t hash, const char *string);
+static CocoaGame_Bool CocoaGame_CanCacheProgramBinaries(void);
+static GLuint CocoaGame_LoadCachedProgram(uint64_t hash);
+static void CocoaGame_SaveCachedProgram(uint64_t hash, GLuint program);
+#if COCOAGAME_PROGRAM_BINARIES
+static char *CocoaGame_GetProgramCacheFilePath(uint64_t hash);
+static CocoaGame_Bool CocoaGame_HasProgramBinaries(void);
+static CocoaGame_Bool CocoaGame_IsProgramBinaryFormatSupported(GLenum format);
+static CocoaGame_Bool CocoaGame_WriteCachedProgram(FILE *fp, void *context);
+#endif
+static GLuint CocoaGame_CompileProgram(const char *vertexSource, const char *fragmentSource,
+	const char *const *attributes, CocoaGame_Bool retrievable);
+static GLuint CocoaGame_CompileShader(GLenum type, const char *source);
+
+//
+// Private data
+//
+
+static char *programCachePath;
+
+static CocoaGame_ProgramCacheStats programCacheStats;
+static pthread_mutex_t programCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The context current on this thread, and the number of binary formats it offers, or -1 if it hasn't been asked yet.
+static __thread void *programCacheContext;
+static __thread GLint programCacheBinaryFormats = -1;
+
+//
+// Program cache
+//
+
+void CocoaGame_SetProgramCacheDirectory(const char *path)
+{
+	CocoaGame_Free(programCachePath);
+	programCachePath = NULL;
+
+	if (path) {
+		programCachePath = CocoaGame_StrDup(path, COCOAGAME_ALLOC_CACHES);
+
+		// Only the last component is created. If it already exists, this harmlessly fails.
+		mkdir(path, 0755);
+	}
+}
+
+GLuint CocoaGame_CreateProgram(const char *vertexSource, const char *fragmentSource, const char *const *attributes)
+{
+	CocoaGame_BeginZone(__FUNCTION__);
+
+	CocoaGame_Bool cacheable = programCachePath && CocoaGame_CanCacheProgramBinaries();
+	uint64_t hash = cacheable ? CocoaGame_HashProgram(vertexSource, fragmentSource, attributes) : 0;
+
+	uint64_t start = CocoaGame_GetNanoseconds();
+	GLuint program = cacheable ? CocoaGame_LoadCachedProgram(hash) : 0;
+	uint64_t loaded = CocoaGame_GetNanoseconds();
+
+	if (program) {
+		pthread_mutex_lock(&programCacheMutex);
+		programCacheStats.hits++;
+		programCacheStats.loadNanoseconds += loaded - start;
+		pthread_mutex_unlock(&programCacheMutex);
+
+		CocoaGame_EndZone();
+		return program;
+	}
+
+	program = CocoaGame_CompileProgram(vertexSource, fragmentSource, attributes, cacheable);
+	uint64_t compiled = CocoaGame_GetNanoseconds();
+
+	pthread_mutex_lock(&programCacheMutex);
+	programCacheStats.misses++;
+	programCacheStats.compileNanoseconds += compiled - loaded;
+	pthread_mutex_unlock(&programCacheMutex);
+
+	if (program && cacheable)
+		CocoaGame_SaveCachedProgram(hash, program);
+
+	CocoaGame_EndZone();
+	return program;
+}
+
+void CocoaGame_ProgramCacheContextCurrent(void *context)
+{
+	if (context == programCacheContext)
+		return;
+
+	programCacheContext = context;
+	programCacheBinaryFormats = -1;
+}
+
+void CocoaGame_ProgramCacheContextDestroyed(void *context)
+{
+	// Another context may be created at the same address.
+	if (context == programCacheContext) {
+		programCacheContext = NULL;
+		programCacheBinaryFormats = -1;
+	}
+}
+
+void CocoaGame_GetProgramCacheStats(CocoaGame_ProgramCacheStats *stats)
+{
+	pthread_mutex_lock(&programCacheMutex);
+	*stats = programCacheStats;
+	pthread_mutex_unlock(&programCacheMutex);
+}
+
+void CocoaGame_ResetProgramCacheStats(void)
+{
+	pthread_mutex_lock(&programCacheMutex);
+	memset(&programCacheStats, 0, sizeof(programCacheStats));
+	pthread_mutex_unlock(&programCacheMutex);
+}
+
+//
+// Hashing
+//
+
+// 64-bit FNV-1a. Each string's terminator is hashed too, so moving text between strings changes the hash.
+static uint64_t CocoaGame_HashString(uint64_t hash, const char *string)
+{
+	if (! string)
+		string = "";
+
+	do {
+		hash ^= (unsigned char) *string;
+		hash *= 0x100000001b3ULL;
+	} while (*string++);
+
+	return hash;
+}
+
+static uint64_t CocoaGame_HashProgram(const char *vertexSource, const char *fragmentSource, const char *const *attributes)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	hash = CocoaGame_HashString(hash, (const char *) glGetString(GL_VENDOR));
+	hash = CocoaGame_HashString(hash, (const char *) glGetString(GL_RENDERER));
+	hash = CocoaGame_HashString(hash, (const char *) glGetString(GL_VERSION));
+
+	hash = CocoaGame_HashString(hash, vertexSource);
+	hash = CocoaGame_HashString(hash, fragmentSource);
+
+	if (attributes) {
+		const char *const *attribute;
+		for (attribute = attributes; *attribute; ++attribute)
+			hash = CocoaGame_HashString(hash, *attribute);
+	}
+
+	return hash;
+}
+
+//
+// Program binaries
+//
+
+#if COCOAGAME_PROGRAM_BINARIES
+
+// Returns NULL if out of memory, in which case the program isn't cached.
+static char *CocoaGame_GetProgramCacheFilePath(uint64_t hash)
+{
+	size_t length = strlen(programCachePath) + 1 + 16 + 5 + 1;
+	char *path = CocoaGame_Alloc(length, COCOAGAME_ALLOC_CACHES);
+	if (! path)
+		return NULL;
+
+	snprintf(path, length, "%s/%016llx.prog", programCachePath, (unsigned long long) hash);
+	return path;
+}
+
+// None of the checks here or below use glGetError(), which would take the application's errors along with ours.
+// Instead nothing is asked of the driver that it might not support.
+static CocoaGame_Bool CocoaGame_CanCacheProgramBinaries(void)
+{
+	// Asked once per context. Without a context CocoaGame knows about (e.g., a temporary one), it's asked every time.
+	if (programCacheBinaryFormats < 0 || ! programCacheContext) {
+		programCacheBinaryFormats = 0;
+
+		if (CocoaGame_HasProgramBinaries())
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programCacheBinaryFormats);
+	}
+
+	return programCacheBinaryFormats > 0;
+}
+
+static CocoaGame_Bool CocoaGame_HasProgramBinaries(void)
+{
+	int major = 0, minor = 0;
+	const char *version = (const char *) glGetString(GL_VERSION);
+	if (! version || sscanf(version, "%d.%d", &major, &minor) != 2)
+		return FALSE;
+
+	if (major > 4 || (major == 4 && minor >= 1))
+		return TRUE;
+
+	// A core profile has no GL_EXTENSIONS string, so from 3.0 they're listed one at a time.
+	if (major >= 3) {
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+		GLint i;
+		for (i = 0; i != count; ++i) {
+			const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, (GLuint) i);
+			if (extension && ! strcmp(extension, "GL_ARB_get_program_binary"))
+				return TRUE;
+		}
+
+		return FALSE;
+	}
+
+	const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+	return extensions && strstr(extensions, "GL_ARB_get_program_binary");
+}
+
+// glProgramBinary() raises an error for a format the driver doesn't offer, so the format is checked first.
+static CocoaGame_Bool CocoaGame_IsProgramBinaryFormatSupported(GLenum format)
+{
+	GLint count = programCacheBinaryFormats;
+	if (count <= 0)
+		return FALSE;
+
+	GLint *formats = CocoaGame_Alloc((size_t) count * sizeof(GLint), COCOAGAME_ALLOC_CACHES);
+	if (! formats)
+		return FALSE;
+
+	glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats);
+
+	GLint i;
+	for (i = 0; i != count && (GLenum) formats[i] != format; ++i)
+		{}
+
+	CocoaGame_Free(formats);
+	return i != count;
+}
+
+static GLuint CocoaGame_LoadCachedProgram(uint64_t hash)
+{
+	char *path = CocoaGame_GetProgramCacheFilePath(hash);
+	if (! path)
+		return 0;
+
+	FILE *fp = fopen(path, "rb");
+	if (! fp) {
+		CocoaGame_Free(path);
+		return 0;
+	}
+
+	CocoaGame_ProgramCacheHeader header;
+	void *binary = NULL;
+
+	if (fread(&header, sizeof(header), 1, fp) == 1 &&
+		memcmp(header.magic, COCOAGAME_PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+		header.hash == hash && header.binaryLength && header.binaryLength <= COCOAGAME_PROGRAM_CACHE_MAX_BINARY) {
+		binary = CocoaGame_Alloc(header.binaryLength, COCOAGAME_ALLOC_CACHES);
+		if (binary && fread(binary, header.binaryLength, 1, fp) != 1) {
+			CocoaGame_Free(binary);
+			binary = NULL;
+		}
+	}
+
+	fclose(fp);
+
+	GLuint program = 0;
+
+	if (binary && ! CocoaGame_IsProgramBinaryFormatSupported((GLenum) header.binaryFormat)) {
+		CocoaGame_Free(binary);
+		binary = NULL;
+	}
+
+	if (binary) {
+		program = glCreateProgram();
+		glProgramBinary(program, (GLenum) header.binaryFormat, binary, (GLsizei) header.binaryLength);
+		CocoaGame_Free(binary);
+
+		// A binary the driver no longer accepts fails to link.
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+		if (! linked) {
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+
+	if (! program) {
+		// Compiling will write a replacement.
+		CocoaGame_Trace("%s: \"%s\" rejected, compiling.\n", __FUNCTION__, path);
+
+		pthread_mutex_lock(&programCacheMutex);
+		programCacheStats.failedLoads++;
+		pthread_mutex_unlock(&programCacheMutex);
+	}
+
+	CocoaGame_Free(path);
+	return program;
+}
+
+static void CocoaGame_SaveCachedProgram(uint64_t hash, GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0 || length > COCOAGAME_PROGRAM_CACHE_MAX_BINARY)
+		return;
+
+	// The binary is read in after the header, so the file is written in one go.
+	CocoaGame_ProgramCacheHeader *header = CocoaGame_Alloc(sizeof(*header) + (size_t) length, COCOAGAME_ALLOC_CACHES);
+	if (! header)
+		return;
+
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, header + 1);
+
+	// On failure nothing is written.
+	if (written <= 0) {
+		CocoaGame_Free(header);
+		return;
+	}
+
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, COCOAGAME_PROGRAM_CACHE_MAGIC, sizeof(header->magic));
+	header->hash = hash;
+	header->binaryFormat = (uint32_t) format;
+	header->binaryLength = (uint32_t) written;
+
+	char *path = CocoaGame_GetProgramCacheFilePath(hash);
+	if (path)
+		CocoaGame_WriteFileSafely(path, &CocoaGame_WriteCachedProgram, header);
+
+	CocoaGame_Free(path);
+	CocoaGame_Free(header);
+}
+
+static CocoaGame_Bool CocoaGame_WriteCachedProgram(FILE *fp, void *context)
+{
+	const CocoaGame_ProgramCacheHeader *header = context;
+	return fwrite(header, sizeof(*header) + header->binaryLength, 1, fp) == 1;
+}
+
+#else
+
+static CocoaGame_Bool CocoaGame_CanCacheProgramBinaries(void)
+{
+	return FALSE;
+}
+
+static GLuint CocoaGame_LoadCachedProgram(uint64_t hash)
+{
+	(void) hash;
+	return 0;
+}
+
+static void CocoaGame_SaveCachedProgram(uint64_t hash, GLuint program)
+{
+	(void) hash;
+	(void) program;
+}
+
+#endif
+
+//
+// Compiling
+//
+
+static GLuint CocoaGame_CompileShader(GLenum type, const char *source)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (compiled)
+		return shader;
+
+	char log[1024];
+	log[0] = 0;
+	glGetShaderInfoLog(shader, (GLsizei) sizeof(log), NULL, log);
+	CocoaGame_Trace("%s: %s shader failed to compile: %s\n", __FUNCTION__,
+		type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+
+	glDeleteShader(shader);
+	return 0;
+}
+
+static GLuint CocoaGame_CompileProgram(const char *vertexSource, const char *fragmentSource,
+	const char *const *attributes, CocoaGame_Bool retrievable)
+{
+	GLuint vertexShader = CocoaGame_CompileShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragmentShader = vertexShader ? CocoaGame_CompileShader(GL_FRAGMENT_SHADER, fragmentSource) : 0;
+
+	if (! fragmentShader) {
+		if (vertexShader)
+			glDeleteShader(vertexShader);
+
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+
+	if (attributes) {
+		GLuint location;
+		for (location = 0; attributes[location]; ++location)
+			glBindAttribLocation(program, location, attributes[location]);
+	}
+
+	#if COCOAGAME_PROGRAM_BINARIES
+		if (retrievable)
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	#else
+		(void) retrievable;
+	#endif
+
+	glLinkProgram(program);
+
+	// The program keeps what it needs, so the shaders can go now.
+	glDetachShader(program, vertexShader);
+	glDetachShader(program, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked)
+		return program;
+
+	char log[1024];
+	log[0] = 0;
+	glGetProgramInfoLog(program, (GLsizei) sizeof(log), NULL, log);
+	CocoaGame_Trace("%s: program failed to link: %s\n", __FUNCTION__, log);
+
+	glDeleteProgram(program);
+	return 0;
+}
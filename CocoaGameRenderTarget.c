@@ -0,0 +1,762 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Render targets. Each target is a framebuffer object on the main OpenGL context (using EXT_framebuffer_object, so
+// it works with the Mac's legacy contexts), so switching target is a bind rather than a context switch. Released
+// targets are kept in a pool and reused by later acquisitions. Dynamic resolution is built on a render target which
+// stands in for the screen.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+//
+// Compile-time options
+//
+
+// Number of frames a released render target stays in the pool before it's freed.
+#define COCOAGAME_RENDER_TARGET_MAX_IDLE_FRAMES 300
+
+// Dynamic resolution lowers the scale when the smoothed frame time goes over this percentage of the budget, and
+// raises it when it's under COCOAGAME_DYNAMIC_RESOLUTION_RAISE_PERCENT. The gap between them is the hysteresis.
+#define COCOAGAME_DYNAMIC_RESOLUTION_LOWER_PERCENT 95
+#define COCOAGAME_DYNAMIC_RESOLUTION_RAISE_PERCENT 75
+
+// Amount the scale is raised by at a time. Lowering is proportional to how far over budget frames are.
+#define COCOAGAME_DYNAMIC_RESOLUTION_RAISE_STEP 0.05
+
+// Frames to hold the scale after each change, so the frame time can settle before it's judged again.
+#define COCOAGAME_DYNAMIC_RESOLUTION_HOLD_FRAMES 30
+
+// Weight given to each new frame time in the smoothed frame time.
+#define COCOAGAME_DYNAMIC_RESOLUTION_SMOOTHING 0.1
+
+// Number of GPU timer queries in flight. Results are read when available, so this is how far behind they can be.
+#define COCOAGAME_DYNAMIC_RESOLUTION_QUERIES 4
+
+//
+// Private types
+//
+
+struct CocoaGame_RenderTarget {
+	CocoaGame_RenderTarget *next;
+
+	CocoaGame_RenderTargetConfig config;
+
+	// Drawn in to. For a multisampled target this has a multisampled colour renderbuffer, otherwise the texture.
+	GLuint framebuffer;
+	GLuint colourRenderbuffer;
+	GLuint depthRenderbuffer;
+
+	// Only for multisampled targets: the texture is attached to this, and the samples blitted to it.
+	GLuint resolveFramebuffer;
+
+	GLuint texture;
+
+	CocoaGame_Bool acquired;
+	CocoaGame_Bool needsResolve;
+	uint64_t releasedFrame;
+};
+
+//
+// Private functions
+//
+
+static CocoaGame_RenderTarget *CocoaGame_FindPooledRenderTarget(const CocoaGame_RenderTargetConfig *config);
+static CocoaGame_Bool CocoaGame_AllocRenderTargetStorage(CocoaGame_RenderTarget *target, const CocoaGame_RenderTargetConfig *config);
+static void CocoaGame_FreeRenderTarget(CocoaGame_RenderTarget *target);
+static void CocoaGame_ResolveRenderTarget(CocoaGame_RenderTarget *target);
+static GLuint CocoaGame_GetScreenFramebuffer(void);
+static void CocoaGame_UpscaleDynamicResolution(void);
+static void CocoaGame_DrawScaledRenderTarget(CocoaGame_RenderTarget *target, int width, int height, int screenWidth, int screenHeight);
+static void CocoaGame_UpdateDynamicResolution(double seconds);
+static void CocoaGame_ReadDynamicResolutionQueries(void);
+
+//
+// Private data
+//
+
+const CocoaGame_RenderTargetConfig COCOAGAME_RENDERTARGETCONFIG_DEFAULTS = {
+	.width = 0,
+	.height = 0,
+	.internalFormat = GL_RGBA8,
+	.depthBits = 24,
+	.stencilBits = 0,
+	.samples = 0
+};
+
+const CocoaGame_DynamicResolutionConfig COCOAGAME_DYNAMICRESOLUTIONCONFIG_DEFAULTS = {
+	.enabled = FALSE,
+	.targetFrameSeconds = 1.0 / 60.0,
+	.minScale = 0.5,
+	.maxScale = 1.0,
+	.target = {
+		.width = 0,
+		.height = 0,
+		.internalFormat = GL_RGBA8,
+		.depthBits = 24,
+		.stencilBits = 0,
+		.samples = 0
+	}
+};
+
+static CocoaGame_RenderTarget *renderTargets;
+static CocoaGame_RenderTarget *currentRenderTarget;
+static uint64_t renderTargetFrame;
+
+static CocoaGame_DynamicResolutionConfig dynamicConfig;
+static CocoaGame_RenderTarget *dynamicTarget;
+static CocoaGame_Bool dynamicActive;
+static double dynamicScale = 1.0;
+static int dynamicWidth, dynamicHeight;
+static uint64_t dynamicFrameStart;
+static uint64_t dynamicSubmitEnd;
+static CocoaGame_Bool dynamicMeasuring;
+static double dynamicAverage;
+static double dynamicGPUSeconds;
+static int dynamicHold;
+
+// -1 until the extension string has been checked.
+static int dynamicTimerQueries = -1;
+static GLuint dynamicQueries[COCOAGAME_DYNAMIC_RESOLUTION_QUERIES];
+static int dynamicQueryNext;
+static int dynamicQueryCount;
+static CocoaGame_Bool dynamicQueryStarted;
+
+//
+// Render targets
+//
+
+CocoaGame_RenderTarget *CocoaGame_AcquireRenderTarget(const CocoaGame_RenderTargetConfig *config)
+{
+	assert(config->width > 0 && config->height > 0 && "Render target has no size.");
+
+	CocoaGame_RenderTarget *target = CocoaGame_FindPooledRenderTarget(config);
+
+	if (! target) {
+		target = CocoaGame_AllocZeroed(1, sizeof(*target), COCOAGAME_ALLOC_RENDERING);
+		if (! target)
+			return NULL;
+
+		target->next = renderTargets;
+		renderTargets = target;
+	}
+
+	// A pooled target of a different size keeps its objects and just has its storage replaced.
+	if (memcmp(&target->config, config, sizeof(*config)) != 0) {
+		if (! CocoaGame_AllocRenderTargetStorage(target, config)) {
+			CocoaGame_FreeRenderTarget(target);
+			return NULL;
+		}
+
+		target->config = *config;
+	}
+
+	target->acquired = TRUE;
+	target->needsResolve = FALSE;
+
+	return target;
+}
+
+void CocoaGame_ReleaseRenderTarget(CocoaGame_RenderTarget *target)
+{
+	if (! target)
+		return;
+
+	assert(target->acquired && "Render target released twice.");
+
+	if (currentRenderTarget == target)
+		CocoaGame_SetRenderTarget(NULL);
+
+	target->acquired = FALSE;
+	target->releasedFrame = renderTargetFrame;
+}
+
+void CocoaGame_SetRenderTarget(CocoaGame_RenderTarget *target)
+{
+	if (target == currentRenderTarget)
+		return;
+
+	assert((! target || target->acquired) && "Render target has been released.");
+
+	CocoaGame_GLBindFramebuffer(GL_FRAMEBUFFER_EXT, target ? target->framebuffer : CocoaGame_GetScreenFramebuffer());
+
+	if (target)
+		target->needsResolve = target->resolveFramebuffer != 0;
+	else if (dynamicActive)
+		dynamicTarget->needsResolve = dynamicTarget->resolveFramebuffer != 0;
+
+	currentRenderTarget = target;
+}
+
+GLuint CocoaGame_GetRenderTargetTexture(CocoaGame_RenderTarget *target)
+{
+	// Anything drawn from now on needs resolving again, so a target that's still bound can't be considered resolved.
+	if (target->needsResolve) {
+		CocoaGame_ResolveRenderTarget(target);
+		target->needsResolve = (target == currentRenderTarget);
+	}
+
+	return target->texture;
+}
+
+const CocoaGame_RenderTargetConfig *CocoaGame_GetRenderTargetConfig(CocoaGame_RenderTarget *target)
+{
+	return &target->config;
+}
+
+void CocoaGame_TrimRenderTargets(void)
+{
+	CocoaGame_RenderTarget *target = renderTargets;
+
+	while (target) {
+		CocoaGame_RenderTarget *next = target->next;
+
+		if (! target->acquired)
+			CocoaGame_FreeRenderTarget(target);
+
+		target = next;
+	}
+}
+
+void CocoaGame_RenderTargetsEndRender(void)
+{
+	if (currentRenderTarget)
+		CocoaGame_SetRenderTarget(NULL);
+
+	if (dynamicActive) {
+		if (dynamicQueryStarted)
+			glEndQuery(GL_TIME_ELAPSED_EXT);
+
+		dynamicActive = FALSE;
+
+		CocoaGame_UpscaleDynamicResolution();
+
+		dynamicSubmitEnd = CocoaGame_GetNanoseconds();
+		dynamicMeasuring = TRUE;
+	}
+
+	++renderTargetFrame;
+
+	CocoaGame_RenderTarget *target = renderTargets;
+
+	while (target) {
+		CocoaGame_RenderTarget *next = target->next;
+
+		if (! target->acquired && renderTargetFrame - target->releasedFrame > COCOAGAME_RENDER_TARGET_MAX_IDLE_FRAMES)
+			CocoaGame_FreeRenderTarget(target);
+
+		target = next;
+	}
+}
+
+void CocoaGame_ShutdownRenderTargets(void)
+{
+	if (currentRenderTarget)
+		CocoaGame_SetRenderTarget(NULL);
+
+	if (dynamicTimerQueries > 0)
+		glDeleteQueries(COCOAGAME_DYNAMIC_RESOLUTION_QUERIES, dynamicQueries);
+
+	// The next context may not support timer queries.
+	dynamicTimerQueries = -1;
+	dynamicQueryCount = 0;
+	dynamicActive = FALSE;
+	dynamicMeasuring = FALSE;
+	dynamicTarget = NULL;
+
+	while (renderTargets)
+		CocoaGame_FreeRenderTarget(renderTargets);
+}
+
+// Prefer a released target with the same configuration, then a released target which only differs in size.
+static CocoaGame_RenderTarget *CocoaGame_FindPooledRenderTarget(const CocoaGame_RenderTargetConfig *config)
+{
+	CocoaGame_RenderTarget *resizable = NULL;
+	CocoaGame_RenderTarget *target;
+
+	for (target = renderTargets; target; target = target->next) {
+		if (target->acquired)
+			continue;
+
+		if (memcmp(&target->config, config, sizeof(*config)) == 0)
+			return target;
+
+		if (! resizable &&
+			target->config.internalFormat == config->internalFormat &&
+			target->config.depthBits == config->depthBits &&
+			target->config.stencilBits == config->stencilBits &&
+			target->config.samples == config->samples)
+			resizable = target;
+	}
+
+	return resizable;
+}
+
+static CocoaGame_Bool CocoaGame_AllocRenderTargetStorage(CocoaGame_RenderTarget *target, const CocoaGame_RenderTargetConfig *config)
+{
+	GLint previousTexture;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+	if (! target->texture)
+		glGenTextures(1, &target->texture);
+
+	glBindTexture(GL_TEXTURE_2D, target->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, config->internalFormat, config->width, config->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, (GLuint) previousTexture);
+
+	if (! target->framebuffer)
+		glGenFramebuffersEXT(1, &target->framebuffer);
+
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, target->framebuffer);
+
+	if (config->samples) {
+		if (! target->colourRenderbuffer)
+			glGenRenderbuffersEXT(1, &target->colourRenderbuffer);
+
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, target->colourRenderbuffer);
+		glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER_EXT, config->samples, (GLenum) config->internalFormat, config->width, config->height);
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, target->colourRenderbuffer);
+	} else {
+		if (target->colourRenderbuffer) {
+			glDeleteRenderbuffersEXT(1, &target->colourRenderbuffer);
+			target->colourRenderbuffer = 0;
+		}
+
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, target->texture, 0);
+	}
+
+	GLenum depthFormat = 0;
+	if (config->stencilBits)
+		depthFormat = GL_DEPTH24_STENCIL8_EXT;
+	else if (config->depthBits > 24)
+		depthFormat = GL_DEPTH_COMPONENT32;
+	else if (config->depthBits > 16)
+		depthFormat = GL_DEPTH_COMPONENT24;
+	else if (config->depthBits)
+		depthFormat = GL_DEPTH_COMPONENT16;
+
+	if (depthFormat) {
+		if (! target->depthRenderbuffer)
+			glGenRenderbuffersEXT(1, &target->depthRenderbuffer);
+
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, target->depthRenderbuffer);
+
+		if (config->samples)
+			glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER_EXT, config->samples, depthFormat, config->width, config->height);
+		else
+			glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, depthFormat, config->width, config->height);
+
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, target->depthRenderbuffer);
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, config->stencilBits ? target->depthRenderbuffer : 0);
+	} else {
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, 0);
+		glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, 0);
+
+		if (target->depthRenderbuffer) {
+			glDeleteRenderbuffersEXT(1, &target->depthRenderbuffer);
+			target->depthRenderbuffer = 0;
+		}
+	}
+
+	glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+
+	GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+
+	if (status == GL_FRAMEBUFFER_COMPLETE_EXT && config->samples) {
+		if (! target->resolveFramebuffer)
+			glGenFramebuffersEXT(1, &target->resolveFramebuffer);
+
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, target->resolveFramebuffer);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, target->texture, 0);
+		status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+	} else if (! config->samples && target->resolveFramebuffer) {
+		CocoaGame_GLDeleteFramebuffers(1, &target->resolveFramebuffer);
+		target->resolveFramebuffer = 0;
+	}
+
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, currentRenderTarget ? currentRenderTarget->framebuffer : CocoaGame_GetScreenFramebuffer());
+	CocoaGame_InvalidateGLFramebufferState();
+
+	if (status != GL_FRAMEBUFFER_COMPLETE_EXT) {
+		CocoaGame_Trace("%s: %dx%d render target (format 0x%04x, depth %d, stencil %d, samples %d) incomplete: 0x%04x.\n",
+			__FUNCTION__, config->width, config->height, (unsigned int) config->internalFormat, config->depthBits,
+			config->stencilBits, config->samples, (unsigned int) status);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void CocoaGame_FreeRenderTarget(CocoaGame_RenderTarget *target)
+{
+	CocoaGame_RenderTarget **link = &renderTargets;
+	while (*link != target)
+		link = &(*link)->next;
+
+	*link = target->next;
+
+	if (currentRenderTarget == target)
+		CocoaGame_SetRenderTarget(NULL);
+
+	if (target->framebuffer)
+		CocoaGame_GLDeleteFramebuffers(1, &target->framebuffer);
+
+	if (target->resolveFramebuffer)
+		CocoaGame_GLDeleteFramebuffers(1, &target->resolveFramebuffer);
+
+	if (target->colourRenderbuffer)
+		glDeleteRenderbuffersEXT(1, &target->colourRenderbuffer);
+
+	if (target->depthRenderbuffer)
+		glDeleteRenderbuffersEXT(1, &target->depthRenderbuffer);
+
+	if (target->texture)
+		CocoaGame_GLDeleteTextures(1, &target->texture);
+
+	CocoaGame_Free(target);
+}
+
+static void CocoaGame_ResolveRenderTarget(CocoaGame_RenderTarget *target)
+{
+	int width = target->config.width;
+	int height = target->config.height;
+
+	// Blits are clipped by the scissor test.
+	GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+	if (scissor)
+		glDisable(GL_SCISSOR_TEST);
+
+	glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, target->framebuffer);
+	glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, target->resolveFramebuffer);
+	glBlitFramebufferEXT(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	if (scissor)
+		glEnable(GL_SCISSOR_TEST);
+
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, currentRenderTarget ? currentRenderTarget->framebuffer : CocoaGame_GetScreenFramebuffer());
+	CocoaGame_InvalidateGLFramebufferState();
+}
+
+// The framebuffer CocoaGame_SetRenderTarget(NULL) binds.
+static GLuint CocoaGame_GetScreenFramebuffer(void)
+{
+	return dynamicActive ? dynamicTarget->framebuffer : 0;
+}
+
+//
+// Dynamic resolution
+//
+
+void CocoaGame_SetDynamicResolution(const CocoaGame_DynamicResolutionConfig *config)
+{
+	assert(! dynamicActive && "Dynamic resolution can't be changed during a frame.");
+
+	dynamicConfig = *config;
+
+	if (dynamicConfig.maxScale <= 0)
+		dynamicConfig.maxScale = 1;
+	if (dynamicConfig.minScale <= 0 || dynamicConfig.minScale > dynamicConfig.maxScale)
+		dynamicConfig.minScale = dynamicConfig.maxScale;
+
+	// Start at full quality and let the controller find its level.
+	dynamicScale = dynamicConfig.maxScale;
+	dynamicAverage = 0;
+	dynamicGPUSeconds = 0;
+	dynamicHold = 0;
+
+	if (dynamicTarget && (! dynamicConfig.enabled ||
+		dynamicTarget->config.internalFormat != dynamicConfig.target.internalFormat ||
+		dynamicTarget->config.depthBits != dynamicConfig.target.depthBits ||
+		dynamicTarget->config.stencilBits != dynamicConfig.target.stencilBits ||
+		dynamicTarget->config.samples != dynamicConfig.target.samples)) {
+		CocoaGame_ReleaseRenderTarget(dynamicTarget);
+		dynamicTarget = NULL;
+	}
+}
+
+const CocoaGame_DynamicResolutionConfig *CocoaGame_GetDynamicResolution(void)
+{
+	return &dynamicConfig;
+}
+
+double CocoaGame_GetDynamicResolutionScale(void)
+{
+	return dynamicConfig.enabled ? dynamicScale : 1.0;
+}
+
+void CocoaGame_GetRenderSize(int *width, int *height)
+{
+	if (dynamicActive) {
+		*width = dynamicWidth;
+		*height = dynamicHeight;
+	} else {
+		const CocoaGame_VideoMode *mode = &CocoaGame_GetVideoConfig()->mode;
+		*width = mode->width;
+		*height = mode->height;
+	}
+}
+
+void CocoaGame_RenderTargetsBeginFrame(void)
+{
+	if (! dynamicConfig.enabled)
+		return;
+
+	const CocoaGame_VideoMode *mode = &CocoaGame_GetVideoConfig()->mode;
+
+	// Size the target for the largest scale, so changing scale is just a change of viewport.
+	CocoaGame_RenderTargetConfig targetConfig = dynamicConfig.target;
+	targetConfig.width = (int) ceil(mode->width * dynamicConfig.maxScale);
+	targetConfig.height = (int) ceil(mode->height * dynamicConfig.maxScale);
+	if (targetConfig.width < 1)
+		targetConfig.width = 1;
+	if (targetConfig.height < 1)
+		targetConfig.height = 1;
+
+	if (! dynamicTarget || dynamicTarget->config.width != targetConfig.width || dynamicTarget->config.height != targetConfig.height) {
+		// Releasing first lets the pool resize the old target rather than create another.
+		if (dynamicTarget)
+			CocoaGame_ReleaseRenderTarget(dynamicTarget);
+
+		dynamicTarget = CocoaGame_AcquireRenderTarget(&targetConfig);
+		if (! dynamicTarget) {
+			CocoaGame_Trace("%s: disabling dynamic resolution.\n", __FUNCTION__);
+			dynamicConfig.enabled = FALSE;
+			return;
+		}
+	}
+
+	dynamicWidth = (int) lround(mode->width * dynamicScale);
+	dynamicHeight = (int) lround(mode->height * dynamicScale);
+	if (dynamicWidth < 1)
+		dynamicWidth = 1;
+	if (dynamicWidth > targetConfig.width)
+		dynamicWidth = targetConfig.width;
+	if (dynamicHeight < 1)
+		dynamicHeight = 1;
+	if (dynamicHeight > targetConfig.height)
+		dynamicHeight = targetConfig.height;
+
+	dynamicActive = TRUE;
+
+	CocoaGame_GLBindFramebuffer(GL_FRAMEBUFFER_EXT, dynamicTarget->framebuffer);
+	dynamicTarget->needsResolve = dynamicTarget->resolveFramebuffer != 0;
+	CocoaGame_GLViewport(0, 0, dynamicWidth, dynamicHeight);
+
+	if (dynamicTimerQueries < 0) {
+		const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+		dynamicTimerQueries = extensions && (strstr(extensions, "GL_EXT_timer_query") || strstr(extensions, "GL_ARB_timer_query"));
+
+		if (dynamicTimerQueries)
+			glGenQueries(COCOAGAME_DYNAMIC_RESOLUTION_QUERIES, dynamicQueries);
+
+		CocoaGame_Trace("%s: GPU timer queries %s.\n", __FUNCTION__, dynamicTimerQueries ? "available" : "unavailable");
+	}
+
+	// If every query is still in flight, skip measuring the GPU this frame rather than wait.
+	if (dynamicTimerQueries)
+		CocoaGame_ReadDynamicResolutionQueries();
+
+	dynamicQueryStarted = dynamicTimerQueries && dynamicQueryCount != COCOAGAME_DYNAMIC_RESOLUTION_QUERIES;
+
+	if (dynamicQueryStarted) {
+		glBeginQuery(GL_TIME_ELAPSED_EXT, dynamicQueries[dynamicQueryNext]);
+		dynamicQueryNext = (dynamicQueryNext + 1) % COCOAGAME_DYNAMIC_RESOLUTION_QUERIES;
+		++dynamicQueryCount;
+	}
+
+	dynamicFrameStart = CocoaGame_GetNanoseconds();
+}
+
+static void CocoaGame_UpscaleDynamicResolution(void)
+{
+	const CocoaGame_VideoMode *mode = &CocoaGame_GetVideoConfig()->mode;
+
+	// A blit can't scale in to a multisampled screen, so draw a quad instead.
+	if (CocoaGame_GetGLConfig()->msaa > 1) {
+		CocoaGame_DrawScaledRenderTarget(dynamicTarget, dynamicWidth, dynamicHeight, mode->width, mode->height);
+		return;
+	}
+
+	// Multisampled buffers can't be scaled by a blit either, so resolve at the same size first.
+	GLuint source = dynamicTarget->framebuffer;
+	if (dynamicTarget->resolveFramebuffer) {
+		CocoaGame_GetRenderTargetTexture(dynamicTarget);
+		source = dynamicTarget->resolveFramebuffer;
+	}
+
+	GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+	if (scissor)
+		glDisable(GL_SCISSOR_TEST);
+
+	glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, source);
+	glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, 0);
+	glBlitFramebufferEXT(0, 0, dynamicWidth, dynamicHeight, 0, 0, mode->width, mode->height, GL_COLOR_BUFFER_BIT,
+		dynamicWidth == mode->width && dynamicHeight == mode->height ? GL_NEAREST : GL_LINEAR);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	CocoaGame_InvalidateGLFramebufferState();
+
+	if (scissor)
+		glEnable(GL_SCISSOR_TEST);
+
+	CocoaGame_GLViewport(0, 0, mode->width, mode->height);
+}
+
+// Draw the bottom left width x height of target's texture over the whole of the current framebuffer, leaving the 
+// application's OpenGL state as it was (other than the viewport, which is set to the screen).
+static void CocoaGame_DrawScaledRenderTarget(CocoaGame_RenderTarget *target, int width, int height, int screenWidth, int screenHeight)
+{
+	GLuint texture = CocoaGame_GetRenderTargetTexture(target);
+
+	GLint program, activeTexture;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+
+	glPushAttrib(GL_ALL_ATTRIB_BITS);
+
+	glUseProgram(0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glMatrixMode(GL_TEXTURE);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_FOG);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glDisable(GL_TEXTURE_3D);
+	glDisable(GL_TEXTURE_CUBE_MAP);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+	glViewport(0, 0, screenWidth, screenHeight);
+
+	GLfloat s = (GLfloat) width / (GLfloat) target->config.width;
+	GLfloat t = (GLfloat) height / (GLfloat) target->config.height;
+
+	glBegin(GL_QUADS);
+		glTexCoord2f(0, 0);
+		glVertex2f(-1, -1);
+		glTexCoord2f(s, 0);
+		glVertex2f(1, -1);
+		glTexCoord2f(s, t);
+		glVertex2f(1, 1);
+		glTexCoord2f(0, t);
+		glVertex2f(-1, 1);
+	glEnd();
+
+	glMatrixMode(GL_TEXTURE);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+
+	glPopAttrib();
+
+	glActiveTexture((GLenum) activeTexture);
+	glUseProgram((GLuint) program);
+
+	// Everything's been put back, but the attribute stack may not cover every binding the cache knows about.
+	CocoaGame_InvalidateGLState();
+	CocoaGame_GLViewport(0, 0, screenWidth, screenHeight);
+}
+
+void CocoaGame_RenderTargetsFinishRender(CocoaGame_Bool syncedToRefresh)
+{
+	if (! dynamicMeasuring)
+		return;
+
+	dynamicMeasuring = FALSE;
+
+	// Work the GPU does asynchronously (and all of a software renderer's work) has to be finished by the flush, so
+	// the flush counts unless it might have been waiting for the display.
+	uint64_t end = syncedToRefresh ? dynamicSubmitEnd : CocoaGame_GetNanoseconds();
+
+	CocoaGame_UpdateDynamicResolution((double) (end - dynamicFrameStart) / 1e9);
+}
+
+static void CocoaGame_UpdateDynamicResolution(double seconds)
+{
+	if (dynamicTimerQueries) {
+		CocoaGame_ReadDynamicResolutionQueries();
+
+		// A fill rate bound frame can be submitted quickly but take much longer on the GPU.
+		if (dynamicGPUSeconds > seconds)
+			seconds = dynamicGPUSeconds;
+	}
+
+	dynamicAverage = dynamicAverage ? dynamicAverage + (seconds - dynamicAverage) * COCOAGAME_DYNAMIC_RESOLUTION_SMOOTHING : seconds;
+
+	if (dynamicHold) {
+		--dynamicHold;
+		return;
+	}
+
+	double budget = dynamicConfig.targetFrameSeconds;
+	double newScale = dynamicScale;
+
+	if (dynamicAverage > budget * COCOAGAME_DYNAMIC_RESOLUTION_LOWER_PERCENT / 100.0) {
+		// Cost is roughly proportional to the number of pixels, i.e., to the square of the scale. Aim for the middle
+		// of the hysteresis band.
+		double aim = budget * (COCOAGAME_DYNAMIC_RESOLUTION_LOWER_PERCENT + COCOAGAME_DYNAMIC_RESOLUTION_RAISE_PERCENT) / 200.0;
+		newScale = dynamicScale * sqrt(aim / dynamicAverage);
+	} else if (dynamicAverage < budget * COCOAGAME_DYNAMIC_RESOLUTION_RAISE_PERCENT / 100.0)
+		newScale = dynamicScale + COCOAGAME_DYNAMIC_RESOLUTION_RAISE_STEP;
+
+	if (newScale < dynamicConfig.minScale)
+		newScale = dynamicConfig.minScale;
+	if (newScale > dynamicConfig.maxScale)
+		newScale = dynamicConfig.maxScale;
+
+	if (newScale != dynamicScale) {
+		dynamicScale = newScale;
+		dynamicHold = COCOAGAME_DYNAMIC_RESOLUTION_HOLD_FRAMES;
+
+		// Frames at the old scale no longer say anything about the new one.
+		dynamicAverage = 0;
+		dynamicGPUSeconds = 0;
+	}
+}
+
+// Read the results of the oldest queries that have finished, without waiting for any others.
+static void CocoaGame_ReadDynamicResolutionQueries(void)
+{
+	while (dynamicQueryCount) {
+		int oldest = (dynamicQueryNext + COCOAGAME_DYNAMIC_RESOLUTION_QUERIES - dynamicQueryCount) % COCOAGAME_DYNAMIC_RESOLUTION_QUERIES;
+
+		GLint available = 0;
+		glGetQueryObjectiv(dynamicQueries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (! available)
+			break;
+
+		GLuint64EXT nanoseconds = 0;
+		glGetQueryObjectui64vEXT(dynamicQueries[oldest], GL_QUERY_RESULT, &nanoseconds);
+		dynamicGPUSeconds = (double) nanoseconds / 1e9;
+
+		--dynamicQueryCount;
+	}
+}
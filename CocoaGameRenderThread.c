@@ -0,0 +1,302 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Render thread mode and triple buffered snapshots. The render thread owns the OpenGL context while it runs and
+// holds the backend's context lock for each frame, so the main thread can safely mark the context for update (e.g.,
+// on resize) in between frames.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+//
+// Compile-time options
+//
+
+// How long the render thread sleeps when CocoaGame_BeginRender() says the frame won't be shown, in nanoseconds.
+#define COCOAGAME_RENDER_THREAD_HIDDEN_SLEEP 10000000
+
+// How long the render thread waits for a new snapshot before checking whether it's been asked to stop, in seconds.
+#define COCOAGAME_RENDER_THREAD_SNAPSHOT_TIMEOUT 0.1
+
+//
+// Snapshots
+//
+
+// The low bits of latest are the index of the buffer most recently published. SNAPSHOT_FRESH is set when it hasn't
+// been read yet. The writer and reader each own one of the other two buffers, and swap it with latest atomically, so
+// neither ever waits for the other.
+#define SNAPSHOT_INDEX_MASK 3
+#define SNAPSHOT_FRESH 4
+
+struct CocoaGame_Snapshots {
+	size_t size;
+	unsigned char *buffers[3];
+
+	int writeIndex;
+	int readIndex;
+	int latest;
+
+	// Only used by CocoaGame_WaitForSnapshot().
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int waiters;
+};
+
+//
+// Private functions
+//
+
+static void *CocoaGame_RenderThreadMain(void *context);
+
+//
+// Private data
+//
+
+static pthread_t renderThread;
+static int renderThreadRunning;
+static int renderThreadStop;
+static CocoaGame_Snapshots *renderThreadSnapshots;
+static CocoaGame_RenderThreadCallback renderThreadCallback;
+static void *renderThreadContext;
+
+// Only set on the render thread.
+static __thread CocoaGame_Bool isRenderThread;
+
+//
+// Snapshots
+//
+
+CocoaGame_Snapshots *CocoaGame_CreateSnapshots(size_t size)
+{
+	CocoaGame_Snapshots *snapshots = CocoaGame_AllocZeroed(1, sizeof(*snapshots), COCOAGAME_ALLOC_RENDERING);
+	if (! snapshots)
+		return NULL;
+
+	snapshots->size = size;
+	pthread_mutex_init(&snapshots->mutex, NULL);
+
+	// Timed waits are measured on the monotonic clock, so changing the system time doesn't stretch or cut them short.
+	// The Mac has no pthread_condattr_setclock(), and waits with a relative timeout instead.
+	#ifdef __APPLE__
+		pthread_cond_init(&snapshots->cond, NULL);
+	#else
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&snapshots->cond, &attr);
+		pthread_condattr_destroy(&attr);
+	#endif
+
+	int i;
+	for (i = 0; i != 3; ++i) {
+		snapshots->buffers[i] = CocoaGame_AllocZeroed(1, size ? size : 1, COCOAGAME_ALLOC_RENDERING);
+		if (! snapshots->buffers[i]) {
+			CocoaGame_DestroySnapshots(snapshots);
+			return NULL;
+		}
+	}
+
+	snapshots->writeIndex = 0;
+	snapshots->latest = 1;
+	snapshots->readIndex = 2;
+
+	return snapshots;
+}
+
+void CocoaGame_DestroySnapshots(CocoaGame_Snapshots *snapshots)
+{
+	if (! snapshots)
+		return;
+
+	assert(snapshots != renderThreadSnapshots && "Stop the render thread before destroying its snapshots.");
+
+	int i;
+	for (i = 0; i != 3; ++i)
+		CocoaGame_Free(snapshots->buffers[i]);
+
+	pthread_mutex_destroy(&snapshots->mutex);
+	pthread_cond_destroy(&snapshots->cond);
+
+	CocoaGame_Free(snapshots);
+}
+
+void *CocoaGame_GetSnapshotForWriting(CocoaGame_Snapshots *snapshots)
+{
+	return snapshots->buffers[snapshots->writeIndex];
+}
+
+void CocoaGame_PublishSnapshot(CocoaGame_Snapshots *snapshots)
+{
+	int previous = __atomic_exchange_n(&snapshots->latest, snapshots->writeIndex | SNAPSHOT_FRESH, __ATOMIC_ACQ_REL);
+	snapshots->writeIndex = previous & SNAPSHOT_INDEX_MASK;
+
+	if (__atomic_load_n(&snapshots->waiters, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&snapshots->mutex);
+		pthread_cond_signal(&snapshots->cond);
+		pthread_mutex_unlock(&snapshots->mutex);
+	}
+}
+
+const void *CocoaGame_GetLatestSnapshot(CocoaGame_Snapshots *snapshots)
+{
+	if (__atomic_load_n(&snapshots->latest, __ATOMIC_ACQUIRE) & SNAPSHOT_FRESH) {
+		int previous = __atomic_exchange_n(&snapshots->latest, snapshots->readIndex, __ATOMIC_ACQ_REL);
+		snapshots->readIndex = previous & SNAPSHOT_INDEX_MASK;
+	}
+
+	return snapshots->buffers[snapshots->readIndex];
+}
+
+CocoaGame_Bool CocoaGame_HasNewSnapshot(CocoaGame_Snapshots *snapshots)
+{
+	return (__atomic_load_n(&snapshots->latest, __ATOMIC_ACQUIRE) & SNAPSHOT_FRESH) != 0;
+}
+
+CocoaGame_Bool CocoaGame_WaitForSnapshot(CocoaGame_Snapshots *snapshots, double timeout)
+{
+	if (CocoaGame_HasNewSnapshot(snapshots))
+		return TRUE;
+
+	// CocoaGame_GetNanoseconds() is the monotonic clock.
+	uint64_t deadline = CocoaGame_GetNanoseconds() + (uint64_t) (timeout * 1e9);
+
+	pthread_mutex_lock(&snapshots->mutex);
+	__atomic_add_fetch(&snapshots->waiters, 1, __ATOMIC_ACQ_REL);
+
+	// Having registered as a waiter under the mutex, a publish can't slip between this test and the wait.
+	while (! CocoaGame_HasNewSnapshot(snapshots)) {
+		struct timespec ts;
+
+		#ifdef __APPLE__
+			uint64_t now = CocoaGame_GetNanoseconds();
+			if (now >= deadline)
+				break;
+
+			ts.tv_sec = (time_t) ((deadline - now) / 1000000000u);
+			ts.tv_nsec = (long) ((deadline - now) % 1000000000u);
+
+			if (pthread_cond_timedwait_relative_np(&snapshots->cond, &snapshots->mutex, &ts) == ETIMEDOUT)
+				break;
+		#else
+			ts.tv_sec = (time_t) (deadline / 1000000000u);
+			ts.tv_nsec = (long) (deadline % 1000000000u);
+
+			if (pthread_cond_timedwait(&snapshots->cond, &snapshots->mutex, &ts) == ETIMEDOUT)
+				break;
+		#endif
+	}
+
+	__atomic_sub_fetch(&snapshots->waiters, 1, __ATOMIC_ACQ_REL);
+	pthread_mutex_unlock(&snapshots->mutex);
+
+	return CocoaGame_HasNewSnapshot(snapshots);
+}
+
+//
+// Render thread
+//
+
+CocoaGame_Bool CocoaGame_StartRenderThread(CocoaGame_RenderThreadCallback callback, void *context, CocoaGame_Snapshots *snapshots)
+{
+	assert(! renderThreadRunning && "Render thread already running.");
+
+	renderThreadCallback = callback;
+	renderThreadContext = context;
+	renderThreadSnapshots = snapshots;
+	renderThreadStop = FALSE;
+
+	// The context can only be current on one thread at a time.
+	CocoaGame_PrepareRenderThread();
+
+	__atomic_store_n(&renderThreadRunning, TRUE, __ATOMIC_RELEASE);
+
+	if (pthread_create(&renderThread, NULL, CocoaGame_RenderThreadMain, NULL) != 0) {
+		CocoaGame_Trace("%s: unable to create render thread.\n", __FUNCTION__);
+		__atomic_store_n(&renderThreadRunning, FALSE, __ATOMIC_RELEASE);
+		renderThreadSnapshots = NULL;
+
+		CocoaGame_FinishRenderThread();
+		CocoaGame_ReclaimContext();
+		return FALSE;
+	}
+
+	CocoaGame_Trace("%s: render thread started.\n", __FUNCTION__);
+	return TRUE;
+}
+
+void CocoaGame_StopRenderThread(void)
+{
+	if (! __atomic_load_n(&renderThreadRunning, __ATOMIC_ACQUIRE))
+		return;
+
+	__atomic_store_n(&renderThreadStop, TRUE, __ATOMIC_RELEASE);
+	pthread_join(renderThread, NULL);
+
+	__atomic_store_n(&renderThreadRunning, FALSE, __ATOMIC_RELEASE);
+	renderThreadSnapshots = NULL;
+
+	CocoaGame_ReclaimContext();
+
+	CocoaGame_Trace("%s: render thread stopped.\n", __FUNCTION__);
+}
+
+CocoaGame_Bool CocoaGame_IsRenderThreadRunning(void)
+{
+	return __atomic_load_n(&renderThreadRunning, __ATOMIC_ACQUIRE);
+}
+
+CocoaGame_Bool CocoaGame_IsRenderThread(void)
+{
+	return isRenderThread;
+}
+
+static void *CocoaGame_RenderThreadMain(void *context)
+{
+	(void) context;
+
+	isRenderThread = TRUE;
+
+	CocoaGame_SetProfileThreadName("CocoaGame render thread");
+
+	struct timespec hiddenSleep;
+	hiddenSleep.tv_sec = 0;
+	hiddenSleep.tv_nsec = COCOAGAME_RENDER_THREAD_HIDDEN_SLEEP;
+
+	while (! __atomic_load_n(&renderThreadStop, __ATOMIC_ACQUIRE)) {
+		const void *snapshot = NULL;
+
+		// Wait outside the context lock, so the main thread isn't held up.
+		if (renderThreadSnapshots) {
+			if (! CocoaGame_WaitForSnapshot(renderThreadSnapshots, COCOAGAME_RENDER_THREAD_SNAPSHOT_TIMEOUT))
+				continue;
+
+			snapshot = CocoaGame_GetLatestSnapshot(renderThreadSnapshots);
+		}
+
+		void *pool;
+		CocoaGame_CreateAutoreleasePool(&pool);
+		CocoaGame_LockContext();
+
+		CocoaGame_Bool shown = CocoaGame_BeginRender();
+		if (shown) {
+			(*renderThreadCallback)(snapshot, renderThreadContext);
+			CocoaGame_EndRender();
+		}
+
+		CocoaGame_UnlockContext();
+		CocoaGame_FreeAutoreleasePool(pool);
+
+		if (! shown)
+			nanosleep(&hiddenSleep, NULL);
+	}
+
+	CocoaGame_FinishRenderThread();
+	return NULL;
+}
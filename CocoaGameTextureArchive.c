@@ -0,0 +1,686 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Texture archives. An archive is a single file holding many textures with every mip level already laid out as
+// OpenGL wants it, so loading one is a glTexImage2D() per level straight from a read-only mapping of the file: nothing
+// is decoded or copied in to the heap first. Each texture's levels are contiguous and start on a page boundary, so
+// once a texture has been uploaded its pages can be handed back to the kernel and stop counting towards the resident
+// set. Textures are made resident when they're first asked for, and the least recently used are deleted when the
+// archive goes over its memory budget (never one that's been used during the current frame).
+//
+// The file is a CocoaGame_TextureArchiveHeader followed by an index of CocoaGame_TextureArchiveIndexEntry, then the
+// payload. All values are in the byte order of the machine that wrote the archive.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//
+// Compile-time options
+//
+
+// Written at the start of each archive. Archives with anything else aren't opened.
+#define COCOAGAME_TEXTURE_ARCHIVE_MAGIC "CGTexAr1"
+
+// Alignment of each texture's payload. At least the page size of any machine the archive will be used on.
+#define COCOAGAME_TEXTURE_ARCHIVE_ALIGNMENT 16384
+
+// Alignment of each mip level within a texture's payload.
+#define COCOAGAME_TEXTURE_ARCHIVE_LEVEL_ALIGNMENT 16
+
+//
+// Private types
+//
+
+typedef struct CocoaGame_TextureArchiveHeader {
+	char magic[8];
+	uint32_t textureCount;
+	uint32_t alignment;
+} CocoaGame_TextureArchiveHeader;
+
+typedef struct CocoaGame_TextureArchiveIndexEntry {
+	char name[COCOAGAME_TEXTURE_ARCHIVE_MAX_NAME];
+
+	uint32_t internalFormat;
+
+	// 0 if the levels are compressed in internalFormat.
+	uint32_t format;
+	uint32_t type;
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+
+	// The payload, from the start of the file.
+	uint64_t offset;
+	uint64_t size;
+
+	// Each level, from the start of the payload.
+	uint32_t levelOffsets[COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS];
+	uint32_t levelSizes[COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS];
+} CocoaGame_TextureArchiveIndexEntry;
+
+// A texture's state while the archive is open.
+typedef struct CocoaGame_ArchivedTexture {
+	GLuint texture;
+	uint64_t lastUsedFrame;
+
+	// Links in the archive's list of resident textures, by index, or -1.
+	int moreRecent;
+	int lessRecent;
+
+	// Uploads queued for the upload worker, which must be finished before the texture is used.
+	CocoaGame_Bool pending;
+	CocoaGame_Upload *uploads[COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS];
+} CocoaGame_ArchivedTexture;
+
+struct CocoaGame_TextureArchive {
+	int fd;
+	const unsigned char *mapping;
+	size_t mappingSize;
+
+	const CocoaGame_TextureArchiveIndexEntry *index;
+	int textureCount;
+	CocoaGame_ArchivedTexture *textures;
+
+	// Resident textures, most recently used first.
+	int mostRecent;
+	int leastRecent;
+
+	size_t budget;
+	CocoaGame_TextureArchiveStats stats;
+};
+
+// What CocoaGame_WriteTextureArchive() passes to CocoaGame_WriteTextureArchiveFile().
+typedef struct CocoaGame_TextureArchiveWrite {
+	const CocoaGame_TextureArchiveHeader *header;
+	const CocoaGame_TextureArchiveIndexEntry *index;
+	const CocoaGame_TextureArchiveEntry *textures;
+	int count;
+} CocoaGame_TextureArchiveWrite;
+
+//
+// Private functions
+//
+
+static CocoaGame_Bool CocoaGame_IsTextureArchiveEntryValid(const CocoaGame_TextureArchiveIndexEntry *entry, size_t fileSize);
+static size_t CocoaGame_GetGLPixelSize(GLenum format, GLenum type);
+static void CocoaGame_MakeArchivedTextureResident(CocoaGame_TextureArchive *archive, int index, CocoaGame_Bool async);
+static void CocoaGame_FinishArchivedTexture(CocoaGame_TextureArchive *archive, int index);
+static void CocoaGame_EvictArchivedTexture(CocoaGame_TextureArchive *archive, int index);
+static void CocoaGame_EvictArchivedTextures(CocoaGame_TextureArchive *archive);
+static void CocoaGame_LinkArchivedTexture(CocoaGame_TextureArchive *archive, int index);
+static void CocoaGame_UnlinkArchivedTexture(CocoaGame_TextureArchive *archive, int index);
+static void CocoaGame_AdviseTextureArchive(CocoaGame_TextureArchive *archive, int index, int advice);
+static CocoaGame_Bool CocoaGame_WriteTextureArchiveFile(FILE *fp, void *context);
+static CocoaGame_Bool CocoaGame_WriteTextureArchivePadding(FILE *fp, uint64_t *position, uint64_t alignment);
+
+//
+// Private data
+//
+
+// Incremented at the start of each frame. Textures used since then aren't evicted.
+static uint64_t textureArchiveFrame = 1;
+
+//
+// Opening and closing
+//
+
+CocoaGame_TextureArchive *CocoaGame_OpenTextureArchive(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		CocoaGame_Trace("%s: unable to open \"%s\".\n", __FUNCTION__, path);
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CocoaGame_TextureArchiveHeader)) {
+		CocoaGame_Trace("%s: \"%s\" isn't a texture archive.\n", __FUNCTION__, path);
+		close(fd);
+		return NULL;
+	}
+
+	size_t size = (size_t) st.st_size;
+	void *mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapping == MAP_FAILED) {
+		CocoaGame_Trace("%s: unable to map \"%s\".\n", __FUNCTION__, path);
+		close(fd);
+		return NULL;
+	}
+
+	const CocoaGame_TextureArchiveHeader *header = mapping;
+	const CocoaGame_TextureArchiveIndexEntry *index = (const CocoaGame_TextureArchiveIndexEntry *) (header + 1);
+
+	CocoaGame_Bool valid = memcmp(header->magic, COCOAGAME_TEXTURE_ARCHIVE_MAGIC, sizeof(header->magic)) == 0 &&
+		header->textureCount <= (size - sizeof(*header)) / sizeof(*index);
+
+	uint32_t i;
+	for (i = 0; valid && i != header->textureCount; ++i)
+		valid = CocoaGame_IsTextureArchiveEntryValid(&index[i], size);
+
+	if (! valid) {
+		CocoaGame_Trace("%s: \"%s\" isn't a valid texture archive.\n", __FUNCTION__, path);
+		munmap(mapping, size);
+		close(fd);
+		return NULL;
+	}
+
+	CocoaGame_TextureArchive *archive = CocoaGame_AllocZeroed(1, sizeof(CocoaGame_TextureArchive), COCOAGAME_ALLOC_CACHES);
+	CocoaGame_ArchivedTexture *textures = CocoaGame_AllocZeroed(header->textureCount ? header->textureCount : 1,
+		sizeof(CocoaGame_ArchivedTexture), COCOAGAME_ALLOC_CACHES);
+
+	if (! archive || ! textures) {
+		CocoaGame_Trace("%s: out of memory opening \"%s\".\n", __FUNCTION__, path);
+		CocoaGame_Free(textures);
+		CocoaGame_Free(archive);
+		munmap(mapping, size);
+		close(fd);
+		return NULL;
+	}
+
+	archive->fd = fd;
+	archive->mapping = mapping;
+	archive->mappingSize = size;
+	archive->index = index;
+	archive->textureCount = (int) header->textureCount;
+	archive->textures = textures;
+	archive->mostRecent = -1;
+	archive->leastRecent = -1;
+
+	// Only the index is needed up front. The payload is paged in as textures are uploaded.
+	madvise(mapping, size, MADV_RANDOM);
+
+	CocoaGame_Trace("%s: %d textures in \"%s\".\n", __FUNCTION__, archive->textureCount, path);
+	return archive;
+}
+
+static CocoaGame_Bool CocoaGame_IsTextureArchiveEntryValid(const CocoaGame_TextureArchiveIndexEntry *entry, size_t fileSize)
+{
+	if (! memchr(entry->name, 0, sizeof(entry->name)) || ! entry->width || ! entry->height ||
+		! entry->levelCount || entry->levelCount > COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS ||
+		entry->offset > fileSize || entry->size > fileSize - entry->offset)
+		return FALSE;
+
+	// glTexImage2D() would read past a level that's too short for its dimensions. Compressed levels can't be checked,
+	// nor can formats and types not listed in CocoaGame_GetGLPixelSize().
+	size_t pixelSize = entry->format ? CocoaGame_GetGLPixelSize(entry->format, entry->type) : 0;
+
+	uint32_t level;
+	for (level = 0; level != entry->levelCount; ++level) {
+		if (entry->levelOffsets[level] > entry->size || entry->levelSizes[level] > entry->size - entry->levelOffsets[level])
+			return FALSE;
+
+		uint32_t width = entry->width >> level;
+		uint32_t height = entry->height >> level;
+
+		// Levels are uploaded with an unpack alignment of 1, so rows aren't padded.
+		if (pixelSize && entry->levelSizes[level] < (uint64_t) (width ? width : 1) * (height ? height : 1) * pixelSize)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+// Bytes per pixel for uncompressed data in format and type, or 0 if not known.
+static size_t CocoaGame_GetGLPixelSize(GLenum format, GLenum type)
+{
+	size_t components;
+	switch (format) {
+		case GL_RED:
+		case GL_GREEN:
+		case GL_BLUE:
+		case GL_ALPHA:
+		case GL_LUMINANCE:
+		case GL_DEPTH_COMPONENT:
+			components = 1;
+			break;
+
+		case GL_LUMINANCE_ALPHA:
+		case GL_RG:
+			components = 2;
+			break;
+
+		case GL_RGB:
+		case GL_BGR:
+			components = 3;
+			break;
+
+		case GL_RGBA:
+		case GL_BGRA:
+			components = 4;
+			break;
+
+		default:
+			return 0;
+	}
+
+	switch (type) {
+		case GL_UNSIGNED_BYTE:
+		case GL_BYTE:
+			return components;
+
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT_ARB:
+			return components * 2;
+
+		case GL_UNSIGNED_INT:
+		case GL_INT:
+		case GL_FLOAT:
+			return components * 4;
+
+		// The packed types hold a whole pixel.
+		case GL_UNSIGNED_BYTE_3_3_2:
+		case GL_UNSIGNED_BYTE_2_3_3_REV:
+			return 1;
+
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_5_6_5_REV:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+		case GL_UNSIGNED_SHORT_5_5_5_1:
+		case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+			return 2;
+
+		case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_8_8_8_8_REV:
+		case GL_UNSIGNED_INT_10_10_10_2:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+			return 4;
+
+		default:
+			return 0;
+	}
+}
+
+void CocoaGame_CloseTextureArchive(CocoaGame_TextureArchive *archive)
+{
+	if (! archive)
+		return;
+
+	// Queued uploads read from the mapping, so they must be finished before it goes.
+	while (archive->mostRecent >= 0)
+		CocoaGame_EvictArchivedTexture(archive, archive->mostRecent);
+
+	munmap((void *) archive->mapping, archive->mappingSize);
+	close(archive->fd);
+
+	CocoaGame_Free(archive->textures);
+	CocoaGame_Free(archive);
+}
+
+//
+// Textures
+//
+
+int CocoaGame_GetTextureArchiveCount(const CocoaGame_TextureArchive *archive)
+{
+	return archive->textureCount;
+}
+
+int CocoaGame_FindArchivedTexture(const CocoaGame_TextureArchive *archive, const char *name)
+{
+	int i;
+	for (i = 0; i != archive->textureCount; ++i) {
+		if (strcmp(archive->index[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+const char *CocoaGame_GetArchivedTextureName(const CocoaGame_TextureArchive *archive, int index)
+{
+	assert(index >= 0 && index < archive->textureCount);
+	return archive->index[index].name;
+}
+
+void CocoaGame_GetArchivedTextureSize(const CocoaGame_TextureArchive *archive, int index, int *width, int *height)
+{
+	assert(index >= 0 && index < archive->textureCount);
+
+	if (width)
+		*width = (int) archive->index[index].width;
+
+	if (height)
+		*height = (int) archive->index[index].height;
+}
+
+void CocoaGame_PrefetchArchivedTexture(CocoaGame_TextureArchive *archive, int index)
+{
+	assert(index >= 0 && index < archive->textureCount);
+
+	if (archive->textures[index].texture)
+		return;
+
+	CocoaGame_MakeArchivedTextureResident(archive, index, CocoaGame_IsUploadWorkerRunning());
+}
+
+GLuint CocoaGame_GetArchivedTexture(CocoaGame_TextureArchive *archive, int index)
+{
+	assert(index >= 0 && index < archive->textureCount);
+
+	CocoaGame_ArchivedTexture *texture = &archive->textures[index];
+
+	if (! texture->texture)
+		CocoaGame_MakeArchivedTextureResident(archive, index, FALSE);
+	else if (texture->pending)
+		CocoaGame_FinishArchivedTexture(archive, index);
+
+	texture->lastUsedFrame = textureArchiveFrame;
+
+	if (archive->mostRecent != index) {
+		CocoaGame_UnlinkArchivedTexture(archive, index);
+		CocoaGame_LinkArchivedTexture(archive, index);
+	}
+
+	return texture->texture;
+}
+
+static void CocoaGame_MakeArchivedTextureResident(CocoaGame_TextureArchive *archive, int index, CocoaGame_Bool async)
+{
+	const CocoaGame_TextureArchiveIndexEntry *entry = &archive->index[index];
+	CocoaGame_ArchivedTexture *texture = &archive->textures[index];
+	const unsigned char *payload = archive->mapping + entry->offset;
+
+	CocoaGame_BeginZoneWithValue(__FUNCTION__, (int64_t) entry->size);
+
+	// The upload worker only does glTexImage2D().
+	if (! entry->format)
+		async = FALSE;
+
+	// Start reading the pages in now, as they're about to be needed.
+	CocoaGame_AdviseTextureArchive(archive, index, MADV_WILLNEED);
+
+	GLint previousTexture;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture);
+
+	glGenTextures(1, &texture->texture);
+	glBindTexture(GL_TEXTURE_2D, texture->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) entry->levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, entry->levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	uint32_t level;
+
+	if (async) {
+		for (level = 0; level != entry->levelCount; ++level) {
+			GLsizei width = (GLsizei) (entry->width >> level);
+			GLsizei height = (GLsizei) (entry->height >> level);
+
+			texture->uploads[level] = CocoaGame_UploadTexture(texture->texture, GL_TEXTURE_2D, (GLint) level,
+				(GLint) entry->internalFormat, width ? width : 1, height ? height : 1, entry->format, entry->type,
+				payload + entry->levelOffsets[level], entry->levelSizes[level]);
+		}
+
+		texture->pending = TRUE;
+	} else {
+		// Levels are tightly packed, and read from the mapping rather than any bound buffer.
+		GLint previousAlignment;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+		GLint previousBuffer;
+		glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &previousBuffer);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		CocoaGame_GLBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		for (level = 0; level != entry->levelCount; ++level) {
+			GLsizei width = (GLsizei) (entry->width >> level);
+			GLsizei height = (GLsizei) (entry->height >> level);
+			const void *pixels = payload + entry->levelOffsets[level];
+
+			if (entry->format) {
+				glTexImage2D(GL_TEXTURE_2D, (GLint) level, (GLint) entry->internalFormat, width ? width : 1,
+					height ? height : 1, 0, entry->format, entry->type, pixels);
+			} else {
+				glCompressedTexImage2D(GL_TEXTURE_2D, (GLint) level, entry->internalFormat, width ? width : 1,
+					height ? height : 1, 0, (GLsizei) entry->levelSizes[level], pixels);
+			}
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+		CocoaGame_GLBindBuffer(GL_PIXEL_UNPACK_BUFFER, (GLuint) previousBuffer);
+
+		// The driver has its own copy now.
+		CocoaGame_AdviseTextureArchive(archive, index, MADV_DONTNEED);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, (GLuint) previousTexture);
+
+	// Count it as used, so making room for it doesn't evict it straight away.
+	texture->lastUsedFrame = textureArchiveFrame;
+	CocoaGame_LinkArchivedTexture(archive, index);
+
+	archive->stats.residentTextures++;
+	archive->stats.residentBytes += entry->size;
+	archive->stats.uploads++;
+	archive->stats.uploadedBytes += entry->size;
+
+	CocoaGame_EvictArchivedTextures(archive);
+
+	CocoaGame_EndZone();
+}
+
+static void CocoaGame_FinishArchivedTexture(CocoaGame_TextureArchive *archive, int index)
+{
+	CocoaGame_ArchivedTexture *texture = &archive->textures[index];
+
+	uint32_t level;
+	for (level = 0; level != archive->index[index].levelCount; ++level) {
+		CocoaGame_FinishUpload(texture->uploads[level]);
+		texture->uploads[level] = NULL;
+	}
+
+	texture->pending = FALSE;
+
+	CocoaGame_AdviseTextureArchive(archive, index, MADV_DONTNEED);
+}
+
+//
+// Residency
+//
+
+void CocoaGame_TextureArchivesBeginFrame(void)
+{
+	++textureArchiveFrame;
+}
+
+void CocoaGame_SetTextureArchiveBudget(CocoaGame_TextureArchive *archive, size_t bytes)
+{
+	archive->budget = bytes;
+	CocoaGame_EvictArchivedTextures(archive);
+}
+
+void CocoaGame_GetTextureArchiveStats(const CocoaGame_TextureArchive *archive, CocoaGame_TextureArchiveStats *stats)
+{
+	*stats = archive->stats;
+}
+
+// Delete the least recently used textures until the archive is within its budget.
+static void CocoaGame_EvictArchivedTextures(CocoaGame_TextureArchive *archive)
+{
+	if (! archive->budget)
+		return;
+
+	while (archive->stats.residentBytes > archive->budget && archive->leastRecent >= 0) {
+		int index = archive->leastRecent;
+
+		// Everything more recent has been used this frame too, so the budget will have to be exceeded.
+		if (archive->textures[index].lastUsedFrame == textureArchiveFrame)
+			break;
+
+		CocoaGame_EvictArchivedTexture(archive, index);
+		archive->stats.evictions++;
+	}
+}
+
+static void CocoaGame_EvictArchivedTexture(CocoaGame_TextureArchive *archive, int index)
+{
+	CocoaGame_ArchivedTexture *texture = &archive->textures[index];
+
+	if (texture->pending)
+		CocoaGame_FinishArchivedTexture(archive, index);
+
+	CocoaGame_GLDeleteTextures(1, &texture->texture);
+	texture->texture = 0;
+	texture->lastUsedFrame = 0;
+
+	CocoaGame_UnlinkArchivedTexture(archive, index);
+
+	archive->stats.residentTextures--;
+	archive->stats.residentBytes -= archive->index[index].size;
+}
+
+static void CocoaGame_LinkArchivedTexture(CocoaGame_TextureArchive *archive, int index)
+{
+	CocoaGame_ArchivedTexture *texture = &archive->textures[index];
+
+	texture->moreRecent = -1;
+	texture->lessRecent = archive->mostRecent;
+
+	if (archive->mostRecent >= 0)
+		archive->textures[archive->mostRecent].moreRecent = index;
+	else
+		archive->leastRecent = index;
+
+	archive->mostRecent = index;
+}
+
+static void CocoaGame_UnlinkArchivedTexture(CocoaGame_TextureArchive *archive, int index)
+{
+	CocoaGame_ArchivedTexture *texture = &archive->textures[index];
+
+	if (texture->moreRecent >= 0)
+		archive->textures[texture->moreRecent].lessRecent = texture->lessRecent;
+	else
+		archive->mostRecent = texture->lessRecent;
+
+	if (texture->lessRecent >= 0)
+		archive->textures[texture->lessRecent].moreRecent = texture->moreRecent;
+	else
+		archive->leastRecent = texture->moreRecent;
+
+	texture->moreRecent = -1;
+	texture->lessRecent = -1;
+}
+
+// Apply advice to a texture's payload, widened to whole pages.
+static void CocoaGame_AdviseTextureArchive(CocoaGame_TextureArchive *archive, int index, int advice)
+{
+	const CocoaGame_TextureArchiveIndexEntry *entry = &archive->index[index];
+
+	uintptr_t pageSize = (uintptr_t) sysconf(_SC_PAGESIZE);
+	uintptr_t start = (uintptr_t) (archive->mapping + entry->offset) & ~(pageSize - 1);
+	uintptr_t end = (uintptr_t) (archive->mapping + entry->offset + entry->size);
+
+	if (end > start)
+		madvise((void *) start, end - start, advice);
+}
+
+//
+// Writing
+//
+
+CocoaGame_Bool CocoaGame_WriteTextureArchive(const char *path, const CocoaGame_TextureArchiveEntry *textures, int count)
+{
+	CocoaGame_TextureArchiveHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, COCOAGAME_TEXTURE_ARCHIVE_MAGIC, sizeof(header.magic));
+	header.textureCount = (uint32_t) count;
+	header.alignment = COCOAGAME_TEXTURE_ARCHIVE_ALIGNMENT;
+
+	CocoaGame_TextureArchiveIndexEntry *index = CocoaGame_AllocZeroed(count ? (size_t) count : 1,
+		sizeof(CocoaGame_TextureArchiveIndexEntry), COCOAGAME_ALLOC_CACHES);
+	if (! index) {
+		CocoaGame_Trace("%s: out of memory writing \"%s\".\n", __FUNCTION__, path);
+		return FALSE;
+	}
+
+	// Lay the payload out first, so the index can be written in one go.
+	uint64_t position = sizeof(header) + sizeof(*index) * (uint64_t) count;
+
+	int i;
+	for (i = 0; i != count; ++i) {
+		const CocoaGame_TextureArchiveEntry *texture = &textures[i];
+		CocoaGame_TextureArchiveIndexEntry *entry = &index[i];
+
+		assert(texture->levelCount > 0 && texture->levelCount <= COCOAGAME_TEXTURE_ARCHIVE_MAX_LEVELS);
+		assert(strlen(texture->name) < sizeof(entry->name));
+
+		strncpy(entry->name, texture->name, sizeof(entry->name) - 1);
+		entry->internalFormat = (uint32_t) texture->internalFormat;
+		entry->format = texture->format;
+		entry->type = texture->type;
+		entry->width = (uint32_t) texture->width;
+		entry->height = (uint32_t) texture->height;
+		entry->levelCount = (uint32_t) texture->levelCount;
+
+		position = (position + COCOAGAME_TEXTURE_ARCHIVE_ALIGNMENT - 1) & ~(uint64_t) (COCOAGAME_TEXTURE_ARCHIVE_ALIGNMENT - 1);
+		entry->offset = position;
+
+		uint32_t offset = 0;
+		int level;
+		for (level = 0; level != texture->levelCount; ++level) {
+			offset = (offset + COCOAGAME_TEXTURE_ARCHIVE_LEVEL_ALIGNMENT - 1) & ~(uint32_t) (COCOAGAME_TEXTURE_ARCHIVE_LEVEL_ALIGNMENT - 1);
+			entry->levelOffsets[level] = offset;
+			entry->levelSizes[level] = (uint32_t) texture->levelSizes[level];
+			offset += entry->levelSizes[level];
+		}
+
+		entry->size = offset;
+		position += offset;
+	}
+
+	CocoaGame_TextureArchiveWrite contents = { &header, index, textures, count };
+	CocoaGame_Bool ok = CocoaGame_WriteFileSafely(path, &CocoaGame_WriteTextureArchiveFile, &contents);
+
+	CocoaGame_Free(index);
+	return ok;
+}
+
+static CocoaGame_Bool CocoaGame_WriteTextureArchiveFile(FILE *fp, void *context)
+{
+	const CocoaGame_TextureArchiveWrite *contents = context;
+	const CocoaGame_TextureArchiveIndexEntry *index = contents->index;
+	int count = contents->count;
+
+	CocoaGame_Bool ok = fwrite(contents->header, sizeof(*contents->header), 1, fp) == 1 &&
+		(! count || fwrite(index, sizeof(*index), (size_t) count, fp) == (size_t) count);
+
+	uint64_t position = sizeof(*contents->header) + sizeof(*index) * (uint64_t) count;
+
+	int i;
+	for (i = 0; ok && i != count; ++i) {
+		const CocoaGame_TextureArchiveIndexEntry *entry = &index[i];
+
+		ok = CocoaGame_WriteTextureArchivePadding(fp, &position, COCOAGAME_TEXTURE_ARCHIVE_ALIGNMENT);
+
+		int level;
+		for (level = 0; ok && level != contents->textures[i].levelCount; ++level) {
+			ok = CocoaGame_WriteTextureArchivePadding(fp, &position, COCOAGAME_TEXTURE_ARCHIVE_LEVEL_ALIGNMENT) &&
+				(! entry->levelSizes[level] || fwrite(contents->textures[i].levels[level], entry->levelSizes[level], 1, fp) == 1);
+			position += entry->levelSizes[level];
+		}
+	}
+
+	return ok;
+}
+
+static CocoaGame_Bool CocoaGame_WriteTextureArchivePadding(FILE *fp, uint64_t *position, uint64_t alignment)
+{
+	static const char zeroes[COCOAGAME_TEXTURE_ARCHIVE_ALIGNMENT];
+
+	uint64_t padding = ((*position + alignment - 1) & ~(alignment - 1)) - *position;
+	*position += padding;
+
+	return ! padding || fwrite(zeroes, (size_t) padding, 1, fp) == 1;
+}
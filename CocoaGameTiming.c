@@ -0,0 +1,440 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Frame timing instrumentation. The backends bracket the phases of each frame with CocoaGame_BeginTiming() and
+// CocoaGame_EndTiming(), which cost a single test when timing is disabled. Events consumed by the application are
+// reported by CocoaGame_DequeueEvent() and CocoaGame_LatchInput(), and once the frame they went in to has been flushed
+// their ages are recorded as its input latency.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+//
+// Compile-time options
+//
+
+// Number of frames kept in the log and used for the percentiles.
+#define COCOAGAME_FRAME_TIMING_HISTORY 1024
+
+//
+// Histograms
+//
+
+// Durations are stored as nanoseconds in 32 bits (so anything over 4.29 seconds is clamped). Each power of two is
+// split in to 16 buckets, so the percentiles are within 1/32 of the true value.
+#define COCOAGAME_HISTOGRAM_SUB_BUCKET_BITS 4
+#define COCOAGAME_HISTOGRAM_SUB_BUCKETS (1 << COCOAGAME_HISTOGRAM_SUB_BUCKET_BITS)
+#define COCOAGAME_HISTOGRAM_BUCKETS ((32 - COCOAGAME_HISTOGRAM_SUB_BUCKET_BITS + 1) * COCOAGAME_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct CocoaGame_FrameTimingRecord {
+	uint64_t frame;
+	uint64_t start;
+	uint32_t phases[COCOAGAME_FRAME_PHASE_COUNT];
+	int queueDepth;
+	uint32_t droppedEvents;
+
+	// Ages of the oldest and newest input consumed for the frame, valid if hasInput is set.
+	CocoaGame_Bool hasInput;
+	uint32_t inputAges[COCOAGAME_INPUT_AGE_COUNT];
+} CocoaGame_FrameTimingRecord;
+
+//
+// Private functions
+//
+
+static int CocoaGame_HistogramBucket(uint32_t value);
+static uint32_t CocoaGame_HistogramBucketValue(int bucket);
+static uint32_t CocoaGame_ClampDuration(uint64_t duration);
+static void CocoaGame_AddPhaseTime(CocoaGame_FramePhase phase, uint64_t duration);
+static void CocoaGame_FinishTimedFrame(uint64_t now);
+static double CocoaGame_GetPercentile(const uint32_t *histogram, int count, int percent);
+static void CocoaGame_Summarise(const uint32_t *histogram, int count, uint32_t max, CocoaGame_FrameTimingSummary *summary);
+static const CocoaGame_FrameTimingRecord *CocoaGame_GetTimingRecord(int index);
+
+//
+// Private data
+//
+
+static CocoaGame_Bool timingEnabled = FALSE;
+
+static CocoaGame_FrameTimingRecord timingRecords[COCOAGAME_FRAME_TIMING_HISTORY];
+static int timingRecordCount;
+static int timingRecordNext;
+
+static uint32_t timingHistograms[COCOAGAME_FRAME_PHASE_COUNT][COCOAGAME_HISTOGRAM_BUCKETS];
+
+// Only frames which consumed input contribute to the latency histograms.
+static uint32_t timingLatencyHistograms[COCOAGAME_INPUT_AGE_COUNT][COCOAGAME_HISTOGRAM_BUCKETS];
+static int timingLatencyFrames;
+
+// Timestamps of the oldest and newest events consumed since the last frame was flushed, or 0. Written by the thread
+// reading events, which may not be the one rendering.
+static uint64_t timingOldestInput;
+static uint64_t timingNewestInput;
+
+// The frame currently being timed, started by the last CocoaGame_BeginRender().
+static CocoaGame_FrameTimingRecord timingCurrent;
+static CocoaGame_Bool timingInFrame;
+static uint64_t timingRenderStart;
+static uint64_t timingFrameNumber;
+static uint64_t timingLastDroppedEvents;
+
+static const char *PHASE_NAMES[COCOAGAME_FRAME_PHASE_COUNT] = {
+	"poll",
+	"begin_render",
+	"render",
+	"end_render",
+	"frame",
+};
+
+static const char *INPUT_AGE_NAMES[COCOAGAME_INPUT_AGE_COUNT] = {
+	"oldest_input",
+	"newest_input",
+};
+
+//
+// Frame timing
+//
+
+void CocoaGame_SetFrameTimingEnabled(CocoaGame_Bool enabled)
+{
+	if (enabled && ! timingEnabled)
+		CocoaGame_ResetFrameTiming();
+
+	timingEnabled = enabled;
+}
+
+CocoaGame_Bool CocoaGame_IsFrameTimingEnabled(void)
+{
+	return timingEnabled;
+}
+
+void CocoaGame_ResetFrameTiming(void)
+{
+	memset(timingHistograms, 0, sizeof(timingHistograms));
+	memset(timingLatencyHistograms, 0, sizeof(timingLatencyHistograms));
+	timingLatencyFrames = 0;
+	timingRecordCount = 0;
+	timingRecordNext = 0;
+	timingInFrame = FALSE;
+	timingRenderStart = 0;
+
+	__atomic_store_n(&timingOldestInput, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&timingNewestInput, 0, __ATOMIC_RELAXED);
+
+	CocoaGame_EventQueueStats stats;
+	CocoaGame_GetEventQueueStats(&stats);
+	timingLastDroppedEvents = stats.droppedEvents;
+}
+
+uint64_t CocoaGame_BeginTiming(void)
+{
+	return timingEnabled ? CocoaGame_GetNanoseconds() : 0;
+}
+
+void CocoaGame_EndTiming(CocoaGame_FramePhase phase, uint64_t start)
+{
+	if (! start || ! timingInFrame)
+		return;
+
+	// With a render thread, CocoaGame_Poll() runs on the main thread, and frames are timed on the render thread.
+	if (phase == COCOAGAME_FRAME_PHASE_POLL && CocoaGame_IsRenderThreadRunning())
+		return;
+
+	uint64_t now = CocoaGame_GetNanoseconds();
+	CocoaGame_AddPhaseTime(phase, now - start);
+
+	// Whatever the application does between CocoaGame_BeginRender() and CocoaGame_EndRender() is its render time.
+	if (phase == COCOAGAME_FRAME_PHASE_BEGIN_RENDER)
+		timingRenderStart = now;
+}
+
+void CocoaGame_FrameTimingBeginRender(void)
+{
+	if (! timingEnabled)
+		return;
+
+	uint64_t now = CocoaGame_GetNanoseconds();
+
+	if (timingInFrame)
+		CocoaGame_FinishTimedFrame(now);
+
+	CocoaGame_EventQueueStats stats;
+	CocoaGame_GetEventQueueStats(&stats);
+
+	memset(&timingCurrent, 0, sizeof(timingCurrent));
+	timingCurrent.frame = timingFrameNumber++;
+	timingCurrent.start = now;
+	timingCurrent.queueDepth = stats.depth;
+	timingCurrent.droppedEvents = (uint32_t) (stats.droppedEvents - timingLastDroppedEvents);
+	timingLastDroppedEvents = stats.droppedEvents;
+
+	timingInFrame = TRUE;
+	timingRenderStart = 0;
+}
+
+void CocoaGame_FrameTimingEndRender(void)
+{
+	if (! timingEnabled || ! timingRenderStart)
+		return;
+
+	CocoaGame_AddPhaseTime(COCOAGAME_FRAME_PHASE_RENDER, CocoaGame_GetNanoseconds() - timingRenderStart);
+	timingRenderStart = 0;
+}
+
+void CocoaGame_FrameTimingInputConsumed(uint64_t oldest, uint64_t newest)
+{
+	if (! timingEnabled)
+		return;
+
+	// Handlers consume input on the threads that queue it, alongside the consumer, so only the first one in sets it.
+	uint64_t unset = 0;
+	__atomic_compare_exchange_n(&timingOldestInput, &unset, oldest, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&timingNewestInput, newest, __ATOMIC_RELAXED);
+}
+
+void CocoaGame_FrameTimingFinishRender(CocoaGame_Bool discarded)
+{
+	if (! timingEnabled || ! timingInFrame || discarded)
+		return;
+
+	// Input consumed for a frame that wasn't shown carries over to the next one that is.
+	uint64_t oldest = __atomic_exchange_n(&timingOldestInput, 0, __ATOMIC_RELAXED);
+	uint64_t newest = __atomic_exchange_n(&timingNewestInput, 0, __ATOMIC_RELAXED);
+	if (! oldest)
+		return;
+
+	uint64_t now = CocoaGame_GetNanoseconds();
+
+	timingCurrent.hasInput = TRUE;
+	timingCurrent.inputAges[COCOAGAME_INPUT_AGE_OLDEST] = CocoaGame_ClampDuration(now > oldest ? now - oldest : 0);
+	timingCurrent.inputAges[COCOAGAME_INPUT_AGE_NEWEST] = CocoaGame_ClampDuration(now > newest ? now - newest : 0);
+}
+
+static uint32_t CocoaGame_ClampDuration(uint64_t duration)
+{
+	return duration > UINT32_MAX ? UINT32_MAX : (uint32_t) duration;
+}
+
+static void CocoaGame_AddPhaseTime(CocoaGame_FramePhase phase, uint64_t duration)
+{
+	timingCurrent.phases[phase] = CocoaGame_ClampDuration(timingCurrent.phases[phase] + duration);
+}
+
+// A frame lasts from one CocoaGame_BeginRender() to the next. Move it in to the log and the histograms, evicting the
+// oldest frame if the log is full.
+static void CocoaGame_FinishTimedFrame(uint64_t now)
+{
+	CocoaGame_AddPhaseTime(COCOAGAME_FRAME_PHASE_FRAME, now - timingCurrent.start);
+
+	CocoaGame_FrameTimingRecord *record = &timingRecords[timingRecordNext];
+	int phase, age;
+
+	if (timingRecordCount == COCOAGAME_FRAME_TIMING_HISTORY) {
+		for (phase = 0; phase != COCOAGAME_FRAME_PHASE_COUNT; ++phase)
+			--timingHistograms[phase][CocoaGame_HistogramBucket(record->phases[phase])];
+
+		if (record->hasInput) {
+			for (age = 0; age != COCOAGAME_INPUT_AGE_COUNT; ++age)
+				--timingLatencyHistograms[age][CocoaGame_HistogramBucket(record->inputAges[age])];
+
+			--timingLatencyFrames;
+		}
+	} else
+		++timingRecordCount;
+
+	*record = timingCurrent;
+
+	for (phase = 0; phase != COCOAGAME_FRAME_PHASE_COUNT; ++phase)
+		++timingHistograms[phase][CocoaGame_HistogramBucket(record->phases[phase])];
+
+	if (record->hasInput) {
+		for (age = 0; age != COCOAGAME_INPUT_AGE_COUNT; ++age)
+			++timingLatencyHistograms[age][CocoaGame_HistogramBucket(record->inputAges[age])];
+
+		++timingLatencyFrames;
+	}
+
+	timingRecordNext = (timingRecordNext + 1) % COCOAGAME_FRAME_TIMING_HISTORY;
+}
+
+static int CocoaGame_HistogramBucket(uint32_t value)
+{
+	if (value < COCOAGAME_HISTOGRAM_SUB_BUCKETS)
+		return (int) value;
+
+	int exponent = 31 - __builtin_clz(value);
+	int shift = exponent - COCOAGAME_HISTOGRAM_SUB_BUCKET_BITS;
+	int subBucket = (int) (value >> shift) & (COCOAGAME_HISTOGRAM_SUB_BUCKETS - 1);
+
+	return (shift + 1) * COCOAGAME_HISTOGRAM_SUB_BUCKETS + subBucket;
+}
+
+// The midpoint of a bucket's range.
+static uint32_t CocoaGame_HistogramBucketValue(int bucket)
+{
+	if (bucket < COCOAGAME_HISTOGRAM_SUB_BUCKETS)
+		return (uint32_t) bucket;
+
+	int shift = bucket / COCOAGAME_HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t low = (uint64_t) (COCOAGAME_HISTOGRAM_SUB_BUCKETS + bucket % COCOAGAME_HISTOGRAM_SUB_BUCKETS) << shift;
+
+	return (uint32_t) (low + (((uint64_t) 1 << shift) >> 1));
+}
+
+// histogram holds count samples.
+static double CocoaGame_GetPercentile(const uint32_t *histogram, int count, int percent)
+{
+	if (! count)
+		return 0.0;
+
+	// The rank of the sample we're looking for, rounded up.
+	uint32_t rank = (uint32_t) ((count * percent + 99) / 100);
+	if (rank < 1)
+		rank = 1;
+
+	uint32_t seen = 0;
+	int bucket;
+	for (bucket = 0; bucket != COCOAGAME_HISTOGRAM_BUCKETS; ++bucket) {
+		seen += histogram[bucket];
+		if (seen >= rank)
+			break;
+	}
+
+	return (double) CocoaGame_HistogramBucketValue(bucket) / 1e9;
+}
+
+// max is the exact maximum, in nanoseconds.
+static void CocoaGame_Summarise(const uint32_t *histogram, int count, uint32_t max, CocoaGame_FrameTimingSummary *summary)
+{
+	memset(summary, 0, sizeof(*summary));
+	summary->frames = count;
+
+	if (! count)
+		return;
+
+	summary->p50 = CocoaGame_GetPercentile(histogram, count, 50);
+	summary->p95 = CocoaGame_GetPercentile(histogram, count, 95);
+	summary->p99 = CocoaGame_GetPercentile(histogram, count, 99);
+	summary->max = (double) max / 1e9;
+}
+
+void CocoaGame_GetFrameTimingSummary(CocoaGame_FramePhase phase, CocoaGame_FrameTimingSummary *summary)
+{
+	assert(phase >= 0 && phase < COCOAGAME_FRAME_PHASE_COUNT);
+
+	uint32_t max = 0;
+	int i;
+	for (i = 0; i != timingRecordCount; ++i) {
+		if (timingRecords[i].phases[phase] > max)
+			max = timingRecords[i].phases[phase];
+	}
+
+	CocoaGame_Summarise(timingHistograms[phase], timingRecordCount, max, summary);
+}
+
+void CocoaGame_GetInputLatencySummary(CocoaGame_InputAge age, CocoaGame_FrameTimingSummary *summary)
+{
+	assert(age >= 0 && age < COCOAGAME_INPUT_AGE_COUNT);
+
+	uint32_t max = 0;
+	int i;
+	for (i = 0; i != timingRecordCount; ++i) {
+		if (timingRecords[i].hasInput && timingRecords[i].inputAges[age] > max)
+			max = timingRecords[i].inputAges[age];
+	}
+
+	CocoaGame_Summarise(timingLatencyHistograms[age], timingLatencyFrames, max, summary);
+}
+
+// Records in order, oldest first.
+static const CocoaGame_FrameTimingRecord *CocoaGame_GetTimingRecord(int index)
+{
+	int first = timingRecordCount == COCOAGAME_FRAME_TIMING_HISTORY ? timingRecordNext : 0;
+
+	return &timingRecords[(first + index) % COCOAGAME_FRAME_TIMING_HISTORY];
+}
+
+CocoaGame_Bool CocoaGame_WriteFrameTimingLog(const char *path, CocoaGame_FrameTimingFormat format)
+{
+	FILE *fp = fopen(path, "w");
+	if (! fp) {
+		CocoaGame_Trace("%s: unable to create \"%s\".\n", __FUNCTION__, path);
+		return FALSE;
+	}
+
+	int i, phase, age;
+
+	if (format == COCOAGAME_FRAME_TIMING_CSV) {
+		fputs("frame,start_ns", fp);
+		for (phase = 0; phase != COCOAGAME_FRAME_PHASE_COUNT; ++phase)
+			fprintf(fp, ",%s_ns", PHASE_NAMES[phase]);
+		fputs(",queue_depth,dropped_events", fp);
+		for (age = 0; age != COCOAGAME_INPUT_AGE_COUNT; ++age)
+			fprintf(fp, ",%s_ns", INPUT_AGE_NAMES[age]);
+		fputs("\n", fp);
+
+		for (i = 0; i != timingRecordCount; ++i) {
+			const CocoaGame_FrameTimingRecord *record = CocoaGame_GetTimingRecord(i);
+
+			fprintf(fp, "%llu,%llu", (unsigned long long) record->frame, (unsigned long long) record->start);
+			for (phase = 0; phase != COCOAGAME_FRAME_PHASE_COUNT; ++phase)
+				fprintf(fp, ",%u", (unsigned int) record->phases[phase]);
+			fprintf(fp, ",%d,%u", record->queueDepth, (unsigned int) record->droppedEvents);
+
+			// Empty if the frame consumed no input.
+			for (age = 0; age != COCOAGAME_INPUT_AGE_COUNT; ++age) {
+				if (record->hasInput)
+					fprintf(fp, ",%u", (unsigned int) record->inputAges[age]);
+				else
+					fputs(",", fp);
+			}
+			fputs("\n", fp);
+		}
+	} else {
+		fputs("{\n\t\"summary\": {", fp);
+		for (phase = 0; phase != COCOAGAME_FRAME_PHASE_COUNT; ++phase) {
+			CocoaGame_FrameTimingSummary summary;
+			CocoaGame_GetFrameTimingSummary((CocoaGame_FramePhase) phase, &summary);
+
+			fprintf(fp, "%s\n\t\t\"%s\": {\"p50\": %.9f, \"p95\": %.9f, \"p99\": %.9f, \"max\": %.9f}",
+				phase ? "," : "", PHASE_NAMES[phase], summary.p50, summary.p95, summary.p99, summary.max);
+		}
+		for (age = 0; age != COCOAGAME_INPUT_AGE_COUNT; ++age) {
+			CocoaGame_FrameTimingSummary summary;
+			CocoaGame_GetInputLatencySummary((CocoaGame_InputAge) age, &summary);
+
+			fprintf(fp, ",\n\t\t\"%s\": {\"frames\": %d, \"p50\": %.9f, \"p95\": %.9f, \"p99\": %.9f, \"max\": %.9f}",
+				INPUT_AGE_NAMES[age], summary.frames, summary.p50, summary.p95, summary.p99, summary.max);
+		}
+		fputs("\n\t},\n\t\"frames\": [", fp);
+
+		for (i = 0; i != timingRecordCount; ++i) {
+			const CocoaGame_FrameTimingRecord *record = CocoaGame_GetTimingRecord(i);
+
+			fprintf(fp, "%s\n\t\t{\"frame\": %llu, \"start_ns\": %llu", i ? "," : "", (unsigned long long) record->frame,
+				(unsigned long long) record->start);
+			for (phase = 0; phase != COCOAGAME_FRAME_PHASE_COUNT; ++phase)
+				fprintf(fp, ", \"%s_ns\": %u", PHASE_NAMES[phase], (unsigned int) record->phases[phase]);
+			fprintf(fp, ", \"queue_depth\": %d, \"dropped_events\": %u", record->queueDepth, (unsigned int) record->droppedEvents);
+			if (record->hasInput) {
+				for (age = 0; age != COCOAGAME_INPUT_AGE_COUNT; ++age)
+					fprintf(fp, ", \"%s_ns\": %u", INPUT_AGE_NAMES[age], (unsigned int) record->inputAges[age]);
+			}
+			fputs("}", fp);
+		}
+		fputs("\n\t]\n}\n", fp);
+	}
+
+	if (fclose(fp) != 0) {
+		CocoaGame_Trace("%s: error writing \"%s\".\n", __FUNCTION__, path);
+		return FALSE;
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,296 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Transient buffer allocator. Geometry and uniforms that only live for a frame are bump allocated from one region
+// of a ring of COCOAGAME_TRANSIENT_FRAMES regions in a single buffer object. Where ARB_buffer_storage is available
+// the buffer is mapped persistently and each region is fenced at CocoaGame_EndRender(), so a region is only
+// written again once the GPU has finished with it. Otherwise, allocations are made in system memory and copied in to
+// a buffer orphaned at the start of each frame when the buffer is bound.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+//
+// Compile-time options
+//
+
+// Number of frames the ring holds. The GPU can be this many frames behind before allocation has to wait for it.
+#define COCOAGAME_TRANSIENT_FRAMES 3
+
+// Bytes available to each frame if CocoaGame_SetTransientBufferSize() isn't called.
+#define COCOAGAME_DEFAULT_TRANSIENT_SIZE (4 * 1024 * 1024)
+
+// How long to wait for the GPU to finish with a region before giving up on the fence, in nanoseconds.
+#define COCOAGAME_TRANSIENT_WAIT_TIMEOUT 1000000000ull
+
+//
+// Private functions
+//
+
+static CocoaGame_Bool CocoaGame_CreateTransientBuffer(void);
+static void CocoaGame_DestroyTransientBuffer(void);
+static void CocoaGame_WaitForTransientRegion(int region);
+
+//
+// Private data
+//
+
+static size_t transientRequestedSize = COCOAGAME_DEFAULT_TRANSIENT_SIZE;
+
+static GLuint transientBuffer;
+static CocoaGame_Bool transientPersistent;
+static size_t transientCapacity;
+
+// The persistent mapping of the whole ring, or the system memory copy of this frame's region.
+static unsigned char *transientMemory;
+
+static GLsync transientFences[COCOAGAME_TRANSIENT_FRAMES];
+static int transientRegion;
+static CocoaGame_Bool transientInFrame;
+
+// Bytes allocated this frame, and (without persistent mapping) bytes copied to the buffer.
+static size_t transientUsed;
+static size_t transientUploaded;
+
+// The largest frame's demand, including allocations that didn't fit, used to grow the ring.
+static size_t transientDemand;
+
+static CocoaGame_TransientStats transientStats;
+
+//
+// Transient buffers
+//
+
+void CocoaGame_SetTransientBufferSize(size_t bytesPerFrame)
+{
+	transientRequestedSize = bytesPerFrame;
+}
+
+static CocoaGame_Bool CocoaGame_CreateTransientBuffer(void)
+{
+	transientCapacity = transientRequestedSize;
+	if (transientCapacity < 1024)
+		transientCapacity = 1024;
+
+	glGenBuffers(1, &transientBuffer);
+	CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, transientBuffer);
+
+	transientPersistent = FALSE;
+
+	#ifdef GL_ARB_buffer_storage
+		const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+		if (extensions && strstr(extensions, "GL_ARB_buffer_storage")) {
+			GLsizeiptr size = (GLsizeiptr) (transientCapacity * COCOAGAME_TRANSIENT_FRAMES);
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+			glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+			transientMemory = (unsigned char *) glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+			transientPersistent = transientMemory != NULL;
+
+			// A buffer's storage can't be respecified, so start again with a new one for the fallback.
+			if (! transientPersistent) {
+				CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, 0);
+				CocoaGame_GLDeleteBuffers(1, &transientBuffer);
+				glGenBuffers(1, &transientBuffer);
+				CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, transientBuffer);
+			}
+		}
+	#endif
+
+	if (! transientPersistent) {
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) transientCapacity, NULL, GL_STREAM_DRAW);
+		transientMemory = CocoaGame_Alloc(transientCapacity, COCOAGAME_ALLOC_RENDERING);
+	}
+
+	CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (! transientMemory) {
+		CocoaGame_Trace("%s: unable to allocate %lu byte transient buffer.\n", __FUNCTION__, (unsigned long) transientCapacity);
+		CocoaGame_DestroyTransientBuffer();
+		return FALSE;
+	}
+
+	transientStats.capacity = transientCapacity;
+	transientStats.persistent = transientPersistent;
+
+	CocoaGame_Trace("%s: %lu bytes per frame (%s).\n", __FUNCTION__, (unsigned long) transientCapacity, transientPersistent ? "persistently mapped" : "orphaned");
+	return TRUE;
+}
+
+static void CocoaGame_DestroyTransientBuffer(void)
+{
+	int i;
+	for (i = 0; i != COCOAGAME_TRANSIENT_FRAMES; ++i) {
+		if (transientFences[i]) {
+			glDeleteSync(transientFences[i]);
+			transientFences[i] = 0;
+		}
+	}
+
+	if (transientBuffer) {
+		if (transientPersistent && transientMemory) {
+			CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, transientBuffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		CocoaGame_GLDeleteBuffers(1, &transientBuffer);
+		transientBuffer = 0;
+	}
+
+	if (! transientPersistent)
+		CocoaGame_Free(transientMemory);
+
+	transientMemory = NULL;
+	transientCapacity = 0;
+	transientPersistent = FALSE;
+}
+
+void CocoaGame_TransientBeginFrame(void)
+{
+	transientInFrame = TRUE;
+	transientUsed = 0;
+	transientUploaded = 0;
+
+	if (! transientBuffer)
+		return;
+
+	// If a frame didn't fit, grow to fit it. Every region is in use by the GPU until its fence signals.
+	if (transientDemand > transientCapacity) {
+		int i;
+		for (i = 0; i != COCOAGAME_TRANSIENT_FRAMES; ++i)
+			CocoaGame_WaitForTransientRegion(i);
+
+		size_t newSize = transientCapacity;
+		while (newSize < transientDemand)
+			newSize *= 2;
+
+		CocoaGame_DestroyTransientBuffer();
+		transientRequestedSize = newSize;
+
+		if (! CocoaGame_CreateTransientBuffer())
+			return;
+	}
+
+	transientDemand = 0;
+
+	transientRegion = (transientRegion + 1) % COCOAGAME_TRANSIENT_FRAMES;
+
+	if (transientPersistent)
+		CocoaGame_WaitForTransientRegion(transientRegion);
+	else {
+		// Give the driver a fresh block of memory rather than having it wait for draws using the old one.
+		CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, transientBuffer);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) transientCapacity, NULL, GL_STREAM_DRAW);
+		CocoaGame_GLBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+static void CocoaGame_WaitForTransientRegion(int region)
+{
+	GLsync fence = transientFences[region];
+	if (! fence)
+		return;
+
+	if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+		CocoaGame_BeginZone(__FUNCTION__);
+		transientStats.stalls++;
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, COCOAGAME_TRANSIENT_WAIT_TIMEOUT);
+		CocoaGame_EndZone();
+	}
+
+	glDeleteSync(fence);
+	transientFences[region] = 0;
+}
+
+void CocoaGame_TransientEndRender(void)
+{
+	if (! transientInFrame)
+		return;
+
+	transientInFrame = FALSE;
+
+	if (transientPersistent && transientUsed)
+		transientFences[transientRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	transientStats.frames++;
+	transientStats.lastFrameBytes = transientUsed;
+	transientStats.totalBytes += transientUsed;
+
+	if (transientUsed > transientStats.peakFrameBytes)
+		transientStats.peakFrameBytes = transientUsed;
+}
+
+void CocoaGame_ShutdownTransient(void)
+{
+	CocoaGame_DestroyTransientBuffer();
+	transientInFrame = FALSE;
+	transientDemand = 0;
+}
+
+void *CocoaGame_AllocTransient(size_t size, size_t alignment, size_t *offset)
+{
+	assert(transientInFrame && "Transient allocations must be made between CocoaGame_BeginRender() and CocoaGame_EndRender().");
+
+	// The buffer is created on first use.
+	if (! transientBuffer && ! CocoaGame_CreateTransientBuffer())
+		return NULL;
+
+	if (alignment < 1)
+		alignment = 1;
+
+	size_t start = (transientUsed + alignment - 1) / alignment * alignment;
+
+	if (start + size > transientCapacity) {
+		transientStats.overflows++;
+		transientDemand = start + size > transientDemand ? start + size : transientDemand;
+		return NULL;
+	}
+
+	transientUsed = start + size;
+	if (transientUsed > transientDemand)
+		transientDemand = transientUsed;
+
+	if (transientPersistent) {
+		*offset = (size_t) transientRegion * transientCapacity + start;
+		return transientMemory + *offset;
+	}
+
+	*offset = start;
+	return transientMemory + start;
+}
+
+GLuint CocoaGame_BindTransientBuffer(GLenum target)
+{
+	if (! transientBuffer)
+		return 0;
+
+	CocoaGame_GLBindBuffer(target, transientBuffer);
+
+	// Copy whatever's been allocated since the last bind.
+	if (! transientPersistent && transientUploaded < transientUsed) {
+		glBufferSubData(target, (GLintptr) transientUploaded, (GLsizeiptr) (transientUsed - transientUploaded), transientMemory + transientUploaded);
+		transientUploaded = transientUsed;
+	}
+
+	return transientBuffer;
+}
+
+void CocoaGame_GetTransientStats(CocoaGame_TransientStats *stats)
+{
+	*stats = transientStats;
+}
+
+void CocoaGame_ResetTransientStats(void)
+{
+	size_t capacity = transientStats.capacity;
+	CocoaGame_Bool persistent = transientStats.persistent;
+
+	memset(&transientStats, 0, sizeof(transientStats));
+	transientStats.capacity = capacity;
+	transientStats.persistent = persistent;
+}
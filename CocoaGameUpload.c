@@ -0,0 +1,345 @@
+//
+// CocoaGame2
+// Copyright (c) 2007-2012 Mark H. P. Lord. All rights reserved.
+//
+// Background uploads. A worker thread with its own context, sharing objects with the main context, takes texture
+// and buffer uploads from a queue. Texture data is staged through a pixel buffer object so the copy in to the
+// driver happens on the worker. Each upload is fenced, and the context that uses the resource waits for the fence
+// on the GPU, so no thread waits for the upload unless the worker hasn't reached it yet.
+//
+
+#include "CocoaGamePrivate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+//
+// Private types
+//
+
+typedef enum CocoaGame_UploadType {
+	COCOAGAME_UPLOAD_TEXTURE,
+	COCOAGAME_UPLOAD_BUFFER
+} CocoaGame_UploadType;
+
+struct CocoaGame_Upload {
+	CocoaGame_Upload *next;
+	CocoaGame_UploadType type;
+
+	GLuint name;
+	const void *data;
+	size_t size;
+
+	// Textures.
+	GLenum target;
+	GLint level;
+	GLint internalFormat;
+	GLsizei width;
+	GLsizei height;
+	GLenum format;
+	GLenum dataType;
+
+	// Buffers.
+	size_t offset;
+
+	// Set by the worker.
+	GLsync fence;
+	CocoaGame_Bool finished;
+};
+
+//
+// Private functions
+//
+
+static CocoaGame_Upload *CocoaGame_QueueUpload(CocoaGame_Upload *upload);
+static void *CocoaGame_UploadWorker(void *context);
+static void CocoaGame_PerformUpload(CocoaGame_Upload *upload, GLuint pbo);
+static GLenum CocoaGame_GetTextureBindingTarget(GLenum target);
+
+//
+// Private data
+//
+
+static CocoaGame_Bool uploadWorkerRunning;
+static void *uploadContext;
+static pthread_t uploadWorker;
+
+// Shared with the worker, protected by uploadMutex. uploadCond is signalled when an upload is queued and when one
+// finishes.
+static CocoaGame_Upload *uploadHead;
+static CocoaGame_Upload *uploadTail;
+static CocoaGame_Bool uploadWorkerStop;
+static CocoaGame_UploadStats uploadStats;
+static pthread_mutex_t uploadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uploadCond = PTHREAD_COND_INITIALIZER;
+
+//
+// Upload worker
+//
+
+CocoaGame_Bool CocoaGame_StartUploadWorker(void)
+{
+	if (uploadWorkerRunning)
+		return TRUE;
+
+	uploadContext = CocoaGame_CreateSharedContext();
+	if (! uploadContext)
+		return FALSE;
+
+	uploadWorkerStop = FALSE;
+
+	if (pthread_create(&uploadWorker, NULL, CocoaGame_UploadWorker, NULL) != 0) {
+		CocoaGame_Trace("%s: unable to create upload thread.\n", __FUNCTION__);
+		CocoaGame_DestroySharedContext(uploadContext);
+		uploadContext = NULL;
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&uploadMutex);
+	uploadWorkerRunning = TRUE;
+	pthread_mutex_unlock(&uploadMutex);
+
+	CocoaGame_Trace("%s: upload worker started.\n", __FUNCTION__);
+	return TRUE;
+}
+
+void CocoaGame_StopUploadWorker(void)
+{
+	if (! uploadWorkerRunning)
+		return;
+
+	pthread_mutex_lock(&uploadMutex);
+	uploadWorkerStop = TRUE;
+	pthread_cond_broadcast(&uploadCond);
+	pthread_mutex_unlock(&uploadMutex);
+
+	pthread_join(uploadWorker, NULL);
+
+	CocoaGame_DestroySharedContext(uploadContext);
+	uploadContext = NULL;
+
+	pthread_mutex_lock(&uploadMutex);
+	uploadWorkerRunning = FALSE;
+	pthread_mutex_unlock(&uploadMutex);
+
+	CocoaGame_Trace("%s: upload worker stopped.\n", __FUNCTION__);
+}
+
+CocoaGame_Bool CocoaGame_IsUploadWorkerRunning(void)
+{
+	return uploadWorkerRunning;
+}
+
+static void *CocoaGame_UploadWorker(void *context)
+{
+	(void) context;
+
+	CocoaGame_SetProfileThreadName("CocoaGame upload worker");
+
+	void *pool;
+	CocoaGame_CreateAutoreleasePool(&pool);
+
+	CocoaGame_Bool current = CocoaGame_MakeSharedContextCurrent(uploadContext);
+	if (! current)
+		CocoaGame_Trace("%s: unable to make the upload context current, uploads will be skipped.\n", __FUNCTION__);
+
+	GLuint pbo = 0;
+	if (current) {
+		glGenBuffers(1, &pbo);
+
+		// Rows are tightly packed.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	}
+
+	pthread_mutex_lock(&uploadMutex);
+
+	for (;;) {
+		while (! uploadHead && ! uploadWorkerStop)
+			pthread_cond_wait(&uploadCond, &uploadMutex);
+
+		// Everything queued is uploaded before the worker stops.
+		CocoaGame_Upload *upload = uploadHead;
+		if (! upload)
+			break;
+
+		uploadHead = upload->next;
+		if (! uploadHead)
+			uploadTail = NULL;
+
+		pthread_mutex_unlock(&uploadMutex);
+
+		if (current)
+			CocoaGame_PerformUpload(upload, pbo);
+
+		pthread_mutex_lock(&uploadMutex);
+
+		uploadStats.completedUploads++;
+		uploadStats.completedBytes += upload->size;
+		__atomic_store_n(&upload->finished, TRUE, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&uploadCond);
+	}
+
+	pthread_mutex_unlock(&uploadMutex);
+
+	if (current) {
+		glDeleteBuffers(1, &pbo);
+		CocoaGame_MakeSharedContextCurrent(NULL);
+	}
+
+	CocoaGame_FreeAutoreleasePool(pool);
+	return NULL;
+}
+
+static void CocoaGame_PerformUpload(CocoaGame_Upload *upload, GLuint pbo)
+{
+	CocoaGame_BeginZoneWithValue(__FUNCTION__, (int64_t) upload->size);
+
+	if (upload->type == COCOAGAME_UPLOAD_TEXTURE) {
+		const void *pixels = upload->data;
+
+		// Orphan the staging buffer's previous storage so the copy doesn't wait for the last upload to be consumed. If
+		// it can't be mapped, fall back to uploading from the caller's memory.
+		if (upload->data && upload->size) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) upload->size, NULL, GL_STREAM_DRAW);
+
+			void *staging = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+			if (staging) {
+				memcpy(staging, upload->data, upload->size);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				pixels = NULL;
+			} else
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		GLenum bindingTarget = CocoaGame_GetTextureBindingTarget(upload->target);
+		glBindTexture(bindingTarget, upload->name);
+		glTexImage2D(upload->target, upload->level, upload->internalFormat, upload->width, upload->height, 0, upload->format, upload->dataType, pixels);
+		glBindTexture(bindingTarget, 0);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, upload->name);
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) upload->offset, (GLsizeiptr) upload->size, upload->data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// The fence has to reach the GPU before another context can wait for it.
+	upload->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	CocoaGame_EndZone();
+}
+
+static GLenum CocoaGame_GetTextureBindingTarget(GLenum target)
+{
+	if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+		return GL_TEXTURE_CUBE_MAP;
+
+	return target;
+}
+
+//
+// Uploads
+//
+
+CocoaGame_Upload *CocoaGame_UploadTexture(GLuint texture, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *pixels, size_t size)
+{
+	CocoaGame_Upload *upload = CocoaGame_AllocZeroed(1, sizeof(*upload), COCOAGAME_ALLOC_RENDERING);
+	if (! upload)
+		return NULL;
+
+	upload->type = COCOAGAME_UPLOAD_TEXTURE;
+	upload->name = texture;
+	upload->data = pixels;
+	upload->size = size;
+	upload->target = target;
+	upload->level = level;
+	upload->internalFormat = internalFormat;
+	upload->width = width;
+	upload->height = height;
+	upload->format = format;
+	upload->dataType = type;
+
+	return CocoaGame_QueueUpload(upload);
+}
+
+CocoaGame_Upload *CocoaGame_UploadBuffer(GLuint buffer, size_t offset, size_t size, const void *data)
+{
+	CocoaGame_Upload *upload = CocoaGame_AllocZeroed(1, sizeof(*upload), COCOAGAME_ALLOC_RENDERING);
+	if (! upload)
+		return NULL;
+
+	upload->type = COCOAGAME_UPLOAD_BUFFER;
+	upload->name = buffer;
+	upload->data = data;
+	upload->size = size;
+	upload->offset = offset;
+
+	return CocoaGame_QueueUpload(upload);
+}
+
+static CocoaGame_Upload *CocoaGame_QueueUpload(CocoaGame_Upload *upload)
+{
+	pthread_mutex_lock(&uploadMutex);
+
+	if (! uploadWorkerRunning || uploadWorkerStop) {
+		pthread_mutex_unlock(&uploadMutex);
+		CocoaGame_Trace("%s: the upload worker isn't running.\n", __FUNCTION__);
+		CocoaGame_Free(upload);
+		return NULL;
+	}
+
+	if (uploadTail)
+		uploadTail->next = upload;
+	else
+		uploadHead = upload;
+
+	uploadTail = upload;
+
+	uploadStats.queuedUploads++;
+	uploadStats.queuedBytes += upload->size;
+
+	pthread_cond_broadcast(&uploadCond);
+	pthread_mutex_unlock(&uploadMutex);
+
+	return upload;
+}
+
+CocoaGame_Bool CocoaGame_IsUploadFinished(const CocoaGame_Upload *upload)
+{
+	return __atomic_load_n(&upload->finished, __ATOMIC_ACQUIRE);
+}
+
+void CocoaGame_FinishUpload(CocoaGame_Upload *upload)
+{
+	if (! upload)
+		return;
+
+	if (! CocoaGame_IsUploadFinished(upload)) {
+		CocoaGame_BeginZone(__FUNCTION__);
+		pthread_mutex_lock(&uploadMutex);
+
+		uploadStats.stalls++;
+		while (! upload->finished)
+			pthread_cond_wait(&uploadCond, &uploadMutex);
+
+		pthread_mutex_unlock(&uploadMutex);
+		CocoaGame_EndZone();
+	}
+
+	// Queue a wait on the GPU rather than waiting here.
+	if (upload->fence) {
+		glWaitSync(upload->fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(upload->fence);
+	}
+
+	CocoaGame_Free(upload);
+}
+
+void CocoaGame_GetUploadStats(CocoaGame_UploadStats *stats)
+{
+	pthread_mutex_lock(&uploadMutex);
+	*stats = uploadStats;
+	pthread_mutex_unlock(&uploadMutex);
+}
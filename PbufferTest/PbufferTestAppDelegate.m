@@ -109,9 +109,9 @@
 		}
 		
 		if (! CocoaGame_BeginRender()) {
-			// If the application is not visible, and sleep for a bit to cut CPU usage. Note that CocoaGame_Sleep 
-			// will interrupt the sleep if an event turns up.
-			CocoaGame_Sleep(1);
+			// If the application is not visible, wait for the hidden frame rate cap to cut CPU usage. Note that 
+			// CocoaGame_ThrottleFrame() returns early if an event turns up.
+			CocoaGame_ThrottleFrame();
 		} else {
 			const CocoaGame_VideoConfig *actualVideoConfig = CocoaGame_GetVideoConfig();
 
@@ -231,9 +231,9 @@
 
 			CocoaGame_EndRender();
 
-			// If the application is inactive but still rendering (i.e., it's running in a window), sleep some.
-			if (! CocoaGame_IsAppActive())
-				CocoaGame_Sleep(1.0 / 16.0); // frame rate will be lower due to swap interval
+			// If the application is inactive but still rendering (i.e., it's running in a window), or the window is
+			// covered, throttle to the inactive or hidden frame rate cap.
+			CocoaGame_ThrottleFrame();
 		}
 	}
 
@@ -1,4 +1,4 @@
-#if 1
+#ifdef __OBJC__
 
 	#import <Cocoa/Cocoa.h>
 
@@ -11,12 +11,12 @@
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
 
-// You can use a reduced size FBO to provide support for lower resolution rendering without changing the video mode.
+// You can use a reduced size render target to provide support for lower resolution rendering without changing the
+// video mode.
 static const int fboWidth = 256;
 static const int fboHeight = 256;
 
-static GLuint fbo;
-static GLuint fboTexture;
+static CocoaGame_RenderTarget *renderTarget;
 
 static double gameTime = 0;
 
@@ -60,36 +60,27 @@ static void InitCocoaGame(void)
 		CocoaGame_Shutdown();
 		exit(EXIT_FAILURE);
 	}
+	
+	// Pace frames at 60 Hz, dropping the swap interval if we can't keep up.
+	CocoaGame_FramePacerConfig pacerConfig = COCOAGAME_FRAMEPACERCONFIG_DEFAULTS;
+	pacerConfig.mode = COCOAGAME_FRAME_PACING_ADAPTIVE;
+	pacerConfig.framesPerSecond = 60.0;
+	CocoaGame_SetFramePacer(&pacerConfig);
 }
 
 static void Draw(void *);
 static void InitDraw(void)
 {
-	glGenFramebuffersEXT(1, &fbo);
-	
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
-	
-	GLuint fboDepthBuffer;
-	glGenRenderbuffersEXT(1, &fboDepthBuffer);
-	glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, fboDepthBuffer);
-	glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, fboWidth, fboHeight);
-	
-	glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, fboDepthBuffer);
+	CocoaGame_RenderTargetConfig renderTargetConfig = COCOAGAME_RENDERTARGETCONFIG_DEFAULTS;
+	renderTargetConfig.width = fboWidth;
+	renderTargetConfig.height = fboHeight;
 	
-	glGenTextures(1, &fboTexture);
-	glBindTexture(GL_TEXTURE_2D, fboTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fboWidth, fboHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	
-	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, fboTexture, 0);
-	
-	GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
-	if (status != GL_FRAMEBUFFER_COMPLETE_EXT) {
+	renderTarget = CocoaGame_AcquireRenderTarget(&renderTargetConfig);
+	if (! renderTarget) {
 		CocoaGame_Shutdown();
 		exit(EXIT_FAILURE);
 	}
 
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
-
 	CocoaGame_SetDrawCallback(&Draw, NULL);
 }
 
@@ -99,20 +90,20 @@ static void Draw(void *context)
 	
 	const CocoaGame_VideoConfig *currentVideoConfig = CocoaGame_GetVideoConfig();
 
-	glViewport(0, 0, currentVideoConfig->mode.width, currentVideoConfig->mode.height);
+	CocoaGame_GLViewport(0, 0, currentVideoConfig->mode.width, currentVideoConfig->mode.height);
 	
-	glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
-	glDisable(GL_SCISSOR_TEST);
+	CocoaGame_GLClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+	CocoaGame_GLDisable(GL_SCISSOR_TEST);
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	#if 1
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
-		glViewport(0, 0, fboWidth, fboHeight);
+		CocoaGame_SetRenderTarget(renderTarget);
+		CocoaGame_GLViewport(0, 0, fboWidth, fboHeight);
 	
 		float r = cosf((float) (fmod(gameTime, 1.0)) * (float) M_PI * 2.0f) * 0.5f + 0.5f;
 
-		glClearColor(r, 0.5f, 0.0f, 1.0f);
-		glDisable(GL_SCISSOR_TEST);
+		CocoaGame_GLClearColor(r, 0.5f, 0.0f, 1.0f);
+		CocoaGame_GLDisable(GL_SCISSOR_TEST);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 	
 		glMatrixMode(GL_PROJECTION);
@@ -126,8 +117,8 @@ static void Draw(void *context)
 		glTranslatef(0.0f, 0.0f, -12.0f);
 		glRotatef((float) fmod(gameTime, 10.0) * 360.0f * 0.1f, 0.0f, 0.0f, 1.0f);
 		
-		glEnable(GL_DEPTH_TEST);
-		glDepthFunc(GL_LEQUAL);
+		CocoaGame_GLEnable(GL_DEPTH_TEST);
+		CocoaGame_GLDepthFunc(GL_LEQUAL);
 	
 		glBegin(GL_TRIANGLES);
 			glColor3f(1.0f, 0.0f, 0.0f);
@@ -153,10 +144,10 @@ static void Draw(void *context)
 			glVertex3f(-10.0f, -10.0f, 0.0f);
 		glEnd();
 	
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+		CocoaGame_SetRenderTarget(NULL);
 	#endif
 
-	glViewport(0, 0, currentVideoConfig->mode.width, currentVideoConfig->mode.height);
+	CocoaGame_GLViewport(0, 0, currentVideoConfig->mode.width, currentVideoConfig->mode.height);
 	
 	int mouseX, mouseY;
 	CocoaGame_GetMousePosition(&mouseX, &mouseY);
@@ -168,8 +159,8 @@ static void Draw(void *context)
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
 	
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, fboTexture);
+	CocoaGame_GLEnable(GL_TEXTURE_2D);
+	CocoaGame_GLBindTexture(GL_TEXTURE0, GL_TEXTURE_2D, CocoaGame_GetRenderTargetTexture(renderTarget));
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -192,13 +183,13 @@ static void Draw(void *context)
 		glVertex3f(0.0f, 0.0f, 0.0f);
 	glEnd();
 
-	glDisable(GL_TEXTURE_2D);
+	CocoaGame_GLDisable(GL_TEXTURE_2D);
 
-	glEnable(GL_SCISSOR_TEST);
-	glScissor(mouseX - 16, mouseY - 16, 32, 32);
-	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+	CocoaGame_GLEnable(GL_SCISSOR_TEST);
+	CocoaGame_GLScissor(mouseX - 16, mouseY - 16, 32, 32);
+	CocoaGame_GLClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
-	glDisable(GL_SCISSOR_TEST);
+	CocoaGame_GLDisable(GL_SCISSOR_TEST);
 }
 
 static void ProcessEvents(void)
@@ -261,18 +252,24 @@ static void Update(void)
 		Update();
 		
 		if (! CocoaGame_BeginRender()) {
-			// If the application is not visible, and sleep for a bit to cut CPU usage. Note that CocoaGame_Sleep 
-			// will interrupt the sleep if an event turns up.
-			CocoaGame_Sleep(1);
+			// If the application is not visible, wait for the hidden frame rate cap to cut CPU usage. Note that 
+			// CocoaGame_ThrottleFrame() returns early if an event turns up.
+			CocoaGame_ThrottleFrame();
 		} else {
 			// Draw may occasionally be called for us.
 			Draw(NULL);
 
 			CocoaGame_EndRender();
 
-			// If the application is inactive but still rendering (i.e., it's running in a window), sleep some.
-			if (! CocoaGame_IsAppActive())
-				CocoaGame_Sleep(1.0 / 16.0);
+			// If the application is inactive but still rendering (i.e., it's running in a window), or the window is
+			// covered, throttle to the inactive or hidden frame rate cap.
+			if (CocoaGame_GetFrameState() != COCOAGAME_FRAME_STATE_ACTIVE)
+				CocoaGame_ThrottleFrame();
+			else {
+				// The pacer returns early if events arrive, so they're handled before the deadline rather than after.
+				while (CocoaGame_WaitForNextFrame() == COCOAGAME_FRAME_WAIT_INPUT)
+					ProcessEvents();
+			}
 		}
 	}
 